@@ -42,4 +42,50 @@ pub fn build(b: *std.Build) !void {
 
     const run_step = b.step("run", "run the test");
     run_step.dependOn(&run.step);
+
+    const ksc_soak = b.addExecutable(.{
+        .name = "ksc_soak",
+        .target = target,
+        .optimize = optimize,
+    });
+
+    ksc_soak.addIncludePath(b.path("include"));
+    ksc_soak.addLibraryPath(b.path(target_path));
+    ksc_soak.addCSourceFile(.{ .file = b.path("tests/ksc_soak.cpp"), .flags = &.{} });
+
+    ksc_soak.linkLibCpp();
+    ksc_soak.addObjectFile(b.path(libkslang_path));
+
+    b.installArtifact(ksc_soak);
+
+    const soak = b.addRunArtifact(ksc_soak);
+    soak.step.dependOn(b.getInstallStep());
+
+    if (b.args) |args| {
+        soak.addArgs(args);
+    }
+
+    const soak_step = b.step("soak", "run the memory soak test");
+    soak_step.dependOn(&soak.step);
+
+    const ksc_arrow = b.addExecutable(.{
+        .name = "ksc_arrow",
+        .target = target,
+        .optimize = optimize,
+    });
+
+    ksc_arrow.addIncludePath(b.path("include"));
+    ksc_arrow.addLibraryPath(b.path(target_path));
+    ksc_arrow.addCSourceFile(.{ .file = b.path("tests/ksc_arrow.cpp"), .flags = &.{} });
+
+    ksc_arrow.linkLibCpp();
+    ksc_arrow.addObjectFile(b.path(libkslang_path));
+
+    b.installArtifact(ksc_arrow);
+
+    const arrow = b.addRunArtifact(ksc_arrow);
+    arrow.step.dependOn(b.getInstallStep());
+
+    const arrow_step = b.step("arrow", "run the Arrow batch evaluation test");
+    arrow_step.dependOn(&arrow.step);
 }
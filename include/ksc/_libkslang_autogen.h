@@ -4,15 +4,90 @@
 #include <ostream>
 #include <new>
 
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+  const char* format;
+  const char* name;
+  const char* metadata;
+  int64_t flags;
+  int64_t n_children;
+  struct ArrowSchema** children;
+  struct ArrowSchema* dictionary;
+  void (*release)(struct ArrowSchema*);
+  void* private_data;
+};
+
+struct ArrowArray {
+  int64_t length;
+  int64_t null_count;
+  int64_t offset;
+  int64_t n_buffers;
+  int64_t n_children;
+  const void** buffers;
+  struct ArrowArray** children;
+  struct ArrowArray* dictionary;
+  void (*release)(struct ArrowArray*);
+  void* private_data;
+};
+
+#endif  // ARROW_C_DATA_INTERFACE
+
+/// Compiled program
+struct KSCProgram {
+
+};
+
 /// Source
 struct KSCSource {
 
 };
 
+/// Token stream
+struct KSCTokens {
+
+};
+
+/// AST
+struct KSCAst {
+
+};
+
+/// 一列输入：列的类型与按顺序排列的分块
+struct KSCColumn {
+  const ArrowSchema *schema;
+  const ArrowArray *chunks;
+  uintptr_t n_chunks;
+};
+
+using KSCBatchErr = uintptr_t;
+
 using KSCSourceKind = uintptr_t;
 
 using KSCSourceErr = uintptr_t;
 
+constexpr static const KSCBatchErr KSC_BATCH_ERR_OK = 0;
+
+/// 函数未定义或列数与形参个数不符
+constexpr static const KSCBatchErr KSC_BATCH_ERR_UNDEFINED = 1;
+
+/// 列不是 float64 数组
+constexpr static const KSCBatchErr KSC_BATCH_ERR_FORMAT = 2;
+
+/// 各列行数不同
+constexpr static const KSCBatchErr KSC_BATCH_ERR_LENGTH = 3;
+
+/// 执行时调用层数超出上限
+constexpr static const KSCBatchErr KSC_BATCH_ERR_TRAP = 4;
+
+/// 无法创建执行线程
+constexpr static const KSCBatchErr KSC_BATCH_ERR_THREAD = 5;
+
 constexpr static const KSCSourceKind KSC_SRC_STDIN = 0;
 
 constexpr static const KSCSourceKind KSC_SRC_STRING = 1;
@@ -27,6 +102,28 @@ constexpr static const KSCSourceErr KSC_SRC_ERR_UTF8 = 2;
 
 extern "C" {
 
+/// 编译为闭包树并执行一次顶层代码，出现错误、顶层代码中止或声明了 `extern` 时返回空指针
+///
+/// # Safety
+const KSCProgram *newKSCProgram(const KSCSource *src);
+
+/// # Safety
+void freeKSCProgram(const KSCProgram *program);
+
+/// 以各列为实参逐行调用顶层函数 `name`，直接读取列的缓冲区
+///
+/// 成功时结果写入 `out_schema` 与 `out_array`，由调用方调用各自的 `release` 释放。
+/// 同一个程序可在多个线程上同时求值，每次求值在内部创建的大栈线程上进行。
+///
+/// # Safety
+KSCBatchErr evalKSCBatch(const KSCProgram *program,
+                         const char *name,
+                         uintptr_t name_len,
+                         const KSCColumn *columns,
+                         uintptr_t n_columns,
+                         ArrowSchema *out_schema,
+                         ArrowArray *out_array);
+
 /// # Safety
 const KSCSource *newKSCSource(KSCSourceKind src_type,
                               const char *src_data,
@@ -43,4 +140,28 @@ const char *getKSCSourceText(const KSCSource *src);
 /// # Safety
 void freeKSCSource(const KSCSource *src);
 
+/// 词法错误时返回空指针
+///
+/// # Safety
+const KSCTokens *newKSCTokens(const KSCSource *src);
+
+/// # Safety
+uintptr_t getKSCTokensLen(const KSCTokens *tokens);
+
+/// # Safety
+void freeKSCTokens(const KSCTokens *tokens);
+
+/// 语法错误时返回空指针，`tokens` 须由同一个 `src` 生成
+///
+/// # Safety
+const KSCAst *newKSCAst(const KSCSource *src, const KSCTokens *tokens);
+
+/// 顶层语句数
+///
+/// # Safety
+uintptr_t getKSCAstLen(const KSCAst *ast);
+
+/// # Safety
+void freeKSCAst(const KSCAst *ast);
+
 }  // extern "C"
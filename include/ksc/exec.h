@@ -0,0 +1,6 @@
+#ifndef KSC_EXEC_H
+#define KSC_EXEC_H
+
+#include "_libkslang_autogen.h"
+
+#endif /* KSC_EXEC_H */
@@ -1,8 +1,49 @@
+/// Arrow C 数据接口的标准定义，宿主已包含 `arrow/c/abi.h` 时跳过
+const ARROW_ABI: &str = "
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+  const char* format;
+  const char* name;
+  const char* metadata;
+  int64_t flags;
+  int64_t n_children;
+  struct ArrowSchema** children;
+  struct ArrowSchema* dictionary;
+  void (*release)(struct ArrowSchema*);
+  void* private_data;
+};
+
+struct ArrowArray {
+  int64_t length;
+  int64_t null_count;
+  int64_t offset;
+  int64_t n_buffers;
+  int64_t n_children;
+  const void** buffers;
+  struct ArrowArray** children;
+  struct ArrowArray* dictionary;
+  void (*release)(struct ArrowArray*);
+  void* private_data;
+};
+
+#endif  // ARROW_C_DATA_INTERFACE
+";
+
 fn main() {
     let crate_dir = env!("CARGO_MANIFEST_DIR");
 
     cbindgen::Builder::new()
         .with_crate(crate_dir)
+        .with_after_include(ARROW_ABI)
+        .exclude_item("ArrowSchema")
+        .exclude_item("ArrowArray")
+        .exclude_item("ARROW_FLAG_NULLABLE")
         .generate()
         .expect("Unable to generate bindings")
         .write_to_file("../include/ksc/_libkslang_autogen.h");
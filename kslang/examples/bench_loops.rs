@@ -0,0 +1,195 @@
+//! 循环变换性能测试
+//!
+//! 对几个典型的循环核心分别在启用与关闭循环变换时生成 C 代码，用 `cc -O2` 编译后
+//! 在真实的按行存储的二维数组上运行，比较执行用时，并打印每个核心上实际应用的变换
+//! 次数。数组通过 `extern pure at(r, c)` 访问，规模参数为数组的边长。
+//!
+//! ```text
+//! cargo run --release --example bench_loops -- [规模] [重复次数]
+//! ```
+
+#[path = "../tests/common/mod.rs"]
+pub mod common;
+
+use common::parse;
+use kslang::compiler::{
+    ast::{FpMode, Stmt},
+    emit::c::{self, c_source},
+    opt::{
+        fold, fp,
+        loops::{Options, Stats, optimize_loops},
+        lto::Module,
+    },
+};
+use std::{path::Path, process::Command, time::Duration};
+
+const KERNELS: &[(&str, &str)] = &[
+    (
+        "fuse",
+        "\
+extern pure at(r, c);
+def kernel(n) {
+    s = 0;
+    t = 0;
+    for i in 0 .. n { s = s + at(i, 0); }
+    for i in 0 .. n { t = t + at(i, 1) * 2; }
+    s + t
+}
+",
+    ),
+    (
+        "interchange",
+        "\
+extern pure at(r, c);
+def fast kernel(n) {
+    s = 0;
+    for c in 0 .. n {
+        for r in 0 .. n {
+            s = s + at(r, c);
+        }
+    }
+    s
+}
+",
+    ),
+    (
+        "unroll_jam",
+        "\
+extern pure at(r, c);
+def fast kernel(n) {
+    s = 0;
+    for r in 0 .. n { for c in 0 .. n { s = s + at(r, c); } }
+    s
+}
+",
+    ),
+];
+
+/// 数组与计时，多次执行取最短用时，输出结果与秒数
+const HARNESS: &str = r#"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+double kernel(double);
+
+static double *data;
+static long stride;
+
+double at(double r, double c) { return data[(long)r * stride + (long)c]; }
+
+int main(int argc, char **argv)
+{
+    long n = atol(argv[1]);
+    int repeat = atoi(argv[2]);
+    stride = n;
+    data = malloc(sizeof(double) * n * n);
+    for (long i = 0; i < n * n; i++)
+        data[i] = (double)(i % 7);
+
+    double best = 1e300, result = 0.0;
+    for (int k = 0; k < repeat; k++) {
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        result = kernel((double)n);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+        if (elapsed < best)
+            best = elapsed;
+    }
+    printf("%.17g %.9f\n", result, best);
+    free(data);
+    return 0;
+}
+"#;
+
+fn compile(text: &str, transform: bool) -> (Vec<Stmt>, Stats) {
+    let mut stmts = parse(text);
+    fp::resolve(&mut stmts, FpMode::Strict);
+    fold::fold_stmts_in(&mut stmts, FpMode::Strict);
+    let mut stats = Stats::default();
+    if transform {
+        stats = optimize_loops(text, &mut stmts, FpMode::Strict, &Options::default());
+        fold::fold_stmts_in(&mut stmts, FpMode::Strict);
+    }
+    (stmts, stats)
+}
+
+/// 生成并编译核心，返回结果、最短用时与变换次数
+fn measure(
+    dir: &Path,
+    name: &str,
+    text: &str,
+    transform: bool,
+    size: usize,
+    repeat: usize,
+) -> (f64, Duration, Stats) {
+    let (stmts, stats) = compile(text, transform);
+    let modules = [Module {
+        src: text,
+        stmts,
+        fp: FpMode::Strict,
+    }];
+    let opts = c::Options {
+        units: 1,
+        ..Default::default()
+    };
+    let source = c_source(&modules, &opts).unwrap();
+
+    let stem = format!("{}-{}", name, if transform { "on" } else { "off" });
+    let kernel = dir.join(format!("{}.c", stem));
+    std::fs::write(&kernel, format!("{}{}", source.prelude, source.units[0])).unwrap();
+    let exe = dir.join(&stem);
+    let status = Command::new("cc")
+        .args(["-O2", "-o"])
+        .arg(&exe)
+        .arg(&kernel)
+        .arg(dir.join("harness.c"))
+        .arg("-lm")
+        .status()
+        .expect("需要 C 编译器 cc");
+    assert!(status.success(), "{stem}: 编译失败");
+
+    let output = Command::new(&exe)
+        .args([size.to_string(), repeat.to_string()])
+        .output()
+        .unwrap();
+    let output = String::from_utf8(output.stdout).unwrap();
+    let (result, secs) = output.trim().split_once(' ').unwrap();
+    (
+        result.parse().unwrap(),
+        Duration::from_secs_f64(secs.parse().unwrap()),
+        stats,
+    )
+}
+
+fn main() {
+    let mut args = std::env::args().skip(1);
+    let size = args.next().map_or(2000, |arg| arg.parse().unwrap());
+    let repeat = args.next().map_or(5, |arg| arg.parse().unwrap());
+
+    let dir = std::env::temp_dir().join(format!("kslang-bench-loops-{}", std::process::id()));
+    std::fs::create_dir_all(&dir).unwrap();
+    std::fs::write(dir.join("harness.c"), HARNESS).unwrap();
+
+    println!(
+        "{:<12} {:>12} {:>12} {:>8}  变换",
+        "核心", "关闭", "启用", "加速比"
+    );
+    for (name, text) in KERNELS {
+        let (base, before, _) = measure(&dir, name, text, false, size, repeat);
+        let (result, after, stats) = measure(&dir, name, text, true, size, repeat);
+        assert_eq!(base, result, "{name}: 变换前后结果不同");
+        println!(
+            "{:<12} {:>12?} {:>12?} {:>8.2}  合并 {} 交换 {} 展开合并 {}",
+            name,
+            before,
+            after,
+            before.as_secs_f64() / after.as_secs_f64(),
+            stats.fused,
+            stats.interchanged,
+            stats.jammed,
+        );
+    }
+    std::fs::remove_dir_all(&dir).unwrap();
+}
@@ -0,0 +1,164 @@
+//! 前端性能模糊测试
+//!
+//! 对源代码做变异搜索，目标是每字节的词法与语法分析工作量。输入按结果类别
+//! （成功或错误种类）分组保留，出现新类别的输入即使目标值不高也会进入语料，
+//! 以覆盖更多解析路径。结束时打印得分最高的输入。
+//!
+//! ```text
+//! cargo run --release --example fuzz_parse -- [迭代次数] [随机种子]
+//! ```
+
+use kslang::compiler::{lexer::Lexer, parse_ast, parse_steps};
+use std::{collections::HashMap, time::Instant};
+
+const MAX_LEN: usize = 4096;
+
+const DICT: &[&str] = &[
+    "def ", "extern ", "if ", " then ", " else ", "for ", " in ", "return ", "break", "continue",
+    "(", ")", "{", "}", ",", ";", " .. ", "...", " = ", " == ", " + ", " - ", " * ", " / ", " && ",
+    " || ", "!", " < ", "x", "f", "1", "2.5e3", " ", "\n", "# c\n",
+];
+
+const SEEDS: &[&str] = &[
+    "def fib(x) if x < 3 then 1 else fib(x - 1) + fib(x - 2)",
+    "extern sin(x);\nfor i in 0 .. 10 { s = s + sin(i); }",
+    "def f(a, b) { c = a * b; return c + 1; }\nf(1, 2);",
+    "if x == 1 then 1 else if x == 2 then 2 else 3",
+];
+
+struct Rng(u64);
+
+impl Rng {
+    /// xorshift 的状态为 0 时不再变化，种子 0 换为固定的非零值
+    fn new(seed: u64) -> Self {
+        Self(if seed == 0 {
+            0x9e37_79b9_7f4a_7c15
+        } else {
+            seed
+        })
+    }
+
+    fn next(&mut self) -> u64 {
+        self.0 ^= self.0 << 13;
+        self.0 ^= self.0 >> 7;
+        self.0 ^= self.0 << 17;
+        self.0
+    }
+
+    fn below(&mut self, n: usize) -> usize {
+        (self.next() % n.max(1) as u64) as usize
+    }
+}
+
+struct Sample {
+    text: String,
+    score: f64,
+    nanos_per_byte: f64,
+}
+
+fn evaluate(text: &str) -> (f64, f64, String) {
+    let start = Instant::now();
+    let tokens = Lexer::from_text(0, text)
+        .filter_map(Result::ok)
+        .collect::<Vec<_>>();
+    let result = parse_ast(text, &tokens);
+    let nanos = start.elapsed().as_nanos() as f64;
+
+    let steps = (tokens.len() + parse_steps()) as f64;
+    let len = text.len().max(1) as f64;
+    let class = match result {
+        Ok(_) => "Ok".to_string(),
+        Err(e) => format!("{:?}", e).split('(').next().unwrap().to_string(),
+    };
+    (steps / len, nanos / len, class)
+}
+
+fn mutate(rng: &mut Rng, text: &str, other: &str) -> String {
+    let mut text = text.to_string();
+    let at = rng.below(text.len() + 1);
+    match rng.below(5) {
+        0 => text.insert_str(at, DICT[rng.below(DICT.len())]),
+        1 => {
+            let end = (at + rng.below(16)).min(text.len());
+            text.replace_range(at..end, "");
+        }
+        2 => {
+            let end = (at + rng.below(32)).min(text.len());
+            let slice = text[at..end].repeat(1 + rng.below(8));
+            text.insert_str(end, &slice);
+        }
+        3 => {
+            let end = (at + rng.below(32)).min(text.len());
+            let (open, close) = [("(", ")"), ("{", "}"), ("f(", ")")][rng.below(3)];
+            text.insert_str(end, close);
+            text.insert_str(at, open);
+        }
+        _ => {
+            let from = rng.below(other.len() + 1);
+            let end = (from + rng.below(64)).min(other.len());
+            text.insert_str(at, &other[from..end]);
+        }
+    }
+    text.truncate(MAX_LEN);
+    text
+}
+
+fn main() {
+    let mut args = std::env::args().skip(1);
+    let iterations = args.next().and_then(|n| n.parse().ok()).unwrap_or(100_000);
+    let mut rng = Rng::new(args.next().and_then(|n| n.parse().ok()).unwrap_or(0));
+
+    let mut corpus: HashMap<String, Vec<Sample>> = HashMap::new();
+    for seed in SEEDS {
+        let (score, nanos_per_byte, class) = evaluate(seed);
+        corpus.entry(class).or_default().push(Sample {
+            text: seed.to_string(),
+            score,
+            nanos_per_byte,
+        });
+    }
+
+    for _ in 0..iterations {
+        let classes = corpus.keys().cloned().collect::<Vec<_>>();
+        let pick = |rng: &mut Rng| {
+            let samples = &corpus[&classes[rng.below(classes.len())]];
+            samples[rng.below(samples.len())].text.clone()
+        };
+        let (parent, other) = (pick(&mut rng), pick(&mut rng));
+        let text = mutate(&mut rng, &parent, &other);
+        if text.is_empty() {
+            continue;
+        }
+
+        let (score, nanos_per_byte, class) = evaluate(&text);
+        let samples = corpus.entry(class).or_default();
+        let worst = samples
+            .iter()
+            .enumerate()
+            .min_by(|a, b| a.1.score.total_cmp(&b.1.score))
+            .map(|(index, sample)| (index, sample.score));
+        let sample = Sample {
+            text,
+            score,
+            nanos_per_byte,
+        };
+        match worst {
+            _ if samples.len() < 16 => samples.push(sample),
+            Some((index, worst)) if score > worst => samples[index] = sample,
+            _ => {}
+        }
+    }
+
+    let mut samples = corpus.into_values().flatten().collect::<Vec<_>>();
+    samples.sort_by(|a, b| b.score.total_cmp(&a.score));
+    for sample in samples.iter().take(5) {
+        let preview = sample.text.chars().take(80).collect::<String>();
+        println!(
+            "{:8.3} steps/B {:10.1} ns/B {:6} B  {:?}",
+            sample.score,
+            sample.nanos_per_byte,
+            sample.text.len(),
+            preview
+        );
+    }
+}
@@ -2,13 +2,29 @@ pub mod ast;
 pub mod lexer;
 
 pub mod analyzer;
+pub mod arena;
+pub mod emit;
+pub mod exec;
+pub mod index;
+pub mod load;
+pub mod opt;
+pub mod snapshot;
+pub mod stream;
+pub mod visit;
 
+mod cexec;
 mod clexer;
+mod cparser;
 mod parser;
 
 pub use lexer::{CodeSpan, Source, SourceSequence};
-pub use parser::parse_ast;
+pub use parser::{
+    MAX_NESTING_DEPTH, NextStmt, ParseError, lazy, max_nesting_depth, parse_ast,
+    parse_ast_with_limit, parse_next, parse_steps,
+};
 
 pub mod cextern {
+    pub use super::cexec::*;
     pub use super::clexer::*;
+    pub use super::cparser::*;
 }
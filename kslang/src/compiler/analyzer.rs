@@ -1,6 +1,11 @@
-use super::CodeSpan;
+use super::{
+    CodeSpan,
+    ast::{Expr, ExprKind, ExternAttr, Stmt, StmtKind, scope::scope_expr},
+    visit::{self, Cx, Pass},
+};
+use serde::{Deserialize, Serialize};
 use std::{
-    collections::HashMap,
+    collections::{HashMap, HashSet},
     rc::Weak,
     sync::{Arc, Mutex},
 };
@@ -9,29 +14,44 @@ type Astr = Arc<str>;
 type L<T> = Arc<Mutex<T>>;
 type W<T> = Weak<Mutex<T>>;
 
+#[derive(Default)]
 pub struct Analyzer {
     pub undef_fn_calls: HashMap<Astr, Vec<UndefFnCall>>,
+    /// 已声明的顶层函数与变量，见 `Analyzer::declare`
+    pub globals: HashMap<Astr, Named>,
+    /// 顶层名称到符号的映射
     pub names: HashMap<Astr, usize>,
+    pub symbols: Vec<Astr>,
+    /// 各符号所属的作用域，0 为顶层，每个函数体各占一个
+    pub scopes: Vec<u32>,
+    /// 函数体内的局部符号，按 `(作用域, 名称)` 区分同名绑定
+    locals: HashMap<(u32, Astr), usize>,
+    pub refs: RefTable,
 }
 
 pub struct VarInfo {
     pub name: Astr,
     pub def_span: CodeSpan,
-    pub use_spans: Vec<CodeSpan>,
+    /// 定义与使用位置见 `Analyzer::refs`
+    pub sym: usize,
 }
 
 pub struct FnInfo {
     pub name: Astr,
     pub def_span: CodeSpan,
-    pub use_spans: Vec<CodeSpan>,
+    /// 定义与使用位置见 `Analyzer::refs`
+    pub sym: usize,
 
     pub params: Vec<Astr>,
     pub args_span: CodeSpan,
     pub is_vararg: bool,
+    /// `extern` 的调用属性，`def` 为 `None`
+    pub attr: Option<ExternAttr>,
 
     pub scope: Option<L<Scope>>,
 }
 
+#[derive(Clone, Debug)]
 pub struct UndefFnCall {
     pub name: Astr,
     pub use_span: CodeSpan,
@@ -39,6 +59,29 @@ pub struct UndefFnCall {
     pub args_span: CodeSpan,
 }
 
+#[derive(Debug)]
+pub enum CallError {
+    /// 直到输入结束仍未定义
+    Undefined(UndefFnCall),
+    /// 实参个数与定义不符
+    ArgsMismatch(UndefFnCall, usize),
+}
+
+impl std::fmt::Display for CallError {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        match self {
+            Self::Undefined(call) => write!(f, "{}: 未定义的函数 `{}`", call.use_span, call.name),
+            Self::ArgsMismatch(call, expected) => write!(
+                f,
+                "{}: `{}` 需要 {} 个参数，实际传入 {} 个",
+                call.args_span, call.name, expected, call.params_num
+            ),
+        }
+    }
+}
+
+impl std::error::Error for CallError {}
+
 pub enum Named {
     Var(VarInfo),
     Fn(FnInfo),
@@ -51,3 +94,503 @@ pub struct Scope {
     pub cells: HashMap<Astr, L<Named>>,
     pub outers: HashMap<Astr, L<Named>>,
 }
+
+#[derive(Clone, Copy, Debug, PartialEq, Eq, Deserialize, Serialize)]
+#[repr(u8)]
+pub enum RefKind {
+    Def,
+    Use,
+}
+
+/// 紧凑的引用记录（16 字节，`CodeSpan` 为 32 字节）
+#[derive(Clone, Copy, Debug, PartialEq, Eq, Deserialize, Serialize)]
+pub struct Ref {
+    pub start: u32,
+    pub end: u32,
+    pub line: u32,
+    pub src_id: u16,
+    pub kind: RefKind,
+}
+
+#[derive(Debug)]
+pub enum RefError {
+    /// 位置超出紧凑记录的表示范围
+    Span(CodeSpan),
+    /// 符号或引用总数超过 `u32`
+    TooMany,
+}
+
+impl std::fmt::Display for RefError {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        match self {
+            Self::Span(span) => write!(f, "{}: 位置超出引用记录的范围", span),
+            Self::TooMany => write!(f, "符号或引用过多"),
+        }
+    }
+}
+
+impl std::error::Error for RefError {}
+
+impl Ref {
+    pub fn new(kind: RefKind, span: CodeSpan) -> Result<Self, RefError> {
+        let narrow = || {
+            Some(Self {
+                start: u32::try_from(span.start).ok()?,
+                end: u32::try_from(span.end).ok()?,
+                line: u32::try_from(span.line).ok()?,
+                src_id: u16::try_from(span.src_id).ok()?,
+                kind,
+            })
+        };
+        narrow().ok_or(RefError::Span(span))
+    }
+
+    pub fn span(&self) -> CodeSpan {
+        CodeSpan {
+            line: self.line as usize,
+            src_id: self.src_id as usize,
+            start: self.start as usize,
+            end: self.end as usize,
+        }
+    }
+}
+
+/// 按符号分行的压缩稀疏行（CSR）引用表
+///
+/// 所有记录存放在一段连续内存中，第 `sym` 行为
+/// `records[offsets[2 * sym]..offsets[2 * sym + 2]]`，其中定义在前、使用在后，
+/// 两者以 `offsets[2 * sym + 1]` 分隔。
+#[derive(Default)]
+pub struct RefTable {
+    offsets: Vec<u32>,
+    records: Vec<Ref>,
+}
+
+impl RefTable {
+    /// 由 `(符号, 引用)` 对构建，同一行内保持输入顺序
+    pub fn build(symbols: usize, refs: &[(u32, Ref)]) -> Self {
+        let mut offsets = vec![0u32; symbols * 2 + 1];
+        for (sym, r) in refs {
+            offsets[*sym as usize * 2 + r.kind as usize + 1] += 1;
+        }
+        for index in 1..offsets.len() {
+            offsets[index] += offsets[index - 1];
+        }
+
+        let mut cursor = offsets.clone();
+        let mut records = vec![
+            Ref {
+                start: 0,
+                end: 0,
+                line: 0,
+                src_id: 0,
+                kind: RefKind::Use,
+            };
+            refs.len()
+        ];
+        for (sym, r) in refs {
+            let slot = &mut cursor[*sym as usize * 2 + r.kind as usize];
+            records[*slot as usize] = *r;
+            *slot += 1;
+        }
+
+        Self { offsets, records }
+    }
+
+    pub fn len(&self) -> usize {
+        self.offsets.len() / 2
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+
+    pub fn refs(&self, sym: usize) -> &[Ref] {
+        &self.records[self.offsets[sym * 2] as usize..self.offsets[sym * 2 + 2] as usize]
+    }
+
+    pub fn defs(&self, sym: usize) -> &[Ref] {
+        &self.records[self.offsets[sym * 2] as usize..self.offsets[sym * 2 + 1] as usize]
+    }
+
+    pub fn uses(&self, sym: usize) -> &[Ref] {
+        &self.records[self.offsets[sym * 2 + 1] as usize..self.offsets[sym * 2 + 2] as usize]
+    }
+
+    /// 有定义但从未使用的符号
+    pub fn unused(&self) -> impl Iterator<Item = usize> + '_ {
+        self.offsets
+            .chunks_exact(2)
+            .zip(self.offsets[1..].chunks_exact(2))
+            .enumerate()
+            .filter(|(_, (row, rest))| row[0] < row[1] && rest[0] == rest[1])
+            .map(|(sym, _)| sym)
+    }
+}
+
+impl Analyzer {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    /// 一次遍历收集所有标识符的定义与使用
+    ///
+    /// 函数的形参与函数体内赋值的名称自成符号，不与其他函数或顶层的同名绑定合并。
+    pub fn index(&mut self, src: &str, stmts: &[Stmt]) -> Result<(), RefError> {
+        let indexer = Indexer {
+            analyzer: self,
+            frames: vec![Frame::default()],
+            last_scope: 0,
+            refs: Vec::new(),
+            error: None,
+        };
+        let Ok(((indexer,), _)) = visit::run(src, stmts, (indexer,)) else {
+            unreachable!()
+        };
+        if let Some(error) = indexer.error {
+            return Err(error);
+        }
+        let refs = indexer.refs;
+        u32::try_from(refs.len()).map_err(|_| RefError::TooMany)?;
+        self.refs = RefTable::build(self.symbols.len(), &refs);
+        Ok(())
+    }
+
+    /// 顶层名称的定义与使用
+    pub fn references(&self, name: &str) -> &[Ref] {
+        self.names.get(name).map_or(&[], |sym| self.refs.refs(*sym))
+    }
+
+    pub fn unused(&self) -> impl Iterator<Item = (&Astr, &[Ref])> + '_ {
+        self.refs
+            .unused()
+            .map(|sym| (&self.symbols[sym], self.refs.defs(sym)))
+    }
+
+    /// 逐条登记顶层语句，只保留签名，供流式编译在丢弃语法树后检查调用
+    ///
+    /// 调用尚未定义的函数时记入 `undef_fn_calls`，定义出现后再核对实参个数。
+    pub fn declare(&mut self, src: &str, stmt: &Stmt) -> Vec<CallError> {
+        let mut errors = Vec::new();
+        match &stmt.kind {
+            StmtKind::Def {
+                ident,
+                args,
+                args_span,
+                ..
+            }
+            | StmtKind::Extern {
+                ident,
+                args,
+                args_span,
+                ..
+            } => {
+                let name: Astr = Arc::from(&src[ident.span.start..ident.span.end]);
+                let info = FnInfo {
+                    name: name.clone(),
+                    def_span: ident.span,
+                    sym: self.symbol(0, &name),
+                    params: args
+                        .iter()
+                        .filter(|arg| matches!(arg.kind, ExprKind::Ident))
+                        .map(|arg| Arc::from(&src[arg.span.start..arg.span.end]))
+                        .collect(),
+                    args_span: *args_span,
+                    is_vararg: args
+                        .iter()
+                        .any(|arg| matches!(arg.kind, ExprKind::Ellipsis)),
+                    attr: match stmt.kind {
+                        StmtKind::Extern { attr, .. } => attr,
+                        _ => None,
+                    },
+                    scope: None,
+                };
+                for call in self.undef_fn_calls.remove(&name).into_iter().flatten() {
+                    errors.extend(check_call(&info, call));
+                }
+                self.globals.insert(name, Named::Fn(info));
+            }
+            StmtKind::Assign { left, .. } => {
+                let name: Astr = Arc::from(&src[left.span.start..left.span.end]);
+                let info = VarInfo {
+                    name: name.clone(),
+                    def_span: left.span,
+                    sym: self.symbol(0, &name),
+                };
+                self.globals.entry(name).or_insert(Named::Var(info));
+            }
+            _ => {}
+        }
+
+        // 语句内绑定的名称可能遮蔽顶层函数，不做检查
+        let passes = (Bindings::default(), Calls::default());
+        let Ok(((Bindings(mut locals), Calls(calls)), _)) =
+            visit::run(src, std::slice::from_ref(stmt), passes)
+        else {
+            unreachable!()
+        };
+        if let StmtKind::Def { ident, .. } = &stmt.kind {
+            locals.remove(&src[ident.span.start..ident.span.end]);
+        }
+
+        for call in calls {
+            if locals.contains(&*call.name) {
+                continue;
+            }
+            match self.globals.get(&call.name) {
+                Some(Named::Fn(info)) => errors.extend(check_call(info, call)),
+                Some(Named::Var(_)) => {}
+                None => self
+                    .undef_fn_calls
+                    .entry(call.name.clone())
+                    .or_default()
+                    .push(call),
+            }
+        }
+        errors
+    }
+
+    /// 输入结束后仍未定义的函数调用，按位置排序
+    pub fn undefined(&mut self) -> Vec<CallError> {
+        let mut calls = self
+            .undef_fn_calls
+            .drain()
+            .flat_map(|(_, calls)| calls)
+            .collect::<Vec<_>>();
+        calls.sort_by_key(|call| (call.use_span.src_id, call.use_span.start));
+        calls.into_iter().map(CallError::Undefined).collect()
+    }
+
+    fn symbol(&mut self, scope: u32, name: &str) -> usize {
+        let found = match scope {
+            0 => self.names.get(name),
+            _ => self.locals.get(&(scope, Arc::from(name))),
+        };
+        if let Some(sym) = found {
+            return *sym;
+        }
+        let name: Astr = Arc::from(name);
+        let sym = self.symbols.len();
+        match scope {
+            0 => self.names.insert(name.clone(), sym),
+            _ => self.locals.insert((scope, name.clone()), sym),
+        };
+        self.symbols.push(name);
+        self.scopes.push(scope);
+        sym
+    }
+}
+
+/// 一层函数作用域
+#[derive(Default)]
+struct Frame<'s> {
+    scope: u32,
+    /// 形参、赋值与循环变量，顶层为空
+    vars: HashSet<&'s str>,
+    /// 函数体内直接定义的嵌套函数
+    fns: HashSet<&'s str>,
+}
+
+struct Indexer<'a, 's> {
+    analyzer: &'a mut Analyzer,
+    frames: Vec<Frame<'s>>,
+    last_scope: u32,
+    refs: Vec<(u32, Ref)>,
+    /// 第一个错误，之后不再记录
+    error: Option<RefError>,
+}
+
+impl<'s> Pass<'s> for Indexer<'_, 's> {
+    const NAME: &'static str = "index";
+
+    fn enter_stmt(&mut self, cx: &mut Cx<'s>, stmt: &'s Stmt) {
+        let result = match &stmt.kind {
+            StmtKind::Def {
+                ident, args, body, ..
+            } => self
+                .ident(cx, ident, RefKind::Def, true)
+                .and_then(|()| self.function(cx, args, Some(body))),
+            StmtKind::Extern { ident, args, .. } => self
+                .push(cx, ident, RefKind::Def, 0)
+                .and_then(|()| self.function(cx, args, None)),
+            StmtKind::For { loop_var, .. } => self.ident(cx, loop_var, RefKind::Def, false),
+            _ => Ok(()),
+        };
+        self.record(result);
+    }
+
+    fn leave_stmt(&mut self, cx: &mut Cx<'s>, stmt: &'s Stmt) {
+        let result = match &stmt.kind {
+            StmtKind::Assign { left, .. } => self.ident(cx, left, RefKind::Def, false),
+            StmtKind::Def { .. } => {
+                self.frames.pop();
+                Ok(())
+            }
+            _ => Ok(()),
+        };
+        self.record(result);
+    }
+
+    fn enter_expr(&mut self, cx: &mut Cx<'s>, expr: &'s Expr) {
+        let result = match &expr.kind {
+            ExprKind::Ident => self.ident(cx, expr, RefKind::Use, false),
+            ExprKind::Call { callee, .. } => self.ident(cx, callee, RefKind::Use, true),
+            _ => Ok(()),
+        };
+        self.record(result);
+    }
+}
+
+impl<'s> Indexer<'_, 's> {
+    fn record(&mut self, result: Result<(), RefError>) {
+        if let Err(error) = result {
+            self.error.get_or_insert(error);
+        }
+    }
+
+    /// 变量只查当前函数，嵌套函数不能捕获外层局部变量；函数名由内向外查找嵌套定义
+    fn resolve(&self, name: &str, callee: bool) -> u32 {
+        let frame = &self.frames[self.frames.len() - 1];
+        if callee {
+            self.frames
+                .iter()
+                .rev()
+                .find(|frame| frame.fns.contains(name))
+                .map_or(0, |frame| frame.scope)
+        } else if frame.vars.contains(name) {
+            frame.scope
+        } else {
+            0
+        }
+    }
+
+    /// 非标识符与出错后的节点不记录
+    fn push(
+        &mut self,
+        cx: &Cx<'s>,
+        expr: &Expr,
+        kind: RefKind,
+        scope: u32,
+    ) -> Result<(), RefError> {
+        if matches!(expr.kind, ExprKind::Ident) && self.error.is_none() {
+            let sym = self.analyzer.symbol(scope, cx.text(expr));
+            let sym = u32::try_from(sym).map_err(|_| RefError::TooMany)?;
+            self.refs.push((sym, Ref::new(kind, expr.span)?));
+        }
+        Ok(())
+    }
+
+    fn ident(
+        &mut self,
+        cx: &Cx<'s>,
+        expr: &Expr,
+        kind: RefKind,
+        callee: bool,
+    ) -> Result<(), RefError> {
+        let scope = self.resolve(cx.text(expr), callee);
+        self.push(cx, expr, kind, scope)
+    }
+
+    /// 进入函数体并登记形参；`def` 的函数体由遍历访问，离开时弹出，`extern` 立即弹出
+    fn function(
+        &mut self,
+        cx: &Cx<'s>,
+        args: &[Expr],
+        body: Option<&'s Expr>,
+    ) -> Result<(), RefError> {
+        let src = cx.src;
+        let mut vars = args
+            .iter()
+            .filter(|arg| matches!(arg.kind, ExprKind::Ident))
+            .map(|arg| cx.text(arg))
+            .collect::<HashSet<_>>();
+        let mut defs = vec![];
+        if let Some(body) = body {
+            scope_expr(src, body, &mut vars, &mut defs);
+        }
+        let fns = defs
+            .iter()
+            .filter_map(|(_, def)| match &def.kind {
+                StmtKind::Def { ident, .. } => Some(cx.text(ident)),
+                _ => None,
+            })
+            .collect();
+
+        // 出错时仍压入一层，使离开函数体时的弹出保持配对
+        let scope = self.last_scope.checked_add(1);
+        self.last_scope = scope.unwrap_or(self.last_scope);
+        self.frames.push(Frame {
+            scope: self.last_scope,
+            vars,
+            fns,
+        });
+        let result = scope.ok_or(RefError::TooMany).and_then(|_| {
+            args.iter()
+                .try_for_each(|arg| self.ident(cx, arg, RefKind::Def, false))
+        });
+        if body.is_none() {
+            self.frames.pop();
+        }
+        result
+    }
+}
+
+fn check_call(info: &FnInfo, call: UndefFnCall) -> Option<CallError> {
+    let expected = info.params.len();
+    let matches = if info.is_vararg {
+        call.params_num >= expected
+    } else {
+        call.params_num == expected
+    };
+    (!matches).then(|| CallError::ArgsMismatch(call, expected))
+}
+
+/// 以标识符为被调用者的调用
+#[derive(Default)]
+struct Calls(Vec<UndefFnCall>);
+
+impl<'s> Pass<'s> for Calls {
+    const NAME: &'static str = "calls";
+
+    fn enter_expr(&mut self, cx: &mut Cx<'s>, expr: &'s Expr) {
+        if let ExprKind::Call {
+            callee,
+            args,
+            args_span,
+        } = &expr.kind
+            && matches!(callee.kind, ExprKind::Ident)
+        {
+            self.0.push(UndefFnCall {
+                name: Arc::from(cx.text(callee)),
+                use_span: callee.span,
+                params_num: args.len(),
+                args_span: *args_span,
+            });
+        }
+    }
+}
+
+/// 所有绑定的名称：形参、嵌套函数、赋值与循环变量
+#[derive(Default)]
+struct Bindings<'s>(HashSet<&'s str>);
+
+impl<'s> Pass<'s> for Bindings<'s> {
+    const NAME: &'static str = "bindings";
+
+    fn enter_stmt(&mut self, cx: &mut Cx<'s>, stmt: &'s Stmt) {
+        let mut bind = |expr: &Expr| {
+            if matches!(expr.kind, ExprKind::Ident) {
+                self.0.insert(cx.text(expr));
+            }
+        };
+        match &stmt.kind {
+            StmtKind::Def { ident, args, .. } => {
+                bind(ident);
+                args.iter().for_each(bind);
+            }
+            StmtKind::Assign { left, .. } => bind(left),
+            StmtKind::For { loop_var, .. } => bind(loop_var),
+            _ => {}
+        }
+    }
+}
@@ -0,0 +1,173 @@
+use super::lexer::{CodeSpan, Lexer, Source, SourceSequence};
+use std::{fmt::Display, path::PathBuf};
+
+/// 源代码的来源，内容存放在 [`SourceArena`] 中
+#[derive(Debug, Clone)]
+pub enum Origin {
+    Stdin,
+    String,
+    File(PathBuf),
+}
+
+impl Display for Origin {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        match self {
+            Self::Stdin => f.write_str("stdin"),
+            Self::String => f.write_str("string"),
+            Self::File(path) => write!(f, "{}", path.display()),
+        }
+    }
+}
+
+#[derive(Debug)]
+pub enum ArenaError {
+    /// 源代码总长度超过 4 GiB
+    TooLarge,
+}
+
+impl Display for ArenaError {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        match self {
+            Self::TooLarge => f.write_str("源代码总长度超过 4 GiB"),
+        }
+    }
+}
+
+impl std::error::Error for ArenaError {}
+
+/// 以全局字节偏移表示的位置，跨文件时不需要 `src_id`
+#[derive(Clone, Copy, Debug, Default, PartialEq, Eq, Hash)]
+pub struct Span {
+    pub start: u32,
+    pub end: u32,
+}
+
+/// 会话内所有源代码首尾相接存放在同一块文本中，以全局偏移寻址
+///
+/// 偏移到文件与行号的转换各是一次二分查找；丢弃或 [`clear`](Self::clear) 时一并释放。
+#[derive(Default)]
+pub struct SourceArena {
+    text: String,
+    /// 各文件的起始偏移与来源，按偏移递增
+    files: Vec<(u32, Origin)>,
+    /// 所有换行符的全局偏移
+    newlines: Vec<u32>,
+}
+
+impl SourceArena {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    /// 追加一个源代码，返回其 `src_id`；总长度超过 4 GiB 时不追加
+    pub fn add(&mut self, source: Source) -> Result<usize, ArenaError> {
+        let (origin, contents) = match source {
+            Source::Stdin(contents) => (Origin::Stdin, contents),
+            Source::String(contents) => (Origin::String, contents),
+            Source::File { path, contents } => (Origin::File(path), contents),
+        };
+        let start = self.text.len();
+        if start + contents.len() > u32::MAX as usize {
+            return Err(ArenaError::TooLarge);
+        }
+
+        let newlines = contents.bytes().enumerate().filter(|(_, b)| *b == b'\n');
+        self.newlines
+            .extend(newlines.map(|(i, _)| (start + i) as u32));
+        self.text.push_str(&contents);
+        self.files.push((start as u32, origin));
+        Ok(self.files.len() - 1)
+    }
+
+    pub fn len(&self) -> usize {
+        self.files.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.files.is_empty()
+    }
+
+    pub fn origin(&self, src_id: usize) -> &Origin {
+        &self.files[src_id].1
+    }
+
+    fn range(&self, src_id: usize) -> (u32, u32) {
+        let start = self.files[src_id].0;
+        let end = self
+            .files
+            .get(src_id + 1)
+            .map_or(self.text.len() as u32, |file| file.0);
+        (start, end)
+    }
+
+    pub fn text(&self, src_id: usize) -> &str {
+        let (start, end) = self.range(src_id);
+        &self.text[start as usize..end as usize]
+    }
+
+    pub fn get_text(&self, span: Span) -> Option<&str> {
+        self.text.get(span.start as usize..span.end as usize)
+    }
+
+    pub fn lexer(&self, src_id: usize) -> Lexer<'_> {
+        Lexer::from_text(src_id, self.text(src_id))
+    }
+
+    /// 偏移所在的文件，位于两个文件交界处时属于后一个；超出全部文本时为 `None`
+    pub fn locate(&self, offset: u32) -> Option<usize> {
+        if offset as usize > self.text.len() {
+            return None;
+        }
+        self.files
+            .partition_point(|file| file.0 <= offset)
+            .checked_sub(1)
+    }
+
+    /// 文件内的位置转换为全局偏移，文件不存在或位置超出文件时为 `None`
+    pub fn global(&self, span: CodeSpan) -> Option<Span> {
+        if span.src_id >= self.files.len() || span.start > span.end {
+            return None;
+        }
+        let (start, end) = self.range(span.src_id);
+        if span.end > (end - start) as usize {
+            return None;
+        }
+        Some(Span {
+            start: start + span.start as u32,
+            end: start + span.end as u32,
+        })
+    }
+
+    /// 全局偏移转换为文件内的位置，行号与词法分析得到的一致；跨越文件时为 `None`
+    pub fn span(&self, span: Span) -> Option<CodeSpan> {
+        let src_id = self.locate(span.start)?;
+        let (base, end) = self.range(src_id);
+        if span.start > span.end || span.end > end {
+            return None;
+        }
+        let before = |offset| self.newlines.partition_point(|&n| n < offset);
+        Some(CodeSpan {
+            line: before(span.start) - before(base),
+            src_id,
+            start: (span.start - base) as usize,
+            end: (span.end - base) as usize,
+        })
+    }
+
+    /// 释放全部源代码
+    pub fn clear(&mut self) {
+        *self = Self::default();
+    }
+}
+
+impl TryFrom<SourceSequence> for SourceArena {
+    type Error = ArenaError;
+
+    fn try_from(srcs: SourceSequence) -> Result<Self, ArenaError> {
+        let mut arena = Self::new();
+        for source in srcs.sources {
+            arena.add(source)?;
+        }
+        Ok(arena)
+    }
+}
@@ -1,3 +1,6 @@
+pub mod json;
+pub(super) mod scope;
+
 use super::CodeSpan;
 use super::lexer::Operator;
 use serde::{Deserialize, Serialize};
@@ -46,6 +49,22 @@ pub enum ExprKind {
         if_then_span: CodeSpan,
         else_branch: Option<Box<ElseExpr>>,
     },
+
+    /// 由 `if x == K1 then ... else if x == K2 then ...` 分支链降级得到的多路分派
+    Switch {
+        scrutinee: Box<Expr>,
+        /// 按值升序排列且互不相同
+        cases: Vec<SwitchCase>,
+        default: Option<Box<Expr>>,
+        /// 分支值为稠密整数，可以用跳转表分派；否则按二分决策树分派
+        dense: bool,
+    },
+}
+
+#[derive(Debug, Clone, Deserialize, Serialize)]
+pub struct SwitchCase {
+    pub value: f64,
+    pub expr: Expr,
 }
 
 #[derive(Debug, Clone, Deserialize, Serialize)]
@@ -94,6 +113,10 @@ pub enum StmtKind {
         /// def add(a, b) a + b
         ///               ^^^^^
         body_span: CodeSpan,
+        /// def fast add(a, b) a + b
+        ///     ^^^^
+        #[serde(default)]
+        fp: Option<FpMode>,
     },
 
     Empty,
@@ -106,6 +129,10 @@ pub enum StmtKind {
         /// extern add(a, b);
         ///           ^^^^^^
         args_span: CodeSpan,
+        /// extern const sqrt(x);
+        ///        ^^^^^
+        #[serde(default)]
+        attr: Option<ExternAttr>,
     },
 
     For {
@@ -118,8 +145,180 @@ pub enum StmtKind {
     Return(Expr),
 }
 
+/// 浮点语义
+///
+/// - `Strict`：严格 IEEE 754，每步运算单独舍入
+/// - `Contract`：允许将 `a * b + c` 融合为一次舍入的 FMA
+/// - `Fast`：另允许重结合、以倒数乘代替除法，并假定不出现 NaN、无穷与负零
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq, Hash, Deserialize, Serialize)]
+pub enum FpMode {
+    #[default]
+    Strict,
+    Contract,
+    Fast,
+}
+
+impl FpMode {
+    pub fn from_name(name: &str) -> Option<Self> {
+        match name {
+            "strict" => Some(Self::Strict),
+            "contract" => Some(Self::Contract),
+            "fast" => Some(Self::Fast),
+            _ => None,
+        }
+    }
+}
+
+/// `extern` 函数的调用属性，未标注时调用可能有任意副作用
+///
+/// - `Pure`：没有副作用，结果取决于实参与外部状态，两次调用之间没有其他外部调用时结果相同
+/// - `Const`：没有副作用，结果只取决于实参
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash, Deserialize, Serialize)]
+pub enum ExternAttr {
+    Pure,
+    Const,
+}
+
+impl ExternAttr {
+    pub fn from_name(name: &str) -> Option<Self> {
+        match name {
+            "pure" => Some(Self::Pure),
+            "const" => Some(Self::Const),
+            _ => None,
+        }
+    }
+}
+
 #[derive(Debug, Clone, Deserialize, Serialize)]
 pub struct Stmt {
     pub kind: StmtKind,
     pub span: CodeSpan,
 }
+
+impl Expr {
+    pub fn for_each_span_mut(&mut self, f: &mut impl FnMut(&mut CodeSpan)) {
+        f(&mut self.span);
+        match &mut self.kind {
+            ExprKind::Ident | ExprKind::Ellipsis | ExprKind::Lit(_) => {}
+            ExprKind::Parented(inner) => inner.for_each_span_mut(f),
+            ExprKind::Block(stmts) => {
+                for stmt in stmts {
+                    stmt.for_each_span_mut(f);
+                }
+            }
+            ExprKind::Call {
+                callee,
+                args,
+                args_span,
+            } => {
+                callee.for_each_span_mut(f);
+                for arg in args {
+                    arg.for_each_span_mut(f);
+                }
+                f(args_span);
+            }
+            ExprKind::UnOp { op_span, arg, .. } => {
+                f(op_span);
+                arg.for_each_span_mut(f);
+            }
+            ExprKind::BinOp {
+                op_span,
+                left,
+                right,
+                ..
+            } => {
+                f(op_span);
+                left.for_each_span_mut(f);
+                right.for_each_span_mut(f);
+            }
+            ExprKind::If {
+                if_then_exprs,
+                if_then_span,
+                else_branch,
+            } => {
+                for if_then in if_then_exprs {
+                    if_then.cond.for_each_span_mut(f);
+                    if_then.then.for_each_span_mut(f);
+                    f(&mut if_then.span);
+                }
+                f(if_then_span);
+                if let Some(else_expr) = else_branch {
+                    else_expr.expr.for_each_span_mut(f);
+                    f(&mut else_expr.span);
+                }
+            }
+            ExprKind::Switch {
+                scrutinee,
+                cases,
+                default,
+                ..
+            } => {
+                scrutinee.for_each_span_mut(f);
+                for case in cases {
+                    case.expr.for_each_span_mut(f);
+                }
+                if let Some(default) = default {
+                    default.for_each_span_mut(f);
+                }
+            }
+        }
+    }
+}
+
+impl Stmt {
+    pub fn for_each_span_mut(&mut self, f: &mut impl FnMut(&mut CodeSpan)) {
+        f(&mut self.span);
+        match &mut self.kind {
+            StmtKind::Assign {
+                left,
+                right,
+                assign_span,
+            } => {
+                left.for_each_span_mut(f);
+                right.for_each_span_mut(f);
+                f(assign_span);
+            }
+            StmtKind::Break | StmtKind::Continue | StmtKind::Empty => {}
+            StmtKind::Def {
+                ident,
+                args,
+                args_span,
+                body,
+                body_span,
+                ..
+            } => {
+                ident.for_each_span_mut(f);
+                for arg in args {
+                    arg.for_each_span_mut(f);
+                }
+                f(args_span);
+                body.for_each_span_mut(f);
+                f(body_span);
+            }
+            StmtKind::Expr(expr) | StmtKind::Return(expr) => expr.for_each_span_mut(f),
+            StmtKind::Extern {
+                ident,
+                args,
+                args_span,
+                ..
+            } => {
+                ident.for_each_span_mut(f);
+                for arg in args {
+                    arg.for_each_span_mut(f);
+                }
+                f(args_span);
+            }
+            StmtKind::For {
+                loop_var,
+                loop_iter,
+                head_span,
+                loop_body,
+            } => {
+                loop_var.for_each_span_mut(f);
+                loop_iter.for_each_span_mut(f);
+                f(head_span);
+                loop_body.for_each_span_mut(f);
+            }
+        }
+    }
+}
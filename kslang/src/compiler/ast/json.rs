@@ -0,0 +1,87 @@
+use super::Stmt;
+use std::io::{IoSlice, Write};
+
+/// 语句少于此数时不启用多线程
+const MIN_PARALLEL: usize = 256;
+
+/// 按顶层语句分块并行序列化，各块依次拼接后与 `serde_json::to_vec(stmts)` 逐字节相同
+///
+/// 块之间的 `,` 与首尾的方括号由 [`write_json`] 补上。分块按语句的源代码长度均分，
+/// 块数不超过 `jobs`。
+pub fn to_json_chunks(stmts: &[Stmt], jobs: usize) -> serde_json::Result<Vec<Vec<u8>>> {
+    let ranges = split(stmts, jobs);
+    if ranges.len() <= 1 {
+        return Ok(vec![serialize(stmts)?]);
+    }
+
+    std::thread::scope(|scope| {
+        let workers = ranges
+            .into_iter()
+            .map(|(start, end)| scope.spawn(move || serialize(&stmts[start..end])))
+            .collect::<Vec<_>>();
+        workers
+            .into_iter()
+            .map(|worker| worker.join().unwrap())
+            .collect()
+    })
+}
+
+/// 以一次向量写入输出各块，结果与 `serde_json::to_writer(out, stmts)` 相同
+pub fn write_json(out: &mut dyn Write, stmts: &[Stmt], jobs: usize) -> std::io::Result<()> {
+    let chunks = to_json_chunks(stmts, jobs)?;
+    let mut slices = vec![IoSlice::new(b"[")];
+    for (index, chunk) in chunks.iter().enumerate() {
+        if index > 0 {
+            slices.push(IoSlice::new(b","));
+        }
+        slices.push(IoSlice::new(chunk));
+    }
+    slices.push(IoSlice::new(b"]"));
+
+    let mut slices = slices.as_mut_slice();
+    while !slices.is_empty() {
+        match out.write_vectored(slices) {
+            Ok(0) => return Err(std::io::ErrorKind::WriteZero.into()),
+            Ok(written) => IoSlice::advance_slices(&mut slices, written),
+            Err(e) if e.kind() == std::io::ErrorKind::Interrupted => {}
+            Err(e) => return Err(e),
+        }
+    }
+    Ok(())
+}
+
+/// 逗号分隔的语句，不含方括号
+fn serialize(stmts: &[Stmt]) -> serde_json::Result<Vec<u8>> {
+    let mut buffer = Vec::new();
+    for (index, stmt) in stmts.iter().enumerate() {
+        if index > 0 {
+            buffer.push(b',');
+        }
+        serde_json::to_writer(&mut buffer, stmt)?;
+    }
+    Ok(buffer)
+}
+
+/// 按源代码长度切分为至多 `jobs` 个非空区间
+fn split(stmts: &[Stmt], jobs: usize) -> Vec<(usize, usize)> {
+    if stmts.len() < MIN_PARALLEL || jobs <= 1 {
+        return vec![(0, stmts.len())];
+    }
+
+    let weight = |stmt: &Stmt| (stmt.span.end - stmt.span.start).max(1);
+    let total = stmts.iter().map(weight).sum::<usize>();
+    let target = total.div_ceil(jobs);
+    let mut ranges = vec![];
+    let (mut start, mut acc) = (0, 0);
+    for (index, stmt) in stmts.iter().enumerate() {
+        acc += weight(stmt);
+        if acc >= target {
+            ranges.push((start, index + 1));
+            (start, acc) = (index + 1, 0);
+        }
+    }
+    if start < stmts.len() {
+        ranges.push((start, stmts.len()));
+    }
+    ranges
+}
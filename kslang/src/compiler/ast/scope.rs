@@ -0,0 +1,248 @@
+//! 函数体内的名称与作用域，供各后端与分析共用
+
+use super::{
+    super::{
+        CodeSpan,
+        lexer::Operator,
+        visit::{self, Cx, Pass},
+    },
+    Expr, ExprKind, ExternAttr, Stmt, StmtKind,
+};
+use std::collections::{HashMap, HashSet};
+
+/// 一个函数体内直接出现的嵌套函数
+///
+/// 同名函数可以定义在互不相交的语句块中，此时调用解析为包含调用处的最内层语句块中的定义；
+/// 只有一个定义的名称在整个函数体内可见。
+#[derive(Clone)]
+pub(in crate::compiler) struct NestedDefs<'a, S> {
+    defs: HashMap<&'a str, Vec<(CodeSpan, S)>>,
+}
+
+impl<S> Default for NestedDefs<'_, S> {
+    fn default() -> Self {
+        Self {
+            defs: HashMap::new(),
+        }
+    }
+}
+
+impl<'a, S> NestedDefs<'a, S> {
+    /// 同一语句块中已有同名定义时返回 `false`
+    pub(in crate::compiler) fn insert(&mut self, name: &'a str, block: CodeSpan, def: S) -> bool {
+        let defs = self.defs.entry(name).or_default();
+        if defs.iter().any(|(other, _)| *other == block) {
+            return false;
+        }
+        defs.push((block, def));
+        true
+    }
+
+    pub(in crate::compiler) fn get(&self, name: &str, at: CodeSpan) -> Option<&S> {
+        match self.defs.get(name)?.as_slice() {
+            [(_, def)] => Some(def),
+            defs => defs
+                .iter()
+                .filter(|(block, _)| {
+                    block.src_id == at.src_id && block.start <= at.start && at.end <= block.end
+                })
+                .min_by_key(|(block, _)| block.end - block.start)
+                .map(|(_, def)| def),
+        }
+    }
+
+    pub(in crate::compiler) fn values(&self) -> impl Iterator<Item = &S> {
+        self.defs.values().flatten().map(|(_, def)| def)
+    }
+}
+
+/// 加减法中的乘法操作数
+pub(in crate::compiler) fn product(expr: &Expr) -> Option<(&Expr, &Expr)> {
+    match &expr.kind {
+        ExprKind::BinOp {
+            op: Operator::Mul,
+            left,
+            right,
+            ..
+        } => Some((left, right)),
+        _ => None,
+    }
+}
+
+/// 含有嵌套函数定义
+pub(in crate::compiler) fn has_def(src: &str, expr: &Expr) -> bool {
+    let mut defs = vec![];
+    defs_expr(src, expr, expr.span, &mut defs);
+    !defs.is_empty()
+}
+
+/// 不进入嵌套函数体，每个定义连同其所在的最内层语句块
+pub(in crate::compiler) fn defs_stmt<'e>(
+    src: &'e str,
+    stmt: &'e Stmt,
+    block: CodeSpan,
+    defs: &mut Vec<(CodeSpan, &'e Stmt)>,
+) {
+    let pass = Defs {
+        block,
+        outer: vec![],
+        out: defs,
+    };
+    let Ok(_) = visit::run(src, std::slice::from_ref(stmt), (pass,)) else {
+        unreachable!()
+    };
+}
+
+fn defs_expr<'e>(
+    src: &'e str,
+    expr: &'e Expr,
+    block: CodeSpan,
+    defs: &mut Vec<(CodeSpan, &'e Stmt)>,
+) {
+    let pass = Defs {
+        block,
+        outer: vec![],
+        out: defs,
+    };
+    let Ok(_) = visit::run_expr(src, expr, (pass,)) else {
+        unreachable!()
+    };
+}
+
+struct Defs<'e, 'o> {
+    /// 当前所在的最内层语句块
+    block: CodeSpan,
+    outer: Vec<CodeSpan>,
+    out: &'o mut Vec<(CodeSpan, &'e Stmt)>,
+}
+
+impl<'e> Pass<'e> for Defs<'e, '_> {
+    const NAME: &'static str = "defs";
+
+    fn enter_stmt(&mut self, cx: &mut Cx<'e>, stmt: &'e Stmt) {
+        if cx.defs.is_empty() && matches!(stmt.kind, StmtKind::Def { .. }) {
+            self.out.push((self.block, stmt));
+        }
+    }
+
+    fn enter_expr(&mut self, _cx: &mut Cx<'e>, expr: &'e Expr) {
+        if let ExprKind::Block(_) = expr.kind {
+            self.outer
+                .push(std::mem::replace(&mut self.block, expr.span));
+        }
+    }
+
+    fn leave_expr(&mut self, _cx: &mut Cx<'e>, expr: &'e Expr) {
+        if let ExprKind::Block(_) = expr.kind
+            && let Some(block) = self.outer.pop()
+        {
+            self.block = block;
+        }
+    }
+}
+
+/// 被赋值的名称与循环变量，不进入嵌套函数体
+pub(in crate::compiler) fn assigned_stmt<'a>(
+    src: &'a str,
+    stmt: &Stmt,
+    names: &mut HashSet<&'a str>,
+) {
+    let Ok(_) = visit::run(src, std::slice::from_ref(stmt), (Assigned { src, names },)) else {
+        unreachable!()
+    };
+}
+
+/// 名称借用 `src` 本身，可以比遍历的语法树活得久
+struct Assigned<'a, 'o> {
+    src: &'a str,
+    names: &'o mut HashSet<&'a str>,
+}
+
+impl<'e> Pass<'e> for Assigned<'_, '_> {
+    const NAME: &'static str = "assigned";
+
+    fn enter_stmt(&mut self, cx: &mut Cx<'e>, stmt: &'e Stmt) {
+        if !cx.defs.is_empty() {
+            return;
+        }
+        let name = match &stmt.kind {
+            StmtKind::Assign { left, .. } => left,
+            StmtKind::For { loop_var, .. } => loop_var,
+            _ => return,
+        };
+        self.names.insert(text(self.src, name));
+    }
+}
+
+/// 一次遍历同时得出 [`assigned_stmt`] 与 [`defs_stmt`] 的结果，`block` 为语句本身
+pub(in crate::compiler) fn scope_stmt<'a: 'e, 'e>(
+    src: &'a str,
+    stmt: &'e Stmt,
+    names: &mut HashSet<&'a str>,
+    defs: &mut Vec<(CodeSpan, &'e Stmt)>,
+) {
+    let passes = (
+        Assigned { src, names },
+        Defs {
+            block: stmt.span,
+            outer: vec![],
+            out: defs,
+        },
+    );
+    let Ok(_) = visit::run(src, std::slice::from_ref(stmt), passes) else {
+        unreachable!()
+    };
+}
+
+/// 函数体的版本，`block` 为函数体本身
+pub(in crate::compiler) fn scope_expr<'a: 'e, 'e>(
+    src: &'a str,
+    expr: &'e Expr,
+    names: &mut HashSet<&'a str>,
+    defs: &mut Vec<(CodeSpan, &'e Stmt)>,
+) {
+    let passes = (
+        Assigned { src, names },
+        Defs {
+            block: expr.span,
+            outer: vec![],
+            out: defs,
+        },
+    );
+    let Ok(_) = visit::run_expr(src, expr, passes) else {
+        unreachable!()
+    };
+}
+
+/// 所有层级的 `extern` 声明
+pub(in crate::compiler) fn externs_stmt<'a: 's, 's>(
+    src: &'a str,
+    stmt: &'s Stmt,
+    out: &mut Vec<(&'a str, &'s Expr, &'s [Expr], Option<ExternAttr>)>,
+) {
+    let Ok(_) = visit::run(src, std::slice::from_ref(stmt), (Externs { src, out },)) else {
+        unreachable!()
+    };
+}
+
+struct Externs<'a, 's, 'o> {
+    src: &'a str,
+    out: &'o mut Vec<(&'a str, &'s Expr, &'s [Expr], Option<ExternAttr>)>,
+}
+
+impl<'s> Pass<'s> for Externs<'_, 's, '_> {
+    const NAME: &'static str = "externs";
+
+    fn enter_stmt(&mut self, _cx: &mut Cx<'s>, stmt: &'s Stmt) {
+        if let StmtKind::Extern {
+            ident, args, attr, ..
+        } = &stmt.kind
+        {
+            self.out.push((self.src, ident, args, *attr));
+        }
+    }
+}
+
+fn text<'a>(src: &'a str, expr: &Expr) -> &'a str {
+    &src[expr.span.start..expr.span.end]
+}
@@ -0,0 +1,179 @@
+use super::{
+    Source,
+    clexer::KSCSource,
+    exec::{
+        Machine, Program,
+        arrow::{ArrowArray, ArrowSchema, BatchError, Column, eval, output_schema},
+    },
+    lexer::Lexer,
+    opt::{self, fp, lto::Module},
+    parse_ast,
+};
+use std::{collections::HashMap, ffi::c_char};
+
+/// Compiled program
+#[repr(C)]
+pub struct KSCProgram;
+
+/// 编译结果与执行顶层代码后的全局变量，求值时不再重复执行顶层代码
+struct Compiled {
+    program: Program,
+    globals: Vec<f64>,
+}
+
+/// 执行线程的栈大小，调用层数达到 `MAX_DEPTH` 前不会耗尽；宿主线程的栈大小未知
+const STACK_SIZE: usize = 1 << 30;
+
+/// 在栈足够大的新线程上执行，无法创建线程时返回 `None`
+fn on_stack<T: Send>(f: impl FnOnce() -> T + Send) -> Option<T> {
+    std::thread::scope(|scope| {
+        let thread = std::thread::Builder::new()
+            .stack_size(STACK_SIZE)
+            .spawn_scoped(scope, f)
+            .ok()?;
+        Some(
+            thread
+                .join()
+                .unwrap_or_else(|e| std::panic::resume_unwind(e)),
+        )
+    })
+}
+
+/// 一列输入：列的类型与按顺序排列的分块
+#[repr(C)]
+pub struct KSCColumn {
+    pub schema: *const ArrowSchema,
+    pub chunks: *const ArrowArray,
+    pub n_chunks: usize,
+}
+
+pub type KSCBatchErr = usize;
+
+pub const KSC_BATCH_ERR_OK: KSCBatchErr = 0;
+/// 函数未定义或列数与形参个数不符
+pub const KSC_BATCH_ERR_UNDEFINED: KSCBatchErr = 1;
+/// 列不是 float64 数组
+pub const KSC_BATCH_ERR_FORMAT: KSCBatchErr = 2;
+/// 各列行数不同
+pub const KSC_BATCH_ERR_LENGTH: KSCBatchErr = 3;
+/// 执行时调用层数超出上限
+pub const KSC_BATCH_ERR_TRAP: KSCBatchErr = 4;
+/// 无法创建执行线程
+pub const KSC_BATCH_ERR_THREAD: KSCBatchErr = 5;
+
+/// 编译为闭包树并执行一次顶层代码，出现错误、顶层代码中止或声明了 `extern` 时返回空指针
+///
+/// # Safety
+#[unsafe(no_mangle)]
+pub unsafe extern "C" fn newKSCProgram(src: *const KSCSource) -> *const KSCProgram {
+    if src.is_null() {
+        return std::ptr::null();
+    }
+
+    let text = unsafe { &*(src as *const Source) }.text();
+    let Ok(tokens) = Lexer::from_text(0, text).collect::<Result<Vec<_>, _>>() else {
+        return std::ptr::null();
+    };
+    let Ok(mut stmts) = parse_ast(text, &tokens) else {
+        return std::ptr::null();
+    };
+    let mode = fp::module_mode(text).unwrap_or_default();
+    opt::optimize(text, &mut stmts, mode);
+    let modules = [Module {
+        src: text,
+        stmts,
+        fp: mode,
+    }];
+    let Ok(program) = Program::compile(&modules, &HashMap::new()) else {
+        return std::ptr::null();
+    };
+    let globals = on_stack(|| {
+        let mut machine = Machine::new(&program);
+        machine.run().ok().map(|()| machine.globals().to_vec())
+    });
+    match globals.flatten() {
+        Some(globals) => {
+            Box::into_raw(Box::new(Compiled { program, globals })) as *const KSCProgram
+        }
+        None => std::ptr::null(),
+    }
+}
+
+/// # Safety
+#[unsafe(no_mangle)]
+pub unsafe extern "C" fn freeKSCProgram(program: *const KSCProgram) {
+    if !program.is_null() {
+        unsafe { _ = Box::from_raw(program as *mut Compiled) };
+    }
+}
+
+/// 以各列为实参逐行调用顶层函数 `name`，直接读取列的缓冲区
+///
+/// 成功时结果写入 `out_schema` 与 `out_array`，由调用方调用各自的 `release` 释放。
+/// 同一个程序可在多个线程上同时求值，每次求值在内部创建的大栈线程上进行。
+///
+/// # Safety
+#[unsafe(no_mangle)]
+pub unsafe extern "C" fn evalKSCBatch(
+    program: *const KSCProgram,
+    name: *const c_char,
+    name_len: usize,
+    columns: *const KSCColumn,
+    n_columns: usize,
+    out_schema: *mut ArrowSchema,
+    out_array: *mut ArrowArray,
+) -> KSCBatchErr {
+    if program.is_null() || name.is_null() || out_schema.is_null() || out_array.is_null() {
+        return KSC_BATCH_ERR_UNDEFINED;
+    }
+
+    let compiled = unsafe { &*(program as *const Compiled) };
+    let program = &compiled.program;
+    let name = unsafe { std::slice::from_raw_parts(name as *const u8, name_len) };
+    let Some(entry) = std::str::from_utf8(name)
+        .ok()
+        .and_then(|name| program.entry(name))
+    else {
+        return KSC_BATCH_ERR_UNDEFINED;
+    };
+
+    let columns = match n_columns {
+        0 => &[],
+        _ if columns.is_null() => return KSC_BATCH_ERR_FORMAT,
+        _ => unsafe { std::slice::from_raw_parts(columns, n_columns) },
+    };
+    let mut views = Vec::with_capacity(columns.len());
+    for column in columns {
+        if column.schema.is_null() || column.chunks.is_null() && column.n_chunks > 0 {
+            return KSC_BATCH_ERR_FORMAT;
+        }
+        let chunks = match column.n_chunks {
+            0 => &[],
+            n => unsafe { std::slice::from_raw_parts(column.chunks, n) },
+        };
+        match unsafe { Column::import(&*column.schema, chunks) } {
+            Some(view) => views.push(view),
+            None => return KSC_BATCH_ERR_FORMAT,
+        }
+    }
+
+    let result = on_stack(|| {
+        let mut machine = Machine::with_globals(program, &compiled.globals);
+        eval(&mut machine, entry, &views)
+    });
+    let Some(result) = result else {
+        return KSC_BATCH_ERR_THREAD;
+    };
+    match result {
+        Ok(output) => {
+            unsafe {
+                out_schema.write(output_schema());
+                out_array.write(output.export());
+            }
+            KSC_BATCH_ERR_OK
+        }
+        Err(BatchError::Arity) => KSC_BATCH_ERR_UNDEFINED,
+        Err(BatchError::Length) => KSC_BATCH_ERR_LENGTH,
+        Err(BatchError::Trap(_)) => KSC_BATCH_ERR_TRAP,
+    }
+}
@@ -1,4 +1,7 @@
-use super::Source;
+use super::{
+    Source,
+    lexer::{Lexer, Token},
+};
 use std::{ffi::c_char, path::PathBuf};
 
 macro_rules! set {
@@ -13,6 +16,10 @@ macro_rules! set {
 #[repr(C)]
 pub struct KSCSource;
 
+/// Token stream
+#[repr(C)]
+pub struct KSCTokens;
+
 pub type KSCSourceKind = usize;
 
 // Source kinds
@@ -103,6 +110,40 @@ pub unsafe extern "C" fn getKSCSourceText(src: *const KSCSource) -> *const c_cha
 #[unsafe(no_mangle)]
 pub unsafe extern "C" fn freeKSCSource(src: *const KSCSource) {
     if !src.is_null() {
-        unsafe { _ = Box::from_raw(src as *mut KSCSource) };
+        unsafe { _ = Box::from_raw(src as *mut Source) };
+    }
+}
+
+/// 词法错误时返回空指针
+///
+/// # Safety
+#[unsafe(no_mangle)]
+pub unsafe extern "C" fn newKSCTokens(src: *const KSCSource) -> *const KSCTokens {
+    if src.is_null() {
+        return std::ptr::null();
+    }
+
+    let src = unsafe { &*(src as *const Source) };
+    match Lexer::from_text(0, src.text()).collect::<Result<Vec<Token>, _>>() {
+        Ok(tokens) => Box::into_raw(Box::new(tokens)) as *const KSCTokens,
+        Err(_) => std::ptr::null(),
+    }
+}
+
+/// # Safety
+#[unsafe(no_mangle)]
+pub unsafe extern "C" fn getKSCTokensLen(tokens: *const KSCTokens) -> usize {
+    if tokens.is_null() {
+        return 0;
+    }
+
+    unsafe { &*(tokens as *const Vec<Token>) }.len()
+}
+
+/// # Safety
+#[unsafe(no_mangle)]
+pub unsafe extern "C" fn freeKSCTokens(tokens: *const KSCTokens) {
+    if !tokens.is_null() {
+        unsafe { _ = Box::from_raw(tokens as *mut Vec<Token>) };
     }
 }
@@ -0,0 +1,51 @@
+use super::{
+    Source,
+    ast::Stmt,
+    clexer::{KSCSource, KSCTokens},
+    lexer::Token,
+    parse_ast,
+};
+
+/// AST
+#[repr(C)]
+pub struct KSCAst;
+
+/// 语法错误时返回空指针，`tokens` 须由同一个 `src` 生成
+///
+/// # Safety
+#[unsafe(no_mangle)]
+pub unsafe extern "C" fn newKSCAst(
+    src: *const KSCSource,
+    tokens: *const KSCTokens,
+) -> *const KSCAst {
+    if src.is_null() || tokens.is_null() {
+        return std::ptr::null();
+    }
+
+    let src = unsafe { &*(src as *const Source) };
+    let tokens = unsafe { &*(tokens as *const Vec<Token>) };
+    match parse_ast(src.text(), tokens) {
+        Ok(stmts) => Box::into_raw(Box::new(stmts)) as *const KSCAst,
+        Err(_) => std::ptr::null(),
+    }
+}
+
+/// 顶层语句数
+///
+/// # Safety
+#[unsafe(no_mangle)]
+pub unsafe extern "C" fn getKSCAstLen(ast: *const KSCAst) -> usize {
+    if ast.is_null() {
+        return 0;
+    }
+
+    unsafe { &*(ast as *const Vec<Stmt>) }.len()
+}
+
+/// # Safety
+#[unsafe(no_mangle)]
+pub unsafe extern "C" fn freeKSCAst(ast: *const KSCAst) {
+    if !ast.is_null() {
+        unsafe { _ = Box::from_raw(ast as *mut Vec<Stmt>) };
+    }
+}
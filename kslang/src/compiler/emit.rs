@@ -0,0 +1,303 @@
+pub mod c;
+pub mod header;
+
+use super::{
+    CodeSpan,
+    ast::{Expr, ExprKind, Stmt, StmtKind},
+};
+use std::collections::HashMap;
+
+#[derive(Debug)]
+pub enum EmitError {
+    /// 名称不是合法的 C 标识符或与 C 关键字冲突
+    InvalidSymbol(CodeSpan),
+    /// 同名函数重复定义，链接符号不唯一
+    Duplicate(CodeSpan),
+    /// 仅有可变参数，C 至少需要一个具名参数
+    VarargOnly(CodeSpan),
+    /// 读取未赋值的变量或调用未定义的函数
+    Undefined(CodeSpan),
+    /// 嵌套函数引用外层函数的局部变量，C 函数不能捕获
+    Capture(CodeSpan),
+    /// 无法翻译为 C 的构造
+    Unsupported(CodeSpan),
+    /// 调用的实参个数与定义不符
+    Arity(CodeSpan),
+}
+
+impl std::fmt::Display for EmitError {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        match self {
+            Self::InvalidSymbol(span) => write!(f, "{}: 函数名不是合法的 C 符号", span),
+            Self::Duplicate(span) => write!(f, "{}: 导出函数重复定义", span),
+            Self::VarargOnly(span) => write!(f, "{}: 导出函数缺少具名参数", span),
+            Self::Undefined(span) => write!(f, "{}: 未定义的名称", span),
+            Self::Capture(span) => write!(f, "{}: 嵌套函数不能引用外层函数的局部变量", span),
+            Self::Unsupported(span) => write!(f, "{}: 无法翻译为 C 代码", span),
+            Self::Arity(span) => write!(f, "{}: 实参个数与定义不符", span),
+        }
+    }
+}
+
+impl std::error::Error for EmitError {}
+
+/// 顶层 `def` 导出为 `double name(double, ...)`
+pub struct Export<'s> {
+    pub name: &'s str,
+    /// 形参名，不是合法 C 标识符时为 `None`
+    pub params: Vec<Option<&'s str>>,
+    pub vararg: bool,
+    pub span: CodeSpan,
+}
+
+/// 按定义顺序收集顶层 `def`，与 libc/libm 重名的函数只在内部使用，不导出
+pub fn exports<'s>(src: &'s str, stmts: &[Stmt]) -> Result<Vec<Export<'s>>, EmitError> {
+    let mut seen = HashMap::new();
+    let mut exports = Vec::new();
+    for stmt in stmts {
+        let StmtKind::Def { ident, args, .. } = &stmt.kind else {
+            continue;
+        };
+
+        let name = text(src, ident);
+        if !c_ident(name) {
+            return Err(EmitError::InvalidSymbol(ident.span));
+        }
+        if seen.insert(name, ident.span).is_some() {
+            return Err(EmitError::Duplicate(ident.span));
+        }
+        if libc_name(name) {
+            continue;
+        }
+
+        let vararg = args
+            .iter()
+            .any(|arg| matches!(arg.kind, ExprKind::Ellipsis));
+        let params = args
+            .iter()
+            .filter(|arg| matches!(arg.kind, ExprKind::Ident))
+            .map(|arg| Some(text(src, arg)).filter(|name| c_ident(name)))
+            .collect::<Vec<_>>();
+        if vararg && params.is_empty() {
+            return Err(EmitError::VarargOnly(ident.span));
+        }
+
+        exports.push(Export {
+            name,
+            params,
+            vararg,
+            span: stmt.span,
+        });
+    }
+    Ok(exports)
+}
+
+fn text<'s>(src: &'s str, expr: &Expr) -> &'s str {
+    &src[expr.span.start..expr.span.end]
+}
+
+/// C23 与 C++20 的关键字及替代运算符记号，另加 `main`
+const C_KEYWORDS: &[&str] = &[
+    "alignas",
+    "alignof",
+    "and",
+    "and_eq",
+    "asm",
+    "auto",
+    "bitand",
+    "bitor",
+    "bool",
+    "break",
+    "case",
+    "catch",
+    "char",
+    "char16_t",
+    "char32_t",
+    "char8_t",
+    "class",
+    "co_await",
+    "co_return",
+    "co_yield",
+    "compl",
+    "concept",
+    "const",
+    "const_cast",
+    "consteval",
+    "constexpr",
+    "constinit",
+    "continue",
+    "decltype",
+    "default",
+    "delete",
+    "do",
+    "double",
+    "dynamic_cast",
+    "else",
+    "enum",
+    "explicit",
+    "export",
+    "extern",
+    "false",
+    "float",
+    "for",
+    "friend",
+    "goto",
+    "if",
+    "inline",
+    "int",
+    "long",
+    "main",
+    "mutable",
+    "namespace",
+    "new",
+    "noexcept",
+    "not",
+    "not_eq",
+    "nullptr",
+    "operator",
+    "or",
+    "or_eq",
+    "private",
+    "protected",
+    "public",
+    "register",
+    "reinterpret_cast",
+    "requires",
+    "restrict",
+    "return",
+    "short",
+    "signed",
+    "sizeof",
+    "static",
+    "static_assert",
+    "static_cast",
+    "struct",
+    "switch",
+    "template",
+    "this",
+    "thread_local",
+    "throw",
+    "true",
+    "try",
+    "typedef",
+    "typeid",
+    "typename",
+    "typeof",
+    "typeof_unqual",
+    "union",
+    "unsigned",
+    "using",
+    "virtual",
+    "void",
+    "volatile",
+    "wchar_t",
+    "while",
+    "xor",
+    "xor_eq",
+];
+
+/// libm 的双精度函数，另有 `f`/`l` 后缀的单精度与长双精度版本
+const LIBM_NAMES: &[&str] = &[
+    "acos",
+    "acosh",
+    "asin",
+    "asinh",
+    "atan",
+    "atan2",
+    "atanh",
+    "cbrt",
+    "ceil",
+    "copysign",
+    "cos",
+    "cosh",
+    "erf",
+    "erfc",
+    "exp",
+    "exp10",
+    "exp2",
+    "expm1",
+    "fabs",
+    "fdim",
+    "floor",
+    "fma",
+    "fmax",
+    "fmin",
+    "fmod",
+    "frexp",
+    "gamma",
+    "hypot",
+    "ilogb",
+    "j0",
+    "j1",
+    "jn",
+    "ldexp",
+    "lgamma",
+    "llrint",
+    "llround",
+    "log",
+    "log10",
+    "log1p",
+    "log2",
+    "logb",
+    "lrint",
+    "lround",
+    "modf",
+    "nan",
+    "nearbyint",
+    "nextafter",
+    "nexttoward",
+    "pow",
+    "remainder",
+    "remquo",
+    "rint",
+    "round",
+    "scalb",
+    "scalbln",
+    "scalbn",
+    "significand",
+    "sin",
+    "sincos",
+    "sinh",
+    "sqrt",
+    "tan",
+    "tanh",
+    "tgamma",
+    "trunc",
+    "y0",
+    "y1",
+    "yn",
+];
+
+/// 常用的 libc 函数
+const LIBC_NAMES: &[&str] = &[
+    "abort", "abs", "atexit", "atof", "atoi", "atol", "atoll", "bsearch", "calloc", "clock", "div",
+    "exit", "fclose", "fflush", "fopen", "fprintf", "fputs", "free", "fscanf", "getchar", "getenv",
+    "labs", "ldiv", "llabs", "malloc", "memchr", "memcmp", "memcpy", "memmove", "memset", "printf",
+    "putchar", "puts", "qsort", "raise", "rand", "realloc", "scanf", "signal", "snprintf",
+    "sprintf", "srand", "sscanf", "strcat", "strchr", "strcmp", "strcpy", "strlen", "strncmp",
+    "strncpy", "strrchr", "strstr", "strtod", "strtol", "system", "time",
+];
+
+/// 与 libc/libm 函数重名
+///
+/// 以这些名称导出的函数可能被 C 编译器替换为内建函数，链接后也会替换宿主进程中的
+/// 同名函数。
+pub fn libc_name(name: &str) -> bool {
+    LIBC_NAMES.contains(&name)
+        || LIBM_NAMES.contains(&name)
+        || name
+            .strip_suffix(['f', 'l'])
+            .is_some_and(|base| LIBM_NAMES.contains(&base))
+}
+
+/// ASCII 标识符，且不与 C/C++ 关键字冲突、不占用保留的 `_` 前缀
+pub fn c_ident(name: &str) -> bool {
+    let bytes = name.as_bytes();
+    !bytes.is_empty()
+        && !bytes[0].is_ascii_digit()
+        && bytes[0] != b'_'
+        && bytes
+            .iter()
+            .all(|b| b.is_ascii_alphanumeric() || *b == b'_')
+        && !C_KEYWORDS.contains(&name)
+}
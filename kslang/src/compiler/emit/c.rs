@@ -0,0 +1,1396 @@
+use super::{
+    super::{
+        CodeSpan,
+        ast::{
+            Expr, ExprKind, ExternAttr, FpMode, IfThenExpr, Stmt, StmtKind, SwitchCase,
+            scope::{
+                NestedDefs, assigned_stmt, defs_stmt, externs_stmt, has_def, product, scope_expr,
+                scope_stmt,
+            },
+        },
+        lexer::Operator,
+        opt::{lto::Module, size_expr},
+        visit::{self, Cx, Pass},
+    },
+    EmitError, c_ident, libc_name,
+};
+use std::{
+    collections::{BTreeSet, HashMap, HashSet},
+    fmt::Write,
+    ops::Range,
+};
+
+/// 生成代码使用的名称前缀，用户函数不能占用
+pub const RESERVED_PREFIX: &str = "ks_";
+
+pub struct Options {
+    /// 翻译单元数，多个单元可以并行编译
+    pub units: usize,
+    /// 函数体节点数不超过该值时以 `static inline` 放入公共声明
+    pub inline_size: usize,
+}
+
+impl Default for Options {
+    fn default() -> Self {
+        Self {
+            units: 1,
+            inline_size: 16,
+        }
+    }
+}
+
+/// 生成的 C 源码
+///
+/// `prelude` 为各单元共用的声明，单一单元时直接置于源文件开头，否则作为头文件
+/// 由每个单元包含。全局变量与 `ks_init` 位于第一个单元。
+pub struct CSource {
+    pub prelude: String,
+    pub units: Vec<String>,
+}
+
+#[derive(Clone)]
+struct FnSig {
+    c_name: String,
+    params: usize,
+    vararg: bool,
+}
+
+#[derive(Default)]
+struct Context<'a> {
+    fns: HashMap<&'a str, FnSig>,
+    globals: HashSet<&'a str>,
+    /// 提升为文件级函数的嵌套函数计数
+    next: usize,
+    /// 当前函数中提升出的嵌套函数：原型与定义
+    hoisted: Vec<(String, String)>,
+}
+
+/// 将分析后的模块翻译为 C 源码
+///
+/// 每个 `def` 翻译为 `double ks_f_name(double, ...)`，另以原名导出转调的包装函数，
+/// 与 libc/libm 重名的除外；嵌套函数提升为文件级 `static` 函数，顶层语句按模块
+/// 顺序放入 `ks_init`。运算顺序与求值次数保持不变，`contract` 与 `fast` 函数中的
+/// `a * b + c` 显式写为 FMA。
+pub fn c_source(modules: &[Module], opts: &Options) -> Result<CSource, EmitError> {
+    let mut ctx = Context::default();
+
+    let mut defs = vec![];
+    let mut exported = String::new();
+    for module in modules {
+        let src = module.src;
+        for stmt in &module.stmts {
+            let StmtKind::Def {
+                ident, args, body, ..
+            } = &stmt.kind
+            else {
+                assigned_stmt(src, stmt, &mut ctx.globals);
+                continue;
+            };
+
+            let (name, mut sig) = export_sig(src, ident, args)?;
+            let inline =
+                !sig.vararg && size_expr(src, body) <= opts.inline_size && !has_def(src, body);
+            if inline {
+                sig.c_name = format!("{}i_{}", RESERVED_PREFIX, mangle(name));
+            } else {
+                writeln!(exported, "double {}({});", sig.c_name, param_types(&sig)).unwrap();
+            }
+            declare_export(name, &sig, &mut exported);
+            if ctx.fns.insert(name, sig).is_some() {
+                return Err(EmitError::Duplicate(ident.span));
+            }
+            defs.push((module, stmt, inline));
+        }
+    }
+
+    let mut externs = vec![];
+    for module in modules {
+        for stmt in &module.stmts {
+            externs_stmt(module.src, stmt, &mut externs);
+        }
+    }
+    let mut prototypes = String::new();
+    for (src, ident, args, attr) in externs {
+        let name = text(src, ident);
+        if ctx.fns.contains_key(name) {
+            continue;
+        }
+        let sig = extern_proto(name, ident.span, params(src, args)?, attr, &mut prototypes)?;
+        ctx.fns.insert(name, sig);
+    }
+
+    let mut globals = ctx.globals.iter().copied().collect::<Vec<_>>();
+    globals.sort_unstable();
+
+    let mut inlines = String::new();
+    let mut inline_protos = String::new();
+    let mut placed = vec![];
+    for (module, stmt, inline) in defs {
+        let StmtKind::Def {
+            ident,
+            args,
+            body,
+            fp,
+            ..
+        } = &stmt.kind
+        else {
+            unreachable!()
+        };
+        let src = module.src;
+        let sig = ctx.fns[text(src, ident)].clone();
+        let (params, _) = params(src, args)?;
+        let mode = fp.unwrap_or(module.fp);
+
+        if inline {
+            let code = function(&mut ctx, src, &params, body, mode, vec![], vec![])?;
+            let head = signature(&sig, &params, &format!("static inline {}", fast_attr(mode)));
+            writeln!(inline_protos, "{};", head).unwrap();
+            write!(inlines, "\n{}\n{}", head, code).unwrap();
+            if let Some(wrapper) = wrapper(text(src, ident), &sig, &params) {
+                placed.push(Unit::with(wrapper, vec![]));
+            }
+        } else {
+            let mut unit = def_unit(&mut ctx, src, &sig, &params, body, mode)?;
+            if let Some(wrapper) = wrapper(text(src, ident), &sig, &params) {
+                unit.code.push(wrapper);
+            }
+            placed.push(unit);
+        }
+    }
+
+    // 顶层语句与全局变量放在第一个单元
+    let mut init = String::new();
+    for global in &globals {
+        writeln!(init, "double {} = 0.0;", global_name(global)).unwrap();
+    }
+    let mut calls = String::new();
+    for (index, module) in modules.iter().enumerate() {
+        let code = toplevel(&mut ctx, module)?;
+        let attrs = fast_attr(module.fp);
+        write!(
+            init,
+            "\n{}void {}init_{}(void)\n{}",
+            attrs, RESERVED_PREFIX, index, code
+        )
+        .unwrap();
+        writeln!(calls, "    {}init_{}();", RESERVED_PREFIX, index).unwrap();
+    }
+    write!(
+        init,
+        "\nvoid {}init(void)\n{{\n{}}}\n",
+        RESERVED_PREFIX, calls
+    )
+    .unwrap();
+    let mut units = vec![Unit::default(); opts.units.max(1)];
+    units[0].push(Unit::with(init, std::mem::take(&mut ctx.hoisted)));
+
+    // 按代码量从大到小贪心分配，单元内保持定义顺序
+    let mut loads = units.iter().map(Unit::size).collect::<Vec<_>>();
+    let mut order = (0..placed.len()).collect::<Vec<_>>();
+    order.sort_by_key(|index| std::cmp::Reverse(placed[*index].size()));
+    let mut assigned = vec![0; placed.len()];
+    for index in order {
+        let unit = (0..loads.len()).min_by_key(|unit| loads[*unit]).unwrap();
+        loads[unit] += placed[index].size();
+        assigned[index] = unit;
+    }
+    for (index, part) in placed.into_iter().enumerate() {
+        units[assigned[index]].push(part);
+    }
+
+    let mut prelude = prelude(&prototypes, &globals, &exported, modules.len());
+    if !inlines.is_empty() {
+        write!(prelude, "\n{}{}", inline_protos, inlines).unwrap();
+    }
+
+    Ok(CSource {
+        prelude,
+        units: units.into_iter().map(Unit::finish).collect(),
+    })
+}
+
+/// 逐条语句生成 C 代码，供流式编译在丢弃语法树后继续输出
+///
+/// 先以 `declare` 按顺序登记所有语句，由 `prelude` 得到公共声明，再按相同顺序
+/// 以 `emit` 翻译每条语句。函数定义各自成段，可以分散到多个单元；顶层语句各自
+/// 翻译为一个 `static` 函数，与 `init_head`、`init` 一起组成 `ks_init` 所在的单元。
+/// 不做 `static inline` 展开，其余与 `c_source` 的结果相同。
+#[derive(Default)]
+pub struct StreamEmitter<'a> {
+    ctx: Context<'a>,
+    exported: String,
+    externs: Vec<(
+        &'a str,
+        CodeSpan,
+        Result<(Vec<&'a str>, bool), EmitError>,
+        Option<ExternAttr>,
+    )>,
+    /// 各模块顶层语句中的嵌套函数
+    nested: Vec<NestedDefs<'a, FnSig>>,
+    /// 各模块顶层语句函数的编号
+    stmts: Vec<Range<usize>>,
+}
+
+pub enum Fragment {
+    /// 函数定义，连同其中提升出的嵌套函数
+    Def(String),
+    /// 顶层语句，放入 `ks_init` 所在的单元
+    Init(String),
+}
+
+impl<'a> StreamEmitter<'a> {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    pub fn declare(&mut self, module: usize, src: &'a str, stmt: &Stmt) -> Result<(), EmitError> {
+        if self.nested.len() <= module {
+            self.nested.resize_with(module + 1, NestedDefs::default);
+        }
+        let mut externs = vec![];
+        externs_stmt(src, stmt, &mut externs);
+        for (src, ident, args, attr) in externs {
+            let name = text(src, ident);
+            self.externs
+                .push((name, ident.span, params(src, args), attr));
+        }
+
+        if let StmtKind::Def { ident, args, .. } = &stmt.kind {
+            let (name, sig) = export_sig(src, ident, args)?;
+            writeln!(
+                self.exported,
+                "double {}({});",
+                sig.c_name,
+                param_types(&sig)
+            )
+            .unwrap();
+            declare_export(name, &sig, &mut self.exported);
+            if self.ctx.fns.insert(name, sig).is_some() {
+                return Err(EmitError::Duplicate(ident.span));
+            }
+            return Ok(());
+        }
+
+        let mut defs = vec![];
+        scope_stmt(src, stmt, &mut self.ctx.globals, &mut defs);
+        nested_defs(&mut self.ctx, src, defs, &mut self.nested[module])
+    }
+
+    /// 所有语句登记后调用，此后才能 `emit`
+    pub fn prelude(&mut self, modules: usize) -> Result<String, EmitError> {
+        let mut prototypes = String::new();
+        for (name, span, params, attr) in std::mem::take(&mut self.externs) {
+            if self.ctx.fns.contains_key(name) {
+                continue;
+            }
+            let sig = extern_proto(name, span, params?, attr, &mut prototypes)?;
+            self.ctx.fns.insert(name, sig);
+        }
+        Ok(prelude(
+            &prototypes,
+            &self.globals(),
+            &self.exported,
+            modules,
+        ))
+    }
+
+    /// `ks_init` 所在单元的开头：全局变量与顶层嵌套函数的原型
+    pub fn init_head(&self) -> String {
+        let mut out = String::new();
+        for global in self.globals() {
+            writeln!(out, "double {} = 0.0;", global_name(global)).unwrap();
+        }
+        for sig in self.nested.iter().flat_map(NestedDefs::values) {
+            writeln!(out, "static double {}({});", sig.c_name, param_types(sig)).unwrap();
+        }
+        out
+    }
+
+    pub fn emit(
+        &mut self,
+        module: usize,
+        src: &'a str,
+        mode: FpMode,
+        stmt: &Stmt,
+    ) -> Result<Option<Fragment>, EmitError> {
+        match &stmt.kind {
+            StmtKind::Def {
+                ident,
+                args,
+                body,
+                fp,
+                ..
+            } => {
+                let sig = self.ctx.fns[text(src, ident)].clone();
+                let (params, _) = params(src, args)?;
+                let mode = fp.unwrap_or(mode);
+                let mut unit = def_unit(&mut self.ctx, src, &sig, &params, body, mode)?;
+                if let Some(wrapper) = wrapper(text(src, ident), &sig, &params) {
+                    unit.code.push(wrapper);
+                }
+                Ok(Some(Fragment::Def(unit.finish())))
+            }
+            StmtKind::Empty | StmtKind::Extern { .. } => Ok(None),
+            _ => {
+                let start = self.stmts.last().map_or(0, |stmts| stmts.end);
+                if self.stmts.len() <= module {
+                    self.stmts.resize(module + 1, start..start);
+                }
+                let index = self.stmts[module].end;
+                self.stmts[module].end += 1;
+
+                let nested = vec![self.nested[module].clone()];
+                let code = toplevel_code(&mut self.ctx, src, mode, nested, [stmt], "return 1;")?;
+                // 返回值表示是否执行了顶层 `return`
+                let code = format!(
+                    "{}static int {}s{}(void)\n{}    return 0;\n}}\n",
+                    fast_attr(mode),
+                    RESERVED_PREFIX,
+                    index,
+                    code.strip_suffix("}\n").unwrap()
+                );
+                let unit = Unit::with(code, std::mem::take(&mut self.ctx.hoisted));
+                Ok(Some(Fragment::Init(unit.finish())))
+            }
+        }
+    }
+
+    /// 依次调用顶层语句的 `ks_init_N` 与 `ks_init`，顶层 `return` 结束所在模块
+    pub fn init(&self, modules: usize) -> String {
+        let mut out = String::new();
+        for module in 0..modules {
+            writeln!(out, "\nvoid {}init_{}(void)\n{{", RESERVED_PREFIX, module).unwrap();
+            for index in self.stmts.get(module).cloned().unwrap_or_default() {
+                writeln!(out, "    if ({}s{}()) return;", RESERVED_PREFIX, index).unwrap();
+            }
+            out.push_str("}\n");
+        }
+        writeln!(out, "\nvoid {}init(void)\n{{", RESERVED_PREFIX).unwrap();
+        for module in 0..modules {
+            writeln!(out, "    {}init_{}();", RESERVED_PREFIX, module).unwrap();
+        }
+        out.push_str("}\n");
+        out
+    }
+
+    fn globals(&self) -> Vec<&'a str> {
+        let mut globals = self.ctx.globals.iter().copied().collect::<Vec<_>>();
+        globals.sort_unstable();
+        globals
+    }
+}
+
+/// 各单元共用的声明，不含 `static inline` 函数
+fn prelude(prototypes: &str, globals: &[&str], exported: &str, modules: usize) -> String {
+    let mut prelude = String::new();
+    prelude.push_str(PRELUDE);
+    prelude.push_str(prototypes);
+    for global in globals {
+        writeln!(prelude, "extern double {};", global_name(global)).unwrap();
+    }
+    prelude.push_str(exported);
+    for index in 0..modules {
+        writeln!(prelude, "void {}init_{}(void);", RESERVED_PREFIX, index).unwrap();
+    }
+    writeln!(prelude, "void {}init(void);", RESERVED_PREFIX).unwrap();
+    prelude
+}
+
+/// 校验顶层 `def` 的名称与形参，返回以 `ks_f_` 为前缀的内部签名
+///
+/// 定义不直接使用原名，以免与 C 编译器内建或 libc/libm 中的同名函数互相替换。
+fn export_sig<'a>(
+    src: &'a str,
+    ident: &Expr,
+    args: &[Expr],
+) -> Result<(&'a str, FnSig), EmitError> {
+    let name = text(src, ident);
+    if !c_ident(name) || name.starts_with(RESERVED_PREFIX) {
+        return Err(EmitError::InvalidSymbol(ident.span));
+    }
+    let (params, vararg) = params(src, args)?;
+    if vararg && params.is_empty() {
+        return Err(EmitError::VarargOnly(ident.span));
+    }
+    let sig = FnSig {
+        c_name: format!("{}f_{}", RESERVED_PREFIX, mangle(name)),
+        params: params.len(),
+        vararg,
+    };
+    Ok((name, sig))
+}
+
+/// 以原名导出的函数声明，与 libc/libm 重名的函数不导出
+fn declare_export(name: &str, sig: &FnSig, out: &mut String) {
+    if !libc_name(name) {
+        writeln!(out, "double {}({});", name, param_types(sig)).unwrap();
+    }
+}
+
+/// 以原名导出、转调内部定义的函数，多余的可变参数不会被函数体使用，直接丢弃
+fn wrapper(name: &str, sig: &FnSig, params: &[&str]) -> Option<String> {
+    if libc_name(name) {
+        return None;
+    }
+    let export = FnSig {
+        c_name: name.to_string(),
+        ..sig.clone()
+    };
+    let args = params.iter().map(|param| local(param)).collect::<Vec<_>>();
+    Some(format!(
+        "{}\n{{\n    return {}({});\n}}\n",
+        signature(&export, params, ""),
+        sig.c_name,
+        args.join(", ")
+    ))
+}
+
+/// 校验 `extern` 并写出原型
+fn extern_proto(
+    name: &str,
+    span: CodeSpan,
+    (params, vararg): (Vec<&str>, bool),
+    attr: Option<ExternAttr>,
+    prototypes: &mut String,
+) -> Result<FnSig, EmitError> {
+    if !c_ident(name) || name.starts_with(RESERVED_PREFIX) {
+        return Err(EmitError::InvalidSymbol(span));
+    }
+    if vararg && params.is_empty() {
+        return Err(EmitError::VarargOnly(span));
+    }
+    let sig = FnSig {
+        c_name: name.to_string(),
+        params: params.len(),
+        vararg,
+    };
+    // 让 C 编译器可以外提与合并循环中的调用
+    let prefix = match attr {
+        Some(ExternAttr::Pure) => "KS_PURE ",
+        Some(ExternAttr::Const) => "KS_CONST ",
+        None => "",
+    };
+    writeln!(prototypes, "{};", signature(&sig, &params, prefix)).unwrap();
+    Ok(sig)
+}
+
+/// 非内联的函数定义，连同其中提升出的嵌套函数
+fn def_unit<'a>(
+    ctx: &mut Context<'a>,
+    src: &'a str,
+    sig: &FnSig,
+    params: &[&'a str],
+    body: &Expr,
+    mode: FpMode,
+) -> Result<Unit, EmitError> {
+    let code = function(ctx, src, params, body, mode, vec![], vec![])?;
+    let code = format!(
+        "{}{}\n{}",
+        fast_attr(mode),
+        signature(sig, params, ""),
+        code
+    );
+    Ok(Unit::with(code, std::mem::take(&mut ctx.hoisted)))
+}
+
+const PRELUDE: &str = "\
+/* 由 kslangc 生成，请勿手动修改 */
+/* 严格浮点语义的函数依赖不做乘加融合，GCC 不支持标准的 FP_CONTRACT 编译指示 */
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC optimize(\"fp-contract=off\")
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define KS_FMA __builtin_fma
+#else
+double fma(double, double, double);
+#define KS_FMA fma
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define KS_PURE __attribute__((pure))
+#define KS_CONST __attribute__((const))
+#else
+#define KS_PURE
+#define KS_CONST
+#endif
+
+/* fast 函数：GCC 使用函数属性，clang 在函数体开头使用编译指示，其他编译器按严格语义 */
+#if defined(__clang__)
+#define KS_FAST
+#define KS_FAST_BODY _Pragma(\"clang fp reassociate(on) contract(fast)\")
+#elif defined(__GNUC__)
+#define KS_FAST __attribute__((optimize(\"fast-math\")))
+#define KS_FAST_BODY
+#else
+#define KS_FAST
+#define KS_FAST_BODY
+#endif
+
+";
+
+#[derive(Clone, Default)]
+struct Unit {
+    protos: Vec<String>,
+    code: Vec<String>,
+}
+
+impl Unit {
+    fn with(code: String, hoisted: Vec<(String, String)>) -> Self {
+        let mut unit = Self::default();
+        for (proto, def) in hoisted {
+            unit.protos.push(proto);
+            unit.code.push(def);
+        }
+        unit.code.push(code);
+        unit
+    }
+
+    fn push(&mut self, other: Unit) {
+        self.protos.extend(other.protos);
+        self.code.extend(other.code);
+    }
+
+    fn size(&self) -> usize {
+        self.code.iter().map(String::len).sum()
+    }
+
+    fn finish(self) -> String {
+        let mut out = String::new();
+        for proto in &self.protos {
+            writeln!(out, "{};", proto).unwrap();
+        }
+        for code in &self.code {
+            writeln!(out, "\n{}", code.trim_end()).unwrap();
+        }
+        out
+    }
+}
+
+/// 函数体的开头，`fast` 函数在其中放置 clang 的浮点编译指示
+fn open_body(mode: FpMode) -> String {
+    match mode {
+        FpMode::Fast => "{\n    KS_FAST_BODY\n".to_string(),
+        FpMode::Strict | FpMode::Contract => "{\n".to_string(),
+    }
+}
+
+fn fast_attr(mode: FpMode) -> &'static str {
+    match mode {
+        FpMode::Fast => "KS_FAST ",
+        FpMode::Strict | FpMode::Contract => "",
+    }
+}
+
+fn signature(sig: &FnSig, params: &[&str], prefix: &str) -> String {
+    let mut list = params
+        .iter()
+        .map(|param| format!("double {}", local(param)))
+        .collect::<Vec<_>>();
+    if sig.vararg {
+        list.push("...".to_string());
+    }
+    let list = if list.is_empty() {
+        "void".to_string()
+    } else {
+        list.join(", ")
+    };
+    format!("{}double {}({})", prefix, sig.c_name, list)
+}
+
+fn param_types(sig: &FnSig) -> String {
+    let mut list = vec!["double"; sig.params];
+    if sig.vararg {
+        list.push("...");
+    }
+    if list.is_empty() {
+        "void".to_string()
+    } else {
+        list.join(", ")
+    }
+}
+
+fn params<'a>(src: &'a str, args: &[Expr]) -> Result<(Vec<&'a str>, bool), EmitError> {
+    let mut params = vec![];
+    let mut vararg = false;
+    for arg in args {
+        match arg.kind {
+            ExprKind::Ident => params.push(text(src, arg)),
+            ExprKind::Ellipsis => vararg = true,
+            _ => return Err(EmitError::Unsupported(arg.span)),
+        }
+    }
+    Ok((params, vararg))
+}
+
+/// 非 ASCII 字符编码为 `_uXXXX_`，保证生成的名称是合法的 C 标识符
+///
+/// 后跟 `u` 的 `_` 同样编码，使结果中的 `_u` 总是转义的开头，不同名称不会撞名。
+fn mangle(name: &str) -> String {
+    let mut out = String::with_capacity(name.len());
+    let mut chars = name.chars().peekable();
+    while let Some(c) = chars.next() {
+        if c.is_ascii_alphanumeric() || c == '_' && chars.peek() != Some(&'u') {
+            out.push(c);
+        } else {
+            write!(out, "_u{:x}_", c as u32).unwrap();
+        }
+    }
+    out
+}
+
+fn local(name: &str) -> String {
+    format!("{}v_{}", RESERVED_PREFIX, mangle(name))
+}
+
+fn global_name(name: &str) -> String {
+    format!("{}g_{}", RESERVED_PREFIX, mangle(name))
+}
+
+fn text<'a>(src: &'a str, expr: &Expr) -> &'a str {
+    &src[expr.span.start..expr.span.end]
+}
+
+/// 精确还原的 C 浮点字面量
+fn lit(value: f64) -> String {
+    if value.is_nan() {
+        "(0.0 / 0.0)".to_string()
+    } else if value.is_infinite() {
+        let sign = if value < 0.0 { "-" } else { "" };
+        format!("({}1e300 * 1e300)", sign)
+    } else if value.is_sign_negative() {
+        format!("({:?})", value)
+    } else {
+        format!("{:?}", value)
+    }
+}
+
+fn function<'a>(
+    ctx: &mut Context<'a>,
+    src: &'a str,
+    params: &[&'a str],
+    body: &Expr,
+    mode: FpMode,
+    outer: Vec<HashSet<&'a str>>,
+    mut nested: Vec<NestedDefs<'a, FnSig>>,
+) -> Result<String, EmitError> {
+    let mut locals = params.iter().copied().collect::<HashSet<_>>();
+    let mut defs = vec![];
+    scope_expr(src, body, &mut locals, &mut defs);
+    let mut inner = NestedDefs::default();
+    nested_defs(ctx, src, defs, &mut inner)?;
+    nested.push(inner);
+
+    let mut func = Func {
+        src,
+        ctx,
+        mode,
+        locals: Some(locals),
+        outer,
+        nested,
+        body: String::new(),
+        indent: 1,
+        temps: 0,
+        loops: 0,
+        exit: "return;",
+    };
+    let value = func.expr(body)?;
+    func.line(format_args!("return {};", value));
+
+    let locals = func.locals.take().unwrap();
+    let mut out = open_body(mode);
+    let declared = locals
+        .iter()
+        .filter(|name| !params.contains(name))
+        .collect::<BTreeSet<_>>();
+    for name in declared {
+        writeln!(out, "    double {} = 0.0;", local(name)).unwrap();
+    }
+    func.declare_temps(&mut out);
+    out.push_str(&func.body);
+    out.push_str("}\n");
+    Ok(out)
+}
+
+fn toplevel<'a>(ctx: &mut Context<'a>, module: &Module<'a>) -> Result<String, EmitError> {
+    let src = module.src;
+    let stmts = module
+        .stmts
+        .iter()
+        .filter(|stmt| !matches!(stmt.kind, StmtKind::Def { .. }));
+    let mut defs = vec![];
+    for stmt in stmts.clone() {
+        defs_stmt(src, stmt, stmt.span, &mut defs);
+    }
+    let mut nested = NestedDefs::default();
+    nested_defs(ctx, src, defs, &mut nested)?;
+    let nested = vec![nested];
+    toplevel_code(ctx, src, module.fp, nested, stmts, "return;")
+}
+
+/// 顶层语句的函数体，`exit` 为顶层 `return` 生成的语句
+fn toplevel_code<'a, 's>(
+    ctx: &mut Context<'a>,
+    src: &'a str,
+    mode: FpMode,
+    nested: Vec<NestedDefs<'a, FnSig>>,
+    stmts: impl IntoIterator<Item = &'s Stmt>,
+    exit: &'static str,
+) -> Result<String, EmitError> {
+    let mut func = Func {
+        src,
+        ctx,
+        mode,
+        locals: None,
+        outer: vec![],
+        nested,
+        body: String::new(),
+        indent: 1,
+        temps: 0,
+        loops: 0,
+        exit,
+    };
+    for stmt in stmts {
+        match &stmt.kind {
+            StmtKind::Expr(expr) => func.discard(expr)?,
+            _ => func.stmt(stmt)?,
+        }
+    }
+
+    let mut out = open_body(mode);
+    func.declare_temps(&mut out);
+    out.push_str(&func.body);
+    out.push_str("}\n");
+    Ok(out)
+}
+
+/// 登记函数体内直接出现的嵌套函数，更深层的在翻译该嵌套函数时登记
+fn nested_defs<'a>(
+    ctx: &mut Context<'a>,
+    src: &'a str,
+    defs: Vec<(CodeSpan, &Stmt)>,
+    nested: &mut NestedDefs<'a, FnSig>,
+) -> Result<(), EmitError> {
+    for (block, def) in defs {
+        let StmtKind::Def { ident, args, .. } = &def.kind else {
+            unreachable!()
+        };
+        let name = text(src, ident);
+        let (params, vararg) = params(src, args)?;
+        if vararg && params.is_empty() {
+            return Err(EmitError::VarargOnly(ident.span));
+        }
+        let sig = FnSig {
+            c_name: format!("{}n{}_{}", RESERVED_PREFIX, ctx.next, mangle(name)),
+            params: params.len(),
+            vararg,
+        };
+        ctx.next += 1;
+        if !nested.insert(name, block, sig) {
+            return Err(EmitError::Duplicate(ident.span));
+        }
+    }
+    Ok(())
+}
+
+struct Func<'a, 'c> {
+    src: &'a str,
+    ctx: &'c mut Context<'a>,
+    mode: FpMode,
+    /// 局部变量，顶层代码为 `None`，此时变量均为全局变量
+    locals: Option<HashSet<&'a str>>,
+    /// 外层函数的局部变量，嵌套函数不能引用
+    outer: Vec<HashSet<&'a str>>,
+    /// 可见的嵌套函数，内层在后
+    nested: Vec<NestedDefs<'a, FnSig>>,
+    body: String,
+    indent: usize,
+    temps: usize,
+    loops: usize,
+    /// 顶层 `return` 生成的语句
+    exit: &'static str,
+}
+
+impl<'a> Func<'a, '_> {
+    fn line(&mut self, line: impl std::fmt::Display) {
+        for _ in 0..self.indent {
+            self.body.push_str("    ");
+        }
+        writeln!(self.body, "{}", line).unwrap();
+    }
+
+    /// 放入在缩进 0 处生成的代码
+    fn put(&mut self, code: &str) {
+        for line in code.lines() {
+            self.line(line);
+        }
+    }
+
+    /// 单独生成 `f` 的语句，返回语句与值
+    fn capture(
+        &mut self,
+        f: impl FnOnce(&mut Self) -> Result<String, EmitError>,
+    ) -> Result<(String, String), EmitError> {
+        let body = std::mem::take(&mut self.body);
+        let indent = std::mem::replace(&mut self.indent, 0);
+        let value = f(self);
+        let code = std::mem::replace(&mut self.body, body);
+        self.indent = indent;
+        Ok((code, value?))
+    }
+
+    /// 分支以跳转结束时不再赋值
+    fn arm(&mut self, result: &str, code: &str, value: &str) {
+        self.put(code);
+        let last = code.lines().last().unwrap_or_default().trim_start();
+        let jumps = ["break;", "continue;", "return"];
+        if !jumps.iter().any(|jump| last.starts_with(jump)) {
+            self.line(format_args!("{} = {};", result, value));
+        }
+    }
+
+    fn temp(&mut self) -> String {
+        self.temps += 1;
+        format!("{}t{}", RESERVED_PREFIX, self.temps - 1)
+    }
+
+    fn declare_temps(&self, out: &mut String) {
+        if self.temps > 0 {
+            let temps = (0..self.temps)
+                .map(|index| format!("{}t{}", RESERVED_PREFIX, index))
+                .collect::<Vec<_>>();
+            writeln!(out, "    double {};", temps.join(", ")).unwrap();
+        }
+    }
+
+    /// 保存到临时变量，使后续语句不影响已求得的值
+    fn save(&mut self, value: String) -> String {
+        let bare = value.trim_start_matches("(-").trim_end_matches(')');
+        if bare.parse::<f64>().is_ok() {
+            return value;
+        }
+        let temp = self.temp();
+        self.line(format_args!("{} = {};", temp, value));
+        temp
+    }
+
+    /// 按从左到右的顺序求值，后面的操作数有副作用时先保存前面的结果
+    fn operands(&mut self, exprs: &[&Expr]) -> Result<Vec<String>, EmitError> {
+        let mut values = Vec::with_capacity(exprs.len());
+        for (index, expr) in exprs.iter().enumerate() {
+            let value = self.expr(expr)?;
+            let later = exprs[index + 1..].iter().any(|expr| effects(expr));
+            values.push(if later { self.save(value) } else { value });
+        }
+        Ok(values)
+    }
+
+    fn var(&self, expr: &Expr) -> Result<String, EmitError> {
+        let name = text(self.src, expr);
+        match &self.locals {
+            Some(locals) if locals.contains(name) => Ok(local(name)),
+            _ if self.outer.iter().any(|locals| locals.contains(name)) => {
+                Err(EmitError::Capture(expr.span))
+            }
+            _ if self.ctx.globals.contains(name) => Ok(global_name(name)),
+            _ => Err(EmitError::Undefined(expr.span)),
+        }
+    }
+
+    fn assign_target(&self, expr: &Expr) -> String {
+        let name = text(self.src, expr);
+        match &self.locals {
+            Some(_) => local(name),
+            None => global_name(name),
+        }
+    }
+
+    fn callee(&self, name: &str, at: CodeSpan) -> Option<FnSig> {
+        self.nested
+            .iter()
+            .rev()
+            .find_map(|nested| nested.get(name, at))
+            .or_else(|| self.ctx.fns.get(name))
+            .cloned()
+    }
+
+    /// 语句块的值为最后一条表达式语句的值，否则为 0
+    fn stmts(&mut self, stmts: &[Stmt]) -> Result<String, EmitError> {
+        for (index, stmt) in stmts.iter().enumerate() {
+            match &stmt.kind {
+                StmtKind::Expr(expr) if index + 1 == stmts.len() => return self.expr(expr),
+                StmtKind::Expr(expr) => self.discard(expr)?,
+                _ => self.stmt(stmt)?,
+            }
+        }
+        Ok(lit(0.0))
+    }
+
+    /// 求值但不使用结果
+    fn discard(&mut self, expr: &Expr) -> Result<(), EmitError> {
+        match &expr.kind {
+            ExprKind::Block(stmts) => {
+                for stmt in stmts {
+                    match &stmt.kind {
+                        StmtKind::Expr(expr) => self.discard(expr)?,
+                        _ => self.stmt(stmt)?,
+                    }
+                }
+            }
+            _ => {
+                let value = self.expr(expr)?;
+                if effects(expr) {
+                    self.line(format_args!("(void)({});", value));
+                }
+            }
+        }
+        Ok(())
+    }
+
+    fn stmt(&mut self, stmt: &Stmt) -> Result<(), EmitError> {
+        match &stmt.kind {
+            StmtKind::Assign { left, right, .. } => {
+                let value = self.expr(right)?;
+                let target = self.assign_target(left);
+                self.line(format_args!("{} = {};", target, value));
+            }
+            StmtKind::Expr(expr) => self.discard(expr)?,
+            StmtKind::Return(expr) => {
+                let value = self.expr(expr)?;
+                if self.locals.is_some() {
+                    self.line(format_args!("return {};", value));
+                } else {
+                    if effects(expr) {
+                        self.line(format_args!("(void)({});", value));
+                    }
+                    self.line(self.exit);
+                }
+            }
+            StmtKind::Break | StmtKind::Continue if self.loops == 0 => {
+                return Err(EmitError::Unsupported(stmt.span));
+            }
+            StmtKind::Break => self.line("break;"),
+            StmtKind::Continue => self.line("continue;"),
+            StmtKind::Def {
+                ident,
+                args,
+                body,
+                fp,
+                ..
+            } => {
+                let name = text(self.src, ident);
+                let sig = self
+                    .nested
+                    .last()
+                    .and_then(|nested| nested.get(name, ident.span))
+                    .cloned();
+                let Some(sig) = sig else {
+                    return Err(EmitError::Unsupported(ident.span));
+                };
+                let (params, _) = params(self.src, args)?;
+                let mut outer = self.outer.clone();
+                outer.extend(self.locals.clone());
+                let mode = fp.unwrap_or(self.mode);
+                let code = function(
+                    self.ctx,
+                    self.src,
+                    &params,
+                    body,
+                    mode,
+                    outer,
+                    self.nested.clone(),
+                )?;
+                let head = signature(&sig, &params, &format!("static {}", fast_attr(mode)));
+                self.ctx
+                    .hoisted
+                    .push((head.clone(), format!("{}\n{}", head, code)));
+            }
+            StmtKind::For {
+                loop_var,
+                loop_iter,
+                loop_body,
+                ..
+            } => {
+                let values = match &loop_iter.kind {
+                    ExprKind::BinOp {
+                        op: Operator::Range,
+                        left,
+                        right,
+                        ..
+                    } => self.operands(&[left, right])?,
+                    _ => vec![lit(0.0), self.expr(loop_iter)?],
+                };
+                let end = self.temp();
+                self.line(format_args!("{} = {};", end, values[1]));
+                let var = self.assign_target(loop_var);
+                self.line(format_args!(
+                    "for ({var} = {}; {var} < {end}; {var} += 1.0) {{",
+                    values[0]
+                ));
+                self.indent += 1;
+                self.loops += 1;
+                self.discard(loop_body)?;
+                self.loops -= 1;
+                self.indent -= 1;
+                self.line("}");
+            }
+            StmtKind::Empty | StmtKind::Extern { .. } => {}
+        }
+        Ok(())
+    }
+
+    fn expr(&mut self, expr: &Expr) -> Result<String, EmitError> {
+        match &expr.kind {
+            ExprKind::Ident => self.var(expr),
+            ExprKind::Lit(value) => Ok(lit(*value)),
+            ExprKind::Ellipsis => Err(EmitError::Unsupported(expr.span)),
+            ExprKind::Parented(inner) => self.expr(inner),
+            ExprKind::Block(stmts) => self.stmts(stmts),
+            ExprKind::UnOp { op, arg, .. } => {
+                let value = self.expr(arg)?;
+                match op {
+                    Operator::Sub => Ok(format!("(-{})", value)),
+                    Operator::Not => Ok(format!("(double)({} == 0.0)", value)),
+                    _ => Err(EmitError::Unsupported(expr.span)),
+                }
+            }
+            ExprKind::Call { callee, args, .. } => {
+                let ExprKind::Ident = callee.kind else {
+                    return Err(EmitError::Unsupported(callee.span));
+                };
+                let Some(sig) = self.callee(text(self.src, callee), callee.span) else {
+                    return Err(EmitError::Undefined(callee.span));
+                };
+                let arity = if sig.vararg {
+                    args.len() >= sig.params
+                } else {
+                    args.len() == sig.params
+                };
+                if !arity {
+                    return Err(EmitError::Arity(expr.span));
+                }
+                let args = args.iter().collect::<Vec<_>>();
+                let values = self.operands(&args)?;
+                Ok(format!("{}({})", sig.c_name, values.join(", ")))
+            }
+            ExprKind::BinOp {
+                op, left, right, ..
+            } => self.binop(expr, *op, left, right),
+            ExprKind::If {
+                if_then_exprs,
+                else_branch,
+                ..
+            } => self.if_expr(
+                if_then_exprs,
+                else_branch.as_ref().map(|else_expr| &else_expr.expr),
+            ),
+            ExprKind::Switch {
+                scrutinee,
+                cases,
+                default,
+                dense,
+            } => self.switch(scrutinee, cases, default.as_deref(), *dense),
+        }
+    }
+
+    fn binop(
+        &mut self,
+        expr: &Expr,
+        op: Operator,
+        left: &Expr,
+        right: &Expr,
+    ) -> Result<String, EmitError> {
+        if let Some(value) = self.fused(op, left, right)? {
+            return Ok(value);
+        }
+
+        let symbol = match op {
+            Operator::And | Operator::Or => return self.logic(op, left, right),
+            Operator::Add => "+",
+            Operator::Sub => "-",
+            Operator::Mul => "*",
+            Operator::Div => "/",
+            Operator::Eq => "==",
+            Operator::Ne => "!=",
+            Operator::Gt => ">",
+            Operator::Ge => ">=",
+            Operator::Lt => "<",
+            Operator::Le => "<=",
+            Operator::Assign | Operator::Not | Operator::Range => {
+                return Err(EmitError::Unsupported(expr.span));
+            }
+        };
+        let values = self.operands(&[left, right])?;
+        Ok(match op {
+            Operator::Add | Operator::Sub | Operator::Mul | Operator::Div => {
+                format!("({} {} {})", values[0], symbol, values[1])
+            }
+            _ => format!("(double)({} {} {})", values[0], symbol, values[1]),
+        })
+    }
+
+    /// 与常量折叠相同的融合方式
+    fn fused(
+        &mut self,
+        op: Operator,
+        left: &Expr,
+        right: &Expr,
+    ) -> Result<Option<String>, EmitError> {
+        if self.mode == FpMode::Strict || !matches!(op, Operator::Add | Operator::Sub) {
+            return Ok(None);
+        }
+        let value = match (product(left), product(right), op) {
+            (Some((a, b)), _, _) => {
+                let v = self.operands(&[a, b, right])?;
+                match op {
+                    Operator::Add => format!("KS_FMA({}, {}, {})", v[0], v[1], v[2]),
+                    _ => format!("KS_FMA({}, {}, -{})", v[0], v[1], v[2]),
+                }
+            }
+            (None, Some((a, b)), _) => {
+                let v = self.operands(&[left, a, b])?;
+                match op {
+                    Operator::Add => format!("KS_FMA({}, {}, {})", v[1], v[2], v[0]),
+                    _ => format!("KS_FMA(-{}, {}, {})", v[1], v[2], v[0]),
+                }
+            }
+            _ => return Ok(None),
+        };
+        Ok(Some(value))
+    }
+
+    fn logic(&mut self, op: Operator, left: &Expr, right: &Expr) -> Result<String, EmitError> {
+        let left = self.expr(left)?;
+        let (code, right) = self.capture(|func| func.expr(right))?;
+        let symbol = if op == Operator::And { "&&" } else { "||" };
+        if code.is_empty() {
+            return Ok(format!(
+                "(double)({} {} {})",
+                test(&left),
+                symbol,
+                test(&right)
+            ));
+        }
+
+        // 右侧需要语句时展开为条件语句，保持短路求值
+        let temp = self.temp();
+        self.line(format_args!("{} = (double)({});", temp, test(&left)));
+        let check = if op == Operator::And { "!=" } else { "==" };
+        self.line(format_args!("if ({} {} 0.0) {{", temp, check));
+        self.indent += 1;
+        self.put(&code);
+        self.line(format_args!("{} = (double)({});", temp, test(&right)));
+        self.indent -= 1;
+        self.line("}");
+        Ok(temp)
+    }
+
+    fn if_expr(
+        &mut self,
+        if_then_exprs: &[IfThenExpr],
+        else_expr: Option<&Expr>,
+    ) -> Result<String, EmitError> {
+        let mut arms = Vec::with_capacity(if_then_exprs.len());
+        for if_then in if_then_exprs {
+            let cond = self.capture(|func| func.expr(&if_then.cond))?;
+            let then = self.capture(|func| func.expr(&if_then.then))?;
+            arms.push((cond, then));
+        }
+        let otherwise = match else_expr {
+            Some(expr) => self.capture(|func| func.expr(expr))?,
+            None => (String::new(), lit(0.0)),
+        };
+
+        // 除第一个条件外均无需语句时写为条件表达式
+        let simple = arms
+            .iter()
+            .enumerate()
+            .all(|(index, ((cond, _), (then, _)))| {
+                (index == 0 || cond.is_empty()) && then.is_empty()
+            })
+            && otherwise.0.is_empty();
+        if simple {
+            self.put(&arms[0].0.0);
+            let mut value = otherwise.1;
+            for ((_, cond), (_, then)) in arms.into_iter().rev() {
+                value = format!("({} ? {} : {})", test(&cond), then, value);
+            }
+            return Ok(value);
+        }
+
+        let result = self.temp();
+        let mut opened = 0;
+        for (index, ((cond_code, cond), (then_code, then))) in arms.into_iter().enumerate() {
+            if index == 0 {
+                self.put(&cond_code);
+                self.line(format_args!("if ({}) {{", test(&cond)));
+            } else if cond_code.is_empty() {
+                self.line(format_args!("}} else if ({}) {{", test(&cond)));
+            } else {
+                self.line("} else {");
+                self.indent += 1;
+                opened += 1;
+                self.put(&cond_code);
+                self.line(format_args!("if ({}) {{", test(&cond)));
+            }
+            self.indent += 1;
+            self.arm(&result, &then_code, &then);
+            self.indent -= 1;
+        }
+        self.line("} else {");
+        self.indent += 1;
+        self.arm(&result, &otherwise.0, &otherwise.1);
+        self.indent -= 1;
+        self.line("}");
+        for _ in 0..opened {
+            self.indent -= 1;
+            self.line("}");
+        }
+        Ok(result)
+    }
+
+    fn switch(
+        &mut self,
+        scrutinee: &Expr,
+        cases: &[SwitchCase],
+        default: Option<&Expr>,
+        dense: bool,
+    ) -> Result<String, EmitError> {
+        let value = self.expr(scrutinee)?;
+        let key = self.temp();
+        self.line(format_args!("{} = {};", key, value));
+        let result = self.temp();
+
+        let mut arms = Vec::with_capacity(cases.len());
+        for case in cases {
+            arms.push((case.value, self.capture(|func| func.expr(&case.expr))?));
+        }
+        let otherwise = match default {
+            Some(expr) => self.capture(|func| func.expr(expr))?,
+            None => (String::new(), lit(0.0)),
+        };
+
+        // `break` 在 C 的 `switch` 中含义不同，此时改用条件语句
+        const LIMIT: f64 = 2147483648.0;
+        let (lo, hi) = match (cases.first(), cases.last()) {
+            (Some(first), Some(last)) => (first.value, last.value),
+            _ => (0.0, 0.0),
+        };
+        let table = dense
+            && lo > -LIMIT
+            && hi < LIMIT
+            && !cases.iter().any(|case| breaks_expr(self.src, &case.expr))
+            && !default.is_some_and(|expr| breaks_expr(self.src, expr));
+
+        if table {
+            self.line(format_args!(
+                "switch (({key} >= {lo:?} && {key} <= {hi:?} && {key} == (double)(long long){key}) ? (long long){key} : {}LL) {{",
+                lo as i64 - 1
+            ));
+            for (value, (code, then)) in arms {
+                self.line(format_args!("case {}: {{", value as i64));
+                self.indent += 1;
+                self.arm(&result, &code, &then);
+                self.line("break;");
+                self.indent -= 1;
+                self.line("}");
+            }
+            self.line("default: {");
+        } else {
+            for (index, (value, (code, then))) in arms.into_iter().enumerate() {
+                let keyword = if index == 0 { "if" } else { "} else if" };
+                self.line(format_args!("{} ({} == {}) {{", keyword, key, lit(value)));
+                self.indent += 1;
+                self.arm(&result, &code, &then);
+                self.indent -= 1;
+            }
+            self.line(if cases.is_empty() { "{" } else { "} else {" });
+        }
+        self.indent += 1;
+        self.arm(&result, &otherwise.0, &otherwise.1);
+        if table {
+            self.line("break;");
+        }
+        self.indent -= 1;
+        self.line("}");
+        if table {
+            self.line("}");
+        }
+        Ok(result)
+    }
+}
+
+/// 作为条件的值，比较运算的结果直接使用
+fn test(value: &str) -> String {
+    if let Some(inner) = value.strip_prefix("(double)(") {
+        let mut depth = 1;
+        for (index, c) in inner.char_indices() {
+            match c {
+                '(' => depth += 1,
+                ')' => depth -= 1,
+                _ => {}
+            }
+            if depth == 0 {
+                if index + 1 == inner.len() {
+                    return inner[..index].to_string();
+                }
+                break;
+            }
+        }
+    }
+    format!("{} != 0.0", value)
+}
+
+/// 可能调用函数或修改变量
+fn effects(expr: &Expr) -> bool {
+    match &expr.kind {
+        ExprKind::Ident | ExprKind::Ellipsis | ExprKind::Lit(_) => false,
+        ExprKind::Block(_) | ExprKind::Call { .. } => true,
+        ExprKind::Parented(inner) | ExprKind::UnOp { arg: inner, .. } => effects(inner),
+        ExprKind::BinOp { left, right, .. } => effects(left) || effects(right),
+        ExprKind::If {
+            if_then_exprs,
+            else_branch,
+            ..
+        } => {
+            if_then_exprs
+                .iter()
+                .any(|if_then| effects(&if_then.cond) || effects(&if_then.then))
+                || else_branch
+                    .as_ref()
+                    .is_some_and(|else_expr| effects(&else_expr.expr))
+        }
+        ExprKind::Switch {
+            scrutinee,
+            cases,
+            default,
+            ..
+        } => {
+            effects(scrutinee)
+                || cases.iter().any(|case| effects(&case.expr))
+                || default.as_deref().is_some_and(effects)
+        }
+    }
+}
+
+/// 不在内层循环中的 `break`
+fn breaks_expr(src: &str, expr: &Expr) -> bool {
+    let Ok(((Breaks(breaks),), _)) = visit::run_expr(src, expr, (Breaks(false),)) else {
+        unreachable!()
+    };
+    breaks
+}
+
+struct Breaks(bool);
+
+impl<'e> Pass<'e> for Breaks {
+    const NAME: &'static str = "breaks";
+
+    fn enter_stmt(&mut self, cx: &mut Cx<'e>, stmt: &'e Stmt) {
+        if let StmtKind::Break = stmt.kind {
+            self.0 |= cx.loops == 0 && cx.defs.is_empty();
+        }
+    }
+}
@@ -0,0 +1,35 @@
+use super::Export;
+use std::fmt::Write;
+
+/// 生成声明导出函数的 C/C++ 头文件
+///
+/// 与 `include/ksc/_libkslang_autogen.h` 相同，在 C++ 中以 `extern "C"` 声明。
+pub fn header(exports: &[Export]) -> String {
+    let mut out = String::new();
+    out.push_str("/* 由 kslangc 生成，请勿手动修改 */\n");
+    out.push_str("#pragma once\n\n");
+    out.push_str("#ifdef __cplusplus\nextern \"C\" {\n#endif\n\n");
+
+    for export in exports {
+        let mut params = export
+            .params
+            .iter()
+            .map(|param| match param {
+                Some(name) => format!("double {}", name),
+                None => "double".to_string(),
+            })
+            .collect::<Vec<_>>();
+        if export.vararg {
+            params.push("...".to_string());
+        }
+        let params = if params.is_empty() {
+            "void".to_string()
+        } else {
+            params.join(", ")
+        };
+        writeln!(out, "double {}({});", export.name, params).unwrap();
+    }
+
+    out.push_str("\n#ifdef __cplusplus\n} // extern \"C\"\n#endif\n");
+    out
+}
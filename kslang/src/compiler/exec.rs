@@ -0,0 +1,1089 @@
+//! 把语法树编译为嵌套闭包后执行
+//!
+//! 不生成机器码。编译时解析名称、栈槽与调用目标，执行时不再查表，开销低于逐节点解释语法树，
+//! 但仍是一次闭包调用对应一个节点。
+
+pub mod arrow;
+
+use super::{
+    CodeSpan,
+    ast::{
+        Expr, ExprKind, ExternAttr, FpMode, IfThenExpr, Stmt, StmtKind, SwitchCase,
+        scope::{NestedDefs, assigned_stmt, defs_stmt, externs_stmt, product, scope_expr},
+    },
+    lexer::Operator,
+    opt::{fold::truthy, lto::Module, size_stmt},
+};
+use std::{
+    cmp::Ordering,
+    collections::{HashMap, HashSet},
+    time::{Duration, Instant},
+};
+
+/// 调用层数上限，超出时中止执行而不是耗尽线程栈
+///
+/// 每层调用占用的线程栈与表达式嵌套深度有关，深递归的程序应在栈足够大的线程上执行。
+pub const MAX_DEPTH: usize = 100_000;
+
+/// 设定了时限时，每经过这么多次调用或循环迭代读一次时钟
+const TICKS: u32 = 1 << 12;
+
+/// 宿主提供的 `extern` 函数，参数为全部实参
+pub type Extern = fn(&[f64]) -> f64;
+
+#[derive(Debug)]
+pub enum CompileError {
+    /// 读取未赋值的变量或调用未定义的函数
+    Undefined(CodeSpan),
+    /// 嵌套函数引用外层函数的局部变量
+    Capture(CodeSpan),
+    /// 循环外的 `break`/`continue` 等无法执行的构造
+    Unsupported(CodeSpan),
+    /// 调用的实参个数与定义不符
+    Arity(CodeSpan),
+    /// 同名函数重复定义
+    Duplicate(CodeSpan),
+    /// `extern` 声明的函数没有宿主实现
+    Unbound(CodeSpan),
+}
+
+impl std::fmt::Display for CompileError {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        match self {
+            Self::Undefined(span) => write!(f, "{}: 未定义的名称", span),
+            Self::Capture(span) => write!(f, "{}: 嵌套函数不能引用外层函数的局部变量", span),
+            Self::Unsupported(span) => write!(f, "{}: 无法执行的语句", span),
+            Self::Arity(span) => write!(f, "{}: 实参个数与定义不符", span),
+            Self::Duplicate(span) => write!(f, "{}: 函数重复定义", span),
+            Self::Unbound(span) => write!(f, "{}: 外部函数没有实现", span),
+        }
+    }
+}
+
+impl std::error::Error for CompileError {}
+
+/// 运行期中止
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Trap {
+    StackOverflow,
+    /// 超过 `Machine::set_deadline` 设定的时间
+    Timeout,
+}
+
+impl std::fmt::Display for Trap {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        match self {
+            Self::StackOverflow => write!(f, "调用层数超过 {}", MAX_DEPTH),
+            Self::Timeout => write!(f, "执行超时"),
+        }
+    }
+}
+
+impl std::error::Error for Trap {}
+
+/// 非顺序的控制流，沿闭包调用链向外传递
+enum Flow {
+    Break,
+    Continue,
+    Return(f64),
+    Trap(Trap),
+}
+
+/// 编译好的节点，常量、栈槽位置与调用目标在编译时捕获
+type Code = Box<dyn Fn(&mut Machine<'_>, usize) -> Result<f64, Flow> + Send + Sync>;
+
+struct Function {
+    params: usize,
+    /// 形参与局部变量的栈槽数
+    slots: usize,
+    body: Code,
+}
+
+#[derive(Debug, Default, Clone, Copy)]
+pub struct Stats {
+    /// 编译的函数数，含嵌套函数与各模块的顶层代码
+    pub functions: usize,
+    /// 编译的语法树节点数，近似为生成的闭包数
+    pub nodes: usize,
+    pub elapsed: Duration,
+}
+
+/// 编译完成的程序，可由多个 [`Machine`] 在不同线程上分别执行
+pub struct Program {
+    fns: Vec<Function>,
+    /// 各模块的顶层代码
+    init: Vec<Function>,
+    exports: HashMap<String, usize>,
+    globals: HashMap<String, usize>,
+    externs: Vec<Extern>,
+    /// 标注了 `pure`/`const` 的 `extern` 调用点数，每个调用点缓存最近一次的结果
+    sites: usize,
+    stats: Stats,
+}
+
+impl Program {
+    /// 逐节点生成闭包并捕获操作数，不做额外的分析与优化
+    ///
+    /// 输入应已经过 `opt::optimize`。`extern` 声明的函数在 `externs` 中查找，
+    /// 同名的 `def` 优先。
+    pub fn compile(
+        modules: &[Module],
+        externs: &HashMap<&str, Extern>,
+    ) -> Result<Self, CompileError> {
+        let start = Instant::now();
+        let mut compiler = Compiler {
+            fns: vec![],
+            sigs: HashMap::new(),
+            globals: HashMap::new(),
+            externs: vec![],
+            sites: 0,
+        };
+
+        let mut defs = vec![];
+        let mut names = HashSet::new();
+        for module in modules {
+            for stmt in &module.stmts {
+                match &stmt.kind {
+                    StmtKind::Def { .. } => defs.push((module, stmt)),
+                    _ => assigned_stmt(module.src, stmt, &mut names),
+                }
+            }
+        }
+        let mut names = names.into_iter().collect::<Vec<_>>();
+        names.sort_unstable();
+        for name in names {
+            let index = compiler.globals.len();
+            compiler.globals.insert(name, index);
+        }
+
+        let mut exports = HashMap::new();
+        for (module, stmt) in &defs {
+            let StmtKind::Def { ident, args, .. } = &stmt.kind else {
+                unreachable!()
+            };
+            let name = text(module.src, ident);
+            let sig = compiler.declare(module.src, args)?;
+            if compiler.sigs.insert(name, sig).is_some() {
+                return Err(CompileError::Duplicate(ident.span));
+            }
+            if let Target::Fn(index) = sig.target {
+                exports.insert(name.to_string(), index);
+            }
+        }
+
+        for module in modules {
+            let mut decls = vec![];
+            for stmt in &module.stmts {
+                externs_stmt(module.src, stmt, &mut decls);
+            }
+            for (src, ident, args, attr) in decls {
+                let name = text(src, ident);
+                if compiler.sigs.contains_key(name) {
+                    continue;
+                }
+                let Some(f) = externs.get(name) else {
+                    return Err(CompileError::Unbound(ident.span));
+                };
+                let (params, vararg) = params(src, args)?;
+                compiler.sigs.insert(
+                    name,
+                    Sig {
+                        target: Target::Extern(compiler.externs.len(), attr),
+                        params: params.len(),
+                        vararg,
+                    },
+                );
+                compiler.externs.push(*f);
+            }
+        }
+
+        for (module, stmt) in defs {
+            let StmtKind::Def {
+                ident,
+                args,
+                body,
+                fp,
+                ..
+            } = &stmt.kind
+            else {
+                unreachable!()
+            };
+            let Target::Fn(index) = compiler.sigs[text(module.src, ident)].target else {
+                unreachable!()
+            };
+            let (params, _) = params(module.src, args)?;
+            let mode = fp.unwrap_or(module.fp);
+            compiler.function(module.src, index, &params, body, mode, vec![], vec![])?;
+        }
+
+        let mut init = Vec::with_capacity(modules.len());
+        for module in modules {
+            init.push(compiler.toplevel(module)?);
+        }
+
+        let nodes = modules
+            .iter()
+            .flat_map(|module| module.stmts.iter().map(|stmt| size_stmt(module.src, stmt)))
+            .sum();
+        let stats = Stats {
+            functions: compiler.fns.len() + init.len(),
+            nodes,
+            elapsed: start.elapsed(),
+        };
+        Ok(Self {
+            fns: compiler.fns,
+            init,
+            exports,
+            globals: compiler
+                .globals
+                .into_iter()
+                .map(|(name, index)| (name.to_string(), index))
+                .collect(),
+            externs: compiler.externs,
+            sites: compiler.sites,
+            stats,
+        })
+    }
+
+    pub fn stats(&self) -> Stats {
+        self.stats
+    }
+
+    /// 按名称查找顶层函数，逐行调用同一函数时只需查找一次
+    pub fn entry(&self, name: &str) -> Option<Entry> {
+        let index = *self.exports.get(name)?;
+        Some(Entry {
+            index,
+            params: self.fns[index].params,
+        })
+    }
+}
+
+/// 顶层函数的调用入口，只对取得它的 [`Program`] 有效
+#[derive(Debug, Clone, Copy)]
+pub struct Entry {
+    index: usize,
+    pub params: usize,
+}
+
+/// 执行状态：全局变量与调用栈
+pub struct Machine<'p> {
+    program: &'p Program,
+    globals: Vec<f64>,
+    stack: Vec<f64>,
+    depth: usize,
+    /// 各调用点最近一次的纪元、实参与结果
+    memo: Vec<Option<(u64, Box<[f64]>, f64)>>,
+    /// 每次调用未标注的 `extern` 以及每次从宿主进入执行时加一，`pure` 的缓存只在同一纪元内
+    /// 有效；两次进入之间宿主可能改变了 `pure` 函数读取的状态
+    epoch: u64,
+    deadline: Option<Instant>,
+    ticks: u32,
+}
+
+impl<'p> Machine<'p> {
+    pub fn new(program: &'p Program) -> Self {
+        Self {
+            program,
+            globals: vec![0.0; program.globals.len()],
+            stack: Vec::new(),
+            depth: 0,
+            memo: vec![None; program.sites],
+            epoch: 0,
+            deadline: None,
+            ticks: 0,
+        }
+    }
+
+    /// 以 `globals` 为全局变量的初值，通常取自另一个已执行顶层代码的 [`Machine::globals`]，
+    /// 之后不必再 `run`
+    pub fn with_globals(program: &'p Program, globals: &[f64]) -> Self {
+        assert_eq!(
+            globals.len(),
+            program.globals.len(),
+            "全局变量个数与程序不符"
+        );
+        Self {
+            globals: globals.to_vec(),
+            ..Self::new(program)
+        }
+    }
+
+    /// 按编号排列的全部全局变量
+    pub fn globals(&self) -> &[f64] {
+        &self.globals
+    }
+
+    /// 之后的执行在 `deadline` 后以 `Trap::Timeout` 中止，`None` 为不限时
+    pub fn set_deadline(&mut self, deadline: Option<Instant>) {
+        self.deadline = deadline;
+    }
+
+    fn tick(&mut self) -> Result<(), Flow> {
+        let Some(deadline) = self.deadline else {
+            return Ok(());
+        };
+        self.ticks = self.ticks.wrapping_add(1);
+        if self.ticks % TICKS == 0 && Instant::now() >= deadline {
+            return Err(Flow::Trap(Trap::Timeout));
+        }
+        Ok(())
+    }
+
+    /// 按模块顺序执行顶层代码
+    pub fn run(&mut self) -> Result<(), Trap> {
+        let program = self.program;
+        self.epoch += 1;
+        for init in &program.init {
+            self.stack.resize(init.slots, 0.0);
+            let result = (init.body)(self, 0);
+            self.stack.clear();
+            match result {
+                Ok(_) | Err(Flow::Return(_)) => {}
+                Err(Flow::Trap(trap)) => return Err(trap),
+                Err(Flow::Break | Flow::Continue) => unreachable!(),
+            }
+        }
+        Ok(())
+    }
+
+    /// 调用顶层函数，函数不存在或实参个数不符时返回 `None`
+    pub fn call(&mut self, name: &str, args: &[f64]) -> Option<Result<f64, Trap>> {
+        let entry = self.program.entry(name)?;
+        if args.len() != entry.params {
+            return None;
+        }
+        Some(self.call_entry(entry, args))
+    }
+
+    /// `args` 的个数须与 `entry.params` 相同
+    pub fn call_entry(&mut self, entry: Entry, args: &[f64]) -> Result<f64, Trap> {
+        assert_eq!(args.len(), entry.params, "实参个数与定义不符");
+        self.epoch += 1;
+        let frame = self.stack.len();
+        self.stack.extend_from_slice(args);
+        match self.invoke(entry.index, frame) {
+            Ok(value) => Ok(value),
+            Err(Flow::Trap(trap)) => Err(trap),
+            Err(_) => unreachable!(),
+        }
+    }
+
+    pub fn global(&self, name: &str) -> Option<f64> {
+        self.program
+            .globals
+            .get(name)
+            .map(|index| self.globals[*index])
+    }
+
+    /// 实参已压入 `frame` 起的栈槽，多余的可变参数被丢弃
+    fn invoke(&mut self, index: usize, frame: usize) -> Result<f64, Flow> {
+        let program = self.program;
+        let function = &program.fns[index];
+        if self.depth >= MAX_DEPTH {
+            self.stack.truncate(frame);
+            return Err(Flow::Trap(Trap::StackOverflow));
+        }
+        if let Err(flow) = self.tick() {
+            self.stack.truncate(frame);
+            return Err(flow);
+        }
+        self.stack.truncate(frame + function.params);
+        self.stack.resize(frame + function.slots, 0.0);
+        self.depth += 1;
+        let result = (function.body)(self, frame);
+        self.depth -= 1;
+        self.stack.truncate(frame);
+        match result {
+            Ok(value) | Err(Flow::Return(value)) => Ok(value),
+            Err(flow) => Err(flow),
+        }
+    }
+}
+
+#[derive(Clone, Copy)]
+enum Target {
+    Fn(usize),
+    Extern(usize, Option<ExternAttr>),
+}
+
+#[derive(Clone, Copy)]
+struct Sig {
+    target: Target,
+    params: usize,
+    vararg: bool,
+}
+
+#[derive(Clone, Copy)]
+enum Place {
+    Local(usize),
+    Global(usize),
+}
+
+/// 叶子操作数直接由父节点的闭包捕获，不再经过一次闭包调用
+enum Operand {
+    Lit(f64),
+    Local(usize),
+    Code(Code),
+}
+
+struct Compiler<'a> {
+    fns: Vec<Function>,
+    sigs: HashMap<&'a str, Sig>,
+    globals: HashMap<&'a str, usize>,
+    externs: Vec<Extern>,
+    sites: usize,
+}
+
+impl<'a> Compiler<'a> {
+    /// 预留函数表项，函数体稍后填入，以便递归与前向调用
+    fn declare(&mut self, src: &str, args: &[Expr]) -> Result<Sig, CompileError> {
+        let (params, vararg) = params(src, args)?;
+        self.fns.push(Function {
+            params: params.len(),
+            slots: params.len(),
+            body: Box::new(|_, _| Ok(0.0)),
+        });
+        Ok(Sig {
+            target: Target::Fn(self.fns.len() - 1),
+            params: params.len(),
+            vararg,
+        })
+    }
+
+    fn function(
+        &mut self,
+        src: &'a str,
+        index: usize,
+        params: &[&'a str],
+        body: &Expr,
+        mode: FpMode,
+        outer: Vec<HashSet<&'a str>>,
+        mut nested: Vec<NestedDefs<'a, Sig>>,
+    ) -> Result<(), CompileError> {
+        let mut names = HashSet::new();
+        let mut defs = vec![];
+        scope_expr(src, body, &mut names, &mut defs);
+        let mut others = names
+            .into_iter()
+            .filter(|name| !params.contains(name))
+            .collect::<Vec<_>>();
+        others.sort_unstable();
+        let mut locals = HashMap::new();
+        for name in params.iter().copied().chain(others) {
+            let slot = locals.len();
+            locals.entry(name).or_insert(slot);
+        }
+
+        nested.push(self.nested(src, defs)?);
+
+        let slots = locals.len();
+        let mut scope = Scope {
+            src,
+            compiler: self,
+            mode,
+            locals: Some(locals),
+            outer,
+            nested,
+            loops: 0,
+        };
+        let body = scope.code(body)?;
+        self.fns[index].slots = slots;
+        self.fns[index].body = body;
+        Ok(())
+    }
+
+    fn toplevel(&mut self, module: &Module<'a>) -> Result<Function, CompileError> {
+        let src = module.src;
+        let stmts = module
+            .stmts
+            .iter()
+            .filter(|stmt| !matches!(stmt.kind, StmtKind::Def { .. }))
+            .collect::<Vec<_>>();
+        let mut defs = vec![];
+        for stmt in &stmts {
+            defs_stmt(src, stmt, stmt.span, &mut defs);
+        }
+        let nested = vec![self.nested(src, defs)?];
+
+        let mut scope = Scope {
+            src,
+            compiler: self,
+            mode: module.fp,
+            locals: None,
+            outer: vec![],
+            nested,
+            loops: 0,
+        };
+        let body = scope.stmts(stmts)?;
+        Ok(Function {
+            params: 0,
+            slots: 0,
+            body,
+        })
+    }
+
+    /// 登记函数体内直接出现的嵌套函数，更深层的在编译该嵌套函数时登记
+    fn nested(
+        &mut self,
+        src: &'a str,
+        defs: Vec<(CodeSpan, &Stmt)>,
+    ) -> Result<NestedDefs<'a, Sig>, CompileError> {
+        let mut nested = NestedDefs::default();
+        for (block, def) in defs {
+            let StmtKind::Def { ident, args, .. } = &def.kind else {
+                unreachable!()
+            };
+            let sig = self.declare(src, args)?;
+            if !nested.insert(text(src, ident), block, sig) {
+                return Err(CompileError::Duplicate(ident.span));
+            }
+        }
+        Ok(nested)
+    }
+}
+
+struct Scope<'a, 'c> {
+    src: &'a str,
+    compiler: &'c mut Compiler<'a>,
+    mode: FpMode,
+    /// 局部变量的栈槽，顶层代码为 `None`，此时变量均为全局变量
+    locals: Option<HashMap<&'a str, usize>>,
+    /// 外层函数的局部变量，嵌套函数不能引用
+    outer: Vec<HashSet<&'a str>>,
+    /// 可见的嵌套函数，内层在后
+    nested: Vec<NestedDefs<'a, Sig>>,
+    loops: usize,
+}
+
+impl<'a> Scope<'a, '_> {
+    fn code(&mut self, expr: &Expr) -> Result<Code, CompileError> {
+        Ok(boxed(self.operand(expr)?))
+    }
+
+    fn operand(&mut self, expr: &Expr) -> Result<Operand, CompileError> {
+        Ok(match &expr.kind {
+            ExprKind::Ident => self.read(expr)?,
+            ExprKind::Lit(value) => Operand::Lit(*value),
+            ExprKind::Ellipsis => return Err(CompileError::Unsupported(expr.span)),
+            ExprKind::Parented(inner) => self.operand(inner)?,
+            ExprKind::Block(stmts) => Operand::Code(self.stmts(stmts)?),
+            ExprKind::UnOp { op, arg, .. } => {
+                let arg = self.code(arg)?;
+                Operand::Code(match op {
+                    Operator::Sub => Box::new(move |m, base| Ok(-arg(m, base)?)),
+                    Operator::Not => {
+                        Box::new(move |m, base| Ok(bool_value(!truthy(arg(m, base)?))))
+                    }
+                    _ => return Err(CompileError::Unsupported(expr.span)),
+                })
+            }
+            ExprKind::Call { callee, args, .. } => self.call(expr, callee, args)?,
+            ExprKind::BinOp {
+                op, left, right, ..
+            } => self.binop(expr, *op, left, right)?,
+            ExprKind::If {
+                if_then_exprs,
+                else_branch,
+                ..
+            } => self.if_expr(
+                if_then_exprs,
+                else_branch.as_ref().map(|else_expr| &else_expr.expr),
+            )?,
+            ExprKind::Switch {
+                scrutinee,
+                cases,
+                default,
+                dense,
+            } => self.switch(scrutinee, cases, default.as_deref(), *dense)?,
+        })
+    }
+
+    fn read(&self, expr: &Expr) -> Result<Operand, CompileError> {
+        let name = text(self.src, expr);
+        if let Some(slot) = self.locals.as_ref().and_then(|locals| locals.get(name)) {
+            return Ok(Operand::Local(*slot));
+        }
+        if self.outer.iter().any(|locals| locals.contains(name)) {
+            return Err(CompileError::Capture(expr.span));
+        }
+        match self.compiler.globals.get(name) {
+            Some(&index) => Ok(Operand::Code(Box::new(move |m, _| Ok(m.globals[index])))),
+            None => Err(CompileError::Undefined(expr.span)),
+        }
+    }
+
+    /// 赋值与循环变量必然已登记为局部变量或全局变量
+    fn place(&self, expr: &Expr) -> Place {
+        let name = text(self.src, expr);
+        match &self.locals {
+            Some(locals) => Place::Local(locals[name]),
+            None => Place::Global(self.compiler.globals[name]),
+        }
+    }
+
+    /// 语句块的值为最后一条表达式语句的值，否则为 0
+    fn stmts<'s>(
+        &mut self,
+        stmts: impl IntoIterator<Item = &'s Stmt>,
+    ) -> Result<Code, CompileError> {
+        let mut codes = vec![];
+        let mut value = false;
+        for stmt in stmts {
+            value = matches!(stmt.kind, StmtKind::Expr(_));
+            codes.extend(self.stmt(stmt)?);
+        }
+
+        Ok(match (codes.len(), value) {
+            (0, _) => Box::new(|_, _| Ok(0.0)),
+            (1, true) => codes.pop().unwrap(),
+            (_, true) => {
+                let last = codes.pop().unwrap();
+                Box::new(move |m, base| {
+                    for code in &codes {
+                        code(m, base)?;
+                    }
+                    last(m, base)
+                })
+            }
+            (_, false) => Box::new(move |m, base| {
+                for code in &codes {
+                    code(m, base)?;
+                }
+                Ok(0.0)
+            }),
+        })
+    }
+
+    /// 不产生运行期操作的语句返回 `None`
+    fn stmt(&mut self, stmt: &Stmt) -> Result<Option<Code>, CompileError> {
+        Ok(Some(match &stmt.kind {
+            StmtKind::Assign { left, right, .. } => {
+                let value = self.code(right)?;
+                match self.place(left) {
+                    Place::Local(slot) => Box::new(move |m, base| {
+                        m.stack[base + slot] = value(m, base)?;
+                        Ok(0.0)
+                    }),
+                    Place::Global(index) => Box::new(move |m, base| {
+                        m.globals[index] = value(m, base)?;
+                        Ok(0.0)
+                    }),
+                }
+            }
+            StmtKind::Expr(expr) => self.code(expr)?,
+            StmtKind::Return(expr) => {
+                let value = self.code(expr)?;
+                Box::new(move |m, base| Err(Flow::Return(value(m, base)?)))
+            }
+            StmtKind::Break | StmtKind::Continue if self.loops == 0 => {
+                return Err(CompileError::Unsupported(stmt.span));
+            }
+            StmtKind::Break => Box::new(|_, _| Err(Flow::Break)),
+            StmtKind::Continue => Box::new(|_, _| Err(Flow::Continue)),
+            StmtKind::Def {
+                ident,
+                args,
+                body,
+                fp,
+                ..
+            } => {
+                let name = text(self.src, ident);
+                let Some(Target::Fn(index)) = self
+                    .nested
+                    .last()
+                    .and_then(|nested| nested.get(name, ident.span))
+                    .map(|sig| sig.target)
+                else {
+                    return Err(CompileError::Unsupported(ident.span));
+                };
+                let (params, _) = params(self.src, args)?;
+                let mut outer = self.outer.clone();
+                outer.extend(
+                    self.locals
+                        .as_ref()
+                        .map(|locals| locals.keys().copied().collect()),
+                );
+                let mode = fp.unwrap_or(self.mode);
+                let nested = self.nested.clone();
+                self.compiler
+                    .function(self.src, index, &params, body, mode, outer, nested)?;
+                return Ok(None);
+            }
+            StmtKind::For {
+                loop_var,
+                loop_iter,
+                loop_body,
+                ..
+            } => {
+                let (start, end) = match &loop_iter.kind {
+                    ExprKind::BinOp {
+                        op: Operator::Range,
+                        left,
+                        right,
+                        ..
+                    } => (self.code(left)?, self.code(right)?),
+                    _ => (boxed(Operand::Lit(0.0)), self.code(loop_iter)?),
+                };
+                self.loops += 1;
+                let body = self.code(loop_body)?;
+                self.loops -= 1;
+                let var = self.place(loop_var);
+                Box::new(move |m, base| {
+                    let start = start(m, base)?;
+                    let end = end(m, base)?;
+                    let mut i = start;
+                    loop {
+                        var.store(m, base, i);
+                        if !(i < end) {
+                            break;
+                        }
+                        m.tick()?;
+                        match body(m, base) {
+                            Ok(_) | Err(Flow::Continue) => {}
+                            Err(Flow::Break) => break,
+                            Err(flow) => return Err(flow),
+                        }
+                        i = var.load(m, base) + 1.0;
+                    }
+                    Ok(0.0)
+                })
+            }
+            StmtKind::Empty | StmtKind::Extern { .. } => return Ok(None),
+        }))
+    }
+
+    fn call(&mut self, expr: &Expr, callee: &Expr, args: &[Expr]) -> Result<Operand, CompileError> {
+        let ExprKind::Ident = callee.kind else {
+            return Err(CompileError::Unsupported(callee.span));
+        };
+        let name = text(self.src, callee);
+        let Some(sig) = self
+            .nested
+            .iter()
+            .rev()
+            .find_map(|nested| nested.get(name, callee.span))
+            .or_else(|| self.compiler.sigs.get(name))
+            .copied()
+        else {
+            return Err(CompileError::Undefined(callee.span));
+        };
+        let arity = if sig.vararg {
+            args.len() >= sig.params
+        } else {
+            args.len() == sig.params
+        };
+        if !arity {
+            return Err(CompileError::Arity(expr.span));
+        }
+
+        let mut codes = Vec::with_capacity(args.len());
+        for arg in args {
+            codes.push(self.code(arg)?);
+        }
+        Ok(Operand::Code(match (sig.target, codes.len()) {
+            // 单个实参求值完毕后栈顶即为新栈帧
+            (Target::Fn(index), 1) => {
+                let arg = codes.pop().unwrap();
+                Box::new(move |m, base| {
+                    let value = arg(m, base)?;
+                    let frame = m.stack.len();
+                    m.stack.push(value);
+                    m.invoke(index, frame)
+                })
+            }
+            (Target::Fn(index), _) => Box::new(move |m, base| {
+                let frame = push_args(m, base, &codes)?;
+                m.invoke(index, frame)
+            }),
+            (Target::Extern(index, None), _) => Box::new(move |m, base| {
+                let frame = push_args(m, base, &codes)?;
+                m.epoch += 1;
+                let value = (m.program.externs[index])(&m.stack[frame..]);
+                m.stack.truncate(frame);
+                Ok(value)
+            }),
+            // 实参按位相同时复用上次的结果，循环中实参不变的调用只执行一次
+            (Target::Extern(index, Some(attr)), _) => {
+                let site = self.compiler.sites;
+                self.compiler.sites += 1;
+                Box::new(move |m, base| {
+                    let frame = push_args(m, base, &codes)?;
+                    let epoch = match attr {
+                        ExternAttr::Const => 0,
+                        ExternAttr::Pure => m.epoch,
+                    };
+                    let args = &m.stack[frame..];
+                    let value = match &mut m.memo[site] {
+                        Some((at, cached, value))
+                            if *at == epoch
+                                && cached.len() == args.len()
+                                && cached
+                                    .iter()
+                                    .zip(args)
+                                    .all(|(a, b)| a.to_bits() == b.to_bits()) =>
+                        {
+                            *value
+                        }
+                        // 实参个数不变时复用缓冲区，只有可变参数会改变个数
+                        Some((at, cached, cached_value)) if cached.len() == args.len() => {
+                            let value = (m.program.externs[index])(args);
+                            cached.copy_from_slice(args);
+                            (*at, *cached_value) = (epoch, value);
+                            value
+                        }
+                        slot => {
+                            let value = (m.program.externs[index])(args);
+                            *slot = Some((epoch, args.into(), value));
+                            value
+                        }
+                    };
+                    m.stack.truncate(frame);
+                    Ok(value)
+                })
+            }
+        }))
+    }
+
+    fn binop(
+        &mut self,
+        expr: &Expr,
+        op: Operator,
+        left: &Expr,
+        right: &Expr,
+    ) -> Result<Operand, CompileError> {
+        // 与常量折叠相同的融合方式，保持从左到右的求值顺序
+        if self.mode != FpMode::Strict && matches!(op, Operator::Add | Operator::Sub) {
+            let sign = if op == Operator::Add { 1.0 } else { -1.0 };
+            if let Some((a, b)) = product(left) {
+                let (a, b, c) = (self.code(a)?, self.code(b)?, self.code(right)?);
+                return Ok(Operand::Code(Box::new(move |m, base| {
+                    let a = a(m, base)?;
+                    let b = b(m, base)?;
+                    Ok(a.mul_add(b, sign * c(m, base)?))
+                })));
+            }
+            if let Some((a, b)) = product(right) {
+                let (c, a, b) = (self.code(left)?, self.code(a)?, self.code(b)?);
+                return Ok(Operand::Code(Box::new(move |m, base| {
+                    let c = c(m, base)?;
+                    let a = a(m, base)?;
+                    Ok((sign * a).mul_add(b(m, base)?, c))
+                })));
+            }
+        }
+
+        if let Operator::And | Operator::Or = op {
+            let (left, right) = (self.code(left)?, self.code(right)?);
+            return Ok(Operand::Code(match op {
+                Operator::And => Box::new(move |m, base| {
+                    Ok(bool_value(
+                        truthy(left(m, base)?) && truthy(right(m, base)?),
+                    ))
+                }),
+                _ => Box::new(move |m, base| {
+                    Ok(bool_value(
+                        truthy(left(m, base)?) || truthy(right(m, base)?),
+                    ))
+                }),
+            }));
+        }
+
+        let (l, r) = (self.operand(left)?, self.operand(right)?);
+        Ok(match op {
+            Operator::Add => arith(l, r, |a, b| a + b),
+            Operator::Sub => arith(l, r, |a, b| a - b),
+            Operator::Mul => arith(l, r, |a, b| a * b),
+            Operator::Div => arith(l, r, |a, b| a / b),
+            Operator::Eq => arith(l, r, |a, b| bool_value(a == b)),
+            Operator::Ne => arith(l, r, |a, b| bool_value(a != b)),
+            Operator::Gt => arith(l, r, |a, b| bool_value(a > b)),
+            Operator::Ge => arith(l, r, |a, b| bool_value(a >= b)),
+            Operator::Lt => arith(l, r, |a, b| bool_value(a < b)),
+            Operator::Le => arith(l, r, |a, b| bool_value(a <= b)),
+            _ => return Err(CompileError::Unsupported(expr.span)),
+        })
+    }
+
+    fn if_expr(
+        &mut self,
+        if_then_exprs: &[IfThenExpr],
+        else_expr: Option<&Expr>,
+    ) -> Result<Operand, CompileError> {
+        let mut arms = Vec::with_capacity(if_then_exprs.len());
+        for if_then in if_then_exprs {
+            arms.push((self.code(&if_then.cond)?, self.code(&if_then.then)?));
+        }
+        let otherwise = match else_expr {
+            Some(expr) => self.code(expr)?,
+            None => boxed(Operand::Lit(0.0)),
+        };
+
+        Ok(Operand::Code(if arms.len() == 1 {
+            let (cond, then) = arms.pop().unwrap();
+            Box::new(move |m, base| {
+                if truthy(cond(m, base)?) {
+                    then(m, base)
+                } else {
+                    otherwise(m, base)
+                }
+            })
+        } else {
+            Box::new(move |m, base| {
+                for (cond, then) in &arms {
+                    if truthy(cond(m, base)?) {
+                        return then(m, base);
+                    }
+                }
+                otherwise(m, base)
+            })
+        }))
+    }
+
+    /// 稠密分支查跳转表，否则对有序的分支值二分查找
+    fn switch(
+        &mut self,
+        scrutinee: &Expr,
+        cases: &[SwitchCase],
+        default: Option<&Expr>,
+        dense: bool,
+    ) -> Result<Operand, CompileError> {
+        let key = self.code(scrutinee)?;
+        let mut arms = Vec::with_capacity(cases.len() + 1);
+        for case in cases {
+            arms.push(self.code(&case.expr)?);
+        }
+        arms.push(match default {
+            Some(expr) => self.code(expr)?,
+            None => boxed(Operand::Lit(0.0)),
+        });
+        let values = cases.iter().map(|case| case.value).collect::<Vec<_>>();
+
+        let (lo, hi) = match (values.first(), values.last()) {
+            (Some(lo), Some(hi)) => (*lo, *hi),
+            _ => (0.0, -1.0),
+        };
+        if dense && hi - lo < 2.0 * values.len() as f64 {
+            let mut table = vec![cases.len(); (hi - lo) as usize + 1];
+            for (index, value) in values.iter().enumerate() {
+                table[(value - lo) as usize] = index;
+            }
+            return Ok(Operand::Code(Box::new(move |m, base| {
+                let key = key(m, base)?;
+                let arm = if key >= lo && key <= hi && key.fract() == 0.0 {
+                    table[(key - lo) as usize]
+                } else {
+                    table.len()
+                };
+                arms[arm.min(arms.len() - 1)](m, base)
+            })));
+        }
+
+        Ok(Operand::Code(Box::new(move |m, base| {
+            let key = key(m, base)?;
+            let arm = values
+                .binary_search_by(|value| value.partial_cmp(&key).unwrap_or(Ordering::Less))
+                .unwrap_or(values.len());
+            arms[arm](m, base)
+        })))
+    }
+}
+
+impl Place {
+    #[inline(always)]
+    fn load(self, m: &Machine<'_>, base: usize) -> f64 {
+        match self {
+            Place::Local(slot) => m.stack[base + slot],
+            Place::Global(index) => m.globals[index],
+        }
+    }
+
+    #[inline(always)]
+    fn store(self, m: &mut Machine<'_>, base: usize, value: f64) {
+        match self {
+            Place::Local(slot) => m.stack[base + slot] = value,
+            Place::Global(index) => m.globals[index] = value,
+        }
+    }
+}
+
+/// 依次求值并压栈，返回新栈帧的起点
+fn push_args(m: &mut Machine<'_>, base: usize, args: &[Code]) -> Result<usize, Flow> {
+    let frame = m.stack.len();
+    for arg in args {
+        match arg(m, base) {
+            Ok(value) => m.stack.push(value),
+            Err(flow) => {
+                m.stack.truncate(frame);
+                return Err(flow);
+            }
+        }
+    }
+    Ok(frame)
+}
+
+fn boxed(operand: Operand) -> Code {
+    match operand {
+        Operand::Lit(value) => Box::new(move |_, _| Ok(value)),
+        Operand::Local(slot) => Box::new(move |m, base| Ok(m.stack[base + slot])),
+        Operand::Code(code) => code,
+    }
+}
+
+/// 按操作数种类生成闭包，左侧先于右侧求值
+fn arith(
+    left: Operand,
+    right: Operand,
+    f: impl Fn(f64, f64) -> f64 + Copy + Send + Sync + 'static,
+) -> Operand {
+    Operand::Code(match (left, right) {
+        (Operand::Local(a), Operand::Lit(k)) => {
+            Box::new(move |m, base| Ok(f(m.stack[base + a], k)))
+        }
+        (Operand::Lit(k), Operand::Local(b)) => {
+            Box::new(move |m, base| Ok(f(k, m.stack[base + b])))
+        }
+        (Operand::Local(a), Operand::Local(b)) => {
+            Box::new(move |m, base| Ok(f(m.stack[base + a], m.stack[base + b])))
+        }
+        (Operand::Code(l), Operand::Lit(k)) => Box::new(move |m, base| Ok(f(l(m, base)?, k))),
+        (Operand::Code(l), Operand::Local(b)) => Box::new(move |m, base| {
+            let l = l(m, base)?;
+            Ok(f(l, m.stack[base + b]))
+        }),
+        (Operand::Lit(k), Operand::Code(r)) => Box::new(move |m, base| Ok(f(k, r(m, base)?))),
+        (Operand::Local(a), Operand::Code(r)) => Box::new(move |m, base| {
+            let l = m.stack[base + a];
+            Ok(f(l, r(m, base)?))
+        }),
+        (left, right) => {
+            let (l, r) = (boxed(left), boxed(right));
+            Box::new(move |m, base| {
+                let l = l(m, base)?;
+                Ok(f(l, r(m, base)?))
+            })
+        }
+    })
+}
+
+#[inline(always)]
+const fn bool_value(value: bool) -> f64 {
+    if value { 1.0 } else { 0.0 }
+}
+
+fn params<'a>(src: &'a str, args: &[Expr]) -> Result<(Vec<&'a str>, bool), CompileError> {
+    let mut params = vec![];
+    let mut vararg = false;
+    for arg in args {
+        match arg.kind {
+            ExprKind::Ident => params.push(text(src, arg)),
+            ExprKind::Ellipsis => vararg = true,
+            _ => return Err(CompileError::Unsupported(arg.span)),
+        }
+    }
+    Ok((params, vararg))
+}
+
+fn text<'a>(src: &'a str, expr: &Expr) -> &'a str {
+    &src[expr.span.start..expr.span.end]
+}
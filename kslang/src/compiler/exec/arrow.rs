@@ -0,0 +1,285 @@
+//! 以 Arrow C 数据接口交换的列批量求值
+//!
+//! 只接受 float64（格式 `g`）列，直接读取宿主的缓冲区，不复制列数据。一列可由多个
+//! 分块组成，各列的分块边界可以不同。
+
+use super::{Entry, Machine, Trap};
+use std::ffi::{CStr, c_char, c_void};
+
+/// 与 Arrow 规范中的定义相同
+#[repr(C)]
+pub struct ArrowSchema {
+    pub format: *const c_char,
+    pub name: *const c_char,
+    pub metadata: *const c_char,
+    pub flags: i64,
+    pub n_children: i64,
+    pub children: *mut *mut ArrowSchema,
+    pub dictionary: *mut ArrowSchema,
+    pub release: Option<unsafe extern "C" fn(*mut ArrowSchema)>,
+    pub private_data: *mut c_void,
+}
+
+/// 与 Arrow 规范中的定义相同
+#[repr(C)]
+pub struct ArrowArray {
+    pub length: i64,
+    pub null_count: i64,
+    pub offset: i64,
+    pub n_buffers: i64,
+    pub n_children: i64,
+    pub buffers: *mut *const c_void,
+    pub children: *mut *mut ArrowArray,
+    pub dictionary: *mut ArrowArray,
+    pub release: Option<unsafe extern "C" fn(*mut ArrowArray)>,
+    pub private_data: *mut c_void,
+}
+
+pub const ARROW_FLAG_NULLABLE: i64 = 2;
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum BatchError {
+    /// 各列的总行数不同
+    Length,
+    /// 列数与形参个数不同
+    Arity,
+    Trap(Trap),
+}
+
+impl std::fmt::Display for BatchError {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        match self {
+            Self::Length => write!(f, "各列行数不同"),
+            Self::Arity => write!(f, "列数与形参个数不符"),
+            Self::Trap(trap) => write!(f, "{}", trap),
+        }
+    }
+}
+
+impl std::error::Error for BatchError {}
+
+/// 一个分块中的数据，借用宿主的缓冲区
+#[derive(Clone, Copy)]
+struct Chunk<'a> {
+    values: &'a [f64],
+    /// 有效位图与首行的位偏移，没有空值时为 `None`
+    validity: Option<(&'a [u8], usize)>,
+}
+
+impl Chunk<'_> {
+    fn get(&self, row: usize) -> Option<f64> {
+        match self.validity {
+            Some((bits, offset)) if bits[(offset + row) / 8] >> ((offset + row) % 8) & 1 == 0 => {
+                None
+            }
+            _ => Some(self.values[row]),
+        }
+    }
+}
+
+/// 一列输入，按顺序由若干分块组成
+pub struct Column<'a> {
+    chunks: Vec<Chunk<'a>>,
+    len: usize,
+}
+
+impl<'a> Column<'a> {
+    /// 检查类型与结构，不是 float64 数组时返回 `None`
+    ///
+    /// # Safety
+    /// `schema` 与 `chunks` 须符合 Arrow C 数据接口且尚未释放，返回值存活期间缓冲区
+    /// 不能被修改或释放。
+    pub unsafe fn import(schema: &ArrowSchema, chunks: &'a [ArrowArray]) -> Option<Self> {
+        if schema.release.is_none()
+            || schema.format.is_null()
+            || unsafe { CStr::from_ptr(schema.format) } != c"g"
+            || schema.n_children != 0
+            || !schema.dictionary.is_null()
+        {
+            return None;
+        }
+
+        let mut column = Self {
+            chunks: Vec::with_capacity(chunks.len()),
+            len: 0,
+        };
+        for array in chunks {
+            if array.release.is_none()
+                || array.length < 0
+                || array.offset < 0
+                || array.n_buffers != 2
+                || array.n_children != 0
+                || !array.dictionary.is_null()
+                || array.buffers.is_null()
+            {
+                return None;
+            }
+            let (len, offset) = (array.length as usize, array.offset as usize);
+            if len == 0 {
+                continue;
+            }
+            let buffers = unsafe { std::slice::from_raw_parts(array.buffers, 2) };
+            let values = buffers[1] as *const f64;
+            if values.is_null() || !values.is_aligned() {
+                return None;
+            }
+            let values = unsafe { std::slice::from_raw_parts(values.add(offset), len) };
+            // 空值个数为 0 时不读取位图
+            let validity = match (buffers[0] as *const u8, array.null_count) {
+                (_, 0) => None,
+                (bits, _) if bits.is_null() => None,
+                (bits, _) => {
+                    let bytes = (offset + len).div_ceil(8);
+                    Some((unsafe { std::slice::from_raw_parts(bits, bytes) }, offset))
+                }
+            };
+            column.chunks.push(Chunk { values, validity });
+            column.len += len;
+        }
+        Some(column)
+    }
+
+    pub fn len(&self) -> usize {
+        self.len
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.len == 0
+    }
+
+    fn rows(&self) -> impl Iterator<Item = Option<f64>> + '_ {
+        self.chunks
+            .iter()
+            .flat_map(|chunk| (0..chunk.values.len()).map(move |row| chunk.get(row)))
+    }
+}
+
+/// 求值结果，空值所在行的值为 0
+#[derive(Debug, Default)]
+pub struct Output {
+    values: Vec<f64>,
+    /// 出现空值时才分配
+    validity: Option<Vec<u8>>,
+    null_count: usize,
+}
+
+impl Output {
+    pub fn len(&self) -> usize {
+        self.values.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.values.is_empty()
+    }
+
+    pub fn null_count(&self) -> usize {
+        self.null_count
+    }
+
+    pub fn get(&self, row: usize) -> Option<f64> {
+        match &self.validity {
+            Some(bits) if bits[row / 8] >> (row % 8) & 1 == 0 => None,
+            _ => Some(self.values[row]),
+        }
+    }
+
+    /// 导出为 Arrow 数组，缓冲区交由宿主调用 `release` 释放
+    pub fn export(self) -> ArrowArray {
+        let mut private = Box::new(Exported {
+            buffers: [
+                self.validity
+                    .as_ref()
+                    .map_or(std::ptr::null(), |bits| bits.as_ptr().cast()),
+                self.values.as_ptr().cast(),
+            ],
+            values: self.values,
+            _validity: self.validity,
+        });
+        ArrowArray {
+            length: private.values.len() as i64,
+            null_count: self.null_count as i64,
+            offset: 0,
+            n_buffers: 2,
+            n_children: 0,
+            buffers: private.buffers.as_mut_ptr(),
+            children: std::ptr::null_mut(),
+            dictionary: std::ptr::null_mut(),
+            release: Some(release_array),
+            private_data: Box::into_raw(private).cast(),
+        }
+    }
+}
+
+/// 导出数组持有的缓冲区
+struct Exported {
+    buffers: [*const c_void; 2],
+    values: Vec<f64>,
+    _validity: Option<Vec<u8>>,
+}
+
+unsafe extern "C" fn release_array(array: *mut ArrowArray) {
+    let array = unsafe { &mut *array };
+    drop(unsafe { Box::from_raw(array.private_data.cast::<Exported>()) });
+    array.release = None;
+}
+
+unsafe extern "C" fn release_schema(schema: *mut ArrowSchema) {
+    unsafe { (*schema).release = None };
+}
+
+/// 求值结果的类型：可为空的 float64
+pub fn output_schema() -> ArrowSchema {
+    ArrowSchema {
+        format: c"g".as_ptr(),
+        name: c"".as_ptr(),
+        metadata: std::ptr::null(),
+        flags: ARROW_FLAG_NULLABLE,
+        n_children: 0,
+        children: std::ptr::null_mut(),
+        dictionary: std::ptr::null_mut(),
+        release: Some(release_schema),
+        private_data: std::ptr::null_mut(),
+    }
+}
+
+/// 逐行调用 `entry`，第 `i` 列为第 `i` 个实参
+///
+/// 任一实参为空值时该行结果为空值，不调用函数。没有形参的函数结果为空数组。
+pub fn eval(machine: &mut Machine, entry: Entry, columns: &[Column]) -> Result<Output, BatchError> {
+    if columns.len() != entry.params {
+        return Err(BatchError::Arity);
+    }
+    let len = columns.first().map_or(0, Column::len);
+    if columns.iter().any(|column| column.len() != len) {
+        return Err(BatchError::Length);
+    }
+
+    let mut output = Output {
+        values: Vec::with_capacity(len),
+        validity: None,
+        null_count: 0,
+    };
+    let mut rows = columns.iter().map(Column::rows).collect::<Vec<_>>();
+    let mut args = vec![0.0; columns.len()];
+    for row in 0..len {
+        let mut valid = true;
+        for (arg, column) in args.iter_mut().zip(&mut rows) {
+            match column.next().unwrap() {
+                Some(value) => *arg = value,
+                None => valid = false,
+            }
+        }
+        if valid {
+            let value = machine.call_entry(entry, &args).map_err(BatchError::Trap)?;
+            output.values.push(value);
+            continue;
+        }
+        let bits = output
+            .validity
+            .get_or_insert_with(|| vec![u8::MAX; len.div_ceil(8)]);
+        bits[row / 8] &= !(1 << (row % 8));
+        output.null_count += 1;
+        output.values.push(0.0);
+    }
+    Ok(output)
+}
@@ -0,0 +1,258 @@
+use super::{
+    CodeSpan,
+    analyzer::{Analyzer, Ref},
+    ast::{ExprKind, StmtKind},
+    lexer::{Lexer, Source, SourceSequence},
+    load, parse_ast,
+    snapshot::content_hash,
+};
+use serde::{Deserialize, Serialize};
+use std::{
+    collections::{BTreeMap, HashMap},
+    path::{Path, PathBuf},
+};
+
+/// 索引格式版本，不一致时整体重建
+pub const INDEX_VERSION: u32 = 2;
+
+#[derive(Clone, Copy, Debug, PartialEq, Eq, Deserialize, Serialize)]
+pub enum SymbolKind {
+    Def,
+    Extern,
+}
+
+/// 顶层 `def` / `extern`
+#[derive(Clone, Debug, Deserialize, Serialize)]
+pub struct Symbol {
+    pub name: String,
+    pub kind: SymbolKind,
+    pub arity: usize,
+    pub vararg: bool,
+    pub span: CodeSpan,
+}
+
+#[derive(Clone, Debug, Deserialize, Serialize)]
+pub struct FileIndex {
+    pub path: PathBuf,
+    pub hash: u64,
+    pub symbols: Vec<Symbol>,
+    /// 按名称归组的顶层符号的定义与使用位置，函数内的局部绑定不计入
+    pub refs: BTreeMap<String, Vec<Ref>>,
+    /// 词法或语法错误，此时只保留已索引的部分
+    pub error: Option<String>,
+}
+
+impl FileIndex {
+    pub fn build(path: &Path, text: &str) -> Self {
+        let mut index = Self {
+            path: path.to_path_buf(),
+            hash: content_hash(text),
+            symbols: vec![],
+            refs: BTreeMap::new(),
+            error: None,
+        };
+
+        let srcs = SourceSequence {
+            sources: vec![Source::String(text.to_string())],
+        };
+        let tokens = match Lexer::new(0, &srcs).collect::<Result<Vec<_>, _>>() {
+            Ok(tokens) => tokens,
+            Err(span) => {
+                index.error = Some(format!("词法错误@{}", span));
+                return index;
+            }
+        };
+        let ast = match parse_ast(text, &tokens) {
+            Ok(ast) => ast,
+            Err(e) => {
+                index.error = Some(format!("{:?}", e));
+                return index;
+            }
+        };
+
+        for stmt in &ast {
+            let (kind, ident, args) = match &stmt.kind {
+                StmtKind::Def { ident, args, .. } => (SymbolKind::Def, ident, args),
+                StmtKind::Extern { ident, args, .. } => (SymbolKind::Extern, ident, args),
+                _ => continue,
+            };
+            index.symbols.push(Symbol {
+                name: text[ident.span.start..ident.span.end].to_string(),
+                kind,
+                arity: args
+                    .iter()
+                    .filter(|arg| matches!(arg.kind, ExprKind::Ident))
+                    .count(),
+                vararg: args
+                    .iter()
+                    .any(|arg| matches!(arg.kind, ExprKind::Ellipsis)),
+                span: ident.span,
+            });
+        }
+
+        let mut analyzer = Analyzer::new();
+        if let Err(e) = analyzer.index(text, &ast) {
+            index.error = Some(e.to_string());
+            return index;
+        }
+        for (name, sym) in &analyzer.names {
+            index
+                .refs
+                .insert(name.to_string(), analyzer.refs.refs(*sym).to_vec());
+        }
+        index
+    }
+}
+
+#[derive(Debug, Default)]
+pub struct UpdateStats {
+    pub reused: usize,
+    pub indexed: usize,
+    pub removed: usize,
+}
+
+/// 工作区符号索引
+///
+/// 持久化到磁盘，按内容散列增量更新；载入后无需解析任何文件即可查询。
+#[derive(Debug, Deserialize, Serialize)]
+pub struct WorkspaceIndex {
+    version: u32,
+    files: Vec<FileIndex>,
+    #[serde(skip)]
+    defs: HashMap<String, Vec<(usize, usize)>>,
+}
+
+impl Default for WorkspaceIndex {
+    fn default() -> Self {
+        Self {
+            version: INDEX_VERSION,
+            files: vec![],
+            defs: HashMap::new(),
+        }
+    }
+}
+
+impl WorkspaceIndex {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    /// 载入索引，文件缺失、损坏或版本不符时返回空索引
+    pub fn load(path: &Path) -> Self {
+        let Ok(bytes) = std::fs::read(path) else {
+            return Self::new();
+        };
+        match serde_json::from_slice::<Self>(&bytes) {
+            Ok(mut index) if index.version == INDEX_VERSION => {
+                index.rebuild_defs();
+                index
+            }
+            _ => Self::new(),
+        }
+    }
+
+    /// 先写入临时文件再替换，中断时不会留下不完整的索引
+    pub fn save(&self, path: &Path) -> std::io::Result<()> {
+        let tmp = path.with_extension("tmp");
+        std::fs::write(&tmp, serde_json::to_vec(self)?)?;
+        std::fs::rename(tmp, path)
+    }
+
+    pub fn files(&self) -> &[FileIndex] {
+        &self.files
+    }
+
+    /// 以 `paths` 为工作区内的全部文件更新索引
+    ///
+    /// 内容散列未变的文件直接复用，其余文件由 `jobs` 个线程并行索引。
+    /// 任一文件读取失败时返回错误，索引保持不变。
+    pub fn update(&mut self, paths: &[PathBuf], jobs: usize) -> std::io::Result<UpdateStats> {
+        let hashes = self
+            .files
+            .iter()
+            .map(|file| (file.path.as_path(), file.hash))
+            .collect::<HashMap<_, _>>();
+
+        // 读入后立即在读取线程池中比较哈希并重建，I/O 与分析重叠
+        let opts = load::Options {
+            jobs,
+            ..Default::default()
+        };
+        let loaded = load::map_files(paths, &opts, |i, text| -> std::io::Result<_> {
+            let text = text?;
+            Ok(match hashes.get(paths[i].as_path()) {
+                Some(hash) if *hash == content_hash(&text) => None,
+                _ => Some(FileIndex::build(&paths[i], &text)),
+            })
+        })
+        .into_iter()
+        .collect::<std::io::Result<Vec<_>>>()?;
+
+        let mut old = std::mem::take(&mut self.files)
+            .into_iter()
+            .map(|file| (file.path.clone(), file))
+            .collect::<HashMap<_, _>>();
+        let mut stats = UpdateStats::default();
+        let mut slots = Vec::with_capacity(paths.len());
+        for (path, file) in paths.iter().zip(loaded) {
+            let file = match file {
+                Some(file) => {
+                    stats.indexed += 1;
+                    old.remove(path);
+                    file
+                }
+                None => {
+                    stats.reused += 1;
+                    match old.remove(path) {
+                        Some(file) => file,
+                        // 重复出现的路径，沿用前一次的结果
+                        None => slots
+                            .iter()
+                            .rfind(|file: &&FileIndex| file.path == *path)
+                            .unwrap()
+                            .clone(),
+                    }
+                }
+            };
+            slots.push(file);
+        }
+        stats.removed = old.len();
+
+        self.files = slots;
+        self.rebuild_defs();
+        Ok(stats)
+    }
+
+    pub fn definitions<'a>(&'a self, name: &str) -> impl Iterator<Item = (&'a Path, &'a Symbol)> {
+        self.defs
+            .get(name)
+            .into_iter()
+            .flatten()
+            .map(|(file, sym)| {
+                let file = &self.files[*file];
+                (file.path.as_path(), &file.symbols[*sym])
+            })
+    }
+
+    pub fn references<'a>(&'a self, name: &'a str) -> impl Iterator<Item = (&'a Path, &'a Ref)> {
+        self.files.iter().flat_map(move |file| {
+            file.refs
+                .get(name)
+                .into_iter()
+                .flatten()
+                .map(|r| (file.path.as_path(), r))
+        })
+    }
+
+    fn rebuild_defs(&mut self) {
+        self.defs.clear();
+        for (index, file) in self.files.iter().enumerate() {
+            for (sym, symbol) in file.symbols.iter().enumerate() {
+                self.defs
+                    .entry(symbol.name.clone())
+                    .or_default()
+                    .push((index, sym));
+            }
+        }
+    }
+}
@@ -1,3 +1,5 @@
+pub mod brackets;
+
 use logos::{Logos, SpannedIter};
 use serde::{Deserialize, Serialize};
 use std::{
@@ -195,6 +197,52 @@ impl TokenKind {
     }
 }
 
+impl TryFrom<u32> for TokenKind {
+    type Error = ();
+    fn try_from(value: u32) -> Result<Self, Self::Error> {
+        const KINDS: [TokenKind; 37] = [
+            TokenKind::UTF8BOM,
+            TokenKind::Whitespace,
+            TokenKind::Comment,
+            TokenKind::Ident,
+            TokenKind::Number,
+            TokenKind::Break,
+            TokenKind::Continue,
+            TokenKind::Def,
+            TokenKind::Else,
+            TokenKind::Extern,
+            TokenKind::For,
+            TokenKind::If,
+            TokenKind::In,
+            TokenKind::Return,
+            TokenKind::Then,
+            TokenKind::Assign,
+            TokenKind::Eq,
+            TokenKind::Ne,
+            TokenKind::Gt,
+            TokenKind::Ge,
+            TokenKind::Lt,
+            TokenKind::Le,
+            TokenKind::Add,
+            TokenKind::Sub,
+            TokenKind::Mul,
+            TokenKind::Div,
+            TokenKind::And,
+            TokenKind::Or,
+            TokenKind::Not,
+            TokenKind::Range,
+            TokenKind::OpenParen,
+            TokenKind::CloseParen,
+            TokenKind::OpenBrace,
+            TokenKind::CloseBrace,
+            TokenKind::Semicolon,
+            TokenKind::Comma,
+            TokenKind::Ellipsis,
+        ];
+        KINDS.get(value as usize).copied().ok_or(())
+    }
+}
+
 #[derive(Debug)]
 pub enum Source {
     Stdin(String),
@@ -305,8 +353,11 @@ impl Iterator for Lexer<'_> {
         };
 
         if let Ok(kind) = kind_res {
-            let text = &self.text[span.start..span.end];
-            self.line += text.chars().filter(|c| *c == '\n').count();
+            // 只有空白和注释可能跨行
+            if matches!(kind, TokenKind::Whitespace | TokenKind::Comment) {
+                let text = &self.text[span.start..span.end];
+                self.line += text.bytes().filter(|b| *b == b'\n').count();
+            }
 
             Some(Ok(Token { kind, span }))
         } else {
@@ -317,7 +368,11 @@ impl Iterator for Lexer<'_> {
 
 impl<'s> Lexer<'s> {
     pub fn new(src_id: usize, srcs: &'s SourceSequence) -> Self {
-        let text = srcs.sources[src_id].text();
+        Self::from_text(src_id, srcs.sources[src_id].text())
+    }
+
+    /// 直接解析不在 [`SourceSequence`] 中的文本，`src_id` 只用于标记位置
+    pub fn from_text(src_id: usize, text: &'s str) -> Self {
         let iter = TokenKind::lexer(text).spanned();
         let line = 0;
         Self {
@@ -329,7 +384,7 @@ impl<'s> Lexer<'s> {
     }
 }
 
-#[derive(Debug, Clone, Copy, Deserialize, Serialize)]
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Deserialize, Serialize)]
 pub enum Operator {
     Assign = TokenKind::Assign as isize,
 
@@ -0,0 +1,113 @@
+use super::{CodeSpan, Token, TokenKind};
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum BracketError {
+    /// 开括号没有对应的闭括号
+    Unclosed(CodeSpan),
+    /// 闭括号没有对应的开括号
+    Unopened(CodeSpan),
+    /// 圆括号与花括号交错，如 `( }`
+    Mismatched { open: CodeSpan, close: CodeSpan },
+    /// Token 数超出索引的表示范围
+    TooMany,
+}
+
+impl std::fmt::Display for BracketError {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        match self {
+            Self::Unclosed(span) => write!(f, "{}: 括号没有闭合", span),
+            Self::Unopened(span) => write!(f, "{}: 多余的闭括号", span),
+            Self::Mismatched { open, close } => {
+                write!(f, "{}: 与 {} 处的括号不配对", close, open)
+            }
+            Self::TooMany => write!(f, "Token 数超出括号索引的范围"),
+        }
+    }
+}
+
+impl BracketError {
+    /// 出错处最靠前的字节偏移
+    pub fn start(&self) -> usize {
+        match self {
+            Self::Unclosed(span) | Self::Unopened(span) => span.start,
+            Self::Mismatched { open, .. } => open.start,
+            Self::TooMany => 0,
+        }
+    }
+}
+
+impl std::error::Error for BracketError {}
+
+/// 括号配对索引，由 Token 下标查另一半的下标
+///
+/// 词法分析后一次线性扫描得到，之后跳过整个括号内的 Token 只需一次查表。
+#[derive(Debug, Clone, Default)]
+pub struct Brackets {
+    /// 不是括号的 Token 为 `u32::MAX`
+    partner: Vec<u32>,
+}
+
+const NONE: u32 = u32::MAX;
+
+impl Brackets {
+    /// 按位置顺序报告所有不配对的括号，这些括号在索引中没有另一半，其余括号照常配对
+    ///
+    /// 闭括号与栈顶的开括号种类不同时，若栈中更深处有同种的开括号，则与之配对，其间的
+    /// 开括号均不配对，栈顶以外的报告为未闭合；否则该闭括号不配对。Token 数超出索引范围时返回空索引。
+    pub fn new(tokens: &[Token]) -> (Self, Vec<BracketError>) {
+        if tokens.len() >= NONE as usize {
+            return (Self::default(), vec![BracketError::TooMany]);
+        }
+        let mut partner = vec![NONE; tokens.len()];
+        let mut errors = Vec::new();
+        let mut open = Vec::<usize>::new();
+        for (i, token) in tokens.iter().enumerate() {
+            let expect = match token.kind {
+                TokenKind::OpenParen | TokenKind::OpenBrace => {
+                    open.push(i);
+                    continue;
+                }
+                TokenKind::CloseParen => TokenKind::OpenParen,
+                TokenKind::CloseBrace => TokenKind::OpenBrace,
+                _ => continue,
+            };
+            let Some(&top) = open.last() else {
+                errors.push(BracketError::Unopened(token.span));
+                continue;
+            };
+            if tokens[top].kind != expect {
+                errors.push(BracketError::Mismatched {
+                    open: tokens[top].span,
+                    close: token.span,
+                });
+                let Some(depth) = open.iter().rposition(|&j| tokens[j].kind == expect) else {
+                    continue;
+                };
+                // 栈顶已作为不配对报告，其下被跳过的开括号均未闭合
+                let skipped = &open[depth + 1..open.len() - 1];
+                errors.extend(
+                    skipped
+                        .iter()
+                        .map(|&j| BracketError::Unclosed(tokens[j].span)),
+                );
+                open.truncate(depth + 1);
+            }
+            let j = open.pop().unwrap();
+            (partner[i], partner[j]) = (j as u32, i as u32);
+        }
+        errors.extend(
+            open.into_iter()
+                .map(|j| BracketError::Unclosed(tokens[j].span)),
+        );
+        errors.sort_by_key(BracketError::start);
+        (Self { partner }, errors)
+    }
+
+    /// 下标为 `index` 的括号的另一半，不是括号时返回 `None`
+    pub fn partner(&self, index: usize) -> Option<usize> {
+        match self.partner.get(index) {
+            Some(&j) if j != NONE => Some(j as usize),
+            _ => None,
+        }
+    }
+}
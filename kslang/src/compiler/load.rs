@@ -0,0 +1,142 @@
+#[cfg(target_os = "linux")]
+mod uring;
+
+#[cfg(not(target_os = "linux"))]
+mod uring {
+    use std::{io, path::PathBuf};
+
+    pub enum Ring {}
+
+    impl Ring {
+        pub fn new(_entries: u32) -> io::Result<Self> {
+            Err(io::ErrorKind::Unsupported.into())
+        }
+
+        pub fn read_all(
+            self,
+            _paths: &[PathBuf],
+            _depth: usize,
+            _done: impl FnMut(usize, io::Result<String>),
+        ) -> io::Result<()> {
+            match self {}
+        }
+    }
+}
+
+use std::{
+    fs::File,
+    io::{self, Read},
+    path::{Path, PathBuf},
+    sync::{
+        Mutex,
+        atomic::{AtomicUsize, Ordering},
+        mpsc,
+    },
+};
+
+pub struct Options {
+    /// 同时在途的文件数
+    pub depth: usize,
+    /// 处理读入内容的线程数
+    pub jobs: usize,
+    /// 为 `false` 时不尝试 io_uring，直接同步读取
+    pub uring: bool,
+}
+
+impl Default for Options {
+    fn default() -> Self {
+        Self {
+            depth: 64,
+            jobs: std::thread::available_parallelism().map_or(1, |n| n.get()),
+            uring: true,
+        }
+    }
+}
+
+/// 读取所有文件并在读入后立即交给 `f` 处理，结果按 `paths` 的顺序返回
+///
+/// io_uring 可用时由当前线程批量提交打开、查询大小、预读提示与读取，`jobs` 个线程
+/// 处理读入的内容；否则这些线程各自同步读取，读取前提示内核预读整个文件。
+pub fn map_files<T: Send>(
+    paths: &[PathBuf],
+    opts: &Options,
+    f: impl Fn(usize, io::Result<String>) -> T + Sync,
+) -> Vec<T> {
+    let depth = opts.depth.clamp(1, 2048);
+    let ring = if opts.uring && !paths.is_empty() {
+        uring::Ring::new((depth as u32 * 2).next_power_of_two()).ok()
+    } else {
+        None
+    };
+    let queued = ring.is_some();
+
+    let (sender, receiver) = mpsc::channel::<(usize, io::Result<String>)>();
+    let receiver = Mutex::new(receiver);
+    let next = AtomicUsize::new(0);
+    let mut slots = (0..paths.len()).map(|_| None).collect::<Vec<_>>();
+    std::thread::scope(|scope| {
+        let workers = (0..opts.jobs.clamp(1, paths.len().max(1)))
+            .map(|_| {
+                scope.spawn(|| {
+                    let mut done = Vec::new();
+                    loop {
+                        let (index, text) = if queued {
+                            let Ok(loaded) = receiver.lock().unwrap().recv() else {
+                                break done;
+                            };
+                            loaded
+                        } else {
+                            let index = next.fetch_add(1, Ordering::Relaxed);
+                            let Some(path) = paths.get(index) else {
+                                break done;
+                            };
+                            (index, read_file(path))
+                        };
+                        done.push((index, f(index, text)));
+                    }
+                })
+            })
+            .collect::<Vec<_>>();
+
+        if let Some(ring) = ring {
+            let mut sent = vec![false; paths.len()];
+            let result = ring.read_all(paths, depth, |index, text| {
+                sent[index] = true;
+                let _ = sender.send((index, text));
+            });
+            // 环出错时未读完的文件改为同步读取
+            if result.is_err() {
+                for (index, path) in paths.iter().enumerate() {
+                    if !sent[index] {
+                        let _ = sender.send((index, read_file(path)));
+                    }
+                }
+            }
+        }
+        drop(sender);
+
+        for worker in workers {
+            for (index, value) in worker.join().unwrap() {
+                slots[index] = Some(value);
+            }
+        }
+    });
+    slots.into_iter().map(Option::unwrap).collect()
+}
+
+pub fn read_files(paths: &[PathBuf], opts: &Options) -> Vec<io::Result<String>> {
+    map_files(paths, opts, |_, text| text)
+}
+
+fn read_file(path: &Path) -> io::Result<String> {
+    let mut file = File::open(path)?;
+    let len = file.metadata()?.len() as usize;
+    #[cfg(target_os = "linux")]
+    {
+        use std::os::fd::AsRawFd;
+        unsafe { libc::posix_fadvise(file.as_raw_fd(), 0, 0, libc::POSIX_FADV_WILLNEED) };
+    }
+    let mut text = String::with_capacity(len);
+    file.read_to_string(&mut text)?;
+    Ok(text)
+}
@@ -0,0 +1,492 @@
+//! 只包含批量读取所需操作的 io_uring 封装
+
+use std::{
+    ffi::CString,
+    io,
+    os::{fd::AsRawFd, fd::FromRawFd, fd::OwnedFd, unix::ffi::OsStrExt},
+    path::PathBuf,
+    sync::atomic::{AtomicU32, Ordering},
+};
+
+const OFF_SQ_RING: libc::off_t = 0;
+const OFF_CQ_RING: libc::off_t = 0x8000000;
+const OFF_SQES: libc::off_t = 0x10000000;
+const ENTER_GETEVENTS: u32 = 1;
+const REGISTER_PROBE: u32 = 8;
+const PROBE_OPS: usize = 256;
+const OP_SUPPORTED: u16 = 1;
+/// 链接到下一个操作，本操作失败时后者仍然执行
+const SQE_HARDLINK: u8 = 1 << 3;
+
+const OP_OPENAT: u8 = 18;
+const OP_CLOSE: u8 = 19;
+const OP_STATX: u8 = 21;
+const OP_READ: u8 = 22;
+const OP_FADVISE: u8 = 24;
+const OPS: [u8; 5] = [OP_OPENAT, OP_CLOSE, OP_STATX, OP_READ, OP_FADVISE];
+
+/// 完成事件 `user_data` 的低位标记操作，高位为文件序号
+const TAG_BITS: u32 = 3;
+const TAG_OPEN: u64 = 0;
+const TAG_STATX: u64 = 1;
+const TAG_FADVISE: u64 = 2;
+const TAG_READ: u64 = 3;
+const TAG_CLOSE: u64 = 4;
+
+/// 单次读取的上限，`len` 字段只有 32 位
+const MAX_READ: usize = 1 << 30;
+
+#[repr(C)]
+#[derive(Default)]
+struct SqOffsets {
+    head: u32,
+    tail: u32,
+    ring_mask: u32,
+    ring_entries: u32,
+    flags: u32,
+    dropped: u32,
+    array: u32,
+    resv: u32,
+    user_addr: u64,
+}
+
+#[repr(C)]
+#[derive(Default)]
+struct CqOffsets {
+    head: u32,
+    tail: u32,
+    ring_mask: u32,
+    ring_entries: u32,
+    overflow: u32,
+    cqes: u32,
+    flags: u32,
+    resv: u32,
+    user_addr: u64,
+}
+
+#[repr(C)]
+#[derive(Default)]
+struct Params {
+    sq_entries: u32,
+    cq_entries: u32,
+    flags: u32,
+    sq_thread_cpu: u32,
+    sq_thread_idle: u32,
+    features: u32,
+    wq_fd: u32,
+    resv: [u32; 3],
+    sq_off: SqOffsets,
+    cq_off: CqOffsets,
+}
+
+#[repr(C)]
+#[derive(Default)]
+struct Sqe {
+    opcode: u8,
+    flags: u8,
+    ioprio: u16,
+    fd: i32,
+    off: u64,
+    addr: u64,
+    len: u32,
+    op_flags: u32,
+    user_data: u64,
+    buf_index: u16,
+    personality: u16,
+    file_index: i32,
+    addr3: u64,
+    pad: u64,
+}
+
+#[repr(C)]
+#[derive(Clone, Copy, Default)]
+struct ProbeOp {
+    op: u8,
+    resv: u8,
+    flags: u16,
+    resv2: u32,
+}
+
+/// `struct io_uring_probe`，后接 `PROBE_OPS` 个操作
+#[repr(C)]
+struct Probe {
+    last_op: u8,
+    ops_len: u8,
+    resv: u16,
+    resv2: [u32; 3],
+    ops: [ProbeOp; PROBE_OPS],
+}
+
+#[repr(C)]
+#[derive(Clone, Copy)]
+struct Cqe {
+    user_data: u64,
+    res: i32,
+    flags: u32,
+}
+
+/// `struct statx`，只读取其中的文件大小
+#[repr(C, align(8))]
+struct Statx {
+    head: [u8; 40],
+    size: u64,
+    tail: [u8; 208],
+}
+
+struct Mmap {
+    ptr: *mut u8,
+    len: usize,
+}
+
+impl Mmap {
+    fn new(fd: &OwnedFd, len: usize, offset: libc::off_t) -> io::Result<Self> {
+        let ptr = unsafe {
+            libc::mmap(
+                std::ptr::null_mut(),
+                len,
+                libc::PROT_READ | libc::PROT_WRITE,
+                libc::MAP_SHARED | libc::MAP_POPULATE,
+                fd.as_raw_fd(),
+                offset,
+            )
+        };
+        if ptr == libc::MAP_FAILED {
+            return Err(io::Error::last_os_error());
+        }
+        Ok(Self {
+            ptr: ptr as *mut u8,
+            len,
+        })
+    }
+
+    fn at<T>(&self, offset: u32) -> *mut T {
+        unsafe { self.ptr.add(offset as usize) as *mut T }
+    }
+}
+
+impl Drop for Mmap {
+    fn drop(&mut self) {
+        unsafe { libc::munmap(self.ptr as *mut libc::c_void, self.len) };
+    }
+}
+
+pub struct Ring {
+    sq: Mmap,
+    cq: Mmap,
+    sqes: Mmap,
+    sq_off: SqOffsets,
+    cq_off: CqOffsets,
+    sq_mask: u32,
+    cq_mask: u32,
+    sq_tail: u32,
+    to_submit: u32,
+    /// 最后释放，内核在映射解除前不会回收环
+    fd: OwnedFd,
+}
+
+/// 正在读取的文件
+struct Slot {
+    /// 打开完成前内核读取此路径
+    _path: CString,
+    fd: i32,
+    statx: Box<Statx>,
+    buf: Vec<u8>,
+}
+
+impl Ring {
+    /// 内核不支持或禁用 io_uring，或缺少所需的操作时返回错误
+    ///
+    /// 打开、查询大小与预读提示从 5.6 起才有，探测操作也从 5.6 起才有，
+    /// 更早的内核在探测时即返回错误。
+    pub fn new(entries: u32) -> io::Result<Self> {
+        let mut params = Params::default();
+        let fd = unsafe { libc::syscall(libc::SYS_io_uring_setup, entries, &mut params) };
+        if fd < 0 {
+            return Err(io::Error::last_os_error());
+        }
+        let fd = unsafe { OwnedFd::from_raw_fd(fd as i32) };
+        probe(&fd)?;
+
+        let sq_len = params.sq_off.array as usize + params.sq_entries as usize * 4;
+        let cq_len = params.cq_off.cqes as usize + params.cq_entries as usize * size_of::<Cqe>();
+        let sqes_len = params.sq_entries as usize * size_of::<Sqe>();
+        let sq = Mmap::new(&fd, sq_len, OFF_SQ_RING)?;
+        let cq = Mmap::new(&fd, cq_len, OFF_CQ_RING)?;
+        let sqes = Mmap::new(&fd, sqes_len, OFF_SQES)?;
+
+        let sq_mask = unsafe { *sq.at::<u32>(params.sq_off.ring_mask) };
+        let cq_mask = unsafe { *cq.at::<u32>(params.cq_off.ring_mask) };
+        let sq_tail = unsafe { *sq.at::<u32>(params.sq_off.tail) };
+        Ok(Self {
+            sq,
+            cq,
+            sqes,
+            sq_off: params.sq_off,
+            cq_off: params.cq_off,
+            sq_mask,
+            cq_mask,
+            sq_tail,
+            to_submit: 0,
+            fd,
+        })
+    }
+
+    fn atomic<'a>(ptr: *mut u32) -> &'a AtomicU32 {
+        unsafe { AtomicU32::from_ptr(ptr) }
+    }
+
+    fn push(&mut self, sqe: Sqe) -> io::Result<()> {
+        while self.to_submit > self.sq_mask {
+            self.enter(0)?;
+        }
+        let index = self.sq_tail & self.sq_mask;
+        unsafe {
+            self.sqes.at::<Sqe>(0).add(index as usize).write(sqe);
+            *self.sq.at::<u32>(self.sq_off.array).add(index as usize) = index;
+        }
+        self.sq_tail = self.sq_tail.wrapping_add(1);
+        Self::atomic(self.sq.at(self.sq_off.tail)).store(self.sq_tail, Ordering::Release);
+        self.to_submit += 1;
+        Ok(())
+    }
+
+    /// 提交所有操作并等待至少 `wait` 个完成
+    fn enter(&mut self, wait: u32) -> io::Result<()> {
+        loop {
+            let submitted = unsafe {
+                libc::syscall(
+                    libc::SYS_io_uring_enter,
+                    self.fd.as_raw_fd(),
+                    self.to_submit,
+                    wait,
+                    if wait > 0 { ENTER_GETEVENTS } else { 0 },
+                    std::ptr::null::<libc::sigset_t>(),
+                    0usize,
+                )
+            };
+            if submitted >= 0 {
+                self.to_submit -= submitted as u32;
+                return Ok(());
+            }
+            let e = io::Error::last_os_error();
+            if e.kind() != io::ErrorKind::Interrupted {
+                return Err(e);
+            }
+        }
+    }
+
+    fn reap(&mut self, cqes: &mut Vec<Cqe>) {
+        let head = Self::atomic(self.cq.at(self.cq_off.head));
+        let tail = Self::atomic(self.cq.at(self.cq_off.tail)).load(Ordering::Acquire);
+        let mut index = head.load(Ordering::Relaxed);
+        while index != tail {
+            let cqe = unsafe {
+                *self
+                    .cq
+                    .at::<Cqe>(self.cq_off.cqes)
+                    .add((index & self.cq_mask) as usize)
+            };
+            cqes.push(cqe);
+            index = index.wrapping_add(1);
+        }
+        head.store(index, Ordering::Release);
+    }
+
+    /// 读取所有文件，每个文件读完时以其序号调用 `done`
+    ///
+    /// 每个文件依次提交打开、查询大小、预读提示与读取、关闭，同时在途的文件不超过
+    /// `depth` 个。环本身出错时返回错误，此时尚未完成的文件不会调用 `done`。
+    pub fn read_all(
+        mut self,
+        paths: &[PathBuf],
+        depth: usize,
+        done: impl FnMut(usize, io::Result<String>),
+    ) -> io::Result<()> {
+        let mut slots = (0..paths.len())
+            .map(|_| None)
+            .collect::<Vec<Option<Slot>>>();
+        let result = self.drive(paths, depth, &mut slots, done);
+        if result.is_err() {
+            // 在途操作仍可能写入缓冲区，不能释放
+            std::mem::forget(slots);
+        }
+        result
+    }
+
+    fn drive(
+        &mut self,
+        paths: &[PathBuf],
+        depth: usize,
+        slots: &mut [Option<Slot>],
+        mut done: impl FnMut(usize, io::Result<String>),
+    ) -> io::Result<()> {
+        let empty = c"";
+        let (mut next, mut open, mut cqes) = (0, 0, Vec::new());
+        while next < paths.len() || open > 0 {
+            while next < paths.len() && open < depth {
+                let index = next;
+                next += 1;
+                let Ok(path) = CString::new(paths[index].as_os_str().as_bytes()) else {
+                    done(index, Err(io::ErrorKind::InvalidInput.into()));
+                    continue;
+                };
+                self.push(Sqe {
+                    opcode: OP_OPENAT,
+                    fd: libc::AT_FDCWD,
+                    addr: path.as_ptr() as u64,
+                    op_flags: (libc::O_RDONLY | libc::O_CLOEXEC) as u32,
+                    user_data: (index as u64) << TAG_BITS | TAG_OPEN,
+                    ..Default::default()
+                })?;
+                let statx = Box::new(Statx {
+                    head: [0; 40],
+                    size: 0,
+                    tail: [0; 208],
+                });
+                let buf = Vec::new();
+                slots[index] = Some(Slot {
+                    _path: path,
+                    fd: -1,
+                    statx,
+                    buf,
+                });
+                open += 1;
+            }
+            if open == 0 {
+                break;
+            }
+
+            self.enter(1)?;
+            cqes.clear();
+            self.reap(&mut cqes);
+            for cqe in &cqes {
+                let index = (cqe.user_data >> TAG_BITS) as usize;
+                let slot = slots[index].as_mut().unwrap();
+                match cqe.user_data & ((1 << TAG_BITS) - 1) {
+                    TAG_OPEN if cqe.res < 0 => {
+                        slots[index] = None;
+                        open -= 1;
+                        done(index, Err(io::Error::from_raw_os_error(-cqe.res)));
+                    }
+                    TAG_OPEN => {
+                        slot.fd = cqe.res;
+                        let sqe = Sqe {
+                            opcode: OP_STATX,
+                            fd: slot.fd,
+                            addr: empty.as_ptr() as u64,
+                            off: &mut *slot.statx as *mut Statx as u64,
+                            len: libc::STATX_SIZE,
+                            op_flags: libc::AT_EMPTY_PATH as u32,
+                            user_data: (index as u64) << TAG_BITS | TAG_STATX,
+                            ..Default::default()
+                        };
+                        self.push(sqe)?;
+                    }
+                    TAG_STATX if cqe.res < 0 => {
+                        done(index, Err(io::Error::from_raw_os_error(-cqe.res)));
+                        self.push(close(index, slot.fd))?;
+                    }
+                    TAG_STATX => {
+                        // 多留一个字节，确认到达末尾的那次读取不需要扩容
+                        let size = slot.statx.size as usize;
+                        slot.buf.reserve_exact(size + 1);
+                        self.push(Sqe {
+                            opcode: OP_FADVISE,
+                            flags: SQE_HARDLINK,
+                            fd: slot.fd,
+                            len: size.min(u32::MAX as usize) as u32,
+                            op_flags: libc::POSIX_FADV_WILLNEED as u32,
+                            user_data: (index as u64) << TAG_BITS | TAG_FADVISE,
+                            ..Default::default()
+                        })?;
+                        self.push(read(index, slot))?;
+                    }
+                    TAG_FADVISE => {}
+                    TAG_READ if cqe.res == -libc::EINTR || cqe.res == -libc::EAGAIN => {
+                        self.push(read(index, slot))?;
+                    }
+                    TAG_READ if cqe.res < 0 => {
+                        done(index, Err(io::Error::from_raw_os_error(-cqe.res)));
+                        self.push(close(index, slot.fd))?;
+                    }
+                    // 读取可能不足请求的长度，读到 0 字节才是末尾
+                    TAG_READ if cqe.res > 0 => {
+                        unsafe { slot.buf.set_len(slot.buf.len() + cqe.res as usize) };
+                        if slot.buf.len() == slot.buf.capacity() {
+                            // 文件在查询大小后变长
+                            slot.buf.reserve(slot.buf.len().max(4096));
+                        }
+                        self.push(read(index, slot))?;
+                    }
+                    TAG_READ => {
+                        let buf = std::mem::take(&mut slot.buf);
+                        let text = String::from_utf8(buf)
+                            .map_err(|e| io::Error::new(io::ErrorKind::InvalidData, e));
+                        done(index, text);
+                        self.push(close(index, slot.fd))?;
+                    }
+                    TAG_CLOSE => {
+                        slots[index] = None;
+                        open -= 1;
+                    }
+                    _ => unreachable!(),
+                }
+            }
+        }
+        Ok(())
+    }
+}
+
+/// 检查所需的操作是否都受支持
+fn probe(fd: &OwnedFd) -> io::Result<()> {
+    let mut probe = Probe {
+        last_op: 0,
+        ops_len: 0,
+        resv: 0,
+        resv2: [0; 3],
+        ops: [ProbeOp::default(); PROBE_OPS],
+    };
+    let result = unsafe {
+        libc::syscall(
+            libc::SYS_io_uring_register,
+            fd.as_raw_fd(),
+            REGISTER_PROBE,
+            &mut probe as *mut Probe,
+            PROBE_OPS as u32,
+        )
+    };
+    if result < 0 {
+        return Err(io::Error::last_os_error());
+    }
+    let supported = |op: u8| {
+        op <= probe.last_op
+            && (op as usize) < probe.ops_len as usize
+            && probe.ops[op as usize].flags & OP_SUPPORTED != 0
+    };
+    if !OPS.into_iter().all(supported) {
+        return Err(io::ErrorKind::Unsupported.into());
+    }
+    Ok(())
+}
+
+fn read(index: usize, slot: &mut Slot) -> Sqe {
+    let len = (slot.buf.capacity() - slot.buf.len()).min(MAX_READ);
+    Sqe {
+        opcode: OP_READ,
+        fd: slot.fd,
+        off: slot.buf.len() as u64,
+        addr: unsafe { slot.buf.as_mut_ptr().add(slot.buf.len()) } as u64,
+        len: len as u32,
+        user_data: (index as u64) << TAG_BITS | TAG_READ,
+        ..Default::default()
+    }
+}
+
+fn close(index: usize, fd: i32) -> Sqe {
+    Sqe {
+        opcode: OP_CLOSE,
+        fd,
+        user_data: (index as u64) << TAG_BITS | TAG_CLOSE,
+        ..Default::default()
+    }
+}
@@ -0,0 +1,144 @@
+pub mod fold;
+pub mod fp;
+pub mod inline;
+pub mod ladder;
+pub mod loops;
+pub mod lto;
+pub mod specialize;
+
+use super::{
+    ast::{Expr, ExprKind, FpMode, Stmt, StmtKind},
+    visit::{self, Cx, Pass},
+};
+use std::collections::HashMap;
+
+/// `fp` 为默认浮点语义，源文件开头的 `#!fp` 指令与 `def` 上的标注优先
+pub fn optimize(src: &str, stmts: &mut [Stmt], fp: FpMode) {
+    let mode = fp::module_mode(src).unwrap_or(fp);
+    fp::resolve(stmts, mode);
+    fold::fold_stmts_in(stmts, mode);
+    specialize::specialize(src, stmts, &specialize::Options::default());
+    inline::inline_loops(src, stmts, mode, &inline::Options::default());
+    loops::optimize_loops(src, stmts, mode, &loops::Options::default());
+    fold::fold_stmts_in(stmts, mode);
+    ladder::lower_ladders(src, stmts);
+}
+
+/// 只做单条语句内的优化，供流式编译在丢弃语法树前调用
+pub fn optimize_stmt(src: &str, stmt: &mut Stmt, fp: FpMode) {
+    let stmts = std::slice::from_mut(stmt);
+    fp::resolve(stmts, fp);
+    fold::fold_stmts_in(stmts, fp);
+    ladder::lower_ladders(src, stmts);
+}
+
+fn ident<'s>(src: &'s str, expr: &Expr) -> Option<&'s str> {
+    match expr.kind {
+        ExprKind::Ident => Some(&src[expr.span.start..expr.span.end]),
+        _ => None,
+    }
+}
+
+/// 将标识符同时替换为对应表达式，替换结果不会再次被替换
+fn substitute_expr(src: &str, expr: &mut Expr, subst: &HashMap<&str, Expr>) {
+    match &mut expr.kind {
+        ExprKind::Ident => {
+            if let Some(value) = ident(src, expr).and_then(|name| subst.get(name)) {
+                *expr = value.clone();
+            }
+        }
+        ExprKind::Ellipsis | ExprKind::Lit(_) => {}
+        ExprKind::Parented(inner) | ExprKind::UnOp { arg: inner, .. } => {
+            substitute_expr(src, inner, subst)
+        }
+        ExprKind::Block(stmts) => {
+            for stmt in stmts {
+                substitute_stmt(src, stmt, subst);
+            }
+        }
+        // 被调用者是函数名而非参数
+        ExprKind::Call { args, .. } => {
+            for arg in args {
+                substitute_expr(src, arg, subst);
+            }
+        }
+        ExprKind::BinOp { left, right, .. } => {
+            substitute_expr(src, left, subst);
+            substitute_expr(src, right, subst);
+        }
+        ExprKind::If {
+            if_then_exprs,
+            else_branch,
+            ..
+        } => {
+            for if_then in if_then_exprs {
+                substitute_expr(src, &mut if_then.cond, subst);
+                substitute_expr(src, &mut if_then.then, subst);
+            }
+            if let Some(else_expr) = else_branch {
+                substitute_expr(src, &mut else_expr.expr, subst);
+            }
+        }
+        ExprKind::Switch {
+            scrutinee,
+            cases,
+            default,
+            ..
+        } => {
+            substitute_expr(src, scrutinee, subst);
+            for case in cases {
+                substitute_expr(src, &mut case.expr, subst);
+            }
+            if let Some(default) = default {
+                substitute_expr(src, default, subst);
+            }
+        }
+    }
+}
+
+fn substitute_stmt(src: &str, stmt: &mut Stmt, subst: &HashMap<&str, Expr>) {
+    match &mut stmt.kind {
+        StmtKind::Assign { right, .. } => substitute_expr(src, right, subst),
+        StmtKind::Def { body, .. } => substitute_expr(src, body, subst),
+        StmtKind::Expr(expr) | StmtKind::Return(expr) => substitute_expr(src, expr, subst),
+        StmtKind::For {
+            loop_iter,
+            loop_body,
+            ..
+        } => {
+            substitute_expr(src, loop_iter, subst);
+            substitute_expr(src, loop_body, subst);
+        }
+        StmtKind::Break | StmtKind::Continue | StmtKind::Empty | StmtKind::Extern { .. } => {}
+    }
+}
+
+/// 语句与表达式的节点数
+pub(super) fn size_expr(src: &str, expr: &Expr) -> usize {
+    let Ok(((Size(size),), _)) = visit::run_expr(src, expr, (Size(0),)) else {
+        unreachable!()
+    };
+    size
+}
+
+pub(super) fn size_stmt(src: &str, stmt: &Stmt) -> usize {
+    let stmts = std::slice::from_ref(stmt);
+    let Ok(((Size(size),), _)) = visit::run(src, stmts, (Size(0),)) else {
+        unreachable!()
+    };
+    size
+}
+
+pub(super) struct Size(pub(super) usize);
+
+impl<'a> Pass<'a> for Size {
+    const NAME: &'static str = "size";
+
+    fn enter_stmt(&mut self, _cx: &mut Cx<'a>, _stmt: &'a Stmt) {
+        self.0 += 1;
+    }
+
+    fn enter_expr(&mut self, _cx: &mut Cx<'a>, _expr: &'a Expr) {
+        self.0 += 1;
+    }
+}
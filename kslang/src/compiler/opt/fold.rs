@@ -0,0 +1,349 @@
+use super::{
+    super::{
+        CodeSpan,
+        ast::{Expr, ExprKind, FpMode, Stmt, StmtKind},
+        lexer::Operator,
+    },
+    inline::pure_arg,
+};
+
+pub fn fold_stmts(stmts: &mut [Stmt]) {
+    fold_stmts_in(stmts, FpMode::Strict);
+}
+
+pub fn fold_stmt(stmt: &mut Stmt) {
+    fold_stmt_in(stmt, FpMode::Strict);
+}
+
+pub fn fold_expr(expr: &mut Expr) {
+    fold_expr_in(expr, FpMode::Strict);
+}
+
+/// 按 `mode` 折叠，`def` 标注的浮点语义优先
+pub fn fold_stmts_in(stmts: &mut [Stmt], mode: FpMode) {
+    for stmt in stmts {
+        fold_stmt_in(stmt, mode);
+    }
+}
+
+pub fn fold_stmt_in(stmt: &mut Stmt, mode: FpMode) {
+    match &mut stmt.kind {
+        StmtKind::Assign { right, .. } => fold_expr_in(right, mode),
+        StmtKind::Def { body, fp, .. } => fold_expr_in(body, fp.unwrap_or(mode)),
+        StmtKind::Expr(expr) | StmtKind::Return(expr) => fold_expr_in(expr, mode),
+        StmtKind::For {
+            loop_iter,
+            loop_body,
+            ..
+        } => {
+            fold_expr_in(loop_iter, mode);
+            fold_expr_in(loop_body, mode);
+        }
+        StmtKind::Break | StmtKind::Continue | StmtKind::Empty | StmtKind::Extern { .. } => {}
+    }
+}
+
+pub fn fold_expr_in(expr: &mut Expr, mode: FpMode) {
+    let span = expr.span;
+    let at = |kind| Expr { kind, span };
+    // 结果为子表达式时沿用其自身的位置，标识符依赖位置取名
+    let folded = match &mut expr.kind {
+        ExprKind::Ident | ExprKind::Ellipsis | ExprKind::Lit(_) => None,
+        ExprKind::Parented(inner) => {
+            fold_expr_in(inner, mode);
+            lit(inner).map(ExprKind::Lit).map(at)
+        }
+        ExprKind::Block(stmts) => {
+            fold_stmts_in(stmts, mode);
+            None
+        }
+        ExprKind::Call { args, .. } => {
+            args.iter_mut().for_each(|arg| fold_expr_in(arg, mode));
+            None
+        }
+        ExprKind::UnOp { op, arg, .. } => {
+            fold_expr_in(arg, mode);
+            lit(arg)
+                .and_then(|v| eval_unop(*op, v))
+                .map(ExprKind::Lit)
+                .map(at)
+        }
+        ExprKind::BinOp {
+            op, left, right, ..
+        } => fold_binop(*op, left, right, span, mode),
+        ExprKind::If {
+            if_then_exprs,
+            if_then_span,
+            else_branch,
+        } => {
+            for if_then in if_then_exprs.iter_mut() {
+                fold_expr_in(&mut if_then.cond, mode);
+                fold_expr_in(&mut if_then.then, mode);
+            }
+            if let Some(else_expr) = else_branch {
+                fold_expr_in(&mut else_expr.expr, mode);
+            }
+
+            if_then_exprs.retain(|if_then| lit(&if_then.cond).is_none_or(truthy));
+            match if_then_exprs.first() {
+                None => Some(match else_branch.take() {
+                    Some(else_expr) => else_expr.expr,
+                    None => at(ExprKind::Lit(0.0)),
+                }),
+                Some(first) if lit(&first.cond).is_some() => {
+                    Some(if_then_exprs.swap_remove(0).then)
+                }
+                Some(first) => {
+                    *if_then_span = first.span.merge(if_then_exprs.last().unwrap().span);
+                    None
+                }
+            }
+        }
+        ExprKind::Switch {
+            scrutinee,
+            cases,
+            default,
+            ..
+        } => {
+            fold_expr_in(scrutinee, mode);
+            for case in cases.iter_mut() {
+                fold_expr_in(&mut case.expr, mode);
+            }
+            if let Some(default) = default {
+                fold_expr_in(default, mode);
+            }
+
+            lit(scrutinee).map(
+                |value| match cases.iter().position(|case| case.value == value) {
+                    Some(index) => cases.swap_remove(index).expr,
+                    None => default
+                        .take()
+                        .map_or(at(ExprKind::Lit(0.0)), |default| *default),
+                },
+            )
+        }
+    };
+
+    if let Some(folded) = folded {
+        *expr = folded;
+    }
+}
+
+fn fold_binop(
+    op: Operator,
+    left: &mut Box<Expr>,
+    right: &mut Box<Expr>,
+    span: CodeSpan,
+    mode: FpMode,
+) -> Option<Expr> {
+    // 允许融合时先保留乘法节点，使 `a * b + c` 只舍入一次
+    let fusable = mode != FpMode::Strict && matches!(op, Operator::Add | Operator::Sub);
+    for side in [&mut *left, &mut *right] {
+        match &mut side.kind {
+            ExprKind::BinOp {
+                op: Operator::Mul,
+                left,
+                right,
+                ..
+            } if fusable => {
+                fold_expr_in(left, mode);
+                fold_expr_in(right, mode);
+            }
+            _ => fold_expr_in(side, mode),
+        }
+    }
+
+    if fusable {
+        let fused = match (op, product(left), lit(right), lit(left), product(right)) {
+            (Operator::Add, Some((a, b)), Some(c), ..) => Some(a.mul_add(b, c)),
+            (Operator::Sub, Some((a, b)), Some(c), ..) => Some(a.mul_add(b, -c)),
+            (Operator::Add, _, _, Some(c), Some((a, b))) => Some(a.mul_add(b, c)),
+            (Operator::Sub, _, _, Some(c), Some((a, b))) => Some((-a).mul_add(b, c)),
+            _ => None,
+        };
+        if let Some(value) = fused {
+            return Some(Expr {
+                kind: ExprKind::Lit(value),
+                span,
+            });
+        }
+
+        // 未能融合的乘法节点，其操作数已经折叠
+        for side in [&mut *left, &mut *right] {
+            let span = side.span;
+            if let ExprKind::BinOp {
+                op: Operator::Mul,
+                left,
+                right,
+                ..
+            } = &mut side.kind
+            {
+                if let Some(folded) = combine(Operator::Mul, left, right, span, mode) {
+                    **side = folded;
+                }
+            }
+        }
+    }
+
+    combine(op, left, right, span, mode)
+}
+
+/// 操作数均已折叠后化简当前节点
+fn combine(
+    op: Operator,
+    left: &mut Box<Expr>,
+    right: &mut Box<Expr>,
+    span: CodeSpan,
+    mode: FpMode,
+) -> Option<Expr> {
+    let value = match (op, lit(left), lit(right)) {
+        (op, Some(l), Some(r)) => eval_binop(op, l, r)?,
+        // `&&` 与 `||` 短路求值，右侧不会被执行
+        (Operator::And, Some(l), None) if !truthy(l) => 0.0,
+        (Operator::Or, Some(l), None) if truthy(l) => 1.0,
+        _ if mode == FpMode::Fast => return reassociate(op, left, right, span),
+        _ => return None,
+    };
+    Some(Expr {
+        kind: ExprKind::Lit(value),
+        span,
+    })
+}
+
+/// 两个操作数均为字面量的乘法
+fn product(expr: &Expr) -> Option<(f64, f64)> {
+    match &expr.kind {
+        ExprKind::BinOp {
+            op: Operator::Mul,
+            left,
+            right,
+            ..
+        } => Some((lit(left)?, lit(right)?)),
+        _ => None,
+    }
+}
+
+/// 快速模式下的代数化简，只在一侧为字面量时进行
+fn reassociate(
+    op: Operator,
+    left: &mut Box<Expr>,
+    right: &mut Box<Expr>,
+    span: CodeSpan,
+) -> Option<Expr> {
+    let take = |expr: &mut Box<Expr>| {
+        let span = expr.span;
+        std::mem::replace(
+            &mut **expr,
+            Expr {
+                kind: ExprKind::Ellipsis,
+                span,
+            },
+        )
+    };
+
+    match (op, lit(left), lit(right)) {
+        // x + 0、x - 0、x * 1、x / 1
+        (Operator::Add | Operator::Sub, None, Some(0.0))
+        | (Operator::Mul | Operator::Div, None, Some(1.0)) => Some(take(left)),
+        (Operator::Add, Some(0.0), None) | (Operator::Mul, Some(1.0), None) => Some(take(right)),
+        // 另一侧有副作用时不能删除
+        (Operator::Mul, Some(0.0), None) if pure_arg(right) => Some(Expr {
+            kind: ExprKind::Lit(0.0),
+            span,
+        }),
+        (Operator::Mul, None, Some(0.0)) if pure_arg(left) => Some(Expr {
+            kind: ExprKind::Lit(0.0),
+            span,
+        }),
+        // x - K => x + (-K)，x / K => x * (1 / K)
+        (Operator::Sub, None, Some(k)) => Some(binop(Operator::Add, take(left), -k, span)),
+        (Operator::Div, None, Some(k)) if k != 0.0 => {
+            Some(binop(Operator::Mul, take(left), 1.0 / k, span))
+        }
+        // K + x => x + K，K * x => x * K
+        (Operator::Add | Operator::Mul, Some(k), None) => Some(regroup(op, take(right), k, span)),
+        (Operator::Add | Operator::Mul, None, Some(k)) => Some(regroup(op, take(left), k, span)),
+        _ => None,
+    }
+}
+
+/// (x op K1) op K2 => x op (K1 op K2)
+fn regroup(op: Operator, mut expr: Expr, k: f64, span: CodeSpan) -> Expr {
+    while let ExprKind::Parented(inner) = expr.kind {
+        expr = *inner;
+    }
+    if let ExprKind::BinOp {
+        op: inner,
+        left,
+        right,
+        ..
+    } = &expr.kind
+    {
+        if *inner == op {
+            if let (None, Some(k1)) = (lit(left), lit(right)) {
+                let value = eval_binop(op, k1, k).unwrap();
+                return binop(op, (**left).clone(), value, span);
+            }
+        }
+    }
+    binop(op, expr, k, span)
+}
+
+fn binop(op: Operator, left: Expr, value: f64, span: CodeSpan) -> Expr {
+    let op_span = left.span;
+    Expr {
+        kind: ExprKind::BinOp {
+            op,
+            op_span,
+            left: Box::new(left),
+            right: Box::new(Expr {
+                kind: ExprKind::Lit(value),
+                span: op_span,
+            }),
+        },
+        span,
+    }
+}
+
+pub fn lit(expr: &Expr) -> Option<f64> {
+    match expr.kind {
+        ExprKind::Lit(value) => Some(value),
+        _ => None,
+    }
+}
+
+#[inline(always)]
+pub const fn truthy(value: f64) -> bool {
+    value != 0.0
+}
+
+#[inline(always)]
+const fn bool_value(value: bool) -> f64 {
+    if value { 1.0 } else { 0.0 }
+}
+
+pub fn eval_unop(op: Operator, arg: f64) -> Option<f64> {
+    match op {
+        Operator::Sub => Some(-arg),
+        Operator::Not => Some(bool_value(!truthy(arg))),
+        _ => None,
+    }
+}
+
+pub fn eval_binop(op: Operator, left: f64, right: f64) -> Option<f64> {
+    Some(match op {
+        Operator::Add => left + right,
+        Operator::Sub => left - right,
+        Operator::Mul => left * right,
+        Operator::Div => left / right,
+        Operator::Eq => bool_value(left == right),
+        Operator::Ne => bool_value(left != right),
+        Operator::Gt => bool_value(left > right),
+        Operator::Ge => bool_value(left >= right),
+        Operator::Lt => bool_value(left < right),
+        Operator::Le => bool_value(left <= right),
+        Operator::And => bool_value(truthy(left) && truthy(right)),
+        Operator::Or => bool_value(truthy(left) || truthy(right)),
+        Operator::Assign | Operator::Not | Operator::Range => return None,
+    })
+}
@@ -0,0 +1,92 @@
+use super::super::ast::{Expr, ExprKind, FpMode, Stmt, StmtKind};
+
+/// 文件开头注释中的 `#!fp <mode>`，作为模块内未标注函数的浮点语义
+pub fn module_mode(src: &str) -> Option<FpMode> {
+    let mut mode = None;
+    for line in src.lines().map(str::trim) {
+        if line.is_empty() {
+            continue;
+        }
+        let Some(comment) = line.strip_prefix('#') else {
+            break;
+        };
+        if let Some(name) = comment.strip_prefix("!fp") {
+            mode = FpMode::from_name(name.trim()).or(mode);
+        }
+    }
+    mode
+}
+
+/// 为每个 `def` 填入生效的浮点语义：自身标注优先，其次为外层函数，最后为 `mode`
+///
+/// 处理后的语法树中所有 `def` 的 `fp` 均为 `Some`，后续各遍与后端直接读取即可。
+pub fn resolve(stmts: &mut [Stmt], mode: FpMode) {
+    for stmt in stmts {
+        resolve_stmt(stmt, mode);
+    }
+}
+
+fn resolve_stmt(stmt: &mut Stmt, mode: FpMode) {
+    match &mut stmt.kind {
+        StmtKind::Def { body, fp, .. } => {
+            let mode = *fp.get_or_insert(mode);
+            resolve_expr(body, mode);
+        }
+        StmtKind::Assign { right: expr, .. } | StmtKind::Expr(expr) | StmtKind::Return(expr) => {
+            resolve_expr(expr, mode)
+        }
+        StmtKind::For {
+            loop_iter,
+            loop_body,
+            ..
+        } => {
+            resolve_expr(loop_iter, mode);
+            resolve_expr(loop_body, mode);
+        }
+        StmtKind::Break | StmtKind::Continue | StmtKind::Empty | StmtKind::Extern { .. } => {}
+    }
+}
+
+fn resolve_expr(expr: &mut Expr, mode: FpMode) {
+    match &mut expr.kind {
+        ExprKind::Ident | ExprKind::Ellipsis | ExprKind::Lit(_) => {}
+        ExprKind::Parented(inner) | ExprKind::UnOp { arg: inner, .. } => resolve_expr(inner, mode),
+        ExprKind::Block(stmts) => resolve(stmts, mode),
+        ExprKind::Call { args, .. } => {
+            for arg in args {
+                resolve_expr(arg, mode);
+            }
+        }
+        ExprKind::BinOp { left, right, .. } => {
+            resolve_expr(left, mode);
+            resolve_expr(right, mode);
+        }
+        ExprKind::If {
+            if_then_exprs,
+            else_branch,
+            ..
+        } => {
+            for if_then in if_then_exprs {
+                resolve_expr(&mut if_then.cond, mode);
+                resolve_expr(&mut if_then.then, mode);
+            }
+            if let Some(else_expr) = else_branch {
+                resolve_expr(&mut else_expr.expr, mode);
+            }
+        }
+        ExprKind::Switch {
+            scrutinee,
+            cases,
+            default,
+            ..
+        } => {
+            resolve_expr(scrutinee, mode);
+            for case in cases {
+                resolve_expr(&mut case.expr, mode);
+            }
+            if let Some(default) = default {
+                resolve_expr(default, mode);
+            }
+        }
+    }
+}
@@ -0,0 +1,347 @@
+use super::{
+    super::{
+        ast::{Expr, ExprKind, FpMode, Stmt, StmtKind},
+        visit::{self, Cx, Pass},
+    },
+    ident, size_expr, substitute_expr,
+};
+use std::collections::{HashMap, HashSet};
+
+pub struct Options {
+    /// 可展开函数体的最大节点数
+    pub max_size: usize,
+    /// 沿调用链展开的最大深度
+    pub max_depth: usize,
+}
+
+impl Default for Options {
+    fn default() -> Self {
+        Self {
+            max_size: 32,
+            max_depth: 4,
+        }
+    }
+}
+
+struct Callee<'s> {
+    params: Vec<&'s str>,
+    body: Expr,
+    fp: FpMode,
+}
+
+/// 展开 `for` 循环体内对小函数的调用
+///
+/// 循环体沿调用链逐层展开，得到一段不跨越函数边界的连续代码，
+/// 其中的 `if` 条件在实参为常量时由常量折叠消去。`mode` 为顶层代码的浮点语义，
+/// 只展开浮点语义与调用方相同的函数。
+pub fn inline_loops(src: &str, stmts: &mut [Stmt], mode: FpMode, opts: &Options) {
+    let callees = callees(src, stmts, opts);
+    if callees.is_empty() {
+        return;
+    }
+
+    for stmt in stmts.iter_mut() {
+        inline_stmt(src, stmt, &callees, opts, mode, false);
+    }
+}
+
+fn callees<'s>(src: &'s str, stmts: &[Stmt], opts: &Options) -> HashMap<&'s str, Callee<'s>> {
+    let Ok((
+        (Defined {
+            defined, shadowed, ..
+        },),
+        _,
+    )) = visit::run(src, stmts, (Defined::default(),))
+    else {
+        unreachable!()
+    };
+
+    let mut callees = HashMap::new();
+    for stmt in stmts {
+        let StmtKind::Def {
+            ident: name,
+            args,
+            body,
+            fp,
+            ..
+        } = &stmt.kind
+        else {
+            continue;
+        };
+
+        let name = &src[name.span.start..name.span.end];
+        if defined[name] > 1 || shadowed.contains(name) || size_expr(src, body) > opts.max_size {
+            continue;
+        }
+
+        let Some(params) = args
+            .iter()
+            .map(|arg| ident(src, arg))
+            .collect::<Option<Vec<_>>>()
+        else {
+            continue;
+        };
+
+        if inlinable(src, body, name, &params, &shadowed) {
+            let body = body.clone();
+            let fp = fp.unwrap_or_default();
+            callees.insert(name, Callee { params, body, fp });
+        }
+    }
+    callees
+}
+
+/// 函数体只引用形参、不产生新的绑定且不直接递归时才能展开到调用点
+fn inlinable(
+    src: &str,
+    expr: &Expr,
+    name: &str,
+    params: &[&str],
+    shadowed: &HashSet<&str>,
+) -> bool {
+    let pass = Inlinable {
+        name,
+        params,
+        shadowed,
+        ok: true,
+    };
+    let Ok(((pass,), _)) = visit::run_expr(src, expr, (pass,)) else {
+        unreachable!()
+    };
+    pass.ok
+}
+
+/// 顶层 `def` 的定义次数与其余各层定义的名称
+#[derive(Default)]
+pub(super) struct Defined<'s> {
+    defined: HashMap<&'s str, usize>,
+    pub(super) shadowed: HashSet<&'s str>,
+    /// 所在的语句块层数，顶层语句不在语句块中
+    blocks: usize,
+}
+
+impl<'s> Pass<'s> for Defined<'s> {
+    const NAME: &'static str = "defined";
+
+    fn enter_stmt(&mut self, cx: &mut Cx<'s>, stmt: &'s Stmt) {
+        let StmtKind::Def { ident, .. } = &stmt.kind else {
+            return;
+        };
+        let name = cx.text(ident);
+        if cx.defs.is_empty() && self.blocks == 0 {
+            *self.defined.entry(name).or_default() += 1;
+        } else {
+            self.shadowed.insert(name);
+        }
+    }
+
+    fn enter_expr(&mut self, _cx: &mut Cx<'s>, expr: &'s Expr) {
+        self.blocks += usize::from(matches!(expr.kind, ExprKind::Block(_)));
+    }
+
+    fn leave_expr(&mut self, _cx: &mut Cx<'s>, expr: &'s Expr) {
+        self.blocks -= usize::from(matches!(expr.kind, ExprKind::Block(_)));
+    }
+}
+
+struct Inlinable<'p> {
+    name: &'p str,
+    params: &'p [&'p str],
+    shadowed: &'p HashSet<&'p str>,
+    ok: bool,
+}
+
+impl<'e> Pass<'e> for Inlinable<'_> {
+    const NAME: &'static str = "inlinable";
+
+    fn enter_expr(&mut self, cx: &mut Cx<'e>, expr: &'e Expr) {
+        self.ok &= match &expr.kind {
+            ExprKind::Ident => self.params.contains(&cx.text(expr)),
+            ExprKind::Ellipsis | ExprKind::Block(_) => false,
+            ExprKind::Call { callee, .. } => {
+                ident(cx.src, callee).is_some_and(|n| n != self.name && !self.shadowed.contains(n))
+            }
+            _ => true,
+        };
+    }
+}
+
+/// 无副作用的实参可以直接代入函数体
+pub(super) fn pure_arg(expr: &Expr) -> bool {
+    match &expr.kind {
+        ExprKind::Ident | ExprKind::Lit(_) => true,
+        ExprKind::Parented(inner) | ExprKind::UnOp { arg: inner, .. } => pure_arg(inner),
+        ExprKind::BinOp { left, right, .. } => pure_arg(left) && pure_arg(right),
+        _ => false,
+    }
+}
+
+pub(super) fn uses(src: &str, expr: &Expr, name: &str) -> usize {
+    let names = [name];
+    let Ok(((uses,), _)) = visit::run_expr(src, expr, (Uses::new(&names),)) else {
+        unreachable!()
+    };
+    uses.counts[0]
+}
+
+/// 各名称在语句块之外被读取的次数
+pub(super) struct Uses<'n> {
+    names: &'n [&'n str],
+    pub(super) counts: Vec<usize>,
+    blocks: usize,
+}
+
+impl<'n> Uses<'n> {
+    pub(super) fn new(names: &'n [&'n str]) -> Self {
+        Self {
+            names,
+            counts: vec![0; names.len()],
+            blocks: 0,
+        }
+    }
+}
+
+impl<'e> Pass<'e> for Uses<'_> {
+    const NAME: &'static str = "uses";
+
+    fn enter_expr(&mut self, cx: &mut Cx<'e>, expr: &'e Expr) {
+        match expr.kind {
+            ExprKind::Block(_) => self.blocks += 1,
+            ExprKind::Ident if self.blocks == 0 => {
+                let name = cx.text(expr);
+                for (count, _) in
+                    (self.counts.iter_mut().zip(self.names)).filter(|(_, n)| **n == name)
+                {
+                    *count += 1;
+                }
+            }
+            _ => {}
+        }
+    }
+
+    fn leave_expr(&mut self, _cx: &mut Cx<'e>, expr: &'e Expr) {
+        self.blocks -= usize::from(matches!(expr.kind, ExprKind::Block(_)));
+    }
+}
+
+fn inline_stmt(
+    src: &str,
+    stmt: &mut Stmt,
+    callees: &HashMap<&str, Callee>,
+    opts: &Options,
+    mode: FpMode,
+    in_loop: bool,
+) {
+    match &mut stmt.kind {
+        StmtKind::Assign { right: expr, .. } | StmtKind::Expr(expr) | StmtKind::Return(expr) => {
+            inline_expr(src, expr, callees, opts, mode, in_loop, 0)
+        }
+        // 内层函数体不在循环中执行
+        StmtKind::Def { body, fp, .. } => {
+            inline_expr(src, body, callees, opts, fp.unwrap_or(mode), false, 0)
+        }
+        StmtKind::For {
+            loop_iter,
+            loop_body,
+            ..
+        } => {
+            inline_expr(src, loop_iter, callees, opts, mode, in_loop, 0);
+            inline_expr(src, loop_body, callees, opts, mode, true, 0);
+        }
+        StmtKind::Break | StmtKind::Continue | StmtKind::Empty | StmtKind::Extern { .. } => {}
+    }
+}
+
+fn inline_expr(
+    src: &str,
+    expr: &mut Expr,
+    callees: &HashMap<&str, Callee>,
+    opts: &Options,
+    mode: FpMode,
+    in_loop: bool,
+    depth: usize,
+) {
+    match &mut expr.kind {
+        ExprKind::Ident | ExprKind::Ellipsis | ExprKind::Lit(_) => {}
+        ExprKind::Parented(inner) | ExprKind::UnOp { arg: inner, .. } => {
+            inline_expr(src, inner, callees, opts, mode, in_loop, depth)
+        }
+        ExprKind::Block(stmts) => {
+            for stmt in stmts {
+                inline_stmt(src, stmt, callees, opts, mode, in_loop);
+            }
+        }
+        ExprKind::BinOp { left, right, .. } => {
+            inline_expr(src, left, callees, opts, mode, in_loop, depth);
+            inline_expr(src, right, callees, opts, mode, in_loop, depth);
+        }
+        ExprKind::If {
+            if_then_exprs,
+            else_branch,
+            ..
+        } => {
+            for if_then in if_then_exprs {
+                inline_expr(src, &mut if_then.cond, callees, opts, mode, in_loop, depth);
+                inline_expr(src, &mut if_then.then, callees, opts, mode, in_loop, depth);
+            }
+            if let Some(else_expr) = else_branch {
+                inline_expr(
+                    src,
+                    &mut else_expr.expr,
+                    callees,
+                    opts,
+                    mode,
+                    in_loop,
+                    depth,
+                );
+            }
+        }
+        ExprKind::Switch {
+            scrutinee,
+            cases,
+            default,
+            ..
+        } => {
+            inline_expr(src, scrutinee, callees, opts, mode, in_loop, depth);
+            for case in cases {
+                inline_expr(src, &mut case.expr, callees, opts, mode, in_loop, depth);
+            }
+            if let Some(default) = default {
+                inline_expr(src, default, callees, opts, mode, in_loop, depth);
+            }
+        }
+        ExprKind::Call { callee, args, .. } => {
+            for arg in args.iter_mut() {
+                inline_expr(src, arg, callees, opts, mode, in_loop, depth);
+            }
+
+            if !in_loop || depth >= opts.max_depth {
+                return;
+            }
+            let Some(Callee { params, body, fp }) = ident(src, callee).and_then(|n| callees.get(n))
+            else {
+                return;
+            };
+            // 浮点语义不同的函数体展开后会按调用方的语义折叠
+            if *fp != mode || params.len() != args.len() {
+                return;
+            }
+
+            // 非平凡实参只在形参恰好使用一次时代入，避免重复求值
+            let substitutable = params.iter().zip(args.iter()).all(|(param, arg)| {
+                pure_arg(arg)
+                    && (matches!(arg.kind, ExprKind::Ident | ExprKind::Lit(_))
+                        || uses(src, body, param) == 1)
+            });
+            if !substitutable {
+                return;
+            }
+
+            let subst = params.iter().copied().zip(args.drain(..)).collect();
+            let mut inlined = body.clone();
+            substitute_expr(src, &mut inlined, &subst);
+            inline_expr(src, &mut inlined, callees, opts, mode, in_loop, depth + 1);
+            *expr = inlined;
+        }
+    }
+}
@@ -0,0 +1,245 @@
+use super::{
+    super::{
+        ast::{ElseExpr, Expr, ExprKind, Stmt, StmtKind, SwitchCase},
+        lexer::Operator,
+    },
+    fold, ident,
+};
+
+/// 降级为 `Switch` 所需的最少连续分支数
+pub const MIN_ARMS: usize = 4;
+/// 跳转表允许的最大值域
+pub const MAX_TABLE: f64 = 4096.0;
+
+/// 将 `if x == K1 then ... else if x == K2 then ...` 分支链降级为多路分派
+///
+/// 连续比较同一变量与不同常量的分支合并为一个 `Switch`：常量为稠密整数时
+/// 标记为跳转表，否则由后端按有序常量做二分查找。链前不符合形式的分支保留为
+/// `if`，链后的分支与 `else` 一起作为 `Switch` 的默认分支。
+pub fn lower_ladders(src: &str, stmts: &mut [Stmt]) {
+    for stmt in stmts {
+        lower_stmt(src, stmt);
+    }
+}
+
+fn lower_stmt(src: &str, stmt: &mut Stmt) {
+    match &mut stmt.kind {
+        StmtKind::Assign { right: expr, .. }
+        | StmtKind::Def { body: expr, .. }
+        | StmtKind::Expr(expr)
+        | StmtKind::Return(expr) => lower_expr(src, expr),
+        StmtKind::For {
+            loop_iter,
+            loop_body,
+            ..
+        } => {
+            lower_expr(src, loop_iter);
+            lower_expr(src, loop_body);
+        }
+        StmtKind::Break | StmtKind::Continue | StmtKind::Empty | StmtKind::Extern { .. } => {}
+    }
+}
+
+fn lower_expr(src: &str, expr: &mut Expr) {
+    match &mut expr.kind {
+        ExprKind::Ident | ExprKind::Ellipsis | ExprKind::Lit(_) => {}
+        ExprKind::Parented(inner) | ExprKind::UnOp { arg: inner, .. } => lower_expr(src, inner),
+        ExprKind::Block(stmts) => lower_ladders(src, stmts),
+        ExprKind::Call { args, .. } => {
+            for arg in args {
+                lower_expr(src, arg);
+            }
+        }
+        ExprKind::BinOp { left, right, .. } => {
+            lower_expr(src, left);
+            lower_expr(src, right);
+        }
+        ExprKind::If {
+            if_then_exprs,
+            else_branch,
+            ..
+        } => {
+            for if_then in if_then_exprs.iter_mut() {
+                lower_expr(src, &mut if_then.cond);
+                lower_expr(src, &mut if_then.then);
+            }
+            if let Some(else_expr) = else_branch {
+                lower_expr(src, &mut else_expr.expr);
+            }
+            lower_if(src, expr);
+        }
+        ExprKind::Switch {
+            scrutinee,
+            cases,
+            default,
+            ..
+        } => {
+            lower_expr(src, scrutinee);
+            for case in cases {
+                lower_expr(src, &mut case.expr);
+            }
+            if let Some(default) = default {
+                lower_expr(src, default);
+            }
+        }
+    }
+}
+
+fn lower_if(src: &str, expr: &mut Expr) {
+    let span = expr.span;
+    let ExprKind::If {
+        if_then_exprs,
+        else_branch,
+        ..
+    } = &mut expr.kind
+    else {
+        return;
+    };
+
+    let arms = if_then_exprs
+        .iter()
+        .map(|if_then| compare(src, &if_then.cond))
+        .collect::<Vec<_>>();
+    let Some((start, end)) = ladder(&arms) else {
+        return;
+    };
+
+    let scrutinee = if_then_exprs[start].cond.clone();
+    let scrutinee = match compare_operands(&scrutinee) {
+        Some((var, _)) => var.clone(),
+        None => return,
+    };
+
+    let suffix = if_then_exprs.split_off(end);
+    let run = if_then_exprs.split_off(start);
+    let prefix = std::mem::take(if_then_exprs);
+    let else_expr = else_branch.take().map(|else_expr| else_expr.expr);
+
+    // 链后的分支连同 `else` 一起作为默认分支
+    let default = if suffix.is_empty() {
+        else_expr
+    } else {
+        let if_then_span = suffix[0].span.merge(suffix.last().unwrap().span);
+        let mut default = Expr {
+            kind: ExprKind::If {
+                if_then_exprs: suffix,
+                if_then_span,
+                else_branch: else_expr.map(|expr| {
+                    Box::new(ElseExpr {
+                        span: expr.span,
+                        expr,
+                    })
+                }),
+            },
+            span,
+        };
+        lower_if(src, &mut default);
+        Some(default)
+    };
+
+    let mut cases: Vec<SwitchCase> = Vec::with_capacity(run.len());
+    for (if_then, arm) in run.into_iter().zip(&arms[start..end]) {
+        // `-0 == 0`，统一为正零；重复的常量只有第一个分支可达
+        let value = arm.unwrap().1 + 0.0;
+        if cases.iter().all(|case| case.value != value) {
+            cases.push(SwitchCase {
+                value,
+                expr: if_then.then,
+            });
+        }
+    }
+    cases.sort_by(|a, b| a.value.total_cmp(&b.value));
+
+    let switch = Expr {
+        kind: ExprKind::Switch {
+            dense: dense(&cases),
+            scrutinee: Box::new(scrutinee),
+            cases,
+            default: default.map(Box::new),
+        },
+        span,
+    };
+
+    *expr = if prefix.is_empty() {
+        switch
+    } else {
+        let if_then_span = prefix[0].span.merge(prefix.last().unwrap().span);
+        Expr {
+            kind: ExprKind::If {
+                if_then_exprs: prefix,
+                if_then_span,
+                else_branch: Some(Box::new(ElseExpr {
+                    span: switch.span,
+                    expr: switch,
+                })),
+            },
+            span,
+        }
+    };
+}
+
+/// 第一段比较同一变量、长度不少于 `MIN_ARMS` 的连续分支
+fn ladder(arms: &[Option<(&str, f64)>]) -> Option<(usize, usize)> {
+    let mut start = 0;
+    while start < arms.len() {
+        let Some((name, _)) = arms[start] else {
+            start += 1;
+            continue;
+        };
+        let len = arms[start..]
+            .iter()
+            .take_while(|arm| arm.is_some_and(|(n, _)| n == name))
+            .count();
+        if len >= MIN_ARMS {
+            return Some((start, start + len));
+        }
+        start += len;
+    }
+    None
+}
+
+/// `x == K` 或 `K == x`，其中 `K` 不为 NaN
+fn compare<'s>(src: &'s str, cond: &Expr) -> Option<(&'s str, f64)> {
+    let (var, value) = compare_operands(cond)?;
+    let value = fold::lit(value)?;
+    if value.is_nan() {
+        return None;
+    }
+    Some((ident(src, var)?, value))
+}
+
+fn compare_operands(cond: &Expr) -> Option<(&Expr, &Expr)> {
+    let ExprKind::BinOp {
+        op: Operator::Eq,
+        left,
+        right,
+        ..
+    } = &unparen(cond).kind
+    else {
+        return None;
+    };
+    let (left, right) = (unparen(left), unparen(right));
+    match (&left.kind, &right.kind) {
+        (ExprKind::Ident, ExprKind::Lit(_)) => Some((left, right)),
+        (ExprKind::Lit(_), ExprKind::Ident) => Some((right, left)),
+        _ => None,
+    }
+}
+
+fn unparen(mut expr: &Expr) -> &Expr {
+    while let ExprKind::Parented(inner) = &expr.kind {
+        expr = inner;
+    }
+    expr
+}
+
+/// 常量均为整数且值域不超过分支数的两倍时适合跳转表
+fn dense(cases: &[SwitchCase]) -> bool {
+    let (Some(first), Some(last)) = (cases.first(), cases.last()) else {
+        return false;
+    };
+    let range = last.value - first.value + 1.0;
+    cases.iter().all(|case| case.value.fract() == 0.0)
+        && range <= MAX_TABLE
+        && range <= 2.0 * cases.len() as f64
+}
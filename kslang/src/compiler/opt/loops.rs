@@ -0,0 +1,849 @@
+use super::{
+    super::{
+        CodeSpan,
+        ast::{Expr, ExprKind, FpMode, Stmt, StmtKind},
+        lexer::Operator,
+        visit::{self, Cx, Pass, calls::CallGraph},
+    },
+    ident,
+    inline::pure_arg,
+    size_expr, substitute_expr,
+};
+use std::collections::{HashMap, HashSet};
+
+pub struct Options {
+    pub fuse: bool,
+    pub interchange: bool,
+    pub unroll_jam: bool,
+    /// 展开合并时内层循环体的最大节点数
+    pub max_jam_size: usize,
+}
+
+impl Default for Options {
+    fn default() -> Self {
+        Self {
+            fuse: true,
+            interchange: true,
+            unroll_jam: true,
+            max_jam_size: 32,
+        }
+    }
+}
+
+#[derive(Debug, Default, Clone, Copy, PartialEq, Eq)]
+pub struct Stats {
+    pub fused: usize,
+    pub interchanged: usize,
+    pub jammed: usize,
+}
+
+/// 范围循环的变换：相邻同范围循环合并、两层完美嵌套的交换与展开合并
+///
+/// 语言中只有标量，依赖按名称分析。每次迭代先赋值后读取的临时变量不构成跨迭代的
+/// 依赖；`s = s + e` 形式的累加只在 `fast` 语义下允许改变累加顺序。对未标注的
+/// `extern` 与有副作用函数的调用、跳出循环的 `break`/`continue`/`return` 以及嵌套
+/// 函数定义都会阻止变换。`mode` 为顶层代码的浮点语义，函数按各自的语义处理。
+pub fn optimize_loops(src: &str, stmts: &mut [Stmt], mode: FpMode, opts: &Options) -> Stats {
+    let pure = pure_fns(src, stmts);
+    let mut scope = Scope {
+        src,
+        pure: &pure,
+        opts,
+        fp: mode,
+        toplevel: true,
+        live: HashSet::new(),
+        stats: Stats::default(),
+    };
+
+    // 顶层循环变量是全局变量，函数体中的读取也算作循环后的使用
+    scope.live = free_reads(src, stmts);
+    scope.seq(stmts);
+    scope.stats
+}
+
+/// 只调用无副作用函数的顶层函数与标注了 `pure`/`const` 的 `extern`，见 [`CallGraph::pure`]
+///
+/// 调用图借用语法树，变换前转为独立的名称集合。
+fn pure_fns(src: &str, stmts: &[Stmt]) -> HashSet<String> {
+    let Ok(((graph,), _)) = visit::run(src, stmts, (CallGraph::default(),)) else {
+        unreachable!()
+    };
+    graph.pure().into_iter().map(str::to_string).collect()
+}
+
+struct Scope<'s, 'o> {
+    src: &'s str,
+    pure: &'o HashSet<String>,
+    opts: &'o Options,
+    fp: FpMode,
+    /// 顶层代码写入的是全局变量，可被函数调用读取
+    toplevel: bool,
+    /// 在未绑定为循环变量处被读取的名称
+    live: HashSet<&'s str>,
+    stats: Stats,
+}
+
+impl<'s> Scope<'s, '_> {
+    fn function(&mut self, body: &mut Expr, fp: FpMode) {
+        let reads = free_reads_expr(self.src, body);
+        let live = std::mem::replace(&mut self.live, reads);
+        let toplevel = std::mem::replace(&mut self.toplevel, false);
+        let mode = std::mem::replace(&mut self.fp, fp);
+        self.expr(body);
+        self.live = live;
+        self.toplevel = toplevel;
+        self.fp = mode;
+    }
+
+    fn expr(&mut self, expr: &mut Expr) {
+        match &mut expr.kind {
+            ExprKind::Ident | ExprKind::Ellipsis | ExprKind::Lit(_) => {}
+            ExprKind::Block(stmts) => self.seq(stmts),
+            ExprKind::Parented(inner) | ExprKind::UnOp { arg: inner, .. } => self.expr(inner),
+            ExprKind::Call { args, .. } => args.iter_mut().for_each(|arg| self.expr(arg)),
+            ExprKind::BinOp { left, right, .. } => {
+                self.expr(left);
+                self.expr(right);
+            }
+            ExprKind::If {
+                if_then_exprs,
+                else_branch,
+                ..
+            } => {
+                for if_then in if_then_exprs {
+                    self.expr(&mut if_then.cond);
+                    self.expr(&mut if_then.then);
+                }
+                if let Some(else_expr) = else_branch {
+                    self.expr(&mut else_expr.expr);
+                }
+            }
+            ExprKind::Switch {
+                scrutinee,
+                cases,
+                default,
+                ..
+            } => {
+                self.expr(scrutinee);
+                for case in cases {
+                    self.expr(&mut case.expr);
+                }
+                if let Some(default) = default {
+                    self.expr(default);
+                }
+            }
+        }
+    }
+
+    /// 先变换内层，再合并本层相邻的循环，最后处理本层的循环嵌套
+    fn seq(&mut self, stmts: &mut [Stmt]) {
+        for stmt in stmts.iter_mut() {
+            match &mut stmt.kind {
+                StmtKind::Assign { right: expr, .. }
+                | StmtKind::Expr(expr)
+                | StmtKind::Return(expr) => self.expr(expr),
+                StmtKind::For { loop_body, .. } => self.expr(loop_body),
+                StmtKind::Def { body, fp, .. } => {
+                    let mode = fp.unwrap_or(self.fp);
+                    self.function(body, mode)
+                }
+                StmtKind::Break
+                | StmtKind::Continue
+                | StmtKind::Empty
+                | StmtKind::Extern { .. } => {}
+            }
+        }
+
+        if self.opts.fuse {
+            let mut first = 0;
+            while first < stmts.len() {
+                let next = (first + 1..stmts.len())
+                    .find(|index| !matches!(stmts[*index].kind, StmtKind::Empty));
+                match next {
+                    Some(second) if self.fuse(stmts, first, second) => self.stats.fused += 1,
+                    _ => first += 1,
+                }
+            }
+        }
+
+        for stmt in stmts.iter_mut() {
+            if self.opts.interchange && self.interchange(stmt) {
+                self.stats.interchanged += 1;
+            }
+            if self.opts.unroll_jam && self.unroll_jam(stmt) {
+                self.stats.jammed += 1;
+            }
+        }
+    }
+
+    fn access(&self, expr: &Expr) -> Access<'s> {
+        let mut access = Access::default();
+        access_expr(self.src, expr, self.pure, &mut access);
+        access
+    }
+
+    /// 顶层代码写入全局变量，调用的函数可能读取它们
+    fn calls_conflict(&self, a: &Access, b: &Access) -> bool {
+        self.toplevel && (a.calls && !b.writes.is_empty() || b.calls && !a.writes.is_empty())
+    }
+
+    /// `for i in R { A }; for j in R { B }` => `for i in R { A; j = i; B }; j = i`
+    ///
+    /// 两个循环变量最终的值相同，同名时省去赋值。第二个循环的位置改为赋值语句。
+    fn fuse(&mut self, stmts: &mut [Stmt], first: usize, second: usize) -> bool {
+        let (Some(a), Some(b)) = (range_loop(&stmts[first]), range_loop(&stmts[second])) else {
+            return false;
+        };
+        let (var_a, var_b) = (text(self.src, a.var), text(self.src, b.var));
+        if !same_expr(self.src, a.iter, b.iter) || !pure_arg(a.iter) {
+            return false;
+        }
+
+        let body_a = self.access(a.body);
+        let body_b = self.access(b.body);
+        let mut range = Access::default();
+        access_expr(self.src, a.iter, self.pure, &mut range);
+        let vars = HashSet::from([var_a, var_b]);
+        // 两个循环体共用的名称只能是各自先赋值后读取的临时变量
+        let mut shared = body_a
+            .writes
+            .iter()
+            .filter(|name| body_b.reads.contains(*name) || body_b.writes.contains(*name))
+            .chain(
+                body_b
+                    .writes
+                    .iter()
+                    .filter(|name| body_a.reads.contains(*name)),
+            );
+        let legal = !body_a.barrier
+            && !body_b.barrier
+            && body_a.writes.is_disjoint(&vars)
+            && body_b.writes.is_disjoint(&vars)
+            && body_a.writes.is_disjoint(&range.reads)
+            && range.reads.is_disjoint(&vars)
+            && (var_a == var_b || !body_a.reads.contains(var_b) && !body_b.reads.contains(var_a))
+            && !self.calls_conflict(&body_a, &body_b);
+        if !legal
+            || shared.any(|name| exposed(self.src, a.body, name) || exposed(self.src, b.body, name))
+        {
+            return false;
+        }
+
+        let copy = (var_a != var_b).then(|| assign(b.var, a.var));
+        let replaced = match &copy {
+            Some(copy) => copy.clone(),
+            None => Stmt {
+                kind: StmtKind::Empty,
+                span: stmts[second].span,
+            },
+        };
+        let second_stmt = std::mem::replace(&mut stmts[second], replaced);
+        let StmtKind::For { loop_body, .. } = second_stmt.kind else {
+            unreachable!()
+        };
+        let span = stmts[first].span.merge(second_stmt.span);
+        let StmtKind::For {
+            loop_body: body, ..
+        } = &mut stmts[first].kind
+        else {
+            unreachable!()
+        };
+
+        let mut parts = vec![std::mem::replace(&mut **body, dummy(span))];
+        parts.extend(copy.map(|copy| Expr {
+            kind: ExprKind::Block(vec![copy]),
+            span,
+        }));
+        parts.push(*loop_body);
+        **body = concat(parts, span);
+        stmts[first].span = span;
+        true
+    }
+
+    /// 按实参位置判断访问的连续方向：调用中越靠后的实参变化越快
+    fn interchange(&mut self, stmt: &mut Stmt) -> bool {
+        let Some((outer, inner)) = nest(stmt) else {
+            return false;
+        };
+        let (var_o, var_i) = (text(self.src, outer.var), text(self.src, inner.var));
+        if var_o == var_i
+            || !self.nest_legal(&outer, &inner)
+            || self.live.contains(var_o)
+            || self.live.contains(var_i)
+        {
+            return false;
+        }
+
+        let mut positions = HashMap::new();
+        arg_positions(self.src, inner.body, &mut positions);
+        let position = |name| positions.get(name).copied().unwrap_or(0);
+        if position(var_o) <= position(var_i) {
+            return false;
+        }
+
+        let StmtKind::For {
+            loop_var,
+            loop_iter,
+            head_span,
+            loop_body,
+        } = &mut stmt.kind
+        else {
+            unreachable!()
+        };
+        let inner = inner_for(loop_body);
+        let StmtKind::For {
+            loop_var: var,
+            loop_iter: iter,
+            head_span: head,
+            ..
+        } = &mut inner.kind
+        else {
+            unreachable!()
+        };
+        std::mem::swap(loop_var, var);
+        std::mem::swap(loop_iter, iter);
+        std::mem::swap(head_span, head);
+        true
+    }
+
+    /// `for i in a .. n { for j in R { B(i) } }` =>
+    /// `for i in a .. n - 1 { for j in R { B(i); B(i + 1) }; i = i + 1 }; for i in i .. n { for j in R { B(i) } }`
+    ///
+    /// 第二个循环至多执行一次，处理剩余的奇数次迭代。
+    fn unroll_jam(&mut self, stmt: &mut Stmt) -> bool {
+        let Some((outer, inner)) = nest(stmt) else {
+            return false;
+        };
+        let var_o = text(self.src, outer.var);
+        if size_expr(self.src, inner.body) > self.opts.max_jam_size
+            || !self.nest_legal(&outer, &inner)
+        {
+            return false;
+        }
+
+        let span = stmt.span;
+        let var = outer.var.clone();
+        let end = range_end(outer.iter).clone();
+        let mut rest = stmt.clone();
+
+        let StmtKind::For {
+            loop_iter,
+            loop_body,
+            ..
+        } = &mut stmt.kind
+        else {
+            unreachable!()
+        };
+        let start = match &loop_iter.kind {
+            ExprKind::BinOp {
+                op: Operator::Range,
+                left,
+                ..
+            } => (**left).clone(),
+            _ => lit(0.0, loop_iter.span),
+        };
+        **loop_iter = binop(
+            Operator::Range,
+            start,
+            binop(Operator::Sub, end, lit(1.0, span)),
+        );
+
+        let inner = inner_for(loop_body);
+        let StmtKind::For {
+            loop_body: body, ..
+        } = &mut inner.kind
+        else {
+            unreachable!()
+        };
+        let mut next = (**body).clone();
+        let step = binop(Operator::Add, var.clone(), lit(1.0, var.span));
+        substitute_expr(self.src, &mut next, &HashMap::from([(var_o, step.clone())]));
+        let jammed = concat(
+            vec![std::mem::replace(&mut **body, dummy(span)), next],
+            span,
+        );
+        **body = jammed;
+        let advance = Stmt {
+            kind: StmtKind::Assign {
+                left: var.clone(),
+                right: step,
+                assign_span: var.span,
+            },
+            span: var.span,
+        };
+        **loop_body = concat(
+            vec![
+                std::mem::replace(&mut **loop_body, dummy(span)),
+                Expr {
+                    kind: ExprKind::Block(vec![advance]),
+                    span,
+                },
+            ],
+            span,
+        );
+
+        if let StmtKind::For { loop_iter, .. } = &mut rest.kind {
+            let end = range_end(loop_iter).clone();
+            **loop_iter = binop(Operator::Range, var, end);
+        }
+        let unrolled = std::mem::replace(
+            stmt,
+            Stmt {
+                kind: StmtKind::Empty,
+                span,
+            },
+        );
+        *stmt = Stmt {
+            kind: StmtKind::Expr(Expr {
+                kind: ExprKind::Block(vec![unrolled, rest]),
+                span,
+            }),
+            span,
+        };
+        true
+    }
+
+    /// 迭代顺序改变后结果不变：循环体内没有跨迭代的依赖，范围不受循环影响
+    ///
+    /// 最后一次迭代在变换前后相同，临时变量在循环结束后的值也不变。
+    fn nest_legal(&self, outer: &RangeLoop, inner: &RangeLoop) -> bool {
+        let body = self.access(inner.body);
+        let mut ranges = Access::default();
+        access_expr(self.src, outer.iter, self.pure, &mut ranges);
+        access_expr(self.src, inner.iter, self.pure, &mut ranges);
+        let vars = HashSet::from([text(self.src, outer.var), text(self.src, inner.var)]);
+        pure_arg(outer.iter)
+            && pure_arg(inner.iter)
+            && !body.barrier
+            && body.writes.is_disjoint(&vars)
+            && body.writes.is_disjoint(&ranges.reads)
+            && ranges.reads.is_disjoint(&vars)
+            && !self.calls_conflict(&body, &body)
+            && body.writes.iter().all(|name| {
+                !exposed(self.src, inner.body, name)
+                    || self.fp == FpMode::Fast && reduction(self.src, inner.body, name)
+            })
+    }
+}
+
+struct RangeLoop<'a> {
+    var: &'a Expr,
+    iter: &'a Expr,
+    body: &'a Expr,
+}
+
+fn range_loop(stmt: &Stmt) -> Option<RangeLoop<'_>> {
+    match &stmt.kind {
+        StmtKind::For {
+            loop_var,
+            loop_iter,
+            loop_body,
+            ..
+        } => Some(RangeLoop {
+            var: loop_var,
+            iter: loop_iter,
+            body: loop_body,
+        }),
+        _ => None,
+    }
+}
+
+/// 外层循环体只有一个内层循环
+fn nest(stmt: &Stmt) -> Option<(RangeLoop<'_>, RangeLoop<'_>)> {
+    let outer = range_loop(stmt)?;
+    let ExprKind::Block(stmts) = &outer.body.kind else {
+        return None;
+    };
+    let mut loops = stmts
+        .iter()
+        .filter(|stmt| !matches!(stmt.kind, StmtKind::Empty));
+    let inner = range_loop(loops.next()?)?;
+    loops.next().is_none().then_some((outer, inner))
+}
+
+fn inner_for(body: &mut Expr) -> &mut Stmt {
+    let ExprKind::Block(stmts) = &mut body.kind else {
+        unreachable!()
+    };
+    stmts
+        .iter_mut()
+        .find(|stmt| matches!(stmt.kind, StmtKind::For { .. }))
+        .unwrap()
+}
+
+fn range_end(iter: &Expr) -> &Expr {
+    match &iter.kind {
+        ExprKind::BinOp {
+            op: Operator::Range,
+            right,
+            ..
+        } => right,
+        _ => iter,
+    }
+}
+
+#[derive(Default)]
+struct Access<'s> {
+    reads: HashSet<&'s str>,
+    writes: HashSet<&'s str>,
+    /// 调用了无副作用的函数，函数体可能读取全局变量
+    calls: bool,
+    /// 有副作用的调用或跳出循环，不能改变执行顺序
+    barrier: bool,
+}
+
+fn access_expr<'s>(src: &'s str, expr: &Expr, pure: &HashSet<String>, access: &mut Access<'s>) {
+    let pass = Accesses {
+        src,
+        pure,
+        access,
+        opaque: 0,
+    };
+    let Ok(_) = visit::run_expr(src, expr, (pass,)) else {
+        unreachable!()
+    };
+}
+
+fn access_stmt<'s>(src: &'s str, stmt: &Stmt, pure: &HashSet<String>, access: &mut Access<'s>) {
+    let pass = Accesses {
+        src,
+        pure,
+        access,
+        opaque: 0,
+    };
+    let Ok(_) = visit::run(src, std::slice::from_ref(stmt), (pass,)) else {
+        unreachable!()
+    };
+}
+
+/// 内层循环中的 `break`/`continue` 不影响外层
+struct Accesses<'s, 'o> {
+    src: &'s str,
+    pure: &'o HashSet<String>,
+    access: &'o mut Access<'s>,
+    /// 所在的 `return` 与嵌套 `def` 层数，其中的读写不计
+    opaque: usize,
+}
+
+impl<'e> Pass<'e> for Accesses<'_, '_> {
+    const NAME: &'static str = "access";
+
+    fn enter_stmt(&mut self, cx: &mut Cx<'e>, stmt: &'e Stmt) {
+        if let StmtKind::Return(_) | StmtKind::Def { .. } = stmt.kind {
+            self.access.barrier |= self.opaque == 0;
+            self.opaque += 1;
+        }
+        if self.opaque > 0 {
+            return;
+        }
+        match &stmt.kind {
+            StmtKind::Assign { left, .. } => {
+                self.access.writes.insert(text(self.src, left));
+            }
+            StmtKind::For { loop_var, .. } => {
+                self.access.writes.insert(text(self.src, loop_var));
+            }
+            StmtKind::Break | StmtKind::Continue => self.access.barrier |= cx.loops == 0,
+            _ => {}
+        }
+    }
+
+    fn leave_stmt(&mut self, _cx: &mut Cx<'e>, stmt: &'e Stmt) {
+        if let StmtKind::Return(_) | StmtKind::Def { .. } = stmt.kind {
+            self.opaque -= 1;
+        }
+    }
+
+    fn enter_expr(&mut self, cx: &mut Cx<'e>, expr: &'e Expr) {
+        if self.opaque > 0 {
+            return;
+        }
+        match &expr.kind {
+            ExprKind::Ident => {
+                self.access.reads.insert(text(self.src, expr));
+            }
+            ExprKind::Call { callee, .. } => match ident(cx.src, callee) {
+                Some(name) if self.pure.contains(name) => self.access.calls = true,
+                _ => self.access.barrier = true,
+            },
+            _ => {}
+        }
+    }
+}
+
+/// 不在绑定该名称的循环内的读取；嵌套函数体不受外层循环变量约束
+fn free_reads<'s>(src: &'s str, stmts: &[Stmt]) -> HashSet<&'s str> {
+    let Ok(((pass,), _)) = visit::run(src, stmts, (FreeReads::new(src),)) else {
+        unreachable!()
+    };
+    pass.reads
+}
+
+fn free_reads_expr<'s>(src: &'s str, expr: &Expr) -> HashSet<&'s str> {
+    let Ok(((pass,), _)) = visit::run_expr(src, expr, (FreeReads::new(src),)) else {
+        unreachable!()
+    };
+    pass.reads
+}
+
+struct FreeReads<'s> {
+    src: &'s str,
+    /// 循环变量及绑定它的循环体所在的 `def` 层数与循环层数
+    bound: Vec<(&'s str, usize, usize)>,
+    reads: HashSet<&'s str>,
+}
+
+impl<'s> FreeReads<'s> {
+    fn new(src: &'s str) -> Self {
+        Self {
+            src,
+            bound: vec![],
+            reads: HashSet::new(),
+        }
+    }
+}
+
+impl<'e> Pass<'e> for FreeReads<'_> {
+    const NAME: &'static str = "free_reads";
+
+    fn enter_stmt(&mut self, cx: &mut Cx<'e>, stmt: &'e Stmt) {
+        if let StmtKind::For { loop_var, .. } = &stmt.kind {
+            let var = text(self.src, loop_var);
+            self.bound.push((var, cx.defs.len(), cx.loops + 1));
+        }
+    }
+
+    fn leave_stmt(&mut self, _cx: &mut Cx<'e>, stmt: &'e Stmt) {
+        if let StmtKind::For { .. } = stmt.kind {
+            self.bound.pop();
+        }
+    }
+
+    fn enter_expr(&mut self, cx: &mut Cx<'e>, expr: &'e Expr) {
+        if !matches!(expr.kind, ExprKind::Ident) {
+            return;
+        }
+        let name = text(self.src, expr);
+        let bound = (self.bound.iter())
+            .any(|&(var, defs, loops)| var == name && defs == cx.defs.len() && loops <= cx.loops);
+        if !bound {
+            self.reads.insert(name);
+        }
+    }
+}
+
+/// 记录每个名称作为调用实参出现的最靠后位置
+fn arg_positions<'s>(src: &'s str, expr: &Expr, positions: &mut HashMap<&'s str, usize>) {
+    match &expr.kind {
+        ExprKind::Call { args, .. } => {
+            for (index, arg) in args.iter().enumerate() {
+                let mut access = Access::default();
+                access_expr(src, arg, &HashSet::new(), &mut access);
+                for name in access.reads {
+                    let position = positions.entry(name).or_default();
+                    *position = (*position).max(index + 1);
+                }
+                arg_positions(src, arg, positions);
+            }
+        }
+        ExprKind::Ident | ExprKind::Ellipsis | ExprKind::Lit(_) => {}
+        ExprKind::Block(stmts) => {
+            for stmt in stmts {
+                match &stmt.kind {
+                    StmtKind::Assign { right: expr, .. }
+                    | StmtKind::Expr(expr)
+                    | StmtKind::Return(expr) => arg_positions(src, expr, positions),
+                    StmtKind::For {
+                        loop_iter,
+                        loop_body,
+                        ..
+                    } => {
+                        arg_positions(src, loop_iter, positions);
+                        arg_positions(src, loop_body, positions);
+                    }
+                    _ => {}
+                }
+            }
+        }
+        ExprKind::Parented(inner) | ExprKind::UnOp { arg: inner, .. } => {
+            arg_positions(src, inner, positions)
+        }
+        ExprKind::BinOp { left, right, .. } => {
+            arg_positions(src, left, positions);
+            arg_positions(src, right, positions);
+        }
+        ExprKind::If {
+            if_then_exprs,
+            else_branch,
+            ..
+        } => {
+            for if_then in if_then_exprs {
+                arg_positions(src, &if_then.cond, positions);
+                arg_positions(src, &if_then.then, positions);
+            }
+            if let Some(else_expr) = else_branch {
+                arg_positions(src, &else_expr.expr, positions);
+            }
+        }
+        ExprKind::Switch {
+            scrutinee,
+            cases,
+            default,
+            ..
+        } => {
+            arg_positions(src, scrutinee, positions);
+            for case in cases {
+                arg_positions(src, &case.expr, positions);
+            }
+            if let Some(default) = default {
+                arg_positions(src, default, positions);
+            }
+        }
+    }
+}
+
+/// 循环体在赋值前读取了 `name`，即读到上一次迭代或循环前的值
+fn exposed(src: &str, body: &Expr, name: &str) -> bool {
+    let ExprKind::Block(stmts) = &body.kind else {
+        let mut access = Access::default();
+        access_expr(src, body, &HashSet::new(), &mut access);
+        return access.reads.contains(name);
+    };
+    for stmt in stmts {
+        let mut access = Access::default();
+        access_stmt(src, stmt, &HashSet::new(), &mut access);
+        if access.reads.contains(name) {
+            return true;
+        }
+        // 只有无条件执行的赋值才确定本次迭代的值
+        if let StmtKind::Assign { left, .. } = &stmt.kind
+            && text(src, left) == name
+        {
+            return false;
+        }
+    }
+    false
+}
+
+/// `name` 只出现在循环体顶层的 `name = name + e` 或同一运算符的累加语句中
+fn reduction(src: &str, body: &Expr, name: &str) -> bool {
+    let ExprKind::Block(stmts) = &body.kind else {
+        return false;
+    };
+    let mut kind = None;
+    for stmt in stmts {
+        let mut access = Access::default();
+        access_stmt(src, stmt, &HashSet::new(), &mut access);
+        if !access.reads.contains(name) && !access.writes.contains(name) {
+            continue;
+        }
+        let StmtKind::Assign { left, right, .. } = &stmt.kind else {
+            return false;
+        };
+        let ExprKind::BinOp {
+            op: op @ (Operator::Add | Operator::Mul),
+            left: a,
+            right: b,
+            ..
+        } = &right.kind
+        else {
+            return false;
+        };
+        let operand = match (ident(src, a), ident(src, b)) {
+            (Some(x), _) if x == name => b,
+            (_, Some(y)) if y == name => a,
+            _ => return false,
+        };
+        let mut access = Access::default();
+        access_expr(src, operand, &HashSet::new(), &mut access);
+        if text(src, left) != name || access.reads.contains(name) || *kind.get_or_insert(op) != op {
+            return false;
+        }
+    }
+    true
+}
+
+/// 结构相同且标识符同名
+fn same_expr(src: &str, a: &Expr, b: &Expr) -> bool {
+    match (&a.kind, &b.kind) {
+        (ExprKind::Ident, ExprKind::Ident) => text(src, a) == text(src, b),
+        (ExprKind::Lit(x), ExprKind::Lit(y)) => x.to_bits() == y.to_bits(),
+        (ExprKind::Parented(x), _) => same_expr(src, x, b),
+        (_, ExprKind::Parented(y)) => same_expr(src, a, y),
+        (ExprKind::UnOp { op: p, arg: x, .. }, ExprKind::UnOp { op: q, arg: y, .. }) => {
+            p == q && same_expr(src, x, y)
+        }
+        (
+            ExprKind::BinOp {
+                op: p,
+                left: l1,
+                right: r1,
+                ..
+            },
+            ExprKind::BinOp {
+                op: q,
+                left: l2,
+                right: r2,
+                ..
+            },
+        ) => p == q && same_expr(src, l1, l2) && same_expr(src, r1, r2),
+        _ => false,
+    }
+}
+
+/// 依次执行各部分的语句块，语句块的值不被使用
+fn concat(parts: Vec<Expr>, span: CodeSpan) -> Expr {
+    let mut stmts = vec![];
+    for part in parts {
+        match part.kind {
+            ExprKind::Block(inner) => stmts.extend(inner),
+            _ => stmts.push(Stmt {
+                span: part.span,
+                kind: StmtKind::Expr(part),
+            }),
+        }
+    }
+    Expr {
+        kind: ExprKind::Block(stmts),
+        span,
+    }
+}
+
+fn assign(left: &Expr, right: &Expr) -> Stmt {
+    Stmt {
+        kind: StmtKind::Assign {
+            left: left.clone(),
+            right: right.clone(),
+            assign_span: left.span,
+        },
+        span: left.span,
+    }
+}
+
+fn binop(op: Operator, left: Expr, right: Expr) -> Expr {
+    let span = left.span.merge(right.span);
+    Expr {
+        kind: ExprKind::BinOp {
+            op,
+            op_span: right.span,
+            left: Box::new(left),
+            right: Box::new(right),
+        },
+        span,
+    }
+}
+
+fn lit(value: f64, span: CodeSpan) -> Expr {
+    Expr {
+        kind: ExprKind::Lit(value),
+        span,
+    }
+}
+
+fn dummy(span: CodeSpan) -> Expr {
+    lit(0.0, span)
+}
+
+fn text<'s>(src: &'s str, expr: &Expr) -> &'s str {
+    &src[expr.span.start..expr.span.end]
+}
@@ -0,0 +1,629 @@
+use super::{
+    super::{
+        ast::{Expr, ExprKind, FpMode, Stmt, StmtKind},
+        visit::{self, Cx, Pass},
+    },
+    Size, fold, ident,
+    inline::{Defined, Uses, pure_arg},
+    specialize::Rebinds,
+    substitute_expr,
+};
+use std::collections::{HashMap, HashSet};
+
+/// 参与链接的一个源文件
+pub struct Module<'s> {
+    pub src: &'s str,
+    pub stmts: Vec<Stmt>,
+    /// 顶层代码的浮点语义，`def` 上已解析的标注优先
+    pub fp: FpMode,
+}
+
+pub struct Options {
+    /// 可跨模块展开的函数体最大节点数
+    pub max_size: usize,
+    /// 对外可见的函数，不删除也不做常量传播
+    pub roots: Vec<String>,
+    /// 摘要与后端阶段的并行线程数
+    pub jobs: usize,
+}
+
+impl Default for Options {
+    fn default() -> Self {
+        Self {
+            max_size: 32,
+            roots: vec![],
+            jobs: std::thread::available_parallelism().map_or(1, |n| n.get()),
+        }
+    }
+}
+
+#[derive(Debug, Default)]
+pub struct LinkStats {
+    pub inlined: usize,
+    pub propagated: usize,
+    pub removed: usize,
+}
+
+/// 全程序链接期优化
+///
+/// 与 ThinLTO 相同分三个阶段：各模块并行生成摘要；串行合并摘要，决定跨模块展开、
+/// 存活函数与常量参数；各模块按决定并行改写。合并阶段只读取摘要，不接触函数体。
+///
+/// - 跨模块展开：只展开叶函数（函数体只引用形参、不含调用），展开后不残留其他模块的标识符
+/// - 死函数删除：从顶层语句与 `roots` 出发不可达的顶层 `def`
+/// - 常量传播：所有调用点对某个形参都传入同一字面量时，代入函数体并折叠
+///
+/// 多个模块定义同名函数时该名称不参与以上优化。
+pub fn link(modules: &mut [Module], opts: &Options) -> LinkStats {
+    let chunk = modules.len().div_ceil(opts.jobs.max(1)).max(1);
+
+    let summaries = std::thread::scope(|scope| {
+        let workers = modules
+            .chunks(chunk)
+            .map(|chunk| scope.spawn(move || chunk.iter().map(summarize).collect::<Vec<_>>()))
+            .collect::<Vec<_>>();
+        workers
+            .into_iter()
+            .flat_map(|worker| worker.join().unwrap())
+            .collect::<Vec<_>>()
+    });
+
+    let plan = plan(&summaries, opts);
+    let srcs = modules.iter().map(|module| module.src).collect::<Vec<_>>();
+
+    std::thread::scope(|scope| {
+        let workers = modules
+            .chunks_mut(chunk)
+            .enumerate()
+            .map(|(index, modules)| {
+                let (plan, srcs) = (&plan, &srcs);
+                scope.spawn(move || {
+                    let mut stats = LinkStats::default();
+                    for (offset, module) in modules.iter_mut().enumerate() {
+                        rewrite(index * chunk + offset, module, plan, srcs, &mut stats);
+                    }
+                    stats
+                })
+            })
+            .collect::<Vec<_>>();
+        workers
+            .into_iter()
+            .map(|worker| worker.join().unwrap())
+            .fold(LinkStats::default(), |mut total, stats| {
+                total.inlined += stats.inlined;
+                total.propagated += stats.propagated;
+                total.removed += stats.removed;
+                total
+            })
+    })
+}
+
+/// 所有模块的顶层 `def`
+///
+/// 作为库发布时没有入口语句，调用方在链接期不可见，未指定 `roots` 时应全部保留。
+pub fn exported(modules: &[Module]) -> Vec<String> {
+    modules
+        .iter()
+        .flat_map(|module| {
+            module.stmts.iter().filter_map(|stmt| match &stmt.kind {
+                StmtKind::Def { ident: name, .. } => {
+                    Some(module.src[name.span.start..name.span.end].to_string())
+                }
+                _ => None,
+            })
+        })
+        .collect()
+}
+
+/// 调用点实参的摘要
+struct Arg {
+    lit: Option<f64>,
+    pure: bool,
+    trivial: bool,
+}
+
+/// 对名称的一次引用，`call` 为 `None` 表示不在被调用位置（函数地址逃逸）
+struct Reference {
+    name: String,
+    call: Option<Vec<Arg>>,
+    /// 引用所在位置的浮点语义
+    mode: FpMode,
+}
+
+struct DefSummary {
+    name: String,
+    fp: FpMode,
+    /// 含 `...` 或非标识符形参时为 `None`
+    params: Option<Vec<String>>,
+    /// 可跨模块展开的叶函数体
+    leaf: Option<Expr>,
+    /// 函数体的节点数
+    size: usize,
+    /// 形参在函数体内的使用次数
+    uses: Vec<usize>,
+    /// 形参是否在函数体内被重新绑定
+    rebound: Vec<bool>,
+    refs: Vec<Reference>,
+}
+
+struct Summary {
+    defs: Vec<DefSummary>,
+    /// 顶层非 `def` 语句中的引用
+    roots: Vec<Reference>,
+    /// 嵌套 `def` 的名称，会遮蔽同名的顶层函数
+    nested: HashSet<String>,
+}
+
+fn summarize(module: &Module) -> Summary {
+    let src = module.src;
+    let mut summary = Summary {
+        defs: vec![],
+        roots: vec![],
+        nested: HashSet::new(),
+    };
+
+    for stmt in &module.stmts {
+        let StmtKind::Def {
+            ident: name,
+            args,
+            body,
+            fp,
+            ..
+        } = &stmt.kind
+        else {
+            let scan = Scan::new(module.fp, &mut summary.nested);
+            let Ok(((scan,), _)) = visit::run(src, std::slice::from_ref(stmt), (scan,)) else {
+                unreachable!()
+            };
+            summary.roots.extend(scan.refs);
+            continue;
+        };
+        let fp = fp.unwrap_or(module.fp);
+
+        let params = args
+            .iter()
+            .map(|arg| ident(src, arg).map(str::to_string))
+            .collect::<Option<Vec<_>>>();
+        // 引用、叶函数判定与形参的使用情况在同一次遍历中得出
+        let names = params
+            .iter()
+            .flatten()
+            .map(String::as_str)
+            .collect::<Vec<_>>();
+        let passes = (
+            Scan::new(fp, &mut summary.nested),
+            Leaf {
+                params: &names,
+                leaf: true,
+            },
+            Uses::new(&names),
+            Rebinds::new(&names),
+            Size(0),
+        );
+        let Ok(((scan, leaf, uses, rebinds, Size(size)), _)) = visit::run_expr(src, body, passes)
+        else {
+            unreachable!()
+        };
+
+        let (leaf, uses, rebound) = match &params {
+            Some(_) => (leaf.leaf.then(|| body.clone()), uses.counts, rebinds.found),
+            None => (None, vec![], vec![]),
+        };
+
+        summary.defs.push(DefSummary {
+            name: src[name.span.start..name.span.end].to_string(),
+            fp,
+            params,
+            leaf,
+            size,
+            uses,
+            rebound,
+            refs: scan.refs,
+        });
+    }
+    summary
+}
+
+/// 函数体只由字面量、形参与运算组成
+struct Leaf<'n> {
+    params: &'n [&'n str],
+    leaf: bool,
+}
+
+impl<'s> Pass<'s> for Leaf<'_> {
+    const NAME: &'static str = "leaf";
+
+    fn enter_expr(&mut self, cx: &mut Cx<'s>, expr: &'s Expr) {
+        self.leaf &= match expr.kind {
+            ExprKind::Ident => self.params.contains(&cx.text(expr)),
+            ExprKind::Ellipsis | ExprKind::Block(_) | ExprKind::Call { .. } => false,
+            _ => true,
+        };
+    }
+}
+
+/// 对名称的引用与嵌套 `def` 的名称，浮点语义随 `def` 的标注切换
+struct Scan<'n> {
+    mode: FpMode,
+    outer: Vec<FpMode>,
+    refs: Vec<Reference>,
+    nested: &'n mut HashSet<String>,
+}
+
+impl<'n> Scan<'n> {
+    fn new(mode: FpMode, nested: &'n mut HashSet<String>) -> Self {
+        Self {
+            mode,
+            outer: vec![],
+            refs: vec![],
+            nested,
+        }
+    }
+}
+
+impl<'s> Pass<'s> for Scan<'_> {
+    const NAME: &'static str = "scan";
+
+    fn enter_stmt(&mut self, cx: &mut Cx<'s>, stmt: &'s Stmt) {
+        if let StmtKind::Def { ident, fp, .. } = &stmt.kind {
+            self.nested.insert(cx.text(ident).to_string());
+            self.outer.push(self.mode);
+            self.mode = fp.unwrap_or(self.mode);
+        }
+    }
+
+    fn leave_stmt(&mut self, _cx: &mut Cx<'s>, stmt: &'s Stmt) {
+        if let StmtKind::Def { .. } = stmt.kind
+            && let Some(mode) = self.outer.pop()
+        {
+            self.mode = mode;
+        }
+    }
+
+    fn enter_expr(&mut self, cx: &mut Cx<'s>, expr: &'s Expr) {
+        let (name, call) = match &expr.kind {
+            ExprKind::Ident => (cx.text(expr), None),
+            ExprKind::Call { callee, args, .. } => {
+                let Some(name) = ident(cx.src, callee) else {
+                    return;
+                };
+                let args = args.iter().map(|arg| Arg {
+                    lit: fold::lit(arg),
+                    pure: pure_arg(arg),
+                    trivial: matches!(arg.kind, ExprKind::Ident | ExprKind::Lit(_)),
+                });
+                (name, Some(args.collect()))
+            }
+            _ => return,
+        };
+        self.refs.push(Reference {
+            name: name.to_string(),
+            call,
+            mode: self.mode,
+        });
+    }
+}
+
+struct Import {
+    module: usize,
+    fp: FpMode,
+    params: Vec<String>,
+    uses: Vec<usize>,
+    body: Expr,
+}
+
+#[derive(Default)]
+struct Plan {
+    imports: HashMap<String, Import>,
+    live: HashSet<String>,
+    /// 函数名 -> (形参序号, 常量)
+    consts: HashMap<String, Vec<(usize, f64)>>,
+}
+
+impl Plan {
+    /// 调用点能否在后端展开，与 `rewrite` 的判断保持一致
+    fn inlines(&self, module: usize, nested: &HashSet<String>, r: &Reference) -> bool {
+        let (Some(args), Some(import)) = (&r.call, self.imports.get(&r.name)) else {
+            return false;
+        };
+        import.module != module
+            && import.fp == r.mode
+            && !nested.contains(&r.name)
+            && args.len() == import.params.len()
+            && args
+                .iter()
+                .zip(&import.uses)
+                .all(|(arg, uses)| arg.pure && (arg.trivial || *uses == 1))
+    }
+}
+
+fn plan(summaries: &[Summary], opts: &Options) -> Plan {
+    let mut defined = HashMap::<&str, Vec<(usize, usize)>>::new();
+    for (module, summary) in summaries.iter().enumerate() {
+        for (index, def) in summary.defs.iter().enumerate() {
+            defined.entry(&def.name).or_default().push((module, index));
+        }
+    }
+    let unique = |name: &str| match defined.get(name).map(Vec::as_slice) {
+        Some([site]) => Some(*site),
+        _ => None,
+    };
+
+    let mut plan = Plan::default();
+    for (name, sites) in &defined {
+        let [(module, index)] = sites.as_slice() else {
+            continue;
+        };
+        let def = &summaries[*module].defs[*index];
+        if let (Some(params), Some(body)) = (&def.params, &def.leaf) {
+            if def.size <= opts.max_size {
+                plan.imports.insert(
+                    name.to_string(),
+                    Import {
+                        module: *module,
+                        fp: def.fp,
+                        params: params.clone(),
+                        uses: def.uses.clone(),
+                        body: body.clone(),
+                    },
+                );
+            }
+        }
+    }
+
+    // 存活分析：展开后不再发生的调用不构成依赖
+    let mut work = Vec::new();
+    let visit = |name: &str, plan: &mut Plan, work: &mut Vec<(usize, usize)>| {
+        if plan.live.insert(name.to_string()) {
+            if let Some(site) = unique(name) {
+                work.push(site);
+            }
+        }
+    };
+    for name in &opts.roots {
+        visit(name, &mut plan, &mut work);
+    }
+    for (name, sites) in &defined {
+        if sites.len() > 1 {
+            visit(name, &mut plan, &mut work);
+        }
+    }
+    for (module, summary) in summaries.iter().enumerate() {
+        for r in &summary.roots {
+            if !plan.inlines(module, &summary.nested, r) {
+                visit(&r.name, &mut plan, &mut work);
+            }
+        }
+    }
+    while let Some((module, index)) = work.pop() {
+        let summary = &summaries[module];
+        for r in &summary.defs[index].refs {
+            if !plan.inlines(module, &summary.nested, r) {
+                visit(&r.name, &mut plan, &mut work);
+            }
+        }
+    }
+
+    // 常量传播：收集所有调用点，地址逃逸或实参数不符的函数不处理
+    let mut sites = HashMap::<&str, Vec<&Reference>>::new();
+    for summary in summaries {
+        let refs = summary
+            .roots
+            .iter()
+            .chain(summary.defs.iter().flat_map(|def| &def.refs));
+        for r in refs {
+            sites.entry(&r.name).or_default().push(r);
+        }
+    }
+    for (name, refs) in &sites {
+        let Some((module, index)) = unique(name) else {
+            continue;
+        };
+        let def = &summaries[module].defs[index];
+        let Some(params) = &def.params else {
+            continue;
+        };
+        if opts.roots.iter().any(|root| root == name) || !plan.live.contains(*name) {
+            continue;
+        }
+        let Some(calls) = refs
+            .iter()
+            .map(|r| r.call.as_ref().filter(|args| args.len() == params.len()))
+            .collect::<Option<Vec<_>>>()
+        else {
+            continue;
+        };
+
+        let consts = (0..params.len())
+            .filter(|param| !def.rebound[*param])
+            .filter_map(|param| {
+                let value = calls[0][param].lit?;
+                let same = calls.iter().all(|args| {
+                    args[param]
+                        .lit
+                        .is_some_and(|v| v.to_bits() == value.to_bits())
+                });
+                (same && !value.is_nan()).then_some((param, value))
+            })
+            .collect::<Vec<_>>();
+        if !consts.is_empty() {
+            plan.consts.insert(name.to_string(), consts);
+        }
+    }
+    plan
+}
+
+fn rewrite(index: usize, module: &mut Module, plan: &Plan, srcs: &[&str], stats: &mut LinkStats) {
+    let src = module.src;
+    let Ok(((defined,), _)) = visit::run(src, &module.stmts, (Defined::default(),)) else {
+        unreachable!()
+    };
+    let nested = (defined.shadowed.into_iter())
+        .map(str::to_string)
+        .collect::<HashSet<_>>();
+
+    for stmt in module.stmts.iter_mut() {
+        inline_stmt(index, src, stmt, module.fp, plan, srcs, &nested, stats);
+    }
+
+    let before = module.stmts.len();
+    module.stmts.retain(|stmt| match &stmt.kind {
+        StmtKind::Def { ident: name, .. } => {
+            plan.live.contains(&src[name.span.start..name.span.end])
+        }
+        _ => true,
+    });
+    stats.removed += before - module.stmts.len();
+
+    for stmt in module.stmts.iter_mut() {
+        let StmtKind::Def {
+            ident: name,
+            args,
+            body,
+            ..
+        } = &mut stmt.kind
+        else {
+            continue;
+        };
+        let Some(consts) = plan.consts.get(&src[name.span.start..name.span.end]) else {
+            continue;
+        };
+        let subst = consts
+            .iter()
+            .map(|(param, value)| {
+                let arg = &args[*param];
+                let lit = Expr {
+                    kind: ExprKind::Lit(*value),
+                    span: arg.span,
+                };
+                (&src[arg.span.start..arg.span.end], lit)
+            })
+            .collect();
+        substitute_expr(src, body, &subst);
+        stats.propagated += consts.len();
+    }
+
+    fold::fold_stmts_in(&mut module.stmts, module.fp);
+}
+
+fn inline_stmt(
+    index: usize,
+    src: &str,
+    stmt: &mut Stmt,
+    mode: FpMode,
+    plan: &Plan,
+    srcs: &[&str],
+    nested: &HashSet<String>,
+    stats: &mut LinkStats,
+) {
+    match &mut stmt.kind {
+        StmtKind::Assign { right: expr, .. } | StmtKind::Expr(expr) | StmtKind::Return(expr) => {
+            inline_expr(index, src, expr, mode, plan, srcs, nested, stats)
+        }
+        StmtKind::Def { body, fp, .. } => {
+            let mode = fp.unwrap_or(mode);
+            inline_expr(index, src, body, mode, plan, srcs, nested, stats)
+        }
+        StmtKind::For {
+            loop_iter,
+            loop_body,
+            ..
+        } => {
+            inline_expr(index, src, loop_iter, mode, plan, srcs, nested, stats);
+            inline_expr(index, src, loop_body, mode, plan, srcs, nested, stats);
+        }
+        StmtKind::Break | StmtKind::Continue | StmtKind::Empty | StmtKind::Extern { .. } => {}
+    }
+}
+
+fn inline_expr(
+    index: usize,
+    src: &str,
+    expr: &mut Expr,
+    mode: FpMode,
+    plan: &Plan,
+    srcs: &[&str],
+    nested: &HashSet<String>,
+    stats: &mut LinkStats,
+) {
+    let mut recurse =
+        |expr: &mut Expr| inline_expr(index, src, expr, mode, plan, srcs, nested, stats);
+    match &mut expr.kind {
+        ExprKind::Ident | ExprKind::Ellipsis | ExprKind::Lit(_) => {}
+        ExprKind::Parented(inner) | ExprKind::UnOp { arg: inner, .. } => recurse(inner),
+        ExprKind::Block(stmts) => {
+            for stmt in stmts {
+                inline_stmt(index, src, stmt, mode, plan, srcs, nested, stats);
+            }
+        }
+        ExprKind::BinOp { left, right, .. } => {
+            recurse(left);
+            recurse(right);
+        }
+        ExprKind::If {
+            if_then_exprs,
+            else_branch,
+            ..
+        } => {
+            for if_then in if_then_exprs {
+                recurse(&mut if_then.cond);
+                recurse(&mut if_then.then);
+            }
+            if let Some(else_expr) = else_branch {
+                recurse(&mut else_expr.expr);
+            }
+        }
+        ExprKind::Switch {
+            scrutinee,
+            cases,
+            default,
+            ..
+        } => {
+            recurse(scrutinee);
+            for case in cases {
+                recurse(&mut case.expr);
+            }
+            if let Some(default) = default {
+                recurse(default);
+            }
+        }
+        ExprKind::Call { callee, args, .. } => {
+            // 按展开前的实参判断，与 `Plan::inlines` 一致；实参中的调用无论是否展开外层都要处理
+            let name = ident(src, callee);
+            let import = name
+                .and_then(|name| Some((name, plan.imports.get(name)?)))
+                .filter(|(name, import)| {
+                    import.module != index
+                        && import.fp == mode
+                        && !nested.contains(*name)
+                        && args.len() == import.params.len()
+                        && args.iter().zip(&import.uses).all(|(arg, uses)| {
+                            pure_arg(arg)
+                                && (matches!(arg.kind, ExprKind::Ident | ExprKind::Lit(_))
+                                    || *uses == 1)
+                        })
+                });
+            if name.is_none() {
+                recurse(callee);
+            }
+            for arg in args.iter_mut() {
+                recurse(arg);
+            }
+            let Some((_, import)) = import else {
+                return;
+            };
+
+            // 叶函数体中的标识符只有形参，代入后全部来自调用方
+            let subst = import
+                .params
+                .iter()
+                .map(String::as_str)
+                .zip(args.drain(..))
+                .collect();
+            let mut inlined = import.body.clone();
+            substitute_expr(srcs[import.module], &mut inlined, &subst);
+            *expr = inlined;
+            stats.inlined += 1;
+        }
+    }
+}
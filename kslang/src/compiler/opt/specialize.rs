@@ -0,0 +1,311 @@
+use super::{
+    super::{
+        ast::{ElseExpr, Expr, ExprKind, IfThenExpr, Stmt, StmtKind},
+        lexer::Operator,
+        visit::{self, Cx, Pass},
+    },
+    fold, ident, size_expr, substitute_expr,
+};
+use std::collections::HashMap;
+
+pub struct Options {
+    /// 参与判断的最少调用次数
+    pub min_calls: usize,
+    /// 主导值占全部调用的最低比例
+    pub min_ratio: f64,
+}
+
+impl Default for Options {
+    fn default() -> Self {
+        Self {
+            min_calls: 2,
+            min_ratio: 0.8,
+        }
+    }
+}
+
+/// 每个 `def` 参数的取值分布
+///
+/// 静态分析按调用点的字面量实参记录，运行时层级也可以直接调用 `record` 写入。
+#[derive(Default)]
+pub struct ValueProfile {
+    calls: HashMap<String, usize>,
+    values: HashMap<(String, usize), HashMap<u64, usize>>,
+}
+
+impl ValueProfile {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    pub fn record_call(&mut self, name: &str) {
+        self.add_calls(name, 1);
+    }
+
+    pub fn record(&mut self, name: &str, param: usize, value: f64) {
+        self.add(name, param, value, 1);
+    }
+
+    pub fn add_calls(&mut self, name: &str, count: usize) {
+        *self.calls.entry(name.to_string()).or_default() += count;
+    }
+
+    pub fn add(&mut self, name: &str, param: usize, value: f64, count: usize) {
+        *self
+            .values
+            .entry((name.to_string(), param))
+            .or_default()
+            .entry(value.to_bits())
+            .or_default() += count;
+    }
+
+    pub fn iter_calls(&self) -> impl Iterator<Item = (&str, usize)> {
+        self.calls
+            .iter()
+            .map(|(name, count)| (name.as_str(), *count))
+    }
+
+    pub fn iter_values(&self) -> impl Iterator<Item = (&str, usize, f64, usize)> {
+        self.values.iter().flat_map(|((name, param), values)| {
+            values
+                .iter()
+                .map(|(bits, count)| (name.as_str(), *param, f64::from_bits(*bits), *count))
+        })
+    }
+
+    pub fn calls(&self, name: &str) -> usize {
+        self.calls.get(name).copied().unwrap_or(0)
+    }
+
+    pub fn dominant(&self, name: &str, param: usize, opts: &Options) -> Option<f64> {
+        let calls = self.calls(name);
+        if calls < opts.min_calls {
+            return None;
+        }
+
+        let values = self.values.get(&(name.to_string(), param))?;
+        let (&bits, &count) = values
+            .iter()
+            .max_by_key(|(bits, count)| (**count, **bits))?;
+        let value = f64::from_bits(bits);
+        if value.is_nan() || (count as f64) < calls as f64 * opts.min_ratio {
+            return None;
+        }
+        Some(value)
+    }
+}
+
+/// 收集顶层 `def` 调用点的字面量实参
+pub fn profile(src: &str, stmts: &[Stmt]) -> ValueProfile {
+    let arities = defs(src, stmts)
+        .map(|(name, params)| (name, params.len()))
+        .collect::<HashMap<_, _>>();
+
+    let pass = Profile {
+        arities,
+        profile: ValueProfile::new(),
+    };
+    let Ok(((pass,), _)) = visit::run(src, stmts, (pass,)) else {
+        unreachable!()
+    };
+    pass.profile
+}
+
+/// 对主导参数值显著的 `def` 生成特化版本
+///
+/// `def f(mode, x) body` 在 `mode` 几乎总为 `K` 时改写为
+/// `def f(mode, x) if mode == K then body[mode := K] else body`，
+/// 守卫失败时回退到通用版本，特化分支交由常量折叠消去死分支。
+pub fn specialize(src: &str, stmts: &mut [Stmt], opts: &Options) {
+    let profile = profile(src, stmts);
+
+    for stmt in stmts.iter_mut() {
+        let StmtKind::Def {
+            ident: name,
+            args,
+            body,
+            fp,
+            ..
+        } = &mut stmt.kind
+        else {
+            continue;
+        };
+        let name = &src[name.span.start..name.span.end];
+        let mode = fp.unwrap_or_default();
+        if args.iter().any(|arg| ident(src, arg).is_none()) {
+            continue;
+        }
+
+        let mut best: Option<(usize, Expr, Expr)> = None;
+        for (index, arg) in args.iter().enumerate() {
+            let Some(value) = profile.dominant(name, index, opts) else {
+                continue;
+            };
+
+            let param = ident(src, arg).unwrap();
+            if rebinds_expr(src, body, param) {
+                continue;
+            }
+
+            let lit = Expr {
+                kind: ExprKind::Lit(value),
+                span: arg.span,
+            };
+            let mut spec = body.clone();
+            substitute_expr(src, &mut spec, &HashMap::from([(param, lit)]));
+            fold::fold_expr_in(&mut spec, mode);
+
+            let gain = size_expr(src, body).saturating_sub(size_expr(src, &spec));
+            if gain > 0
+                && best
+                    .as_ref()
+                    .is_none_or(|(best_gain, ..)| gain > *best_gain)
+            {
+                best = Some((gain, guard(arg, value), spec));
+            }
+        }
+
+        if let Some((_, cond, spec)) = best {
+            let span = body.span;
+            let generic = std::mem::replace(
+                body,
+                Expr {
+                    kind: ExprKind::Ellipsis,
+                    span,
+                },
+            );
+            let kind = ExprKind::If {
+                if_then_exprs: vec![IfThenExpr {
+                    cond,
+                    then: spec,
+                    span,
+                }],
+                if_then_span: span,
+                else_branch: Some(Box::new(ElseExpr {
+                    expr: generic,
+                    span,
+                })),
+            };
+            *body = Expr { kind, span };
+        }
+    }
+}
+
+fn defs<'s>(src: &'s str, stmts: &'s [Stmt]) -> impl Iterator<Item = (&'s str, &'s [Expr])> {
+    stmts.iter().filter_map(move |stmt| match &stmt.kind {
+        StmtKind::Def { ident, args, .. }
+            if args.iter().all(|arg| matches!(arg.kind, ExprKind::Ident)) =>
+        {
+            Some((&src[ident.span.start..ident.span.end], args.as_slice()))
+        }
+        _ => None,
+    })
+}
+
+fn guard(param: &Expr, value: f64) -> Expr {
+    let span = param.span;
+    let binop = |op, left, right| Expr {
+        kind: ExprKind::BinOp {
+            op,
+            op_span: span,
+            left: Box::new(left),
+            right: Box::new(right),
+        },
+        span,
+    };
+    let lit = |value| Expr {
+        kind: ExprKind::Lit(value),
+        span,
+    };
+
+    let eq = binop(Operator::Eq, param.clone(), lit(value));
+    if value != 0.0 {
+        return eq;
+    }
+
+    // `-0 == 0` 成立，需要额外区分零的符号
+    let recip = binop(Operator::Div, lit(1.0), param.clone());
+    let sign = binop(
+        if value.is_sign_negative() {
+            Operator::Lt
+        } else {
+            Operator::Gt
+        },
+        recip,
+        lit(0.0),
+    );
+    binop(Operator::And, eq, sign)
+}
+
+struct Profile<'s> {
+    arities: HashMap<&'s str, usize>,
+    profile: ValueProfile,
+}
+
+impl<'s> Pass<'s> for Profile<'_> {
+    const NAME: &'static str = "profile";
+
+    fn enter_expr(&mut self, cx: &mut Cx<'s>, expr: &'s Expr) {
+        let ExprKind::Call { callee, args, .. } = &expr.kind else {
+            return;
+        };
+        let Some(name) = ident(cx.src, callee) else {
+            return;
+        };
+        if self.arities.get(name) == Some(&args.len()) {
+            self.profile.record_call(name);
+            for (index, arg) in args.iter().enumerate() {
+                if let Some(value) = fold::lit(arg) {
+                    self.profile.record(name, index, value);
+                }
+            }
+        }
+    }
+}
+
+/// 参数是否在函数体内被重新绑定（赋值、循环变量或内层 `def` 形参）
+pub(super) fn rebinds_expr(src: &str, expr: &Expr, name: &str) -> bool {
+    let names = [name];
+    let Ok(((rebinds,), _)) = visit::run_expr(src, expr, (Rebinds::new(&names),)) else {
+        unreachable!()
+    };
+    rebinds.found[0]
+}
+
+/// 各名称是否被赋值、用作循环变量或内层 `def` 的形参
+pub(super) struct Rebinds<'n> {
+    names: &'n [&'n str],
+    pub(super) found: Vec<bool>,
+}
+
+impl<'n> Rebinds<'n> {
+    pub(super) fn new(names: &'n [&'n str]) -> Self {
+        Self {
+            names,
+            found: vec![false; names.len()],
+        }
+    }
+
+    fn bind(&mut self, name: Option<&str>) {
+        for (found, n) in self.found.iter_mut().zip(self.names) {
+            *found |= name == Some(*n);
+        }
+    }
+}
+
+impl<'e> Pass<'e> for Rebinds<'_> {
+    const NAME: &'static str = "rebinds";
+
+    fn enter_stmt(&mut self, cx: &mut Cx<'e>, stmt: &'e Stmt) {
+        match &stmt.kind {
+            StmtKind::Assign { left, .. } => self.bind(ident(cx.src, left)),
+            StmtKind::For { loop_var, .. } => self.bind(ident(cx.src, loop_var)),
+            StmtKind::Def { args, .. } => {
+                for arg in args {
+                    self.bind(ident(cx.src, arg));
+                }
+            }
+            _ => {}
+        }
+    }
+}
@@ -1,8 +1,11 @@
+pub mod lazy;
+
 use super::{
     CodeSpan,
-    ast::{ElseExpr, Expr, ExprKind, IfThenExpr, Stmt, StmtKind},
+    ast::{ElseExpr, Expr, ExprKind, ExternAttr, FpMode, IfThenExpr, Stmt, StmtKind},
     lexer::{Operator, Token, TokenKind},
 };
+use std::cell::Cell;
 
 type Res<'s, T> = Result<(T, &'s [Token], CodeSpan), ParseError>;
 type Ctx<'s> = (&'s str, &'s [Token], CodeSpan);
@@ -38,6 +41,65 @@ pub enum ParseError {
     CondExprError(Box<Self>),
     ThenTokenError(Token),
     ThenExprError(Box<Self>),
+
+    NestingTooDeep(CodeSpan),
+}
+
+/// 每层嵌套占用的栈，按各种嵌套形状中实测的最大值取整
+///
+/// 优化构建中实测最多约 9.1 KiB，未优化的构建中约 31.8 KiB。
+const FRAME_COST: usize = if cfg!(debug_assertions) {
+    32 << 10
+} else {
+    10 << 10
+};
+
+/// 留给调用者与解析之外的栈
+const STACK_RESERVE: usize = 256 << 10;
+
+/// 在 `stack` 字节的线程栈上解析时可用的最大嵌套深度
+pub const fn max_nesting_depth(stack: usize) -> usize {
+    stack.saturating_sub(STACK_RESERVE) / FRAME_COST
+}
+
+/// 默认的表达式最大嵌套深度，保证在 2 MiB 的线程栈上解析不会溢出
+pub const MAX_NESTING_DEPTH: usize = max_nesting_depth(2 << 20);
+
+thread_local! {
+    /// 当前解析的嵌套深度上限，只在 `parse_ast_with_limit` 期间不同于默认值
+    static LIMIT: Cell<usize> = const { Cell::new(MAX_NESTING_DEPTH) };
+    /// 当前嵌套深度与进入表达式的累计次数
+    static DEPTH: Cell<(usize, usize)> = const { Cell::new((0, 0)) };
+    static AT_END: Cell<bool> = const { Cell::new(false) };
+}
+
+/// 当前线程上一次 `parse_ast` 进入表达式的次数，回溯重复解析时随之增长
+pub fn parse_steps() -> usize {
+    DEPTH.get().1
+}
+
+fn reset_steps() {
+    DEPTH.set((DEPTH.get().0, 0));
+}
+
+struct DepthGuard;
+
+impl DepthGuard {
+    fn enter(span: CodeSpan) -> Result<Self, ParseError> {
+        let (depth, steps) = DEPTH.get();
+        if depth >= LIMIT.get() {
+            return Err(ParseError::NestingTooDeep(span));
+        }
+        DEPTH.set((depth + 1, steps + 1));
+        Ok(Self)
+    }
+}
+
+impl Drop for DepthGuard {
+    fn drop(&mut self) {
+        let (depth, steps) = DEPTH.get();
+        DEPTH.set((depth - 1, steps));
+    }
 }
 
 macro_rules! next_or_ret {
@@ -52,24 +114,54 @@ macro_rules! next_or_ret {
     };
 }
 
-fn parse_skips(ctx: Ctx) -> Res<&Token> {
-    let (src, tokens, span) = ctx;
+fn parse_skips(ctx: Ctx<'_>) -> Res<'_, &Token> {
+    let (_, mut tokens, mut span) = ctx;
 
-    let (token, rest) = tokens
-        .split_first()
-        .ok_or(ParseError::UnexpectedEnd(span))?;
+    loop {
+        let Some((token, rest)) = tokens.split_first() else {
+            AT_END.set(true);
+            return Err(ParseError::UnexpectedEnd(span));
+        };
 
-    if !matches!(
-        token.kind,
-        TokenKind::Whitespace | TokenKind::Comment | TokenKind::UTF8BOM
-    ) {
-        Ok((token, rest, token.span))
-    } else {
-        parse_skips((src, rest, token.span))
+        if !matches!(
+            token.kind,
+            TokenKind::Whitespace | TokenKind::Comment | TokenKind::UTF8BOM
+        ) {
+            return Ok((token, rest, token.span));
+        }
+
+        tokens = rest;
+        span = token.span;
     }
 }
 
 pub fn parse_ast(src: &str, tokens: &[Token]) -> Result<Vec<Stmt>, ParseError> {
+    parse_ast_with_limit(src, tokens, MAX_NESTING_DEPTH)
+}
+
+/// 以 `limit` 为嵌套深度上限解析，只影响本次调用
+///
+/// 在栈更大的线程上解析时，可以用 [`max_nesting_depth`] 按栈大小得到上限。
+pub fn parse_ast_with_limit(
+    src: &str,
+    tokens: &[Token],
+    limit: usize,
+) -> Result<Vec<Stmt>, ParseError> {
+    let _guard = LimitGuard(LIMIT.replace(limit));
+    parse_all(src, tokens)
+}
+
+/// 恢复外层的嵌套深度上限
+struct LimitGuard(usize);
+
+impl Drop for LimitGuard {
+    fn drop(&mut self) {
+        LIMIT.set(self.0);
+    }
+}
+
+fn parse_all(src: &str, tokens: &[Token]) -> Result<Vec<Stmt>, ParseError> {
+    reset_steps();
     if tokens.is_empty() || src.trim().is_empty() {
         return Ok(Vec::new());
     }
@@ -97,6 +189,48 @@ pub fn parse_ast(src: &str, tokens: &[Token]) -> Result<Vec<Stmt>, ParseError> {
     Ok(stmts)
 }
 
+/// 流式解析的一步
+pub enum NextStmt {
+    /// 语句、消耗的 Token 数与最后一个 Token 的位置
+    Stmt(Stmt, usize, CodeSpan),
+    /// 只剩空白与注释
+    Done,
+    /// 解析触及已有 Token 的末尾，补充 Token 后结果可能不同
+    More,
+}
+
+/// 从 `tokens` 开头解析一条语句，`last` 表示 `tokens` 之后不再有输入
+///
+/// 解析只取决于检查过的 Token，未触及末尾的结果与一次性解析全部 Token 相同。
+pub fn parse_next(
+    src: &str,
+    tokens: &[Token],
+    last_span: CodeSpan,
+    last: bool,
+) -> Result<NextStmt, ParseError> {
+    AT_END.set(false);
+    let ctx = (src, tokens, last_span);
+    let result = match parse_skips(ctx) {
+        Ok(_) => parse_stmt(ctx).map(Some),
+        Err(_) => Ok(None),
+    };
+    if AT_END.get() && !last {
+        return Ok(NextStmt::More);
+    }
+    Ok(match result? {
+        Some((stmt, rest, span)) => NextStmt::Stmt(stmt, tokens.len() - rest.len(), span),
+        None => NextStmt::Done,
+    })
+}
+
+fn at_end(tokens: &[Token]) -> bool {
+    let end = tokens.is_empty();
+    if end {
+        AT_END.set(true);
+    }
+    end
+}
+
 fn parse_stmt(ctx: Ctx) -> Res<Stmt> {
     let (src, rest, span) = ctx;
 
@@ -121,8 +255,10 @@ fn parse_stmt(ctx: Ctx) -> Res<Stmt> {
     }
 }
 
+/// 所有嵌套结构（括号、块、实参、条件）都经由此处递归，在此限制深度
 #[inline(always)]
 fn parse_expr(ctx: Ctx) -> Res<Expr> {
+    let _guard = DepthGuard::enter(ctx.2)?;
     parse_range(ctx)
 }
 
@@ -140,7 +276,7 @@ fn parse_assign(ctx: Ctx) -> Res<Stmt> {
     let (src, _, _) = ctx;
 
     let (ident, ident_rest, _) = parse_skips(ctx)?;
-    if !matches!(ident.kind, TokenKind::Ident) || ident_rest.is_empty() {
+    if !matches!(ident.kind, TokenKind::Ident) || at_end(ident_rest) {
         return Err(ParseError::UnexpectedToken(*ident));
     }
 
@@ -203,7 +339,12 @@ fn parse_args(ctx: Ctx) -> Res<(Vec<Expr>, CodeSpan)> {
 
     let (mut args, mut rest, mut last_span) = (Vec::new(), rest, open_paren.span);
     let mut flag = false;
-    while let Ok((arg, arg_rest, arg_last_span)) = parse_expr((src, rest, last_span)) {
+    loop {
+        let (arg, arg_rest, arg_last_span) = match parse_expr((src, rest, last_span)) {
+            Ok(arg) => arg,
+            Err(e @ ParseError::NestingTooDeep(_)) => return Err(e),
+            Err(_) => break,
+        };
         args.push(arg);
         rest = arg_rest;
         last_span = arg_last_span;
@@ -238,11 +379,22 @@ fn parse_extern(ctx: Ctx) -> Res<Stmt> {
         return Err(ParseError::UnexpectedToken(*extern_token));
     }
 
-    let (ident, ident_rest, _) = parse_skips((src, rest, extern_token.span))?;
+    let (mut ident, mut ident_rest, _) = parse_skips((src, rest, extern_token.span))?;
     if !matches!(ident.kind, TokenKind::Ident) {
         return Err(ParseError::ExternNameError(ident.span));
     }
 
+    // `extern pure name(...)`：函数名前的标识符为调用属性
+    let mut attr = None;
+    if let Some(a) = ExternAttr::from_name(&src[ident.span.start..ident.span.end]) {
+        if let Ok((name, name_rest, _)) = parse_skips((src, ident_rest, ident.span)) {
+            if matches!(name.kind, TokenKind::Ident) {
+                attr = Some(a);
+                (ident, ident_rest) = (name, name_rest);
+            }
+        }
+    }
+
     let ((args, args_span), args_rest, args_last_span) = parse_args((src, ident_rest, ident.span))
         .map_err(|e| ParseError::ExternArgsError(Box::new(e)))?;
 
@@ -260,41 +412,76 @@ fn parse_extern(ctx: Ctx) -> Res<Stmt> {
         ident,
         args,
         args_span,
+        attr,
     };
     Ok((Stmt { kind, span }, s_rest, s_token.span))
 }
 
-fn parse_def(ctx: Ctx) -> Res<Stmt> {
+/// `def` 的名称、浮点语义修饰与形参
+struct DefHead {
+    def: CodeSpan,
+    ident: Expr,
+    args: Vec<Expr>,
+    args_span: CodeSpan,
+    fp: Option<FpMode>,
+}
+
+fn parse_def_head(ctx: Ctx) -> Res<DefHead> {
     let (src, _, _) = ctx;
     let (def, rest, _) = parse_skips(ctx)?;
     if !matches!(def.kind, TokenKind::Def) {
         return Err(ParseError::UnexpectedToken(*def));
     }
 
-    let (ident, ident_rest, _) = parse_skips((src, rest, def.span))?;
+    let (mut ident, mut ident_rest, _) = parse_skips((src, rest, def.span))?;
     if !matches!(ident.kind, TokenKind::Ident) {
         return Err(ParseError::DefNameError(ident.span));
     }
 
+    // `def fast name(...)`：函数名前的标识符为浮点语义修饰
+    let mut fp = None;
+    if let Some(mode) = FpMode::from_name(&src[ident.span.start..ident.span.end]) {
+        if let Ok((name, name_rest, _)) = parse_skips((src, ident_rest, ident.span)) {
+            if matches!(name.kind, TokenKind::Ident) {
+                fp = Some(mode);
+                (ident, ident_rest) = (name, name_rest);
+            }
+        }
+    }
+
     let ((args, args_span), args_rest, args_last_span) = parse_args((src, ident_rest, ident.span))
         .map_err(|e| ParseError::DefArgsError(Box::new(e)))?;
 
-    let (body, body_rest, body_last_span) = parse_expr((src, args_rest, args_last_span))
-        .map_err(|e| ParseError::DefBodyError(Box::new(e)))?;
-
-    let span = def.span.merge(body.span);
-
     let ident = Expr {
         kind: ExprKind::Ident,
         span: ident.span,
     };
-    let body_span = body.span;
-    let kind = StmtKind::Def {
+    let head = DefHead {
+        def: def.span,
         ident,
         args,
         args_span,
+        fp,
+    };
+    Ok((head, args_rest, args_last_span))
+}
+
+fn parse_def(ctx: Ctx) -> Res<Stmt> {
+    let (src, _, _) = ctx;
+    let (head, args_rest, args_last_span) = parse_def_head(ctx)?;
+
+    let (body, body_rest, body_last_span) = parse_expr((src, args_rest, args_last_span))
+        .map_err(|e| ParseError::DefBodyError(Box::new(e)))?;
+
+    let span = head.def.merge(body.span);
+    let body_span = body.span;
+    let kind = StmtKind::Def {
+        ident: head.ident,
+        args: head.args,
+        args_span: head.args_span,
         body,
         body_span,
+        fp: head.fp,
     };
 
     let (_, rest, last_span) = parse_semi((src, body_rest, body_last_span))?;
@@ -485,7 +672,10 @@ fn parse_unary(ctx: Ctx) -> Res<Expr> {
 fn parse_call(ctx: Ctx) -> Res<Expr> {
     let (src, _, _) = ctx;
     let (ident, ident_rest, _) = parse_skips(ctx)?;
-    if !matches!(ident.kind, TokenKind::Ident) {
+    // 位于输入末尾的标识符不是调用
+    if !matches!(ident.kind, TokenKind::Ident)
+        || parse_skips((src, ident_rest, ident.span)).is_err()
+    {
         return parse_primary(ctx);
     }
 
@@ -532,7 +722,12 @@ fn parse_block(ctx: Ctx) -> Res<Expr> {
     }
 
     let (mut stmts, mut rest, mut last_span) = (Vec::new(), rest, open_brace.span);
-    while let Ok((stmt, stmt_rest, stmt_last_span)) = parse_stmt((src, rest, last_span)) {
+    loop {
+        let (stmt, stmt_rest, stmt_last_span) = match parse_stmt((src, rest, last_span)) {
+            Ok(stmt) => stmt,
+            Err(e @ ParseError::NestingTooDeep(_)) => return Err(e),
+            Err(_) => break,
+        };
         stmts.push(stmt);
         rest = stmt_rest;
         last_span = stmt_last_span;
@@ -0,0 +1,288 @@
+//! 惰性解析
+//!
+//! 预解析完整解析 `def` 以外的顶层语句，`def` 只解析名称与形参，函数体按运算符结构
+//! 扫描出 Token 范围，括号内的 Token 按配对索引整段跳过，首次使用时才构建语法树。
+//! 函数体中的语法错误推迟到解析该函数体时报告；括号不配对时全部语句完整解析。
+
+use super::{
+    Ctx, DefHead, ParseError, parse_def_head, parse_expr, parse_semi, parse_skips, parse_stmt,
+    reset_steps,
+};
+use crate::compiler::{
+    CodeSpan,
+    ast::{Expr, FpMode, Stmt, StmtKind},
+    lexer::{
+        Token, TokenKind,
+        brackets::{BracketError, Brackets},
+    },
+    visit::{self, calls::CallGraph},
+};
+use std::{
+    collections::{HashMap, HashSet},
+    ops::Range,
+    sync::OnceLock,
+};
+
+/// 预解析得到的顶层语句
+pub enum Item {
+    Stmt(Stmt),
+    Def(LazyDef),
+}
+
+/// 函数体尚未解析的 `def`
+pub struct LazyDef {
+    pub ident: Expr,
+    pub args: Vec<Expr>,
+    pub args_span: CodeSpan,
+    pub fp: Option<FpMode>,
+    /// 整条语句的位置，不需要解析函数体即可确定
+    pub span: CodeSpan,
+    pub body_span: CodeSpan,
+    /// 函数体在模块 Token 中的范围，含开头的空白
+    body: Range<usize>,
+    /// 函数体之前最后一个 Token 的位置
+    last_span: CodeSpan,
+    stmt: OnceLock<Result<Stmt, ParseError>>,
+}
+
+pub struct LazyModule<'s> {
+    src: &'s str,
+    tokens: &'s [Token],
+    pub items: Vec<Item>,
+}
+
+impl<'s> LazyModule<'s> {
+    pub fn preparse(src: &'s str, tokens: &'s [Token]) -> Result<Self, ParseError> {
+        reset_steps();
+        let mut items = Vec::new();
+        if tokens.is_empty() || src.trim().is_empty() {
+            return Ok(Self { src, tokens, items });
+        }
+
+        // 第一个不配对的括号之后的 `def` 不跳过函数体，由完整解析报告错误
+        let (brackets, errors) = Brackets::new(tokens);
+        let limit = errors.iter().map(BracketError::start).min();
+        let mut rest = tokens;
+        let mut last_span = CodeSpan {
+            line: 0,
+            src_id: 0,
+            start: 0,
+            end: 0,
+        };
+        while parse_skips((src, rest, last_span)).is_ok() {
+            let ctx = (src, rest, last_span);
+            let def = preparse_def(ctx, tokens.len(), &brackets)
+                .filter(|(_, _, span)| limit.is_none_or(|limit| span.end <= limit));
+            let (item, item_rest, span) = match def {
+                Some((def, def_rest, span)) => (Item::Def(def), def_rest, span),
+                None => {
+                    let (stmt, stmt_rest, span) = parse_stmt(ctx)?;
+                    (Item::Stmt(stmt), stmt_rest, span)
+                }
+            };
+            items.push(item);
+            rest = item_rest;
+            last_span = span;
+        }
+        Ok(Self { src, tokens, items })
+    }
+
+    /// 解析函数体，得到完整的 `def` 语句，结果会被缓存
+    pub fn force<'d>(&self, def: &'d LazyDef) -> Result<&'d Stmt, ParseError> {
+        let stmt = def.stmt.get_or_init(|| {
+            let tokens = &self.tokens[def.body.clone()];
+            let (body, rest, span) = parse_expr((self.src, tokens, def.last_span))
+                .map_err(|e| ParseError::DefBodyError(Box::new(e)))?;
+            // 扫描与解析对函数体的范围不一致，说明函数体不是合法的表达式
+            if let Ok((token, _, _)) = parse_skips((self.src, rest, span)) {
+                let e = ParseError::UnexpectedToken(*token);
+                return Err(ParseError::DefBodyError(Box::new(e)));
+            }
+            let kind = StmtKind::Def {
+                ident: def.ident.clone(),
+                args: def.args.clone(),
+                args_span: def.args_span,
+                body,
+                body_span: def.body_span,
+                fp: def.fp,
+            };
+            Ok(Stmt {
+                kind,
+                span: def.span,
+            })
+        });
+        stmt.as_ref().map_err(Clone::clone)
+    }
+
+    /// 已解析的函数体个数
+    pub fn parsed(&self) -> usize {
+        self.items
+            .iter()
+            .filter(|item| matches!(item, Item::Def(def) if def.stmt.get().is_some()))
+            .count()
+    }
+
+    /// 解析全部函数体，结果与 [`parse_ast`](super::parse_ast) 相同
+    pub fn into_stmts(self) -> Result<Vec<Stmt>, ParseError> {
+        let mut stmts = Vec::with_capacity(self.items.len());
+        for item in &self.items {
+            if let Item::Def(def) = item {
+                self.force(def)?;
+            }
+        }
+        for item in self.items {
+            stmts.push(match item {
+                Item::Stmt(stmt) => stmt,
+                Item::Def(def) => def.stmt.into_inner().unwrap()?,
+            });
+        }
+        Ok(stmts)
+    }
+}
+
+/// 只保留顶层代码与 `roots` 直接或间接调用的 `def`，其余函数体不解析
+///
+/// 同名的 `def` 一并保留；顶层代码中的 `def` 总是保留。
+pub fn shake(modules: Vec<LazyModule<'_>>, roots: &[&str]) -> Result<Vec<Vec<Stmt>>, ParseError> {
+    let mut index = HashMap::<&str, Vec<(usize, usize)>>::new();
+    let mut work = roots
+        .iter()
+        .map(|root| root.to_string())
+        .collect::<Vec<_>>();
+    for (m, module) in modules.iter().enumerate() {
+        for (i, item) in module.items.iter().enumerate() {
+            match item {
+                Item::Def(def) => {
+                    let name = &module.src[def.ident.span.start..def.ident.span.end];
+                    index.entry(name).or_default().push((m, i));
+                }
+                Item::Stmt(stmt) => work.extend(callees(module.src, stmt)),
+            }
+        }
+    }
+
+    let mut live = HashSet::new();
+    let mut seen = HashSet::new();
+    while let Some(name) = work.pop() {
+        if !seen.insert(name.clone()) {
+            continue;
+        }
+        for &(m, i) in index.get(name.as_str()).into_iter().flatten() {
+            let module = &modules[m];
+            let Item::Def(def) = &module.items[i] else {
+                unreachable!()
+            };
+            work.extend(callees(module.src, module.force(def)?));
+            live.insert((m, i));
+        }
+    }
+
+    let mut out = Vec::with_capacity(modules.len());
+    for (m, module) in modules.into_iter().enumerate() {
+        let mut stmts = Vec::new();
+        for (i, item) in module.items.into_iter().enumerate() {
+            match item {
+                Item::Stmt(stmt) => stmts.push(stmt),
+                Item::Def(def) if live.contains(&(m, i)) => {
+                    stmts.push(def.stmt.into_inner().unwrap()?)
+                }
+                Item::Def(_) => {}
+            }
+        }
+        out.push(stmts);
+    }
+    Ok(out)
+}
+
+fn callees(src: &str, stmt: &Stmt) -> Vec<String> {
+    let Ok(((graph,), _)) = visit::run(src, std::slice::from_ref(stmt), (CallGraph::default(),))
+    else {
+        unreachable!()
+    };
+    let names = graph.callees.into_values().flatten();
+    names.map(str::to_string).collect()
+}
+
+/// 解析 `def` 的头部并扫描函数体；不是 `def` 或扫描不出完整的函数体时返回 `None`，
+/// 交给完整解析报告错误
+fn preparse_def<'t>(
+    ctx: Ctx<'t>,
+    total: usize,
+    brackets: &Brackets,
+) -> Option<(LazyDef, &'t [Token], CodeSpan)> {
+    let (src, _, _) = ctx;
+    let (head, args_rest, args_last_span) = parse_def_head(ctx).ok()?;
+    let start = total - args_rest.len();
+    let (len, first, last) = scan_expr(args_rest, start, brackets)?;
+
+    let (_, rest, last_span) = parse_semi((src, &args_rest[len..], last)).ok()?;
+    let DefHead {
+        def,
+        ident,
+        args,
+        args_span,
+        fp,
+    } = head;
+    let body_span = first.merge(last);
+    let lazy = LazyDef {
+        ident,
+        args,
+        args_span,
+        fp,
+        span: def.merge(body_span),
+        body_span,
+        body: start..start + len,
+        last_span: args_last_span,
+        stmt: OnceLock::new(),
+    };
+    Some((lazy, rest, last_span))
+}
+
+/// 扫描一个表达式，返回占用的 Token 数与首尾 Token 的位置，`base` 为 `tokens` 在
+/// 模块 Token 中的起始下标
+///
+/// 括号与花括号按配对索引整段跳过；括号外按“期待操作数”与“操作数之后”两种状态推进：
+/// 一元运算符与 `if` 之后仍期待操作数，二元运算符、`then` 与 `else` 接在操作数之后，
+/// 紧跟标识符的括号为调用。其余 Token 结束表达式。以运算符结尾时返回 `None`。
+fn scan_expr(
+    tokens: &[Token],
+    base: usize,
+    brackets: &Brackets,
+) -> Option<(usize, CodeSpan, CodeSpan)> {
+    use TokenKind::*;
+
+    let (mut operand, mut callee) = (true, false);
+    let (mut len, mut first, mut last) = (0, None, None);
+    let mut i = 0;
+    while let Some(token) = tokens.get(i) {
+        let mut end = i;
+        match token.kind {
+            Whitespace | Comment | UTF8BOM => {
+                i += 1;
+                continue;
+            }
+            Sub | Not | If if operand => {}
+            Ident | Number | Ellipsis if operand => operand = false,
+            OpenParen | OpenBrace if operand || callee && token.kind == OpenParen => {
+                end = brackets.partner(base + i)? - base;
+                operand = false;
+            }
+            Range | And | Or | Eq | Ne | Lt | Le | Gt | Ge | Add | Sub | Mul | Div | Then
+            | Else
+                if !operand =>
+            {
+                operand = true
+            }
+            _ => break,
+        }
+        callee = token.kind == Ident;
+        first.get_or_insert(token.span);
+        last = Some(tokens[end].span);
+        len = end + 1;
+        i = end + 1;
+    }
+    if operand {
+        return None;
+    }
+    Some((len, first?, last?))
+}
@@ -0,0 +1,433 @@
+mod tree;
+
+use super::{
+    ast::Stmt,
+    lexer::{CodeSpan, Token, TokenKind},
+    opt::specialize::ValueProfile,
+};
+use std::{
+    collections::HashMap,
+    fs::File,
+    io::{BufWriter, Write},
+    ops::Deref,
+    path::{Path, PathBuf},
+    sync::{
+        Arc,
+        atomic::{AtomicUsize, Ordering},
+    },
+};
+
+/// 快照文件格式
+///
+/// ```text
+/// header   magic[8] flags:u32 _:u32 hash:u64 (tokens symbols symbols_len calls values ast_len):u64
+/// tokens   (kind line start end):u32
+/// symbols  end:u32 ... bytes
+/// calls    (symbol count):u32
+/// values   (symbol param):u32 (bits count):u64
+/// ast      先序排列的节点，见 `tree`
+/// ```
+///
+/// 所有整数为小端序。位置均相对于源代码本身，载入时重新指定 `src_id`。
+const MAGIC: &[u8; 8] = b"KSSNAP02";
+const HEADER_LEN: usize = 8 + 4 + 4 + 8 + 8 * 6;
+const TOKEN_LEN: usize = 16;
+const CALL_LEN: usize = 8;
+const VALUE_LEN: usize = 24;
+
+pub const SNAP_OPTIMIZED: u32 = 1;
+pub const SNAP_FP_CONTRACT: u32 = 2;
+pub const SNAP_FP_FAST: u32 = 4;
+
+#[derive(Debug)]
+pub enum SnapshotError {
+    Io(std::io::Error),
+    Format,
+    TooLarge,
+}
+
+impl From<std::io::Error> for SnapshotError {
+    fn from(value: std::io::Error) -> Self {
+        Self::Io(value)
+    }
+}
+
+impl std::fmt::Display for SnapshotError {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        match self {
+            Self::Io(e) => write!(f, "{}", e),
+            Self::Format => f.write_str("快照格式错误"),
+            Self::TooLarge => f.write_str("源代码超出快照支持的大小"),
+        }
+    }
+}
+
+impl std::error::Error for SnapshotError {}
+
+/// FNV-1a 内容散列，与平台和运行次数无关
+pub fn content_hash(text: &str) -> u64 {
+    text.bytes().fold(0xcbf2_9ce4_8422_2325, |hash, byte| {
+        (hash ^ byte as u64).wrapping_mul(0x0000_0100_0000_01b3)
+    })
+}
+
+pub struct Session<'a> {
+    pub text: &'a str,
+    pub tokens: &'a [Token],
+    pub ast: &'a [Stmt],
+    pub profile: Option<&'a ValueProfile>,
+    pub flags: u32,
+}
+
+pub fn write(path: &Path, session: &Session) -> Result<(), SnapshotError> {
+    if u32::try_from(session.text.len()).is_err() {
+        return Err(SnapshotError::TooLarge);
+    }
+
+    // 其他进程可能正映射着旧文件，原地截断会使其读到 SIGBUS，因此写入临时文件后替换
+    let tmp = temp_path(path);
+    match File::create(&tmp)
+        .map_err(SnapshotError::from)
+        .and_then(|file| write_to(BufWriter::new(file), session))
+    {
+        Ok(()) => Ok(std::fs::rename(&tmp, path)?),
+        Err(e) => {
+            let _ = std::fs::remove_file(&tmp);
+            Err(e)
+        }
+    }
+}
+
+/// 同一目录下的临时文件，以进程号与计数区分并发的写入者
+fn temp_path(path: &Path) -> PathBuf {
+    static NEXT: AtomicUsize = AtomicUsize::new(0);
+    let mut name = path.file_name().unwrap_or_default().to_os_string();
+    name.push(format!(
+        ".{}.{}.tmp",
+        std::process::id(),
+        NEXT.fetch_add(1, Ordering::Relaxed)
+    ));
+    path.with_file_name(name)
+}
+
+fn write_to(mut out: impl Write, session: &Session) -> Result<(), SnapshotError> {
+    let mut symbols = HashMap::<&str, u32>::new();
+    let mut order = Vec::new();
+    for token in session.tokens {
+        if matches!(token.kind, TokenKind::Ident) {
+            let name = &session.text[token.span.start..token.span.end];
+            symbols.entry(name).or_insert_with(|| {
+                order.push(name);
+                order.len() as u32 - 1
+            });
+        }
+    }
+
+    let (calls, values) = match session.profile {
+        Some(profile) => (
+            profile
+                .iter_calls()
+                .filter_map(|(name, count)| Some((*symbols.get(name)?, count as u32)))
+                .collect::<Vec<_>>(),
+            profile
+                .iter_values()
+                .filter_map(|(name, param, value, count)| {
+                    Some((*symbols.get(name)?, param as u32, value, count as u64))
+                })
+                .collect::<Vec<_>>(),
+        ),
+        None => (vec![], vec![]),
+    };
+
+    let mut ast = Vec::new();
+    tree::encode(session.ast, &mut ast);
+    let symbols_len = order.iter().map(|name| name.len()).sum::<usize>();
+
+    out.write_all(MAGIC)?;
+    out.write_all(&session.flags.to_le_bytes())?;
+    out.write_all(&0u32.to_le_bytes())?;
+    out.write_all(&content_hash(session.text).to_le_bytes())?;
+    for len in [
+        session.tokens.len(),
+        order.len(),
+        symbols_len,
+        calls.len(),
+        values.len(),
+        ast.len(),
+    ] {
+        out.write_all(&(len as u64).to_le_bytes())?;
+    }
+
+    for token in session.tokens {
+        let span = token.span;
+        for field in [
+            token.kind as u32,
+            span.line as u32,
+            span.start as u32,
+            span.end as u32,
+        ] {
+            out.write_all(&field.to_le_bytes())?;
+        }
+    }
+
+    let mut end = 0u32;
+    for name in &order {
+        end += name.len() as u32;
+        out.write_all(&end.to_le_bytes())?;
+    }
+    for name in &order {
+        out.write_all(name.as_bytes())?;
+    }
+
+    for (symbol, count) in calls {
+        out.write_all(&symbol.to_le_bytes())?;
+        out.write_all(&count.to_le_bytes())?;
+    }
+    for (symbol, param, value, count) in values {
+        out.write_all(&symbol.to_le_bytes())?;
+        out.write_all(&param.to_le_bytes())?;
+        out.write_all(&value.to_bits().to_le_bytes())?;
+        out.write_all(&count.to_le_bytes())?;
+    }
+
+    out.write_all(&ast)?;
+    out.flush()?;
+    Ok(())
+}
+
+struct Header {
+    flags: u32,
+    hash: u64,
+    tokens: usize,
+    symbols: usize,
+    symbols_len: usize,
+    calls: usize,
+    values: usize,
+    ast_len: usize,
+}
+
+/// 各段的起始位置
+struct Layout {
+    symbols: usize,
+    /// 符号名的字节
+    names: usize,
+    calls: usize,
+    values: usize,
+    ast: usize,
+}
+
+impl Header {
+    /// 头部来自文件，不可信，任一步溢出时返回 `None`
+    fn layout(&self) -> Option<Layout> {
+        let symbols = self
+            .tokens
+            .checked_mul(TOKEN_LEN)?
+            .checked_add(HEADER_LEN)?;
+        let names = self.symbols.checked_mul(4)?.checked_add(symbols)?;
+        let calls = names.checked_add(self.symbols_len)?;
+        let values = self.calls.checked_mul(CALL_LEN)?.checked_add(calls)?;
+        let ast = self.values.checked_mul(VALUE_LEN)?.checked_add(values)?;
+        Some(Layout {
+            symbols,
+            names,
+            calls,
+            values,
+            ast,
+        })
+    }
+}
+
+/// 映射到内存中的快照，各段按需从映射区域直接解码
+pub struct Snapshot {
+    map: Mapping,
+    header: Header,
+    layout: Layout,
+}
+
+impl Snapshot {
+    pub fn open(path: &Path) -> Result<Self, SnapshotError> {
+        let map = Mapping::open(path)?;
+        if map.len() < HEADER_LEN || &map[..8] != MAGIC {
+            return Err(SnapshotError::Format);
+        }
+
+        let len_at = |index: usize| {
+            usize::try_from(read_u64(&map, 16 + index * 8)).map_err(|_| SnapshotError::Format)
+        };
+        let header = Header {
+            flags: read_u32(&map, 8),
+            hash: read_u64(&map, 16),
+            tokens: len_at(1)?,
+            symbols: len_at(2)?,
+            symbols_len: len_at(3)?,
+            calls: len_at(4)?,
+            values: len_at(5)?,
+            ast_len: len_at(6)?,
+        };
+
+        let layout = header.layout().ok_or(SnapshotError::Format)?;
+        if layout.ast.checked_add(header.ast_len) != Some(map.len()) {
+            return Err(SnapshotError::Format);
+        }
+        Ok(Self {
+            map,
+            header,
+            layout,
+        })
+    }
+
+    /// 快照是否由同一份源代码、同样的选项生成
+    pub fn matches(&self, text: &str, flags: u32) -> bool {
+        self.header.flags == flags && self.header.hash == content_hash(text)
+    }
+
+    pub fn tokens(&self, src_id: usize) -> impl Iterator<Item = Result<Token, SnapshotError>> + '_ {
+        let section = &self.map[HEADER_LEN..self.layout.symbols];
+        section.chunks_exact(TOKEN_LEN).map(move |record| {
+            let kind =
+                TokenKind::try_from(read_u32(record, 0)).map_err(|_| SnapshotError::Format)?;
+            let span = CodeSpan {
+                line: read_u32(record, 4) as usize,
+                src_id,
+                start: read_u32(record, 8) as usize,
+                end: read_u32(record, 12) as usize,
+            };
+            Ok(Token { kind, span })
+        })
+    }
+
+    pub fn symbols(&self) -> Result<Vec<Arc<str>>, SnapshotError> {
+        let Layout { symbols, names, .. } = self.layout;
+        let section = &self.map[names..self.layout.calls];
+        let mut start = 0;
+        self.map[symbols..names]
+            .chunks_exact(4)
+            .map(|record| {
+                let end = read_u32(record, 0) as usize;
+                let name = section
+                    .get(start..end)
+                    .and_then(|name| std::str::from_utf8(name).ok())
+                    .ok_or(SnapshotError::Format)?;
+                start = end;
+                Ok(Arc::from(name))
+            })
+            .collect()
+    }
+
+    /// 符号表，可直接作为 `Analyzer::names`
+    pub fn names(&self) -> Result<HashMap<Arc<str>, usize>, SnapshotError> {
+        Ok(self
+            .symbols()?
+            .into_iter()
+            .enumerate()
+            .map(|(index, name)| (name, index))
+            .collect())
+    }
+
+    pub fn profile(&self) -> Result<ValueProfile, SnapshotError> {
+        let symbols = self.symbols()?;
+        let symbol = |index: u32| symbols.get(index as usize).ok_or(SnapshotError::Format);
+
+        let mut profile = ValueProfile::new();
+        let Layout {
+            calls, values, ast, ..
+        } = self.layout;
+        for record in self.map[calls..values].chunks_exact(CALL_LEN) {
+            profile.add_calls(symbol(read_u32(record, 0))?, read_u32(record, 4) as usize);
+        }
+        for record in self.map[values..ast].chunks_exact(VALUE_LEN) {
+            let name = symbol(read_u32(record, 0))?;
+            let param = read_u32(record, 4) as usize;
+            let value = f64::from_bits(read_u64(record, 8));
+            profile.add(name, param, value, read_u64(record, 16) as usize);
+        }
+        Ok(profile)
+    }
+
+    pub fn ast(&self, src_id: usize) -> Result<Vec<Stmt>, SnapshotError> {
+        tree::decode(&self.map[self.layout.ast..], src_id)
+    }
+}
+
+fn read_u32(bytes: &[u8], offset: usize) -> u32 {
+    u32::from_le_bytes(bytes[offset..offset + 4].try_into().unwrap())
+}
+
+fn read_u64(bytes: &[u8], offset: usize) -> u64 {
+    u64::from_le_bytes(bytes[offset..offset + 8].try_into().unwrap())
+}
+
+#[cfg(unix)]
+struct Mapping {
+    ptr: *mut libc::c_void,
+    len: usize,
+}
+
+#[cfg(unix)]
+impl Mapping {
+    fn open(path: &Path) -> std::io::Result<Self> {
+        use std::os::fd::AsRawFd;
+
+        let file = File::open(path)?;
+        let len = file.metadata()?.len() as usize;
+        if len == 0 {
+            return Ok(Self {
+                ptr: std::ptr::null_mut(),
+                len,
+            });
+        }
+
+        let ptr = unsafe {
+            libc::mmap(
+                std::ptr::null_mut(),
+                len,
+                libc::PROT_READ,
+                libc::MAP_PRIVATE,
+                file.as_raw_fd(),
+                0,
+            )
+        };
+        if ptr == libc::MAP_FAILED {
+            return Err(std::io::Error::last_os_error());
+        }
+        Ok(Self { ptr, len })
+    }
+}
+
+#[cfg(unix)]
+impl Deref for Mapping {
+    type Target = [u8];
+    fn deref(&self) -> &[u8] {
+        if self.len == 0 {
+            return &[];
+        }
+        unsafe { std::slice::from_raw_parts(self.ptr as *const u8, self.len) }
+    }
+}
+
+#[cfg(unix)]
+impl Drop for Mapping {
+    fn drop(&mut self) {
+        if self.len != 0 {
+            unsafe { libc::munmap(self.ptr, self.len) };
+        }
+    }
+}
+
+#[cfg(not(unix))]
+struct Mapping(Vec<u8>);
+
+#[cfg(not(unix))]
+impl Mapping {
+    fn open(path: &Path) -> std::io::Result<Self> {
+        std::fs::read(path).map(Self)
+    }
+}
+
+#[cfg(not(unix))]
+impl Deref for Mapping {
+    type Target = [u8];
+    fn deref(&self) -> &[u8] {
+        &self.0
+    }
+}
@@ -0,0 +1,444 @@
+//! 抽象语法树的二进制编码
+//!
+//! 节点按先序排列，每个节点以一字节标记开头，随后是位置与各字段。位置为
+//! `(line start end):u32`，数量为 `u32`，浮点数为 `u64` 位模式，可选字段以一字节
+//! 标记是否存在。所有整数为小端序。
+
+use super::{
+    super::{
+        CodeSpan,
+        ast::{
+            ElseExpr, Expr, ExprKind, ExternAttr, FpMode, IfThenExpr, Stmt, StmtKind, SwitchCase,
+        },
+        lexer::{Operator, TokenKind},
+    },
+    SnapshotError,
+};
+
+/// 解码时的最大嵌套深度，超过时视为格式错误
+const MAX_DEPTH: usize = 1 << 12;
+
+pub(super) fn encode(stmts: &[Stmt], out: &mut Vec<u8>) {
+    len(stmts.len(), out);
+    for stmt in stmts {
+        encode_stmt(stmt, out);
+    }
+}
+
+fn len(value: usize, out: &mut Vec<u8>) {
+    out.extend_from_slice(&(value as u32).to_le_bytes());
+}
+
+fn span(span: &CodeSpan, out: &mut Vec<u8>) {
+    for field in [span.line, span.start, span.end] {
+        out.extend_from_slice(&(field as u32).to_le_bytes());
+    }
+}
+
+fn exprs(exprs: &[Expr], out: &mut Vec<u8>) {
+    len(exprs.len(), out);
+    for expr in exprs {
+        encode_expr(expr, out);
+    }
+}
+
+fn encode_stmt(stmt: &Stmt, out: &mut Vec<u8>) {
+    let tag = match &stmt.kind {
+        StmtKind::Assign { .. } => 0,
+        StmtKind::Break => 1,
+        StmtKind::Continue => 2,
+        StmtKind::Def { .. } => 3,
+        StmtKind::Empty => 4,
+        StmtKind::Expr(_) => 5,
+        StmtKind::Extern { .. } => 6,
+        StmtKind::For { .. } => 7,
+        StmtKind::Return(_) => 8,
+    };
+    out.push(tag);
+    span(&stmt.span, out);
+    match &stmt.kind {
+        StmtKind::Assign {
+            left,
+            right,
+            assign_span,
+        } => {
+            encode_expr(left, out);
+            encode_expr(right, out);
+            span(assign_span, out);
+        }
+        StmtKind::Break | StmtKind::Continue | StmtKind::Empty => {}
+        StmtKind::Def {
+            ident,
+            args,
+            args_span,
+            body,
+            body_span,
+            fp,
+        } => {
+            encode_expr(ident, out);
+            exprs(args, out);
+            span(args_span, out);
+            encode_expr(body, out);
+            span(body_span, out);
+            out.push(match fp {
+                None => 0,
+                Some(FpMode::Strict) => 1,
+                Some(FpMode::Contract) => 2,
+                Some(FpMode::Fast) => 3,
+            });
+        }
+        StmtKind::Expr(expr) | StmtKind::Return(expr) => encode_expr(expr, out),
+        StmtKind::Extern {
+            ident,
+            args,
+            args_span,
+            attr,
+        } => {
+            encode_expr(ident, out);
+            exprs(args, out);
+            span(args_span, out);
+            out.push(match attr {
+                None => 0,
+                Some(ExternAttr::Pure) => 1,
+                Some(ExternAttr::Const) => 2,
+            });
+        }
+        StmtKind::For {
+            loop_var,
+            loop_iter,
+            head_span,
+            loop_body,
+        } => {
+            encode_expr(loop_var, out);
+            encode_expr(loop_iter, out);
+            span(head_span, out);
+            encode_expr(loop_body, out);
+        }
+    }
+}
+
+fn encode_expr(expr: &Expr, out: &mut Vec<u8>) {
+    let tag = match &expr.kind {
+        ExprKind::Ident => 0,
+        ExprKind::Ellipsis => 1,
+        ExprKind::Lit(_) => 2,
+        ExprKind::Parented(_) => 3,
+        ExprKind::Block(_) => 4,
+        ExprKind::Call { .. } => 5,
+        ExprKind::UnOp { .. } => 6,
+        ExprKind::BinOp { .. } => 7,
+        ExprKind::If { .. } => 8,
+        ExprKind::Switch { .. } => 9,
+    };
+    out.push(tag);
+    span(&expr.span, out);
+    match &expr.kind {
+        ExprKind::Ident | ExprKind::Ellipsis => {}
+        ExprKind::Lit(value) => out.extend_from_slice(&value.to_bits().to_le_bytes()),
+        ExprKind::Parented(inner) => encode_expr(inner, out),
+        ExprKind::Block(stmts) => encode(stmts, out),
+        ExprKind::Call {
+            callee,
+            args,
+            args_span,
+        } => {
+            encode_expr(callee, out);
+            exprs(args, out);
+            span(args_span, out);
+        }
+        ExprKind::UnOp { op, op_span, arg } => {
+            out.push(*op as u8);
+            span(op_span, out);
+            encode_expr(arg, out);
+        }
+        ExprKind::BinOp {
+            op,
+            op_span,
+            left,
+            right,
+        } => {
+            out.push(*op as u8);
+            span(op_span, out);
+            encode_expr(left, out);
+            encode_expr(right, out);
+        }
+        ExprKind::If {
+            if_then_exprs,
+            if_then_span,
+            else_branch,
+        } => {
+            len(if_then_exprs.len(), out);
+            for branch in if_then_exprs {
+                encode_expr(&branch.cond, out);
+                encode_expr(&branch.then, out);
+                span(&branch.span, out);
+            }
+            span(if_then_span, out);
+            match else_branch {
+                Some(branch) => {
+                    out.push(1);
+                    encode_expr(&branch.expr, out);
+                    span(&branch.span, out);
+                }
+                None => out.push(0),
+            }
+        }
+        ExprKind::Switch {
+            scrutinee,
+            cases,
+            default,
+            dense,
+        } => {
+            encode_expr(scrutinee, out);
+            len(cases.len(), out);
+            for case in cases {
+                out.extend_from_slice(&case.value.to_bits().to_le_bytes());
+                encode_expr(&case.expr, out);
+            }
+            match default {
+                Some(default) => {
+                    out.push(1);
+                    encode_expr(default, out);
+                }
+                None => out.push(0),
+            }
+            out.push(*dense as u8);
+        }
+    }
+}
+
+/// 直接从映射区域解码，位置的 `src_id` 取给定值
+pub(super) fn decode(bytes: &[u8], src_id: usize) -> Result<Vec<Stmt>, SnapshotError> {
+    let mut reader = Reader {
+        bytes,
+        src_id,
+        depth: 0,
+    };
+    let stmts = reader.stmts()?;
+    if !reader.bytes.is_empty() {
+        return Err(SnapshotError::Format);
+    }
+    Ok(stmts)
+}
+
+struct Reader<'a> {
+    bytes: &'a [u8],
+    src_id: usize,
+    depth: usize,
+}
+
+impl Reader<'_> {
+    fn take<const N: usize>(&mut self) -> Result<[u8; N], SnapshotError> {
+        let (head, rest) = self
+            .bytes
+            .split_first_chunk::<N>()
+            .ok_or(SnapshotError::Format)?;
+        self.bytes = rest;
+        Ok(*head)
+    }
+
+    fn u8(&mut self) -> Result<u8, SnapshotError> {
+        Ok(self.take::<1>()?[0])
+    }
+
+    fn u32(&mut self) -> Result<u32, SnapshotError> {
+        Ok(u32::from_le_bytes(self.take()?))
+    }
+
+    fn f64(&mut self) -> Result<f64, SnapshotError> {
+        Ok(f64::from_bits(u64::from_le_bytes(self.take()?)))
+    }
+
+    fn flag(&mut self) -> Result<bool, SnapshotError> {
+        match self.u8()? {
+            0 => Ok(false),
+            1 => Ok(true),
+            _ => Err(SnapshotError::Format),
+        }
+    }
+
+    /// 数量来自文件，不可信，按剩余字节数限制预分配
+    fn len(&mut self) -> Result<usize, SnapshotError> {
+        let len = self.u32()? as usize;
+        if len > self.bytes.len() {
+            return Err(SnapshotError::Format);
+        }
+        Ok(len)
+    }
+
+    fn span(&mut self) -> Result<CodeSpan, SnapshotError> {
+        Ok(CodeSpan {
+            line: self.u32()? as usize,
+            src_id: self.src_id,
+            start: self.u32()? as usize,
+            end: self.u32()? as usize,
+        })
+    }
+
+    fn op(&mut self) -> Result<Operator, SnapshotError> {
+        TokenKind::try_from(self.u8()? as u32)
+            .and_then(Operator::try_from)
+            .map_err(|_| SnapshotError::Format)
+    }
+
+    fn stmts(&mut self) -> Result<Vec<Stmt>, SnapshotError> {
+        let len = self.len()?;
+        let mut stmts = Vec::with_capacity(len);
+        for _ in 0..len {
+            stmts.push(self.stmt()?);
+        }
+        Ok(stmts)
+    }
+
+    fn exprs(&mut self) -> Result<Vec<Expr>, SnapshotError> {
+        let len = self.len()?;
+        let mut exprs = Vec::with_capacity(len);
+        for _ in 0..len {
+            exprs.push(self.expr()?);
+        }
+        Ok(exprs)
+    }
+
+    fn boxed(&mut self) -> Result<Box<Expr>, SnapshotError> {
+        self.expr().map(Box::new)
+    }
+
+    fn enter(&mut self) -> Result<(), SnapshotError> {
+        self.depth += 1;
+        if self.depth > MAX_DEPTH {
+            return Err(SnapshotError::Format);
+        }
+        Ok(())
+    }
+
+    fn stmt(&mut self) -> Result<Stmt, SnapshotError> {
+        self.enter()?;
+        let tag = self.u8()?;
+        let span = self.span()?;
+        let kind = match tag {
+            0 => StmtKind::Assign {
+                left: self.expr()?,
+                right: self.expr()?,
+                assign_span: self.span()?,
+            },
+            1 => StmtKind::Break,
+            2 => StmtKind::Continue,
+            3 => StmtKind::Def {
+                ident: self.expr()?,
+                args: self.exprs()?,
+                args_span: self.span()?,
+                body: self.expr()?,
+                body_span: self.span()?,
+                fp: match self.u8()? {
+                    0 => None,
+                    1 => Some(FpMode::Strict),
+                    2 => Some(FpMode::Contract),
+                    3 => Some(FpMode::Fast),
+                    _ => return Err(SnapshotError::Format),
+                },
+            },
+            4 => StmtKind::Empty,
+            5 => StmtKind::Expr(self.expr()?),
+            6 => StmtKind::Extern {
+                ident: self.expr()?,
+                args: self.exprs()?,
+                args_span: self.span()?,
+                attr: match self.u8()? {
+                    0 => None,
+                    1 => Some(ExternAttr::Pure),
+                    2 => Some(ExternAttr::Const),
+                    _ => return Err(SnapshotError::Format),
+                },
+            },
+            7 => StmtKind::For {
+                loop_var: self.boxed()?,
+                loop_iter: self.boxed()?,
+                head_span: self.span()?,
+                loop_body: self.boxed()?,
+            },
+            8 => StmtKind::Return(self.expr()?),
+            _ => return Err(SnapshotError::Format),
+        };
+        self.depth -= 1;
+        Ok(Stmt { kind, span })
+    }
+
+    fn expr(&mut self) -> Result<Expr, SnapshotError> {
+        self.enter()?;
+        let tag = self.u8()?;
+        let span = self.span()?;
+        let kind = match tag {
+            0 => ExprKind::Ident,
+            1 => ExprKind::Ellipsis,
+            2 => ExprKind::Lit(self.f64()?),
+            3 => ExprKind::Parented(self.boxed()?),
+            4 => ExprKind::Block(self.stmts()?),
+            5 => ExprKind::Call {
+                callee: self.boxed()?,
+                args: self.exprs()?,
+                args_span: self.span()?,
+            },
+            6 => ExprKind::UnOp {
+                op: self.op()?,
+                op_span: self.span()?,
+                arg: self.boxed()?,
+            },
+            7 => ExprKind::BinOp {
+                op: self.op()?,
+                op_span: self.span()?,
+                left: self.boxed()?,
+                right: self.boxed()?,
+            },
+            8 => {
+                let len = self.len()?;
+                let mut if_then_exprs = Vec::with_capacity(len);
+                for _ in 0..len {
+                    if_then_exprs.push(IfThenExpr {
+                        cond: self.expr()?,
+                        then: self.expr()?,
+                        span: self.span()?,
+                    });
+                }
+                let if_then_span = self.span()?;
+                let else_branch = if self.flag()? {
+                    Some(Box::new(ElseExpr {
+                        expr: self.expr()?,
+                        span: self.span()?,
+                    }))
+                } else {
+                    None
+                };
+                ExprKind::If {
+                    if_then_exprs,
+                    if_then_span,
+                    else_branch,
+                }
+            }
+            9 => {
+                let scrutinee = self.boxed()?;
+                let len = self.len()?;
+                let mut cases = Vec::with_capacity(len);
+                for _ in 0..len {
+                    cases.push(SwitchCase {
+                        value: self.f64()?,
+                        expr: self.expr()?,
+                    });
+                }
+                let default = if self.flag()? {
+                    Some(self.boxed()?)
+                } else {
+                    None
+                };
+                ExprKind::Switch {
+                    scrutinee,
+                    cases,
+                    default,
+                    dense: self.flag()?,
+                }
+            }
+            _ => return Err(SnapshotError::Format),
+        };
+        self.depth -= 1;
+        Ok(Expr { kind, span })
+    }
+}
@@ -0,0 +1,115 @@
+use super::{
+    CodeSpan,
+    ast::Stmt,
+    lexer::{Lexer, SourceSequence, Token},
+    parser::{NextStmt, ParseError, parse_next},
+};
+
+/// 首次读入的 Token 数
+pub const INITIAL_CHUNK: usize = 4096;
+
+#[derive(Debug)]
+pub enum StreamError {
+    Lexer(CodeSpan),
+    Parser(ParseError),
+}
+
+/// 逐条产出顶层语句，同一时刻只缓存当前语句的 Token
+///
+/// 词法分析按需推进：语句超出已缓存的 Token 时每次多读入一倍，因此单条语句的
+/// 重复解析总代价与其长度成正比。产出的语句与 `parse_ast` 的结果逐条相同。
+pub struct StmtStream<'s> {
+    src: &'s str,
+    lexer: Lexer<'s>,
+    tokens: Vec<Token>,
+    /// 已被解析的 Token 数
+    start: usize,
+    chunk: usize,
+    exhausted: bool,
+    failed: bool,
+    last_span: CodeSpan,
+    peak: usize,
+}
+
+impl<'s> StmtStream<'s> {
+    pub fn new(src_id: usize, srcs: &'s SourceSequence) -> Self {
+        Self::with_chunk(src_id, srcs, INITIAL_CHUNK)
+    }
+
+    pub fn with_chunk(src_id: usize, srcs: &'s SourceSequence, chunk: usize) -> Self {
+        Self {
+            src: srcs.sources[src_id].text(),
+            lexer: Lexer::new(src_id, srcs),
+            tokens: Vec::new(),
+            start: 0,
+            chunk: chunk.max(1),
+            exhausted: false,
+            failed: false,
+            last_span: CodeSpan {
+                line: 0,
+                src_id: 0,
+                start: 0,
+                end: 0,
+            },
+            peak: 0,
+        }
+    }
+
+    /// 缓存中 Token 数的峰值
+    pub fn peak(&self) -> usize {
+        self.peak
+    }
+
+    fn refill(&mut self) -> Result<(), StreamError> {
+        let pending = self.tokens.len() - self.start;
+        if pending >= self.chunk {
+            self.chunk *= 2;
+        }
+        self.tokens.drain(..self.start);
+        self.start = 0;
+
+        for _ in 0..self.chunk {
+            match self.lexer.next() {
+                Some(Ok(token)) => self.tokens.push(token),
+                Some(Err(span)) => return Err(StreamError::Lexer(span)),
+                None => {
+                    self.exhausted = true;
+                    break;
+                }
+            }
+        }
+        self.peak = self.peak.max(self.tokens.len());
+        Ok(())
+    }
+}
+
+impl Iterator for StmtStream<'_> {
+    type Item = Result<Stmt, StreamError>;
+
+    fn next(&mut self) -> Option<Self::Item> {
+        if self.failed {
+            return None;
+        }
+        loop {
+            let tokens = &self.tokens[self.start..];
+            match parse_next(self.src, tokens, self.last_span, self.exhausted) {
+                Ok(NextStmt::Stmt(stmt, consumed, span)) => {
+                    self.start += consumed;
+                    self.last_span = span;
+                    return Some(Ok(stmt));
+                }
+                Ok(NextStmt::Done) => return None,
+                Ok(NextStmt::More) => {
+                    if let Err(e) = self.refill() {
+                        self.failed = true;
+                        return Some(Err(e));
+                    }
+                }
+                Err(e) => {
+                    self.failed = true;
+                    return Some(Err(StreamError::Parser(e)));
+                }
+            }
+        }
+    }
+}
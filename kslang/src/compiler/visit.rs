@@ -0,0 +1,308 @@
+pub mod calls;
+pub mod stats;
+
+use super::ast::{Expr, ExprKind, Stmt, StmtKind};
+
+/// 在一次遍历中执行的分析
+///
+/// 各钩子在前序（`enter_*`）与后序（`leave_*`）位置被调用，子节点按求值顺序访问。
+/// 赋值与循环变量、被调用的函数名及 `def` 的名称与形参不作为表达式访问，因此访问到
+/// 的标识符都是读取。同一节点上，`DEPS` 中列出的分析总是先于本分析执行；要读取它们
+/// 在该节点上的结果，构造时让两者共享状态（如 `Rc<Cell<_>>`），遍历中不再分配。
+pub trait Pass<'a> {
+    const NAME: &'static str;
+    const DEPS: &'static [&'static str] = &[];
+
+    fn enter_stmt(&mut self, _cx: &mut Cx<'a>, _stmt: &'a Stmt) {}
+    fn leave_stmt(&mut self, _cx: &mut Cx<'a>, _stmt: &'a Stmt) {}
+    fn enter_expr(&mut self, _cx: &mut Cx<'a>, _expr: &'a Expr) {}
+    fn leave_expr(&mut self, _cx: &mut Cx<'a>, _expr: &'a Expr) {}
+}
+
+#[derive(Clone, Copy)]
+pub enum Event<'a> {
+    EnterStmt(&'a Stmt),
+    LeaveStmt(&'a Stmt),
+    EnterExpr(&'a Expr),
+    LeaveExpr(&'a Expr),
+}
+
+impl<'a> Event<'a> {
+    fn apply<P: Pass<'a>>(self, pass: &mut P, cx: &mut Cx<'a>) {
+        match self {
+            Self::EnterStmt(stmt) => pass.enter_stmt(cx, stmt),
+            Self::LeaveStmt(stmt) => pass.leave_stmt(cx, stmt),
+            Self::EnterExpr(expr) => pass.enter_expr(cx, expr),
+            Self::LeaveExpr(expr) => pass.leave_expr(cx, expr),
+        }
+    }
+}
+
+/// 一组一起执行的分析，由元组实现，按下标静态分派
+pub trait Passes<'a> {
+    const DECLS: &'static [(&'static str, &'static [&'static str])];
+
+    fn dispatch(&mut self, index: usize, cx: &mut Cx<'a>, event: Event<'a>);
+    /// 按注册顺序分派给每个分析
+    fn dispatch_all(&mut self, cx: &mut Cx<'a>, event: Event<'a>);
+}
+
+macro_rules! impl_passes {
+    ($($index:tt $pass:ident),+) => {
+        impl<'a, $($pass: Pass<'a>),+> Passes<'a> for ($($pass,)+) {
+            const DECLS: &'static [(&'static str, &'static [&'static str])] =
+                &[$(($pass::NAME, $pass::DEPS)),+];
+
+            fn dispatch(&mut self, index: usize, cx: &mut Cx<'a>, event: Event<'a>) {
+                match index {
+                    $($index => event.apply(&mut self.$index, cx),)+
+                    _ => unreachable!(),
+                }
+            }
+
+            fn dispatch_all(&mut self, cx: &mut Cx<'a>, event: Event<'a>) {
+                $(event.apply(&mut self.$index, cx);)+
+            }
+        }
+    };
+}
+
+impl_passes!(0 A);
+impl_passes!(0 A, 1 B);
+impl_passes!(0 A, 1 B, 2 C);
+impl_passes!(0 A, 1 B, 2 C, 3 D);
+impl_passes!(0 A, 1 B, 2 C, 3 D, 4 E);
+impl_passes!(0 A, 1 B, 2 C, 3 D, 4 E, 5 F);
+impl_passes!(0 A, 1 B, 2 C, 3 D, 4 E, 5 F, 6 G);
+impl_passes!(0 A, 1 B, 2 C, 3 D, 4 E, 5 F, 6 G, 7 H);
+
+#[derive(Debug, PartialEq, Eq)]
+pub enum VisitError {
+    /// 依赖的分析不在本次执行的分析中
+    Missing {
+        pass: &'static str,
+        dep: &'static str,
+    },
+    Duplicate(&'static str),
+    /// 循环依赖中的分析
+    Cycle(Vec<&'static str>),
+}
+
+impl std::fmt::Display for VisitError {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        match self {
+            Self::Missing { pass, dep } => write!(f, "分析 `{}` 依赖未注册的分析 `{}`", pass, dep),
+            Self::Duplicate(pass) => write!(f, "分析 `{}` 重复注册", pass),
+            Self::Cycle(passes) => write!(f, "分析之间存在循环依赖：{}", passes.join(", ")),
+        }
+    }
+}
+
+impl std::error::Error for VisitError {}
+
+/// 遍历时的上下文
+pub struct Cx<'a> {
+    pub src: &'a str,
+    /// 由外到内所在的 `def` 名称
+    pub defs: Vec<&'a str>,
+    /// 当前函数内所在的循环层数
+    pub loops: usize,
+}
+
+impl<'a> Cx<'a> {
+    pub fn new(src: &'a str) -> Self {
+        Self {
+            src,
+            defs: vec![],
+            loops: 0,
+        }
+    }
+
+    pub fn text(&self, expr: &Expr) -> &'a str {
+        &self.src[expr.span.start..expr.span.end]
+    }
+}
+
+/// 按依赖关系排列执行顺序，无依赖约束时保持注册顺序
+pub fn schedule(
+    decls: &[(&'static str, &'static [&'static str])],
+) -> Result<Vec<usize>, VisitError> {
+    check_names(decls)?;
+    // 分析数不超过元组的长度上限，线性查找即可
+    let mut deps = vec![];
+    for (name, names) in decls {
+        let mut list = vec![];
+        for dep in names.iter() {
+            let Some(index) = decls.iter().position(|(other, _)| other == dep) else {
+                return Err(VisitError::Missing { pass: name, dep });
+            };
+            list.push(index);
+        }
+        deps.push(list);
+    }
+
+    let mut order = vec![];
+    let mut done = vec![false; decls.len()];
+    while order.len() < decls.len() {
+        let ready = (0..decls.len()).find(|&i| !done[i] && deps[i].iter().all(|&dep| done[dep]));
+        let Some(i) = ready else {
+            let rest = (0..decls.len()).filter(|&i| !done[i]);
+            return Err(VisitError::Cycle(rest.map(|i| decls[i].0).collect()));
+        };
+        done[i] = true;
+        order.push(i);
+    }
+    Ok(order)
+}
+
+fn check_names(decls: &[(&'static str, &'static [&'static str])]) -> Result<(), VisitError> {
+    for (i, (name, _)) in decls.iter().enumerate() {
+        if decls[..i].iter().any(|(other, _)| other == name) {
+            return Err(VisitError::Duplicate(name));
+        }
+    }
+    Ok(())
+}
+
+/// 在一次遍历中执行所有分析，返回遍历后的分析与上下文
+pub fn run<'a, P: Passes<'a>>(
+    src: &'a str,
+    stmts: &'a [Stmt],
+    passes: P,
+) -> Result<(P, Cx<'a>), VisitError> {
+    walk(src, passes, |walker| {
+        for stmt in stmts {
+            walker.stmt(stmt);
+        }
+    })
+}
+
+/// 只遍历一个表达式（如一个函数体），`Cx` 的 `defs` 与 `loops` 从零开始
+pub fn run_expr<'a, P: Passes<'a>>(
+    src: &'a str,
+    expr: &'a Expr,
+    passes: P,
+) -> Result<(P, Cx<'a>), VisitError> {
+    walk(src, passes, |walker| walker.expr(expr))
+}
+
+fn walk<'a, P: Passes<'a>>(
+    src: &'a str,
+    mut passes: P,
+    roots: impl FnOnce(&mut Walker<'_, 'a, P>),
+) -> Result<(P, Cx<'a>), VisitError> {
+    // 没有依赖时按注册顺序静态分派，不必排序
+    let order = if P::DECLS.iter().all(|(_, deps)| deps.is_empty()) {
+        check_names(P::DECLS)?;
+        None
+    } else {
+        Some(schedule(P::DECLS)?)
+    };
+    let mut walker = Walker {
+        passes: &mut passes,
+        order: order.as_deref(),
+        cx: Cx::new(src),
+    };
+    roots(&mut walker);
+    let cx = walker.cx;
+    Ok((passes, cx))
+}
+
+struct Walker<'p, 'a, P> {
+    passes: &'p mut P,
+    order: Option<&'p [usize]>,
+    cx: Cx<'a>,
+}
+
+impl<'a, P: Passes<'a>> Walker<'_, 'a, P> {
+    fn emit(&mut self, event: Event<'a>) {
+        match self.order {
+            None => self.passes.dispatch_all(&mut self.cx, event),
+            Some(order) => {
+                for &index in order {
+                    self.passes.dispatch(index, &mut self.cx, event);
+                }
+            }
+        }
+    }
+
+    fn stmt(&mut self, stmt: &'a Stmt) {
+        self.emit(Event::EnterStmt(stmt));
+        match &stmt.kind {
+            StmtKind::Assign { right, .. } => self.expr(right),
+            StmtKind::Expr(expr) | StmtKind::Return(expr) => self.expr(expr),
+            StmtKind::Def { ident, body, .. } => {
+                self.cx.defs.push(self.cx.text(ident));
+                let loops = std::mem::take(&mut self.cx.loops);
+                self.expr(body);
+                self.cx.loops = loops;
+                self.cx.defs.pop();
+            }
+            StmtKind::For {
+                loop_iter,
+                loop_body,
+                ..
+            } => {
+                self.expr(loop_iter);
+                self.cx.loops += 1;
+                self.expr(loop_body);
+                self.cx.loops -= 1;
+            }
+            StmtKind::Break | StmtKind::Continue | StmtKind::Empty | StmtKind::Extern { .. } => {}
+        }
+        self.emit(Event::LeaveStmt(stmt));
+    }
+
+    fn expr(&mut self, expr: &'a Expr) {
+        self.emit(Event::EnterExpr(expr));
+        match &expr.kind {
+            ExprKind::Ident | ExprKind::Ellipsis | ExprKind::Lit(_) => {}
+            ExprKind::Block(stmts) => {
+                for stmt in stmts {
+                    self.stmt(stmt);
+                }
+            }
+            ExprKind::Parented(inner) | ExprKind::UnOp { arg: inner, .. } => self.expr(inner),
+            ExprKind::Call { callee, args, .. } => {
+                if !matches!(callee.kind, ExprKind::Ident) {
+                    self.expr(callee);
+                }
+                for arg in args {
+                    self.expr(arg);
+                }
+            }
+            ExprKind::BinOp { left, right, .. } => {
+                self.expr(left);
+                self.expr(right);
+            }
+            ExprKind::If {
+                if_then_exprs,
+                else_branch,
+                ..
+            } => {
+                for if_then in if_then_exprs {
+                    self.expr(&if_then.cond);
+                    self.expr(&if_then.then);
+                }
+                if let Some(else_expr) = else_branch {
+                    self.expr(&else_expr.expr);
+                }
+            }
+            ExprKind::Switch {
+                scrutinee,
+                cases,
+                default,
+                ..
+            } => {
+                self.expr(scrutinee);
+                for case in cases {
+                    self.expr(&case.expr);
+                }
+                if let Some(default) = default {
+                    self.expr(default);
+                }
+            }
+        }
+        self.emit(Event::LeaveExpr(expr));
+    }
+}
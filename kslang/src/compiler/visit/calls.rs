@@ -0,0 +1,84 @@
+use super::{
+    super::ast::{Expr, ExprKind, Stmt, StmtKind},
+    Cx, Pass,
+};
+use std::collections::{HashMap, HashSet};
+
+/// 顶层函数间的调用图，顶层代码的调用记在空名称下，嵌套函数中的调用记在所在的顶层函数下
+#[derive(Debug, Default)]
+pub struct CallGraph<'a> {
+    pub callees: HashMap<&'a str, HashSet<&'a str>>,
+    pub defs: HashSet<&'a str>,
+    pub externs: HashSet<&'a str>,
+    /// 标注了 `pure` 或 `const` 的 `extern`
+    pub pure_externs: HashSet<&'a str>,
+    /// 重复定义或同时声明为 `extern` 的顶层名称，调用哪一个不确定
+    pub redefined: HashSet<&'a str>,
+}
+
+impl<'a> Pass<'a> for CallGraph<'a> {
+    const NAME: &'static str = "calls";
+
+    fn enter_stmt(&mut self, cx: &mut Cx<'a>, stmt: &'a Stmt) {
+        if !cx.defs.is_empty() {
+            return;
+        }
+        match &stmt.kind {
+            StmtKind::Def { ident, .. } => {
+                let name = cx.text(ident);
+                if !self.defs.insert(name) || self.externs.contains(name) {
+                    self.redefined.insert(name);
+                }
+                self.callees.entry(name).or_default();
+            }
+            StmtKind::Extern { ident, attr, .. } => {
+                let name = cx.text(ident);
+                if !self.externs.insert(name) || self.defs.contains(name) {
+                    self.redefined.insert(name);
+                }
+                if attr.is_some() {
+                    self.pure_externs.insert(name);
+                }
+            }
+            _ => {}
+        }
+    }
+
+    fn enter_expr(&mut self, cx: &mut Cx<'a>, expr: &'a Expr) {
+        if let ExprKind::Call { callee, .. } = &expr.kind {
+            let caller = cx.defs.first().copied().unwrap_or("");
+            self.callees
+                .entry(caller)
+                .or_default()
+                .insert(cx.text(callee));
+        }
+    }
+}
+
+impl<'a> CallGraph<'a> {
+    /// 不直接或间接调用未标注的 `extern`、嵌套函数与未定义函数的 `def`，以及标注了
+    /// `pure`/`const` 的 `extern`；`redefined` 中的名称除外
+    pub fn pure(&self) -> HashSet<&'a str> {
+        let mut pure = (self.defs.iter().chain(&self.pure_externs))
+            .copied()
+            .filter(|name| !self.redefined.contains(name))
+            .collect::<HashSet<_>>();
+        loop {
+            let impure = pure
+                .iter()
+                .copied()
+                .filter(|name| {
+                    self.callees
+                        .get(name)
+                        .is_some_and(|callees| callees.iter().any(|callee| !pure.contains(callee)))
+                })
+                .collect::<Vec<_>>();
+            if impure.is_empty() {
+                return pure;
+            }
+            for name in impure {
+                pure.remove(name);
+            }
+        }
+    }
+}
@@ -0,0 +1,41 @@
+use super::{
+    super::ast::{Expr, ExprKind, Stmt, StmtKind},
+    Cx, Pass,
+};
+
+/// 语法树规模统计
+#[derive(Debug, Default, Clone, Copy, PartialEq, Eq)]
+pub struct Counts {
+    pub stmts: usize,
+    pub exprs: usize,
+    pub calls: usize,
+    pub defs: usize,
+    pub loops: usize,
+    /// 表达式的最大嵌套层数
+    pub max_depth: usize,
+    depth: usize,
+}
+
+impl<'a> Pass<'a> for Counts {
+    const NAME: &'static str = "stats";
+
+    fn enter_stmt(&mut self, _cx: &mut Cx<'a>, stmt: &'a Stmt) {
+        self.stmts += 1;
+        match stmt.kind {
+            StmtKind::Def { .. } => self.defs += 1,
+            StmtKind::For { .. } => self.loops += 1,
+            _ => {}
+        }
+    }
+
+    fn enter_expr(&mut self, _cx: &mut Cx<'a>, expr: &'a Expr) {
+        self.exprs += 1;
+        self.calls += usize::from(matches!(expr.kind, ExprKind::Call { .. }));
+        self.depth += 1;
+        self.max_depth = self.max_depth.max(self.depth);
+    }
+
+    fn leave_expr(&mut self, _cx: &mut Cx<'a>, _expr: &'a Expr) {
+        self.depth -= 1;
+    }
+}
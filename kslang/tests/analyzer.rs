@@ -0,0 +1,97 @@
+pub mod common;
+
+use common::parse;
+use kslang::compiler::{
+    CodeSpan,
+    analyzer::{Analyzer, Ref, RefError, RefKind},
+};
+
+const CORPUS: &str = "\
+x = 1
+def f(x) x + 1
+def g(a) {
+    x = a;
+    def h(b) b;
+    h(x)
+}
+def k(a) {
+    def h(b) b * 2;
+    h(a)
+}
+y = x + f(2)
+";
+
+fn analyze(text: &str) -> Analyzer {
+    let mut analyzer = Analyzer::new();
+    analyzer.index(text, &parse(text)).unwrap();
+    analyzer
+}
+
+/// 同一名称在每个作用域中的 `(定义数, 使用数)`，按作用域排序
+fn rows(analyzer: &Analyzer, name: &str) -> Vec<(u32, usize, usize)> {
+    let mut rows = analyzer
+        .symbols
+        .iter()
+        .enumerate()
+        .filter(|(_, symbol)| &***symbol == name)
+        .map(|(sym, _)| {
+            (
+                analyzer.scopes[sym],
+                analyzer.refs.defs(sym).len(),
+                analyzer.refs.uses(sym).len(),
+            )
+        })
+        .collect::<Vec<_>>();
+    rows.sort_unstable();
+    rows
+}
+
+#[test]
+fn shadowed_bindings_stay_apart() {
+    let analyzer = analyze(CORPUS);
+
+    // 顶层 x 只在顶层定义与使用，f 的形参与 g 的局部变量各成一行
+    let x = rows(&analyzer, "x");
+    assert_eq!(x.len(), 3);
+    assert_eq!(x[0], (0, 1, 1));
+    assert!(
+        x[1..]
+            .iter()
+            .all(|&(scope, defs, uses)| scope != 0 && defs == 1 && uses == 1)
+    );
+    assert_eq!(analyzer.references("x").len(), 2);
+
+    // 两个嵌套的 h 互不相干，也不是顶层函数
+    let h = rows(&analyzer, "h");
+    assert_eq!(h.len(), 2);
+    assert!(
+        h.iter()
+            .all(|&(scope, defs, uses)| scope != 0 && defs == 1 && uses == 1)
+    );
+    assert!(analyzer.references("h").is_empty());
+
+    // 形参与局部变量都被使用，未使用的只有顶层的 g、k 与 y
+    let mut unused = analyzer
+        .unused()
+        .map(|(name, _)| name.to_string())
+        .collect::<Vec<_>>();
+    unused.sort_unstable();
+    assert_eq!(unused, ["g", "k", "y"]);
+}
+
+#[test]
+fn oversized_spans_are_rejected() {
+    let span = CodeSpan {
+        line: 1,
+        src_id: usize::from(u16::MAX) + 1,
+        start: 0,
+        end: 1,
+    };
+    assert!(matches!(
+        Ref::new(RefKind::Use, span),
+        Err(RefError::Span(_))
+    ));
+
+    let span = CodeSpan { src_id: 3, ..span };
+    assert_eq!(Ref::new(RefKind::Use, span).unwrap().span(), span);
+}
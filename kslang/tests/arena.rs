@@ -0,0 +1,87 @@
+use kslang::compiler::{
+    arena::{SourceArena, Span},
+    lexer::{CodeSpan, Lexer, Source, SourceSequence},
+};
+use std::path::PathBuf;
+
+fn sources() -> Vec<Source> {
+    vec![
+        Source::String("def sq(x) x * x\n# 注释\nsq(2)\n".to_string()),
+        Source::String(String::new()),
+        Source::File {
+            path: PathBuf::from("lib.ks"),
+            contents: "extern printd(x);\n\n\nprintd(\n  sq(3))".to_string(),
+        },
+    ]
+}
+
+/// 全局偏移与文件内位置互相转换后不变，行号与逐文件词法分析一致
+#[test]
+fn spans_round_trip() {
+    let arena = SourceArena::try_from(SourceSequence { sources: sources() }).unwrap();
+    let srcs = SourceSequence { sources: sources() };
+
+    assert_eq!(arena.len(), 3);
+    assert_eq!(arena.origin(2).to_string(), "lib.ks");
+    for src_id in 0..arena.len() {
+        assert_eq!(arena.text(src_id), srcs.sources[src_id].text());
+        let tokens = arena.lexer(src_id).map(Result::unwrap);
+        for (token, expected) in tokens.zip(Lexer::new(src_id, &srcs).map(Result::unwrap)) {
+            let global = arena.global(token.span).unwrap();
+            assert_eq!(arena.span(global), Some(expected.span));
+            assert_eq!(arena.get_text(global), Some(srcs.get_text(expected.span)));
+        }
+    }
+
+    // 空文件与后一个文件共用起始偏移，偏移归属后一个文件
+    let start = arena.global(Lexer::new(2, &srcs).next().unwrap().unwrap().span);
+    assert_eq!(arena.locate(start.unwrap().start), Some(2));
+    assert_eq!(arena.get_text(Span { start: 0, end: 3 }), Some("def"));
+}
+
+/// 越界与跨文件的位置返回 `None`，空的集合不会下溢
+#[test]
+fn rejects_out_of_range() {
+    let mut arena = SourceArena::new();
+    assert_eq!(arena.locate(0), None);
+    assert_eq!(arena.span(Span { start: 0, end: 0 }), None);
+
+    for source in sources() {
+        arena.add(source).unwrap();
+    }
+    let len = arena.text(0).len() as u32;
+    let total = (0..arena.len())
+        .map(|id| arena.text(id).len() as u32)
+        .sum::<u32>();
+    assert!(arena.span(Span { start: 0, end: len }).is_some());
+    assert_eq!(
+        arena.span(Span {
+            start: 4,
+            end: len + 1
+        }),
+        None
+    );
+    assert_eq!(arena.span(Span { start: 5, end: 4 }), None);
+    assert_eq!(arena.locate(total + 1), None);
+    assert_eq!(
+        arena.get_text(Span {
+            start: 0,
+            end: total + 1
+        }),
+        None
+    );
+
+    let span = arena.lexer(0).next().unwrap().unwrap().span;
+    assert!(arena.global(CodeSpan { src_id: 3, ..span }).is_none());
+    assert!(
+        arena
+            .global(CodeSpan {
+                end: len as usize + 1,
+                ..span
+            })
+            .is_none()
+    );
+
+    arena.clear();
+    assert!(arena.is_empty());
+}
@@ -0,0 +1,124 @@
+pub mod common;
+
+use common::program;
+use kslang::compiler::exec::{
+    Machine,
+    arrow::{ArrowArray, BatchError, Column, eval, output_schema},
+};
+use std::{collections::HashMap, ffi::c_void};
+
+const CORPUS: &str = "\
+scale = 10
+def mix(x, y) x * scale + y
+def half(x) x / 2
+";
+
+unsafe extern "C" fn release_array(array: *mut ArrowArray) {
+    unsafe { (*array).release = None };
+}
+
+/// 借用 `buffers` 的分块，数据由测试持有
+fn chunk(
+    buffers: &mut [*const c_void; 2],
+    length: i64,
+    offset: i64,
+    null_count: i64,
+) -> ArrowArray {
+    ArrowArray {
+        length,
+        null_count,
+        offset,
+        n_buffers: 2,
+        n_children: 0,
+        buffers: buffers.as_mut_ptr(),
+        children: std::ptr::null_mut(),
+        dictionary: std::ptr::null_mut(),
+        release: Some(release_array),
+        private_data: std::ptr::null_mut(),
+    }
+}
+
+#[test]
+fn chunked_columns() {
+    let program = program(CORPUS, &HashMap::new()).unwrap();
+    let mut machine = Machine::new(&program);
+    machine.run().unwrap();
+    let schema = output_schema();
+
+    // x 分为两块，第二块从偏移 1 开始且第 2 行为空值；y 为一整块
+    let x0 = [1.0, 2.0];
+    let x1 = [99.0, 3.0, 4.0, 5.0];
+    let bits = [0b1011u8];
+    let y = [0.5, 0.25, 0.125, 0.0625, 0.03125];
+    let mut x0_buffers = [std::ptr::null(), x0.as_ptr().cast()];
+    let mut x1_buffers = [bits.as_ptr().cast(), x1.as_ptr().cast()];
+    let mut y_buffers = [std::ptr::null(), y.as_ptr().cast()];
+    let x = [
+        chunk(&mut x0_buffers, 2, 0, 0),
+        chunk(&mut x1_buffers, 3, 1, 1),
+    ];
+    let y = [chunk(&mut y_buffers, 5, 0, 0)];
+
+    let columns = unsafe {
+        [
+            Column::import(&schema, &x).unwrap(),
+            Column::import(&schema, &y).unwrap(),
+        ]
+    };
+    let mix = program.entry("mix").unwrap();
+    let output = eval(&mut machine, mix, &columns).unwrap();
+    let rows = (0..output.len())
+        .map(|row| output.get(row))
+        .collect::<Vec<_>>();
+    assert_eq!(
+        rows,
+        [Some(10.5), Some(20.25), Some(30.125), None, Some(50.03125)]
+    );
+    assert_eq!(output.null_count(), 1);
+
+    let mut array = output.export();
+    assert_eq!((array.length, array.null_count, array.n_buffers), (5, 1, 2));
+    let buffers = unsafe { std::slice::from_raw_parts(array.buffers, 2) };
+    let values = unsafe { std::slice::from_raw_parts(buffers[1].cast::<f64>(), 5) };
+    assert_eq!(values[4], 50.03125);
+    assert_eq!(unsafe { *buffers[0].cast::<u8>() } & 0b11111, 0b10111);
+    unsafe { array.release.unwrap()(&mut array) };
+    assert!(array.release.is_none());
+}
+
+#[test]
+fn rejected_inputs() {
+    let program = program(CORPUS, &HashMap::new()).unwrap();
+    let mut machine = Machine::new(&program);
+    machine.run().unwrap();
+
+    let mut schema = output_schema();
+    let data = [1.0, 2.0, 3.0];
+    let mut buffers = [std::ptr::null(), data.as_ptr().cast()];
+    let long = [chunk(&mut buffers, 3, 0, 0)];
+    let mut buffers = [std::ptr::null(), data.as_ptr().cast()];
+    let short = [chunk(&mut buffers, 2, 0, 0)];
+
+    let columns = unsafe {
+        [
+            Column::import(&schema, &long).unwrap(),
+            Column::import(&schema, &short).unwrap(),
+        ]
+    };
+    let mix = program.entry("mix").unwrap();
+    let half = program.entry("half").unwrap();
+    assert_eq!(
+        eval(&mut machine, mix, &columns).unwrap_err(),
+        BatchError::Length
+    );
+    assert_eq!(
+        eval(&mut machine, half, &columns).unwrap_err(),
+        BatchError::Arity
+    );
+    let output = eval(&mut machine, half, &columns[..1]).unwrap();
+    assert_eq!(output.get(2), Some(1.5));
+
+    // float32 列
+    schema.format = c"f".as_ptr();
+    assert!(unsafe { Column::import(&schema, &long) }.is_none());
+}
@@ -0,0 +1,78 @@
+use kslang::compiler::lexer::{
+    Lexer, Token,
+    brackets::{BracketError, Brackets},
+};
+
+fn tokens(text: &str) -> Vec<Token> {
+    Lexer::from_text(0, text)
+        .collect::<Result<Vec<_>, _>>()
+        .unwrap()
+}
+
+#[test]
+fn nested_partners() {
+    let text = "def f(x) { g((x)); { } }";
+    let tokens = tokens(text);
+    let (brackets, errors) = Brackets::new(&tokens);
+    assert!(errors.is_empty());
+    let at = |offset: usize| tokens.iter().position(|t| t.span.start == offset).unwrap();
+
+    for (open, close) in [(5, 7), (9, 23), (12, 16), (13, 15), (19, 21)] {
+        assert_eq!(brackets.partner(at(open)), Some(at(close)), "{}", open);
+        assert_eq!(brackets.partner(at(close)), Some(at(open)), "{}", close);
+    }
+    assert_eq!(brackets.partner(at(0)), None);
+    assert_eq!(brackets.partner(tokens.len()), None);
+}
+
+/// 报告所有不配对的括号，其余括号照常配对
+#[test]
+fn unmatched_brackets() {
+    let check = |text: &str, expected: &[BracketError], pairs: &[(usize, usize)]| {
+        let tokens = tokens(text);
+        let (brackets, errors) = Brackets::new(&tokens);
+        assert_eq!(errors, expected, "{text}");
+        let at = |offset: usize| tokens.iter().position(|t| t.span.start == offset).unwrap();
+        for (open, close) in pairs {
+            assert_eq!(brackets.partner(at(*open)), Some(at(*close)), "{text}");
+        }
+    };
+    let span = |text: &str, start: usize| {
+        let token = tokens(text).into_iter().find(|t| t.span.start == start);
+        token.unwrap().span
+    };
+
+    let text = "f((x)";
+    check(text, &[BracketError::Unclosed(span(text, 1))], &[(2, 4)]);
+    let text = "x) + (1)";
+    check(text, &[BracketError::Unopened(span(text, 1))], &[(5, 7)]);
+    let text = "{ (x } )";
+    let mismatched = BracketError::Mismatched {
+        open: span(text, 2),
+        close: span(text, 5),
+    };
+    check(
+        text,
+        &[mismatched, BracketError::Unopened(span(text, 7))],
+        &[(0, 5)],
+    );
+    let text = "(x } ) }";
+    let mismatched = BracketError::Mismatched {
+        open: span(text, 0),
+        close: span(text, 3),
+    };
+    check(
+        text,
+        &[mismatched, BracketError::Unopened(span(text, 7))],
+        &[(0, 5)],
+    );
+    let text = "{ ( ( } x";
+    let errors = [
+        BracketError::Unclosed(span(text, 2)),
+        BracketError::Mismatched {
+            open: span(text, 4),
+            close: span(text, 6),
+        },
+    ];
+    check(text, &errors, &[(0, 6)]);
+}
@@ -0,0 +1,34 @@
+//! 集成测试共用的编译步骤，输入均为单个源文件，出错时 panic
+
+use kslang::compiler::{
+    ast::{FpMode, Stmt},
+    exec::{CompileError, Extern, Program},
+    lexer::{Lexer, Token},
+    opt::{self, lto::Module},
+    parse_ast,
+};
+use std::collections::HashMap;
+
+pub fn lex(text: &str) -> Vec<Token> {
+    Lexer::from_text(0, text).collect::<Result<_, _>>().unwrap()
+}
+
+pub fn parse(text: &str) -> Vec<Stmt> {
+    parse_ast(text, &lex(text)).unwrap()
+}
+
+/// 未经优化的模块
+pub fn module(text: &str) -> Module<'_> {
+    Module {
+        src: text,
+        stmts: parse(text),
+        fp: FpMode::Strict,
+    }
+}
+
+/// 经 `opt::optimize` 后编译
+pub fn program(text: &str, externs: &HashMap<&str, Extern>) -> Result<Program, CompileError> {
+    let mut module = module(text);
+    opt::optimize(text, &mut module.stmts, FpMode::Strict);
+    Program::compile(&[module], externs)
+}
@@ -0,0 +1,196 @@
+pub mod common;
+
+use common::{module, program};
+use kslang::compiler::{
+    emit::{
+        EmitError,
+        c::{Options, c_source},
+    },
+    exec::Machine,
+};
+use std::{collections::HashMap, process::Command};
+
+const CORPUS: &str = "\
+extern printd(x);
+def sq(x) x * x
+def sum(n) {
+    s = 0;
+    for i in 0 .. n { s = s + sq(i); }
+    s
+}
+def pick(k) if k == 1 then 10 else if k == 2 then 20 else if k == 3 then 30 else 0
+def outer(x) {
+    def helper(y) y + 1;
+    printd(helper(x))
+}
+total = sum(10)
+";
+
+fn generate(text: &str, units: usize) -> Result<Vec<String>, EmitError> {
+    let modules = [module(text)];
+    let opts = Options {
+        units,
+        ..Default::default()
+    };
+    let source = c_source(&modules, &opts)?;
+    let mut files = vec![source.prelude];
+    files.extend(source.units);
+    Ok(files)
+}
+
+/// 拆分单元后每个函数恰好定义一次
+#[test]
+fn split_units() {
+    let files = generate(CORPUS, 3).unwrap();
+    assert_eq!(files.len(), 4);
+    for def in [
+        "double sq(double ks_v_x)\n{",
+        "double sum(double ks_v_n)\n{",
+        "double outer(double ks_v_x)\n{",
+        "static double ks_n0_helper(double ks_v_y)\n{",
+        "void ks_init(void)\n{",
+    ] {
+        let count = files
+            .iter()
+            .map(|file| file.matches(def).count())
+            .sum::<usize>();
+        assert_eq!(count, 1, "{def}");
+    }
+}
+
+#[test]
+fn rejects_capture() {
+    let text = "def f(x) { def g(y) x + y; g(1) }";
+    assert!(matches!(generate(text, 1), Err(EmitError::Capture(_))));
+}
+
+/// 编译运行生成的多个单元，结果与解释执行相同；缺少编译器时跳过
+#[test]
+fn matches_interpreter() {
+    let text = "\
+def sq(x) x * x
+def sum(n) {
+    s = 0;
+    for i in 0 .. n { s = s + sq(i); }
+    s
+}
+def pick(k) if k == 1 then 10 else if k == 2 then 20 else 0
+def branch(c) if c then { def h(y) y + 1; h(c) } else { def h(y) y * 10; h(5) }
+total = sum(10)
+p = pick(2)
+b1 = branch(1)
+b0 = branch(0)
+a\u{e9} = 1
+a_ue9_ = 2
+";
+    let files = generate(text, 2).unwrap();
+    let dir = std::env::temp_dir().join(format!("kslang-emit-c-{}", std::process::id()));
+    std::fs::create_dir_all(&dir).unwrap();
+    std::fs::write(dir.join("prelude.h"), &files[0]).unwrap();
+    let mut paths = vec![dir.join("main.c")];
+    std::fs::write(
+        &paths[0],
+        "#include <stdio.h>\n#include \"prelude.h\"\nint main(void) { ks_init(); \
+         printf(\"%g %g %g %g %g %g %g\", ks_g_total, ks_g_p, ks_g_b1, ks_g_b0, \
+         ks_g_a_ue9_, ks_g_a_u5f_ue9_, sum(4)); return 0; }\n",
+    )
+    .unwrap();
+    for (index, unit) in files[1..].iter().enumerate() {
+        let path = dir.join(format!("unit{index}.c"));
+        std::fs::write(&path, format!("#include \"prelude.h\"\n{unit}")).unwrap();
+        paths.push(path);
+    }
+    let exe = dir.join("out");
+    let built = Command::new("cc")
+        .arg("-o")
+        .arg(&exe)
+        .args(&paths)
+        .arg("-lm")
+        .status();
+    if let Ok(status) = built {
+        assert!(status.success());
+        let output = Command::new(&exe).output().unwrap();
+
+        let program = program(text, &HashMap::new()).unwrap();
+        let mut machine = Machine::new(&program);
+        machine.run().unwrap();
+        let mut expected = ["total", "p", "b1", "b0", "a\u{e9}", "a_ue9_"]
+            .map(|name| machine.global(name).unwrap().to_string())
+            .to_vec();
+        expected.push(machine.call("sum", &[4.0]).unwrap().unwrap().to_string());
+        assert_eq!(expected, ["285", "20", "2", "50", "1", "2", "14"]);
+        assert_eq!(
+            String::from_utf8(output.stdout).unwrap(),
+            expected.join(" ")
+        );
+    }
+    std::fs::remove_dir_all(&dir).unwrap();
+}
+
+#[test]
+fn rejects_duplicate_in_block() {
+    let text = "def f(x) { def g(y) y; def g(y) y + 1; g(x) }";
+    assert!(matches!(generate(text, 1), Err(EmitError::Duplicate(_))));
+}
+
+/// 与 libm 重名的函数以内部名称定义且不导出，不被内建函数替换；缺少编译器时跳过
+#[test]
+fn shadows_libm() {
+    let text = "def log(x) x * 2\ny = log(3)\n";
+    let opts = Options {
+        units: 1,
+        inline_size: 0,
+    };
+    let source = c_source(&[module(text)], &opts).unwrap();
+    assert!(source.prelude.contains("double ks_f_log(double);"));
+    assert!(!source.prelude.contains("double log("));
+
+    let dir = std::env::temp_dir().join(format!("kslang-emit-libm-{}", std::process::id()));
+    std::fs::create_dir_all(&dir).unwrap();
+    let path = dir.join("main.c");
+    std::fs::write(
+        &path,
+        format!(
+            "{}{}\n#include <math.h>\n#include <stdio.h>\n\
+             int main(int argc, char **argv) {{ (void)argv; ks_init(); \
+             printf(\"%g %.5f\", ks_g_y, log(argc + 2.0)); return 0; }}\n",
+            source.prelude, source.units[0]
+        ),
+    )
+    .unwrap();
+    let exe = dir.join("out");
+    let built = Command::new("cc")
+        .args(["-O2", "-o"])
+        .arg(&exe)
+        .arg(&path)
+        .arg("-lm")
+        .status();
+    if let Ok(status) = built {
+        assert!(status.success());
+        let output = Command::new(&exe).output().unwrap();
+        assert_eq!(String::from_utf8(output.stdout).unwrap(), "6 1.09861");
+    }
+    std::fs::remove_dir_all(&dir).unwrap();
+}
+
+/// `fast` 函数在 GCC 下使用函数属性，在 clang 下使用函数体开头的编译指示
+#[test]
+fn fast_pragma() {
+    let text = "def fast f(a, b, c) { s = a * b + c; s * s + a }\ny = f(1, 2, 3)\n";
+    let code = generate(text, 1).unwrap().concat();
+    assert!(code.contains("static inline KS_FAST double ks_i_f("));
+    assert!(code.contains("{\n    KS_FAST_BODY\n"));
+
+    let path = std::env::temp_dir().join(format!("kslang-emit-fast-{}.c", std::process::id()));
+    std::fs::write(&path, code).unwrap();
+    for compiler in ["cc", "clang"] {
+        let status = Command::new(compiler)
+            .args(["-fsyntax-only", "-Werror"])
+            .arg(&path)
+            .status();
+        if let Ok(status) = status {
+            assert!(status.success(), "{compiler}");
+        }
+    }
+    std::fs::remove_file(&path).unwrap();
+}
@@ -0,0 +1,63 @@
+pub mod common;
+
+use common::program;
+use kslang::compiler::exec::{CompileError, Extern, Machine, Program, Trap};
+use std::collections::HashMap;
+
+const CORPUS: &str = "\
+extern twice(x);
+def fib(n) if n < 2 then n else fib(n - 1) + fib(n - 2)
+def pick(k) if k == 1 then 10 else if k == 2 then 20 else if k == 3 then 30 else if k == 4 then 40 else 0
+def walk(n) {
+    acc = 0;
+    for i in 1 .. n {
+        if i == 5 then { break } else 0;
+        if i == 2 then { continue } else 0;
+        acc = acc + i;
+    }
+    acc
+}
+def outer(x) {
+    def helper(y) twice(y) + 1;
+    helper(x) * 2
+}
+def deep(n) deep(n + 1)
+total = fib(10) + pick(3)
+";
+
+fn twice(args: &[f64]) -> f64 {
+    args[0] * 2.0
+}
+
+fn compile(text: &str) -> Result<Program, CompileError> {
+    program(text, &HashMap::from([("twice", twice as Extern)]))
+}
+
+#[test]
+fn executes() {
+    let program = compile(CORPUS).unwrap();
+    let mut machine = Machine::new(&program);
+    machine.run().unwrap();
+    assert_eq!(machine.global("total"), Some(85.0));
+    assert_eq!(machine.call("fib", &[20.0]), Some(Ok(6765.0)));
+    let picks = [0.0, 1.0, 2.5, 4.0, 5.0].map(|k| machine.call("pick", &[k]));
+    assert_eq!(picks, [0.0, 10.0, 0.0, 40.0, 0.0].map(|v| Some(Ok(v))));
+    assert_eq!(machine.call("walk", &[10.0]), Some(Ok(8.0)));
+    assert_eq!(machine.call("outer", &[3.0]), Some(Ok(14.0)));
+    assert_eq!(machine.call("fib", &[1.0, 2.0]), None);
+}
+
+#[test]
+fn traps() {
+    let program = compile(CORPUS).unwrap();
+    let result = std::thread::Builder::new()
+        .stack_size(1 << 30)
+        .spawn(move || Machine::new(&program).call("deep", &[0.0]))
+        .unwrap()
+        .join()
+        .unwrap();
+    assert_eq!(result, Some(Err(Trap::StackOverflow)));
+
+    let text = "def f(x) { def g(y) x + y; g(1) }";
+    assert!(matches!(compile(text), Err(CompileError::Capture(_))));
+}
@@ -0,0 +1,116 @@
+pub mod common;
+
+use common::{module, parse, program};
+use kslang::compiler::{
+    ast::{ExternAttr, FpMode, StmtKind},
+    emit::c::{Options, c_source},
+    exec::{Extern, Machine},
+    opt::loops::optimize_loops,
+};
+use std::{
+    collections::HashMap,
+    sync::atomic::{AtomicUsize, Ordering},
+};
+
+const CORPUS: &str = "\
+extern const root(x);
+extern pure level(x);
+extern bump(x);
+def norm(n, k) {
+    s = 0;
+    for i in 0 .. n { s = s + root(k); }
+    s
+}
+def sample(n) {
+    s = 0;
+    for i in 0 .. n { s = s + level(0); }
+    s
+}
+def pumped(n) {
+    s = 0;
+    for i in 0 .. n { s = s + level(0) + bump(i); }
+    s
+}
+def fused(n, k) {
+    a = 0;
+    b = 0;
+    for i in 0 .. n { a = a + root(k); }
+    for j in 0 .. n { b = b + j; }
+    a + b
+}
+";
+
+static ROOTS: AtomicUsize = AtomicUsize::new(0);
+static LEVEL: AtomicUsize = AtomicUsize::new(0);
+static LEVELS: AtomicUsize = AtomicUsize::new(0);
+
+fn root(args: &[f64]) -> f64 {
+    ROOTS.fetch_add(1, Ordering::Relaxed);
+    args[0].sqrt()
+}
+
+fn level(_: &[f64]) -> f64 {
+    LEVELS.fetch_add(1, Ordering::Relaxed);
+    LEVEL.load(Ordering::Relaxed) as f64
+}
+
+fn bump(_: &[f64]) -> f64 {
+    LEVEL.fetch_add(1, Ordering::Relaxed);
+    0.0
+}
+
+#[test]
+fn attrs_reach_backends() {
+    let stmts = parse(CORPUS);
+    let attrs = stmts
+        .iter()
+        .filter_map(|stmt| match stmt.kind {
+            StmtKind::Extern { attr, .. } => Some(attr),
+            _ => None,
+        })
+        .collect::<Vec<_>>();
+    assert_eq!(
+        attrs,
+        [Some(ExternAttr::Const), Some(ExternAttr::Pure), None]
+    );
+
+    let prelude = c_source(&[module(CORPUS)], &Options::default())
+        .unwrap()
+        .prelude;
+    assert!(prelude.contains("KS_CONST double root(double"));
+    assert!(prelude.contains("KS_PURE double level(double"));
+    assert!(prelude.contains("\ndouble bump(double"));
+
+    // 调用 `const` 函数的循环可以合并
+    let mut stmts = stmts;
+    let stats = optimize_loops(CORPUS, &mut stmts, FpMode::Strict, &Default::default());
+    assert_eq!(stats.fused, 1);
+}
+
+#[test]
+fn memoized_calls() {
+    let externs = HashMap::from([("root", root as Extern), ("level", level), ("bump", bump)]);
+    let program = program(CORPUS, &externs).unwrap();
+    let mut machine = Machine::new(&program);
+    machine.run().unwrap();
+
+    assert_eq!(machine.call("norm", &[100.0, 16.0]), Some(Ok(400.0)));
+    assert_eq!(ROOTS.load(Ordering::Relaxed), 1);
+    assert_eq!(machine.call("norm", &[100.0, 9.0]), Some(Ok(300.0)));
+    assert_eq!(ROOTS.load(Ordering::Relaxed), 2);
+
+    // 未标注的调用之间 `pure` 的结果才可复用
+    assert_eq!(machine.call("sample", &[10.0]), Some(Ok(0.0)));
+    assert_eq!(LEVELS.load(Ordering::Relaxed), 1);
+    assert_eq!(
+        machine.call("pumped", &[4.0]),
+        Some(Ok(0.0 + 1.0 + 2.0 + 3.0))
+    );
+    assert_eq!(LEVELS.load(Ordering::Relaxed), 5);
+
+    // 宿主在两次调用之间改变的状态对下一次调用可见
+    assert_eq!(machine.call("sample", &[2.0]), Some(Ok(8.0)));
+    LEVEL.fetch_add(1, Ordering::Relaxed);
+    assert_eq!(machine.call("sample", &[2.0]), Some(Ok(10.0)));
+    assert_eq!(LEVELS.load(Ordering::Relaxed), 7);
+}
@@ -0,0 +1,76 @@
+pub mod common;
+
+use common::{parse, program};
+use kslang::compiler::{
+    ast::{Expr, ExprKind, FpMode, Stmt, StmtKind},
+    exec::Machine,
+    lexer::Operator,
+    opt::{fold, fp},
+};
+use std::collections::HashMap;
+
+fn def(stmt: &Stmt) -> (Option<FpMode>, &Expr) {
+    let StmtKind::Def { fp, body, .. } = &stmt.kind else {
+        panic!("应为函数定义")
+    };
+    (*fp, body)
+}
+
+#[test]
+fn resolves_modes() {
+    let src = "# 模块注释\n#!fp contract\ndef a(x) x\ndef fast b(x) { def c(y) y; c(x) }\ndef strict d(x) x\n";
+    assert_eq!(fp::module_mode(src), Some(FpMode::Contract));
+    assert_eq!(fp::module_mode("x = 1\n#!fp fast\n"), None);
+
+    let mut stmts = parse(src);
+    fp::resolve(&mut stmts, fp::module_mode(src).unwrap());
+    let modes = stmts.iter().map(|stmt| def(stmt).0).collect::<Vec<_>>();
+    assert_eq!(
+        modes,
+        [
+            Some(FpMode::Contract),
+            Some(FpMode::Fast),
+            Some(FpMode::Strict)
+        ]
+    );
+
+    // 嵌套函数继承外层函数的语义
+    let ExprKind::Block(body) = &def(&stmts[1]).1.kind else {
+        panic!("函数体应为语句块")
+    };
+    assert_eq!(def(&body[0]).0, Some(FpMode::Fast));
+}
+
+#[test]
+fn folds_by_mode() {
+    // 0.1 * 10 舍入为 1，融合后只舍入一次，保留乘积的误差
+    let product = |mode| {
+        let mut stmts = parse("y = 0.1 * 10 - 1");
+        fold::fold_stmts_in(&mut stmts, mode);
+        let StmtKind::Assign { right, .. } = &stmts[0].kind else {
+            panic!("应为赋值语句")
+        };
+        fold::lit(right)
+    };
+    assert_eq!(product(FpMode::Strict), Some(0.0));
+    assert_eq!(product(FpMode::Contract), Some(0.1f64.mul_add(10.0, -1.0)));
+    assert_ne!(product(FpMode::Contract), Some(0.0));
+
+    // 快速模式合并常量链、消去单位元，严格模式保持原样
+    let src = "def fast f(x) (x + 1) + 2 - 0\ndef g(x) (x + 1) + 2 - 0\nr = f(1) + g(1)\n";
+    let mut stmts = parse(src);
+    fold::fold_stmts_in(&mut stmts, FpMode::Strict);
+    let ExprKind::BinOp { op, right, .. } = &def(&stmts[0]).1.kind else {
+        panic!("应为二元运算")
+    };
+    assert_eq!((*op, fold::lit(right)), (Operator::Add, Some(3.0)));
+    let ExprKind::BinOp { op, right, .. } = &def(&stmts[1]).1.kind else {
+        panic!("应为二元运算")
+    };
+    assert_eq!((*op, fold::lit(right)), (Operator::Sub, Some(0.0)));
+
+    let program = program(src, &HashMap::new()).unwrap();
+    let mut machine = Machine::new(&program);
+    machine.run().unwrap();
+    assert_eq!(machine.global("r"), Some(8.0));
+}
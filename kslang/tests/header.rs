@@ -0,0 +1,69 @@
+pub mod common;
+
+use common::parse;
+use kslang::compiler::{
+    CodeSpan,
+    emit::{EmitError, exports, header::header},
+};
+use std::{mem::discriminant, process::Command};
+
+const CORPUS: &str = "\
+extern sin(x);
+def sq(x) x * x
+def mix(a, int, b) a * b
+def fmt(f, ...) f
+def zero() 0
+def ops(xor, typeof, co_await, char8_t) xor + typeof * co_await - char8_t
+def sqrt(x) x
+y = sq(2)
+";
+
+#[test]
+fn declares_exports() {
+    let stmts = parse(CORPUS);
+    let exports = exports(CORPUS, &stmts).unwrap();
+    let names = exports.iter().map(|export| export.name).collect::<Vec<_>>();
+    assert_eq!(names, ["sq", "mix", "fmt", "zero", "ops"]);
+
+    let text = header(&exports);
+    for decl in [
+        "double sq(double x);",
+        "double mix(double a, double, double b);",
+        "double fmt(double f, ...);",
+        "double zero(void);",
+        "double ops(double, double, double, double);",
+    ] {
+        assert!(text.contains(decl), "{decl}");
+    }
+
+    // 头文件在 C 与 C++ 中都能通过编译，缺少编译器时跳过
+    let path = std::env::temp_dir().join(format!("kslang-header-{}.h", std::process::id()));
+    std::fs::write(&path, &text).unwrap();
+    for (compiler, lang) in [("cc", "c"), ("c++", "c++")] {
+        let status = Command::new(compiler)
+            .args(["-fsyntax-only", "-x", lang])
+            .arg(&path)
+            .status();
+        if let Ok(status) = status {
+            assert!(status.success(), "{compiler}");
+        }
+    }
+    std::fs::remove_file(&path).unwrap();
+}
+
+#[test]
+fn rejects_unlinkable_defs() {
+    let span = CodeSpan::default();
+    for (text, expected) in [
+        ("def double(x) x", EmitError::InvalidSymbol(span)),
+        ("def _x(x) x", EmitError::InvalidSymbol(span)),
+        ("def xor(x) x", EmitError::InvalidSymbol(span)),
+        ("def static_cast(x) x", EmitError::InvalidSymbol(span)),
+        ("def typeof(x) x", EmitError::InvalidSymbol(span)),
+        ("def f(x) x\ndef f(y) y", EmitError::Duplicate(span)),
+        ("def f(...) 0", EmitError::VarargOnly(span)),
+    ] {
+        let error = exports(text, &parse(text)).err().unwrap();
+        assert_eq!(discriminant(&error), discriminant(&expected), "{text}");
+    }
+}
@@ -0,0 +1,71 @@
+use kslang::compiler::index::WorkspaceIndex;
+use std::path::PathBuf;
+
+fn workspace(name: &str) -> PathBuf {
+    let dir = std::env::temp_dir().join(format!("kslang-index-{}-{}", std::process::id(), name));
+    std::fs::create_dir_all(&dir).unwrap();
+    dir
+}
+
+fn names(index: &WorkspaceIndex) -> Vec<String> {
+    index
+        .files()
+        .iter()
+        .map(|file| {
+            file.path
+                .file_name()
+                .unwrap()
+                .to_string_lossy()
+                .into_owned()
+        })
+        .collect()
+}
+
+#[test]
+fn incremental_update() {
+    let dir = workspace("update");
+    let a = dir.join("a.ks");
+    let b = dir.join("b.ks");
+    std::fs::write(&a, "def sq(x) x * x\ny = sq(2)\n").unwrap();
+    std::fs::write(&b, "def twice(x) sq(x) + sq(x)\n").unwrap();
+
+    let mut index = WorkspaceIndex::new();
+    let stats = index.update(&[a.clone(), b.clone()], 2).unwrap();
+    assert_eq!((stats.indexed, stats.reused, stats.removed), (2, 0, 0));
+    assert_eq!(index.definitions("sq").count(), 1);
+    // 形参 x 是各函数的局部绑定，不计入工作区引用
+    assert_eq!(index.references("sq").count(), 4);
+    assert_eq!(index.references("x").count(), 0);
+
+    let stats = index.update(&[a.clone(), b.clone()], 2).unwrap();
+    assert_eq!((stats.indexed, stats.reused, stats.removed), (0, 2, 0));
+
+    // 修改 b、移除 a
+    std::fs::write(&b, "def sq(x) x * x * x\n").unwrap();
+    let stats = index.update(&[b.clone()], 2).unwrap();
+    assert_eq!((stats.indexed, stats.reused, stats.removed), (1, 0, 1));
+    assert_eq!(names(&index), ["b.ks"]);
+    assert_eq!(index.references("sq").count(), 1);
+    assert_eq!(index.definitions("twice").count(), 0);
+
+    std::fs::remove_dir_all(&dir).unwrap();
+}
+
+#[test]
+fn failed_update_keeps_index() {
+    let dir = workspace("error");
+    let a = dir.join("a.ks");
+    std::fs::write(&a, "def sq(x) x * x\n").unwrap();
+
+    let mut index = WorkspaceIndex::new();
+    index.update(&[a.clone()], 1).unwrap();
+    assert!(
+        index
+            .update(&[a.clone(), dir.join("missing.ks")], 1)
+            .is_err()
+    );
+    assert_eq!(names(&index), ["a.ks"]);
+    assert_eq!(index.definitions("sq").count(), 1);
+
+    std::fs::remove_dir_all(&dir).unwrap();
+}
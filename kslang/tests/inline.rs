@@ -0,0 +1,57 @@
+pub mod common;
+
+use common::{parse, program};
+use kslang::compiler::{
+    ast::FpMode,
+    exec::Machine,
+    opt::{
+        fp,
+        inline::{Options, inline_loops},
+    },
+    visit::{calls::CallGraph, run},
+};
+use std::collections::{HashMap, HashSet};
+
+const CORPUS: &str = "\
+def sq(x) x * x
+def twice(x) sq(x) + sq(x)
+def fast half(x) x / 2
+def sum(n) {
+    s = 0;
+    for i in 0 .. n { s = s + twice(i) + half(i); }
+    s
+}
+outside = twice(3)
+";
+
+/// 循环体内沿调用链展开，循环外与浮点语义不同的调用保留
+#[test]
+fn inlines_loop_bodies_only() {
+    let mut stmts = parse(CORPUS);
+    fp::resolve(&mut stmts, FpMode::Strict);
+    inline_loops(CORPUS, &mut stmts, FpMode::Strict, &Options::default());
+    let ((calls,), _) = run(CORPUS, &stmts, (CallGraph::default(),)).unwrap();
+    assert_eq!(calls.callees["sum"], HashSet::from(["half"]));
+    assert_eq!(calls.callees[""], HashSet::from(["twice"]));
+
+    // 深度为 0 时不展开
+    let mut stmts = parse(CORPUS);
+    fp::resolve(&mut stmts, FpMode::Strict);
+    let opts = Options {
+        max_depth: 0,
+        ..Default::default()
+    };
+    inline_loops(CORPUS, &mut stmts, FpMode::Strict, &opts);
+    let ((calls,), _) = run(CORPUS, &stmts, (CallGraph::default(),)).unwrap();
+    assert_eq!(calls.callees["sum"], HashSet::from(["twice", "half"]));
+}
+
+#[test]
+fn results_unchanged() {
+    let program = program(CORPUS, &HashMap::new()).unwrap();
+    let mut machine = Machine::new(&program);
+    machine.run().unwrap();
+    // 2 * (0 + 1 + 4 + 9 + 16) + (0 + 1 + 2 + 3 + 4) / 2
+    assert_eq!(machine.call("sum", &[5.0]), Some(Ok(65.0)));
+    assert_eq!(machine.global("outside"), Some(18.0));
+}
@@ -0,0 +1,34 @@
+pub mod common;
+
+use common::parse;
+use kslang::compiler::ast::json::write_json;
+
+/// 分块并行输出与整体序列化逐字节相同
+#[test]
+fn matches_serde() {
+    let mut text = String::new();
+    for i in 0..2000 {
+        match i % 4 {
+            0 => text.push_str(&format!(
+                "def f{i}(x, y) if x < {i} then x * y else f{i}(x - 1, y)\n"
+            )),
+            1 => text.push_str(&format!("v{i} = {i}.5 + -3 * (2 / 7)\n")),
+            2 => text.push_str(&format!("for j in 0 .. {i} {{ v = v + j; }}\n")),
+            _ => text.push_str(&format!("extern e{i}(a, ...);\n")),
+        }
+    }
+    let stmts = parse(&text);
+    assert_eq!(stmts.len(), 2000);
+
+    for (stmts, jobs) in [
+        (&stmts[..], 1),
+        (&stmts[..], 3),
+        (&stmts[..], 8),
+        (&stmts[..7], 8),
+        (&[][..], 4),
+    ] {
+        let mut out = Vec::new();
+        write_json(&mut out, stmts, jobs).unwrap();
+        assert_eq!(out, serde_json::to_vec(stmts).unwrap(), "jobs = {jobs}");
+    }
+}
@@ -0,0 +1,121 @@
+pub mod common;
+
+use common::{parse, program};
+use kslang::compiler::{
+    ast::{Expr, ExprKind, Stmt, StmtKind},
+    exec::Machine,
+    opt::{fold, ladder},
+};
+use std::collections::HashMap;
+
+const CORPUS: &str = "\
+def dense(k) if k == 1 then 10 else if k == 2 then 20 else if k == 2 then 99 else if k == 3 then 30 else if k == 4 then 40 else 0
+def sparse(k) if k < 0 then -1 else if k == 100 then a else if k == 0.5 then b else if k == 7 then c else if k == -0 then d else if k > 9 then 9 else 8
+a = 1
+b = 2
+c = 3
+d = 4
+";
+
+fn body(stmt: &Stmt) -> &Expr {
+    let StmtKind::Def { body, .. } = &stmt.kind else {
+        panic!("应为函数定义")
+    };
+    body
+}
+
+fn lowered() -> Vec<Stmt> {
+    let mut stmts = parse(CORPUS);
+    // 与 `opt::optimize` 一致，先折叠 `-0` 等常量
+    fold::fold_stmts(&mut stmts);
+    ladder::lower_ladders(CORPUS, &mut stmts);
+    stmts
+}
+
+#[test]
+fn lowers_ladders() {
+    let stmts = lowered();
+
+    // 重复的常量只保留第一个分支
+    let ExprKind::Switch {
+        cases,
+        default,
+        dense,
+        ..
+    } = &body(&stmts[0]).kind
+    else {
+        panic!("稠密分支链应降级为 Switch")
+    };
+    assert!(*dense);
+    let values = cases.iter().map(|case| case.value).collect::<Vec<_>>();
+    assert_eq!(values, [1.0, 2.0, 3.0, 4.0]);
+    assert!(default.is_some());
+
+    // 链前的 `k < 0` 保留为 if，链后的 `k > 9` 并入默认分支
+    let ExprKind::If {
+        if_then_exprs,
+        else_branch: Some(else_expr),
+        ..
+    } = &body(&stmts[1]).kind
+    else {
+        panic!("链前的分支应保留为 if")
+    };
+    assert_eq!(if_then_exprs.len(), 1);
+    let ExprKind::Switch {
+        cases,
+        default: Some(default),
+        dense,
+        ..
+    } = &else_expr.expr.kind
+    else {
+        panic!("else 分支应为 Switch")
+    };
+    assert!(!*dense);
+    let values = cases.iter().map(|case| case.value).collect::<Vec<_>>();
+    assert_eq!(values, [0.0, 0.5, 7.0, 100.0]);
+    assert!(matches!(default.kind, ExprKind::If { .. }));
+
+    let program = program(CORPUS, &HashMap::new()).unwrap();
+    let mut machine = Machine::new(&program);
+    machine.run().unwrap();
+    for (k, expected) in [(2.0, 20.0), (4.0, 40.0), (5.0, 0.0)] {
+        assert_eq!(machine.call("dense", &[k]), Some(Ok(expected)));
+    }
+    for (k, expected) in [
+        (-3.0, -1.0),
+        (100.0, 1.0),
+        (0.5, 2.0),
+        (7.0, 3.0),
+        (0.0, 4.0),
+        (12.0, 9.0),
+        (8.0, 8.0),
+    ] {
+        assert_eq!(machine.call("sparse", &[k]), Some(Ok(expected)));
+    }
+}
+
+/// 常量分派折叠为某个分支时沿用该分支的位置，标识符按位置取名
+#[test]
+fn folded_switch_keeps_span() {
+    for (value, name) in [(7.0, "c"), (0.0, "d")] {
+        let mut stmts = lowered();
+        let ExprKind::If { else_branch, .. } = &mut body_mut(&mut stmts[1]).kind else {
+            panic!("链前的分支应保留为 if")
+        };
+        let switch = &mut else_branch.as_mut().unwrap().expr;
+        let ExprKind::Switch { scrutinee, .. } = &mut switch.kind else {
+            panic!("else 分支应为 Switch")
+        };
+        scrutinee.kind = ExprKind::Lit(value);
+        fold::fold_expr(switch);
+        assert!(matches!(switch.kind, ExprKind::Ident));
+        assert_eq!(&CORPUS[switch.span.start..switch.span.end], name);
+    }
+}
+
+fn body_mut(stmt: &mut Stmt) -> &mut Expr {
+    let StmtKind::Def { body, .. } = &mut stmt.kind else {
+        panic!("应为函数定义")
+    };
+    body
+}
@@ -0,0 +1,69 @@
+pub mod common;
+
+use common::lex;
+use kslang::compiler::{
+    lazy::{self, Item, LazyModule},
+    parse_ast,
+};
+
+const LIBRARY: &str = "\
+extern printd(x);
+def sq(x) x * x;
+def fast cube(x) x * sq(x)
+def fib(x) if x < 3 then 1 else fib(x - 1) + fib(x - 2)
+def pick(a, b) -if a > b then a else -b * 2
+def sum(n) {
+    s = 0;
+    for i in 0 .. n { s = s + cube(i); }
+    s
+}
+def call(x) sq
+  (x) + ! x
+def unused(x) { def inner(y) y; inner(x) }
+def many(...) 1 .. 3
+printd(sum(3))
+";
+
+#[test]
+fn forced_bodies_match_full_parse() {
+    let tokens = lex(LIBRARY);
+    let module = LazyModule::preparse(LIBRARY, &tokens).unwrap();
+    let defs = module
+        .items
+        .iter()
+        .filter(|item| matches!(item, Item::Def(_)));
+    assert_eq!(defs.count(), 8);
+    assert_eq!(module.parsed(), 0);
+
+    let lazy = serde_json::to_value(module.into_stmts().unwrap()).unwrap();
+    let full = serde_json::to_value(parse_ast(LIBRARY, &tokens).unwrap()).unwrap();
+    assert_eq!(lazy, full);
+
+    // 函数体的语法错误推迟到解析该函数体时报告
+    let text = "def bad(x) (x; 1)\ndef good(x) x\n";
+    let tokens = lex(text);
+    assert!(parse_ast(text, &tokens).is_err());
+    let module = LazyModule::preparse(text, &tokens).unwrap();
+    let Item::Def(bad) = &module.items[0] else {
+        panic!("`bad` 未被惰性解析")
+    };
+    assert!(module.force(bad).is_err());
+}
+
+#[test]
+fn shake_parses_reachable_bodies_only() {
+    let tokens = lex(LIBRARY);
+    let module = LazyModule::preparse(LIBRARY, &tokens).unwrap();
+    let stmts = lazy::shake(vec![module], &["pick"]).unwrap().remove(0);
+    let names = stmts
+        .iter()
+        .filter_map(|stmt| match &stmt.kind {
+            kslang::compiler::ast::StmtKind::Def { ident, .. } => {
+                Some(&LIBRARY[ident.span.start..ident.span.end])
+            }
+            _ => None,
+        })
+        .collect::<Vec<_>>();
+    assert_eq!(names, ["sq", "cube", "pick", "sum"]);
+    assert_eq!(stmts.len(), names.len() + 2);
+}
@@ -0,0 +1,36 @@
+use kslang::compiler::load::{Options, read_files};
+use std::path::PathBuf;
+
+/// io_uring 与同步读取的结果都与逐个 `read_to_string` 一致
+#[test]
+fn matches_read_to_string() {
+    let dir = std::env::temp_dir().join(format!("kslang-load-{}", std::process::id()));
+    std::fs::create_dir_all(&dir).unwrap();
+    let mut paths = Vec::new();
+    for i in 0..300 {
+        let path = dir.join(format!("m{i}.ks"));
+        let text = format!("def f{i}(x) x * {i}\n").repeat(i * 37 % 5000);
+        std::fs::write(&path, text).unwrap();
+        paths.push(path);
+    }
+    std::fs::write(dir.join("bad.ks"), [0xff, 0xfe, b'x']).unwrap();
+    paths.insert(7, dir.join("bad.ks"));
+    paths.insert(3, dir.join("missing.ks"));
+    paths.push(PathBuf::from("\0"));
+
+    for uring in [true, false] {
+        let opts = Options {
+            depth: 16,
+            jobs: 3,
+            uring,
+        };
+        for (path, text) in paths.iter().zip(read_files(&paths, &opts)) {
+            match (text, std::fs::read_to_string(path)) {
+                (Ok(text), Ok(expected)) => assert_eq!(text, expected, "{}", path.display()),
+                (Err(e), Err(expected)) => assert_eq!(e.kind(), expected.kind()),
+                (text, expected) => panic!("{}: {:?} / {:?}", path.display(), text, expected),
+            }
+        }
+    }
+    std::fs::remove_dir_all(dir).unwrap();
+}
@@ -0,0 +1,120 @@
+pub mod common;
+
+use common::parse;
+use kslang::compiler::{
+    ast::{FpMode, Stmt},
+    exec::{Machine, Program},
+    opt::{
+        fold, fp,
+        loops::{Options, Stats, optimize_loops},
+        lto::Module,
+    },
+};
+use std::collections::HashMap;
+
+const CORPUS: &str = "\
+def f(x, y) x * 3 + y
+def g(x) x * x
+def mix(n) {
+    s = 0;
+    t = 0;
+    for i in 0 .. n { s = s + g(i); }
+    for j in 0 .. n { t = t + f(j, 1); }
+    s * 1000 + t + j
+}
+def grid(n, m) {
+    last = 0;
+    for i in 0 .. n {
+        for j in 0 .. m {
+            tmp = f(j, i);
+            last = tmp + 1;
+        }
+    }
+    last
+}
+def fast total(n, m) {
+    s = 0;
+    for i in 1 .. n { for j in 0 .. m { s = s + f(i, j); } }
+    s
+}
+";
+
+fn prepare(text: &str, transform: bool) -> (Vec<Stmt>, Stats) {
+    let mut stmts = parse(text);
+    fp::resolve(&mut stmts, FpMode::Strict);
+    let mut stats = Stats::default();
+    if transform {
+        stats = optimize_loops(text, &mut stmts, FpMode::Strict, &Options::default());
+    }
+    fold::fold_stmts_in(&mut stmts, FpMode::Strict);
+    (stmts, stats)
+}
+
+fn results(text: &str, transform: bool, calls: &[(&str, &[f64])]) -> Vec<f64> {
+    let modules = [Module {
+        src: text,
+        stmts: prepare(text, transform).0,
+        fp: FpMode::Strict,
+    }];
+    let program = Program::compile(&modules, &HashMap::new()).unwrap();
+    let mut machine = Machine::new(&program);
+    machine.run().unwrap();
+    calls
+        .iter()
+        .map(|(name, args)| machine.call(name, args).unwrap().unwrap())
+        .collect()
+}
+
+/// 变换前后各函数的结果相同，奇数次迭代时展开合并的剩余部分也被执行
+#[test]
+fn preserves_results() {
+    let (_, stats) = prepare(CORPUS, true);
+    assert_eq!(
+        stats,
+        Stats {
+            fused: 1,
+            interchanged: 1,
+            jammed: 2,
+        }
+    );
+
+    let calls: &[(&str, &[f64])] = &[
+        ("mix", &[0.0]),
+        ("mix", &[7.0]),
+        ("grid", &[0.0, 4.0]),
+        ("grid", &[5.0, 3.0]),
+        ("grid", &[4.0, 6.0]),
+        ("total", &[6.0, 5.0]),
+        ("total", &[9.0, 0.0]),
+        ("total", &[2.5, 3.0]),
+    ];
+    assert_eq!(results(CORPUS, true, calls), results(CORPUS, false, calls));
+}
+
+#[test]
+fn refuses_dependences() {
+    let text = "\
+extern printd(x);
+def f(x, y) x * 3 + y
+def strict(n) {
+    s = 0;
+    for i in 0 .. n { for j in 0 .. n { s = s + f(i, j); } }
+    s
+}
+def effect(n) {
+    for i in 0 .. n { for j in 0 .. n { printd(f(j, i)); } }
+}
+def carried(n) {
+    s = 0;
+    for i in 0 .. n { s = s + 1; }
+    for i in 0 .. n { s = s * 2; }
+    s
+}
+def shifted(n) {
+    for i in 0 .. n { x = i; }
+    for i in 0 .. x { y = i; }
+    y
+}
+";
+    assert_eq!(prepare(text, true).1, Stats::default());
+}
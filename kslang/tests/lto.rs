@@ -0,0 +1,73 @@
+pub mod common;
+
+use common::module;
+use kslang::compiler::{
+    ast::StmtKind,
+    exec::{Machine, Program},
+    opt::lto::{self, Module, Options},
+};
+use std::collections::HashMap;
+
+const LIB: &str = "\
+def inc(x) x + 1
+def dbl(x) x * 2
+def sum(n) {
+    s = 0;
+    for i in 0 .. n { s = s + i; }
+    s + 0
+}
+def unused(x) x - 1
+";
+
+const MAIN: &str = "\
+y = inc(dbl(3))
+z = sum(dbl(2))
+";
+
+fn defs(module: &Module) -> Vec<String> {
+    module
+        .stmts
+        .iter()
+        .filter_map(|stmt| match &stmt.kind {
+            StmtKind::Def { ident, .. } => {
+                Some(module.src[ident.span.start..ident.span.end].to_string())
+            }
+            _ => None,
+        })
+        .collect()
+}
+
+/// 外层调用无论是否展开，实参中的跨模块调用都要展开，被删除的函数不能残留调用
+#[test]
+fn inlines_nested_calls() {
+    let mut modules = [module(LIB), module(MAIN)];
+    let stats = lto::link(&mut modules, &Options::default());
+    // 外层 `inc` 的实参含调用，按展开前的实参判断不展开
+    assert_eq!(stats.inlined, 2);
+    assert_eq!(defs(&modules[0]), ["inc", "sum"]);
+
+    let program = Program::compile(&modules, &HashMap::new()).unwrap();
+    let mut machine = Machine::new(&program);
+    machine.run().unwrap();
+    assert_eq!(machine.global("y"), Some(7.0));
+    assert_eq!(machine.global("z"), Some(6.0));
+}
+
+#[test]
+fn keeps_library_exports() {
+    let mut modules = [module(LIB)];
+    let opts = Options {
+        roots: lto::exported(&modules),
+        ..Default::default()
+    };
+    assert_eq!(opts.roots, ["inc", "dbl", "sum", "unused"]);
+    assert_eq!(lto::link(&mut modules, &opts).removed, 0);
+
+    let mut modules = [module(LIB), module(MAIN)];
+    let opts = Options {
+        roots: vec!["unused".to_string()],
+        ..Default::default()
+    };
+    lto::link(&mut modules, &opts);
+    assert_eq!(defs(&modules[0]), ["inc", "sum", "unused"]);
+}
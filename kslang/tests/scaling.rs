@@ -0,0 +1,114 @@
+use kslang::compiler::{
+    MAX_NESTING_DEPTH, ParseError,
+    lexer::{Lexer, Source, SourceSequence, Token},
+    max_nesting_depth, parse_ast, parse_ast_with_limit, parse_steps,
+};
+
+/// 每种语料形状在输入翻倍时，词法与语法分析的工作量最多增长到该倍数
+const MAX_GROWTH: f64 = 2.2;
+
+fn lex(text: &str) -> Vec<Token> {
+    let srcs = SourceSequence {
+        sources: vec![Source::String(text.to_string())],
+    };
+    Lexer::new(0, &srcs).filter_map(Result::ok).collect()
+}
+
+/// 以 Token 数与进入表达式的次数衡量工作量，与机器负载无关
+fn work(text: &str) -> usize {
+    let tokens = lex(text);
+    let _ = parse_ast(text, &tokens);
+    tokens.len() + parse_steps()
+}
+
+fn shapes() -> Vec<(&'static str, fn(usize) -> String)> {
+    vec![
+        ("stmts", |n| "x = a + b * c;\n".repeat(n)),
+        ("comments", |n| "# comment\n".repeat(n) + "x"),
+        ("idents", |n| "x ".repeat(n)),
+        ("chain", |n| "1".to_string() + &" + x".repeat(n)),
+        ("args", |n| "f(".to_string() + &"x, ".repeat(n) + "x)"),
+        ("ladder", |n| {
+            (1..n).fold("if x == 0 then 0".to_string(), |s, i| {
+                s + &format!(" else if x == {i} then {i}")
+            }) + " else 0"
+        }),
+        ("defs", |n| "def f(x, y) if x < y then x else y\n".repeat(n)),
+        ("loops", |n| "for i in 0 .. n { s = s + i; }\n".repeat(n)),
+        ("nested", |n| {
+            format!("{}x{};", "(".repeat(32), ")".repeat(32)).repeat(n)
+        }),
+        ("blocks", |n| {
+            format!("{}x{}", "{".repeat(32), "}".repeat(32)).repeat(n)
+        }),
+        ("unclosed", |n| "x = 1;\n".repeat(n) + &"(".repeat(32)),
+    ]
+}
+
+#[test]
+fn front_end_scales_linearly() {
+    for (name, shape) in shapes() {
+        let mut last = work(&shape(256));
+        for n in [512, 1024, 2048] {
+            let current = work(&shape(n));
+            let growth = current as f64 / last as f64;
+            assert!(
+                growth <= MAX_GROWTH,
+                "`{}` 在 n = {} 时工作量增长 {:.2} 倍",
+                name,
+                n,
+                growth
+            );
+            last = current;
+        }
+    }
+}
+
+#[test]
+fn deep_nesting_is_rejected() {
+    let shapes: [fn(usize) -> String; 4] = [
+        |n| "(".repeat(n) + "x" + &")".repeat(n),
+        |n| "{".repeat(n) + "x" + &"}".repeat(n),
+        |n| "f(".repeat(n) + "x" + &")".repeat(n),
+        |n| "if x then ".repeat(n) + "x",
+    ];
+
+    // 在编译服务常见的 2 MiB 工作线程上运行
+    std::thread::Builder::new()
+        .stack_size(2 << 20)
+        .spawn(move || {
+            for shape in shapes {
+                let text = shape(MAX_NESTING_DEPTH - 1);
+                assert!(parse_ast(&text, &lex(&text)).is_ok());
+
+                for n in [MAX_NESTING_DEPTH, 100_000] {
+                    let text = shape(n);
+                    let err = parse_ast(&text, &lex(&text)).unwrap_err();
+                    assert!(format!("{:?}", err).contains("NestingTooDeep"));
+                }
+            }
+
+            let text = "(".repeat(100_000);
+            assert!(matches!(
+                parse_ast(&text, &lex(&text)),
+                Err(ParseError::NestingTooDeep(_))
+            ));
+        })
+        .unwrap()
+        .join()
+        .unwrap();
+
+    // 栈更大的线程上可以调高本次解析的上限，不影响其他解析
+    std::thread::Builder::new()
+        .stack_size(64 << 20)
+        .spawn(|| {
+            let limit = max_nesting_depth(64 << 20);
+            assert!(limit > 1500);
+            let text = "{".repeat(1500) + "x" + &"}".repeat(1500);
+            assert!(parse_ast_with_limit(&text, &lex(&text), limit).is_ok());
+            assert!(parse_ast(&text, &lex(&text)).is_err());
+        })
+        .unwrap()
+        .join()
+        .unwrap();
+}
@@ -0,0 +1,159 @@
+pub mod common;
+
+use common::{lex, parse};
+use kslang::compiler::{
+    ast::FpMode,
+    opt::{self, specialize},
+    snapshot::{SNAP_OPTIMIZED, Session, Snapshot, SnapshotError, write},
+};
+use std::path::PathBuf;
+
+const CORPUS: &str = "\
+def scale(mode, x) if mode == 1 then x * 2 else x
+r = scale(1, 5) + scale(1, 6)
+";
+
+fn temp(name: &str) -> PathBuf {
+    std::env::temp_dir().join(format!("kslang-snapshot-{}-{}", std::process::id(), name))
+}
+
+fn save(path: &PathBuf, text: &str) {
+    let tokens = lex(text);
+    let ast = parse(text);
+    let profile = specialize::profile(text, &ast);
+    let session = Session {
+        text,
+        tokens: &tokens,
+        ast: &ast,
+        profile: Some(&profile),
+        flags: SNAP_OPTIMIZED,
+    };
+    write(path, &session).unwrap();
+}
+
+#[test]
+fn round_trip() {
+    let path = temp("round-trip.snap");
+    save(&path, CORPUS);
+    let snapshot = Snapshot::open(&path).unwrap();
+    assert!(snapshot.matches(CORPUS, SNAP_OPTIMIZED));
+    assert!(!snapshot.matches(CORPUS, 0));
+
+    let tokens = snapshot.tokens(3).collect::<Result<Vec<_>, _>>().unwrap();
+    let expected = lex(CORPUS);
+    assert_eq!(tokens.len(), expected.len());
+    for (token, expected) in tokens.iter().zip(&expected) {
+        assert_eq!(token.kind, expected.kind);
+        assert_eq!(
+            (token.span.start, token.span.end),
+            (expected.span.start, expected.span.end)
+        );
+        assert_eq!(token.span.src_id, 3);
+    }
+    assert_eq!(snapshot.names().unwrap().len(), 4);
+    let profile = snapshot.profile().unwrap();
+    assert_eq!(profile.calls("scale"), 2);
+    assert_eq!(
+        serde_json::to_value(snapshot.ast(0).unwrap()).unwrap(),
+        serde_json::to_value(parse(CORPUS)).unwrap()
+    );
+
+    // 替换文件不影响已映射的旧快照
+    save(&path, "x = 1\n");
+    assert_eq!(snapshot.ast(0).unwrap().len(), 2);
+    assert!(
+        Snapshot::open(&path)
+            .unwrap()
+            .matches("x = 1\n", SNAP_OPTIMIZED)
+    );
+    std::fs::remove_file(&path).unwrap();
+}
+
+/// 损坏或截断的快照返回错误而不是 panic
+#[test]
+fn corrupt_headers() {
+    let path = temp("corrupt.snap");
+    save(&path, CORPUS);
+    let bytes = std::fs::read(&path).unwrap();
+
+    let mut cases = vec![bytes[..bytes.len() - 1].to_vec(), bytes[..20].to_vec()];
+    let mut magic = bytes.clone();
+    magic[0] = b'X';
+    cases.push(magic);
+    // 各个长度字段分别改为会溢出的值
+    for field in 1..=6 {
+        for value in [u64::MAX, u64::MAX / 4, 1 << 40] {
+            let mut bytes = bytes.clone();
+            let offset = 16 + field * 8;
+            bytes[offset..offset + 8].copy_from_slice(&value.to_le_bytes());
+            cases.push(bytes);
+        }
+    }
+
+    for bytes in cases {
+        std::fs::write(&path, &bytes).unwrap();
+        assert!(matches!(Snapshot::open(&path), Err(SnapshotError::Format)));
+    }
+    std::fs::remove_file(&path).unwrap();
+}
+
+/// 二进制编码覆盖各类节点，与 JSON 表示一致；并发写入同一快照互不干扰
+#[test]
+fn all_nodes_and_writers() {
+    let text = "\
+extern pure at(r, ...);
+def fast f(x, y) { for i in 0 .. x { y = y + i; break; continue; }; -x }
+def g(k) if k == 1 then 10 else if k == 2 then 20 else if k == 3 then 30 else if k == 4 then 40 else (k)
+return g(f(2, 3))
+";
+    let tokens = lex(text);
+    let mut ast = parse(text);
+    opt::optimize(text, &mut ast, FpMode::Strict);
+    opt::ladder::lower_ladders(text, &mut ast);
+    let session = Session {
+        text,
+        tokens: &tokens,
+        ast: &ast,
+        profile: None,
+        flags: SNAP_OPTIMIZED,
+    };
+
+    let path = temp("writers.snap");
+    std::thread::scope(|scope| {
+        for _ in 0..4 {
+            scope.spawn(|| {
+                for _ in 0..8 {
+                    write(&path, &session).unwrap();
+                }
+            });
+        }
+    });
+    let json = serde_json::to_string(&ast).unwrap();
+    assert!(json.contains("Switch"), "{json}");
+    let snapshot = Snapshot::open(&path).unwrap();
+    assert_eq!(
+        serde_json::to_string(&snapshot.ast(0).unwrap()).unwrap(),
+        json
+    );
+
+    let name = path.file_name().unwrap().to_string_lossy().into_owned();
+    let leftover = std::fs::read_dir(path.parent().unwrap())
+        .unwrap()
+        .filter(|entry| {
+            let entry = entry.as_ref().unwrap().file_name();
+            let entry = entry.to_string_lossy();
+            entry.starts_with(&name) && entry != name
+        })
+        .count();
+    assert_eq!(leftover, 0);
+
+    // 语法树段中第一条语句的标记改为非法值
+    let mut bytes = std::fs::read(&path).unwrap();
+    let ast_len = u64::from_le_bytes(bytes[64..72].try_into().unwrap()) as usize;
+    let first = bytes.len() - ast_len + 4;
+    bytes[first] = 0xff;
+    std::fs::write(&path, &bytes).unwrap();
+    let snapshot = Snapshot::open(&path).unwrap();
+    assert!(matches!(snapshot.ast(0), Err(SnapshotError::Format)));
+    std::fs::remove_file(&path).unwrap();
+}
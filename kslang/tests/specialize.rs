@@ -0,0 +1,88 @@
+pub mod common;
+
+use common::{parse, program};
+use kslang::compiler::{
+    ast::{Expr, ExprKind, StmtKind},
+    exec::Machine,
+    lexer::Operator,
+    opt::{
+        fold,
+        specialize::{self, Options},
+    },
+};
+use std::collections::HashMap;
+
+const CORPUS: &str = "\
+def scale(mode, x) if mode == 1 then x * 2 else if mode == 2 then x * 3 else x
+r = scale(1, 5) + scale(1, 6) + scale(1, 7) + scale(1, 8) + scale(2, 7)
+";
+
+fn text<'s>(src: &'s str, expr: &Expr) -> &'s str {
+    &src[expr.span.start..expr.span.end]
+}
+
+/// 折叠为某个分支时沿用该分支的位置，标识符按位置取名
+#[test]
+fn folded_branch_keeps_span() {
+    let src = "a = 3\nb = 4\nx = if 1 then a else b\ny = if 0 then a else b\n";
+    let mut stmts = parse(src);
+    fold::fold_stmts(&mut stmts);
+    for (stmt, name) in stmts[2..].iter().zip(["a", "b"]) {
+        let StmtKind::Assign { right, .. } = &stmt.kind else {
+            panic!("应为赋值语句")
+        };
+        assert!(matches!(right.kind, ExprKind::Ident));
+        assert_eq!(text(src, right), name);
+    }
+
+    let program = program(src, &HashMap::new()).unwrap();
+    let mut machine = Machine::new(&program);
+    machine.run().unwrap();
+    assert_eq!(
+        (machine.global("x"), machine.global("y")),
+        (Some(3.0), Some(4.0))
+    );
+}
+
+#[test]
+fn guarded_specialization() {
+    let mut stmts = parse(CORPUS);
+    let profile = specialize::profile(CORPUS, &stmts);
+    let opts = Options::default();
+    assert_eq!(profile.calls("scale"), 5);
+    assert_eq!(profile.dominant("scale", 0, &opts), Some(1.0));
+    assert_eq!(profile.dominant("scale", 1, &opts), None);
+
+    specialize::specialize(CORPUS, &mut stmts, &opts);
+    let StmtKind::Def { body, .. } = &stmts[0].kind else {
+        panic!("应为函数定义")
+    };
+    let ExprKind::If { if_then_exprs, .. } = &body.kind else {
+        panic!("函数体应为守卫分支")
+    };
+    let guard = &if_then_exprs[0];
+    assert!(matches!(
+        guard.cond.kind,
+        ExprKind::BinOp {
+            op: Operator::Eq,
+            ..
+        }
+    ));
+    // 特化分支中 `mode == 1` 已折叠，只剩 `x * 2`
+    assert!(matches!(
+        guard.then.kind,
+        ExprKind::BinOp {
+            op: Operator::Mul,
+            ..
+        }
+    ));
+
+    // 守卫不成立时回退到通用版本
+    let program = program(CORPUS, &HashMap::new()).unwrap();
+    let mut machine = Machine::new(&program);
+    machine.run().unwrap();
+    assert_eq!(machine.global("r"), Some(10.0 + 12.0 + 14.0 + 16.0 + 21.0));
+    for (mode, expected) in [(1.0, 8.0), (2.0, 12.0), (7.0, 4.0)] {
+        assert_eq!(machine.call("scale", &[mode, 4.0]), Some(Ok(expected)));
+    }
+}
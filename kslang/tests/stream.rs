@@ -0,0 +1,130 @@
+pub mod common;
+
+use common::{parse, program};
+use kslang::compiler::{
+    ast::FpMode,
+    emit::c::{Fragment, StreamEmitter},
+    exec::Machine,
+    lexer::{Source, SourceSequence},
+    opt,
+    stream::{StmtStream, StreamError},
+};
+use std::{collections::HashMap, process::Command};
+
+const CORPUS: &str = "\
+# 注释
+extern printd(x);
+def fast f(x, y) if x < y then x else y
+x = a + b * c;
+for i in 0 .. n { s = s + i; }
+y = 1
+  + 2 * f(3, 4)
+g(x)
+def h(a, ...) {
+    def k(b) b * 2;
+    return k(a) + (((a)));
+}
+if x == 1 then 1 else if x == 2 then 2 else if x == 3 then 3 else 0
+";
+
+fn srcs(text: &str) -> SourceSequence {
+    SourceSequence {
+        sources: vec![Source::String(text.to_string())],
+    }
+}
+
+/// 任意缓存大小下与一次性解析的结果逐字节相同
+#[test]
+fn matches_parse_ast() {
+    let srcs = srcs(CORPUS);
+    let expected = serde_json::to_string(&parse(CORPUS)).unwrap();
+
+    for chunk in [1, 2, 3, 5, 8, 64, 4096] {
+        let stmts = StmtStream::with_chunk(0, &srcs, chunk)
+            .collect::<Result<Vec<_>, _>>()
+            .unwrap();
+        assert_eq!(
+            serde_json::to_string(&stmts).unwrap(),
+            expected,
+            "chunk {chunk}"
+        );
+    }
+}
+
+#[test]
+fn bounded_buffer() {
+    let text = "def f(x, y) if x < y then x else y\n".repeat(10_000);
+    let srcs = srcs(&text);
+    let mut stream = StmtStream::with_chunk(0, &srcs, 64);
+    assert_eq!(stream.by_ref().filter(Result::is_ok).count(), 10_000);
+    assert!(stream.peak() < 256, "peak {}", stream.peak());
+}
+
+#[test]
+fn reports_errors() {
+    let srcs = srcs("x = 1;\ndef (x) x\ny = 2");
+    let results = StmtStream::with_chunk(0, &srcs, 2).collect::<Vec<_>>();
+    assert!(results[0].is_ok());
+    assert!(matches!(results[1], Err(StreamError::Parser(_))));
+    assert_eq!(results.len(), 2);
+}
+
+/// 逐条生成的 C 代码编译运行后，全局变量与解释执行的结果相同；缺少编译器时跳过
+#[test]
+fn emits_c_per_statement() {
+    let text = "\
+x = later(2)
+{ def h(y) y + 1; z = h(3) }
+def later(a) {
+    def k(b) b * 2;
+    k(a) + w
+}
+w = 10
+if x > 0 then { return 0 } else 0
+w = 99
+";
+    let srcs = srcs(text);
+    let mut emitter = StreamEmitter::new();
+    for stmt in StmtStream::new(0, &srcs) {
+        emitter.declare(0, text, &stmt.unwrap()).unwrap();
+    }
+    let mut defs = emitter.prelude(1).unwrap();
+    let mut init = emitter.init_head();
+    for stmt in StmtStream::new(0, &srcs) {
+        let mut stmt = stmt.unwrap();
+        opt::optimize_stmt(text, &mut stmt, FpMode::Strict);
+        match emitter.emit(0, text, FpMode::Strict, &stmt).unwrap() {
+            Some(Fragment::Def(code)) => defs.push_str(&code),
+            Some(Fragment::Init(code)) => init.push_str(&code),
+            None => {}
+        }
+    }
+    init.push_str(&emitter.init(1));
+    let main = "#include <stdio.h>\nint main(void) { ks_init(); printf(\"%g %g %g\", ks_g_x, ks_g_z, ks_g_w); return 0; }\n";
+
+    let dir = std::env::temp_dir().join(format!("kslang-stream-{}", std::process::id()));
+    std::fs::create_dir_all(&dir).unwrap();
+    let path = dir.join("out.c");
+    std::fs::write(&path, format!("{}{}{}", defs, init, main)).unwrap();
+    let exe = dir.join("out");
+    let built = Command::new("cc")
+        .args(["-ffp-contract=off", "-o"])
+        .arg(&exe)
+        .arg(&path)
+        .arg("-lm")
+        .status();
+    if let Ok(status) = built {
+        assert!(status.success());
+        let output = Command::new(&exe).output().unwrap();
+
+        let program = program(text, &HashMap::new()).unwrap();
+        let mut machine = Machine::new(&program);
+        machine.run().unwrap();
+        let expected = ["x", "z", "w"].map(|name| machine.global(name).unwrap().to_string());
+        assert_eq!(
+            String::from_utf8(output.stdout).unwrap(),
+            expected.join(" ")
+        );
+    }
+    std::fs::remove_dir_all(&dir).unwrap();
+}
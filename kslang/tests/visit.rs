@@ -0,0 +1,106 @@
+pub mod common;
+
+use common::parse;
+use kslang::compiler::{
+    ast::Expr,
+    visit::{Cx, Pass, VisitError, calls::CallGraph, run, schedule, stats::Counts},
+};
+use std::{cell::Cell, collections::HashSet, rc::Rc};
+
+const CORPUS: &str = "\
+extern printd(x);
+def sq(x) x * x
+def sum(n) {
+    s = 0;
+    for i in 0 .. n { s = s + sq(i); }
+    s
+}
+def show(n) printd(sum(n))
+show(3)
+";
+
+/// 在表达式入口记录其起始位置，与 `check` 共享
+struct Mark(Rc<Cell<Option<usize>>>);
+
+impl<'a> Pass<'a> for Mark {
+    const NAME: &'static str = "mark";
+
+    fn enter_expr(&mut self, _cx: &mut Cx<'a>, expr: &'a Expr) {
+        self.0.set(Some(expr.span.start));
+    }
+}
+
+/// 依赖 `mark`，每个节点上都应读到它刚写入的值
+struct Check {
+    mark: Rc<Cell<Option<usize>>>,
+    seen: usize,
+}
+
+impl<'a> Pass<'a> for Check {
+    const NAME: &'static str = "check";
+    const DEPS: &'static [&'static str] = &["mark"];
+
+    fn enter_expr(&mut self, _cx: &mut Cx<'a>, expr: &'a Expr) {
+        assert_eq!(self.mark.get(), Some(expr.span.start));
+        self.seen += 1;
+    }
+}
+
+#[test]
+fn fused_passes() {
+    let stmts = parse(CORPUS);
+
+    let mark = Rc::new(Cell::new(None));
+    let passes = (
+        Check {
+            mark: mark.clone(),
+            seen: 0,
+        },
+        Mark(mark),
+        Counts::default(),
+        CallGraph::default(),
+    );
+    let ((check, _, counts, calls), _) = run(CORPUS, &stmts, passes).unwrap();
+    assert_eq!(check.seen, counts.exprs);
+    assert_eq!((counts.defs, counts.loops, counts.calls), (3, 1, 4));
+    assert_eq!(calls.callees[""], HashSet::from(["show"]));
+    assert_eq!(calls.pure(), HashSet::from(["sq", "sum"]));
+}
+
+/// 嵌套函数中的调用记在所在的顶层函数下，重复定义的名称不算无副作用
+#[test]
+fn pure_calls() {
+    let text = "\
+extern printd(x);
+extern pure level(x);
+def outer(x) {
+    def inner(y) printd(y);
+    x
+}
+def twice(x) x
+def twice(x) x * 2
+def lvl(x) level(x)
+";
+    let stmts = parse(text);
+    let ((calls,), _) = run(text, &stmts, (CallGraph::default(),)).unwrap();
+    assert_eq!(calls.callees["outer"], HashSet::from(["printd"]));
+    assert_eq!(calls.redefined, HashSet::from(["twice"]));
+    assert_eq!(calls.pure(), HashSet::from(["level", "lvl"]));
+}
+
+#[test]
+fn schedule_order() {
+    let decls: &[(&str, &[&str])] = &[("c", &["b"]), ("a", &[]), ("b", &["a"])];
+    assert_eq!(schedule(decls), Ok(vec![1, 2, 0]));
+
+    let cycle: &[(&str, &[&str])] = &[("a", &["b"]), ("b", &["a"]), ("c", &[])];
+    assert_eq!(schedule(cycle), Err(VisitError::Cycle(vec!["a", "b"])));
+    let missing: &[(&str, &[&str])] = &[("a", &["z"])];
+    assert_eq!(
+        schedule(missing),
+        Err(VisitError::Missing {
+            pass: "a",
+            dep: "z"
+        })
+    );
+}
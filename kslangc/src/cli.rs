@@ -1,5 +1,10 @@
 mod ast;
+mod bench;
+mod build;
+mod index;
 mod lex;
+mod run;
+mod serve;
 mod utils;
 
 use clap::{Command, arg};
@@ -21,6 +26,11 @@ fn command() -> Command {
         .arg(arg!(-v --verbose "启用详细输出"))
         .subcommand(lex::command())
         .subcommand(ast::command())
+        .subcommand(build::command())
+        .subcommand(index::command())
+        .subcommand(run::command())
+        .subcommand(serve::command())
+        .subcommand(bench::command())
 }
 macro_rules! match_subcommands {
     ($m:expr, $v:expr $(=> $($sub:ident),* $(,)?)?) => {
@@ -34,5 +44,5 @@ macro_rules! match_subcommands {
 
 fn match_command(matches: &clap::ArgMatches) -> anyhow::Result<bool> {
     let verbose = matches.get_flag("verbose");
-    Ok(match_subcommands!(matches, verbose => lex, ast))
+    Ok(match_subcommands!(matches, verbose => lex, ast, build, index, run, serve, bench))
 }
@@ -1,7 +1,12 @@
 use super::utils::*;
 use anyhow::Context;
 use clap::arg;
-use kslang::compiler::lexer::{Lexer, Source, SourceSequence};
+use kslang::compiler::{
+    ast::{FpMode, json},
+    lexer::{Lexer, Source, SourceSequence},
+    opt::specialize,
+    snapshot::{self, SNAP_FP_CONTRACT, SNAP_FP_FAST, SNAP_OPTIMIZED, Session, Snapshot},
+};
 use std::{
     io::{BufWriter, Read, Write},
     path::PathBuf,
@@ -15,6 +20,13 @@ pub fn command() -> clap::Command {
         .arg(arg!(-f --format <FORMAT> "输出格式 debug | html (实验) | json（默认）"))
         .arg(arg!(-l --level <LEVEL> "终止等级 debug | warning | error | fatal（默认）"))
         .arg(arg!(-e --error <ERROR> "错误输出到 <FILE> | stdout | stderr（默认）"))
+        .arg(arg!(-O --optimize "输出优化后的抽象语法树"))
+        .arg(arg!(--fp <MODE> "默认浮点语义 strict（默认）| contract | fast"))
+        .arg(arg!(-s --snapshot <FILE> "从快照恢复，快照缺失或过期时重新生成"))
+        .arg(
+            arg!(-j --jobs <N> "JSON 序列化的并行线程数，默认为 CPU 数")
+                .value_parser(clap::value_parser!(usize)),
+        )
 }
 
 pub fn match_command(matches: &clap::ArgMatches, _verbose: bool) -> anyhow::Result<()> {
@@ -154,41 +166,85 @@ pub fn match_command(matches: &clap::ArgMatches, _verbose: bool) -> anyhow::Resu
     };
 
     let srcs = SourceSequence { sources: vec![src] };
-    let lexer = Lexer::new(0, &srcs);
-
-    let mut tokens = Vec::new();
-    let mut err_cnt = 0;
-    for token in lexer {
-        match token {
-            Ok(token) => tokens.push(token),
-            Err(e) => {
-                let src = &srcs.sources[0];
-                let text = srcs.get_text(e);
+    let text = srcs.sources[0].text();
 
-                writeln!(err, "[Lexer:{}] {}@{}\t`{}`", err_cnt, src, e, text)
-                    .context("写入错误输出失败")?;
-                if level.error() {
-                    anyhow::bail!("词法分析出现错误")
+    let optimize = matches.get_flag("optimize");
+    let fp = fp_mode(matches)?;
+    let flags = match (optimize, fp) {
+        (false, _) => 0,
+        (true, FpMode::Strict) => SNAP_OPTIMIZED,
+        (true, FpMode::Contract) => SNAP_OPTIMIZED | SNAP_FP_CONTRACT,
+        (true, FpMode::Fast) => SNAP_OPTIMIZED | SNAP_FP_FAST,
+    };
+    let snapshot_path = matches.get_one::<String>("snapshot").map(PathBuf::from);
+    let restored = snapshot_path
+        .as_deref()
+        .filter(|path| path.exists())
+        .and_then(|path| Snapshot::open(path).ok())
+        .filter(|snapshot| snapshot.matches(text, flags))
+        .and_then(|snapshot| snapshot.ast(0).ok());
+
+    let ast = if let Some(ast) = restored {
+        ast
+    } else {
+        let lexer = Lexer::new(0, &srcs);
+
+        let mut tokens = Vec::new();
+        let mut err_cnt = 0;
+        for token in lexer {
+            match token {
+                Ok(token) => tokens.push(token),
+                Err(e) => {
+                    let src = &srcs.sources[0];
+                    let text = srcs.get_text(e);
+
+                    writeln!(err, "[Lexer:{}] {}@{}\t`{}`", err_cnt, src, e, text)
+                        .context("写入错误输出失败")?;
+                    if level.error() {
+                        anyhow::bail!("词法分析出现错误")
+                    }
+                    err_cnt += 1;
                 }
-                err_cnt += 1;
             }
         }
-    }
 
-    let text = srcs.sources[0].text();
+        let mut ast = match kslang::compiler::parse_ast(text, &tokens) {
+            Ok(ast_ctx) => ast_ctx,
+            Err(e) => {
+                writeln!(err, "[Parser] {:?}", e)?;
+                anyhow::bail!("语法分析出现错误")
+            }
+        };
+
+        let profile = snapshot_path
+            .is_some()
+            .then(|| specialize::profile(text, &ast));
+
+        if optimize {
+            kslang::compiler::opt::optimize(text, &mut ast, fp);
+        }
 
-    let ast = match kslang::compiler::parse_ast(text, &tokens) {
-        Ok(ast_ctx) => ast_ctx,
-        Err(e) => {
-            writeln!(err, "[Parser] {:?}", e)?;
-            anyhow::bail!("语法分析出现错误")
+        if let Some(path) = &snapshot_path {
+            let session = Session {
+                text,
+                tokens: &tokens,
+                ast: &ast,
+                profile: profile.as_ref(),
+                flags,
+            };
+            snapshot::write(path, &session).context("写入快照失败")?;
         }
+        ast
     };
 
     match format {
         Format::Json => {
-            let json = serde_json::to_string(&ast).context("序列化抽象语法树失败")?;
-            out.write_all(json.as_bytes()).context("写入输出失败")?;
+            let jobs = matches
+                .get_one::<usize>("jobs")
+                .copied()
+                .unwrap_or_else(|| std::thread::available_parallelism().map_or(1, |n| n.get()));
+            json::write_json(&mut out, &ast, jobs).context("写入输出失败")?;
+            out.flush().context("写入输出失败")?;
         }
         Format::Html => unimplemented!(),
         Format::Debug => writeln!(out, "{:#?}", ast).context("写入输出失败")?,
@@ -0,0 +1,435 @@
+use super::build::{static_lib, write_c};
+use anyhow::Context;
+use clap::{ArgAction, arg};
+use kslang::compiler::{
+    ast::{FpMode, Stmt, json},
+    emit::c,
+    exec::{Machine, Program},
+    index::WorkspaceIndex,
+    lexer::{Lexer, Token},
+    load,
+    opt::lto::{self, Module},
+    parse_ast,
+};
+use serde_json::{Value, json};
+use std::{
+    collections::HashMap,
+    fmt::Write,
+    path::PathBuf,
+    process::Command,
+    time::{Duration, Instant},
+};
+
+/// 各模式与其测量的阶段
+const MODES: &[(&str, &str)] = &[
+    ("lex", "批量读取并词法分析"),
+    ("parse", "批量读取、词法与语法分析"),
+    ("analyze", "工作区符号索引"),
+    ("kslangc", "以 kslangc build 将全部语料文件编译为静态库"),
+    ("lto", "多模块链接期优化"),
+    ("json", "语法树 JSON 序列化"),
+    ("cc", "并行编译拆分为固定数目翻译单元的 C 代码"),
+    ("exec", "多个执行状态共享同一程序，分段执行同一循环"),
+];
+
+/// `exec` 模式循环的总迭代次数
+const ITERATIONS: usize = 8_000_000;
+
+const KERNEL: &str = "\
+def work(from, to) {
+    s = 0;
+    for i in from .. to { s = s + (i * 0.5 + 1) / (i + 1); }
+    s
+}
+";
+
+pub fn command() -> clap::Command {
+    let modes = MODES.iter().map(|(name, _)| *name).collect::<Vec<_>>();
+    let mut help = String::from("模式：\n");
+    for (name, about) in MODES {
+        writeln!(help, "  {:<8}{}", name, about).unwrap();
+    }
+    clap::Command::new("bench")
+        .about("在固定语料上测量各并行阶段在 1、2、4 … N 个线程下的加速比")
+        .after_help(help)
+        .arg(
+            arg!(-j --jobs <N> "最大线程数，默认为 CPU 数")
+                .value_parser(clap::value_parser!(usize)),
+        )
+        .arg(
+            arg!(--mode <NAME> "只测量指定的模式，可重复指定，默认全部")
+                .action(ArgAction::Append)
+                .value_parser(modes),
+        )
+        .arg(arg!(--files <N> "语料文件数，默认 32").value_parser(clap::value_parser!(usize)))
+        .arg(
+            arg!(--defs <N> "每个语料文件中的函数数，默认 50")
+                .value_parser(clap::value_parser!(usize)),
+        )
+        .arg(
+            arg!(--units <N> "cc 与 kslangc 模式拆分的翻译单元数，默认为最大线程数")
+                .value_parser(clap::value_parser!(usize)),
+        )
+        .arg(
+            arg!(--repeat <N> "每项的重复次数，取最短用时，默认 3")
+                .value_parser(clap::value_parser!(usize)),
+        )
+        .arg(arg!(--json <FILE> "另将结果以 JSON 写入文件"))
+}
+
+pub fn match_command(matches: &clap::ArgMatches, verbose: bool) -> anyhow::Result<()> {
+    let max = matches
+        .get_one::<usize>("jobs")
+        .copied()
+        .unwrap_or_else(|| std::thread::available_parallelism().map_or(1, |n| n.get()))
+        .max(1);
+    let files = matches.get_one::<usize>("files").copied().unwrap_or(32);
+    let defs = matches.get_one::<usize>("defs").copied().unwrap_or(50);
+    let units = matches.get_one::<usize>("units").copied().unwrap_or(max);
+    let repeat = matches.get_one::<usize>("repeat").copied().unwrap_or(3);
+    let modes = matches.get_many::<String>("mode").map_or_else(
+        || MODES.iter().map(|(name, _)| *name).collect(),
+        |modes| modes.map(String::as_str).collect::<Vec<_>>(),
+    );
+
+    let threads = std::iter::successors(Some(1), |n| Some(n * 2))
+        .take_while(|n| *n < max)
+        .chain([max])
+        .collect::<Vec<_>>();
+    let corpus = Corpus::create(files.max(1), defs.max(1))?;
+
+    let mut results = Vec::new();
+    for mode in modes {
+        let mut run = match corpus.runner(mode, units.max(1)) {
+            Ok(run) => run,
+            Err(e) => {
+                eprintln!("跳过 {}：{:#}", mode, e);
+                continue;
+            }
+        };
+        let mut times = Vec::with_capacity(threads.len());
+        for &jobs in &threads {
+            let mut best = Duration::MAX;
+            for _ in 0..repeat.max(1) {
+                best = best.min(run(jobs)?);
+            }
+            if verbose {
+                eprintln!("{} × {}：{:?}", mode, jobs, best);
+            }
+            times.push(best);
+        }
+        results.push((mode, times));
+    }
+
+    print!("{}", table(&threads, &results));
+    if let Some(path) = matches.get_one::<String>("json") {
+        let value = json!({
+            "files": files,
+            "defs": defs,
+            "units": units,
+            "repeat": repeat,
+            "modes": results
+                .iter()
+                .map(|(mode, times)| json!({ "mode": mode, "runs": runs(&threads, times) }))
+                .collect::<Vec<_>>(),
+        });
+        std::fs::write(path, serde_json::to_string_pretty(&value)?).context("写入结果失败")?;
+    }
+    Ok(())
+}
+
+/// 加速比、效率与 Karp–Flatt 串行比例，单线程时串行比例为 `None`
+fn metrics(t1: Duration, threads: usize, time: Duration) -> (f64, f64, Option<f64>) {
+    let speedup = t1.as_secs_f64() / time.as_secs_f64();
+    let p = threads as f64;
+    let serial = (threads > 1).then(|| (1.0 / speedup - 1.0 / p) / (1.0 - 1.0 / p));
+    (speedup, speedup / p, serial)
+}
+
+fn runs(threads: &[usize], times: &[Duration]) -> Vec<Value> {
+    threads
+        .iter()
+        .zip(times)
+        .map(|(&n, &time)| {
+            let (speedup, efficiency, serial) = metrics(times[0], n, time);
+            json!({
+                "threads": n,
+                "seconds": time.as_secs_f64(),
+                "speedup": speedup,
+                "efficiency": efficiency,
+                "serial_fraction": serial,
+            })
+        })
+        .collect()
+}
+
+fn table(threads: &[usize], results: &[(&str, Vec<Duration>)]) -> String {
+    let mut out = String::new();
+    writeln!(
+        out,
+        "{:<8} {:>6} {:>12} {:>8} {:>8} {:>8}",
+        "mode", "jobs", "ms", "speedup", "eff", "serial"
+    )
+    .unwrap();
+    for (mode, times) in results {
+        for (&n, &time) in threads.iter().zip(times) {
+            let (speedup, efficiency, serial) = metrics(times[0], n, time);
+            let serial = serial.map_or_else(|| "-".to_string(), |e| format!("{:.3}", e));
+            writeln!(
+                out,
+                "{:<8} {:>6} {:>12.2} {:>8.2} {:>7.0}% {:>8}",
+                mode,
+                n,
+                time.as_secs_f64() * 1e3,
+                speedup,
+                efficiency * 100.0,
+                serial
+            )
+            .unwrap();
+        }
+    }
+    out
+}
+
+/// 写入临时目录的生成语料，丢弃时删除
+struct Corpus {
+    dir: PathBuf,
+    paths: Vec<PathBuf>,
+    texts: Vec<String>,
+}
+
+type Runner<'c> = Box<dyn FnMut(usize) -> anyhow::Result<Duration> + 'c>;
+
+impl Corpus {
+    /// 每个文件含一个供其他文件调用的叶函数与一条调用链
+    fn create(files: usize, defs: usize) -> anyhow::Result<Self> {
+        let dir = std::env::temp_dir().join(format!("kslangc-bench-{}", std::process::id()));
+        std::fs::create_dir_all(&dir).context("无法创建语料目录")?;
+        let mut corpus = Self {
+            dir,
+            paths: Vec::with_capacity(files),
+            texts: Vec::with_capacity(files),
+        };
+        for file in 0..files {
+            let mut text = format!("def leaf{}(x) x * 2 + 1\n", file);
+            for def in 0..defs {
+                let call = match def {
+                    0 => format!("leaf{}(x + i)", (file + 1) % files),
+                    _ => format!("f{}_{}(x + i, 2)", file, def - 1),
+                };
+                write!(
+                    text,
+                    "def f{file}_{def}(x, y) {{\n    s = 0;\n    for i in 0 .. y {{ s = s + {call} * 0.5; }}\n    if s > x then s - x else x * 1.5 + y\n}}\n"
+                )
+                .unwrap();
+            }
+            writeln!(text, "total{} = leaf{}(1)", file, file).unwrap();
+
+            let path = corpus.dir.join(format!("m{}.ks", file));
+            std::fs::write(&path, &text).context("写入语料失败")?;
+            corpus.paths.push(path);
+            corpus.texts.push(text);
+        }
+        Ok(corpus)
+    }
+
+    fn parse(&self) -> anyhow::Result<Vec<Vec<Stmt>>> {
+        self.texts.iter().map(|text| parse(text)).collect()
+    }
+
+    fn modules(&self, parsed: &[Vec<Stmt>]) -> Vec<Module<'_>> {
+        self.texts
+            .iter()
+            .zip(parsed)
+            .map(|(text, stmts)| Module {
+                src: text,
+                stmts: stmts.clone(),
+                fp: FpMode::Strict,
+            })
+            .collect()
+    }
+
+    /// 返回以给定线程数执行一次并计时的闭包，准备工作不计入用时
+    ///
+    /// `cc` 与 `kslangc` 模式的翻译单元数固定为 `units`，只改变同时编译的单元数。
+    fn runner(&self, mode: &str, units: usize) -> anyhow::Result<Runner<'_>> {
+        Ok(match mode {
+            "lex" => Box::new(|jobs| {
+                let opts = load::Options {
+                    jobs,
+                    ..Default::default()
+                };
+                let start = Instant::now();
+                let results = load::map_files(&self.paths, &opts, |_, text| {
+                    Ok::<_, anyhow::Error>(lex(&text?)?.len())
+                });
+                results.into_iter().collect::<anyhow::Result<Vec<_>>>()?;
+                Ok(start.elapsed())
+            }),
+            "parse" => Box::new(|jobs| {
+                let opts = load::Options {
+                    jobs,
+                    ..Default::default()
+                };
+                let start = Instant::now();
+                let results = load::map_files(&self.paths, &opts, |_, text| parse(&text?));
+                results.into_iter().collect::<anyhow::Result<Vec<_>>>()?;
+                Ok(start.elapsed())
+            }),
+            "analyze" => Box::new(|jobs| {
+                let mut index = WorkspaceIndex::new();
+                let start = Instant::now();
+                index.update(&self.paths, jobs)?;
+                Ok(start.elapsed())
+            }),
+            "lto" => {
+                let parsed = self.parse()?;
+                Box::new(move |jobs| {
+                    let mut modules = self.modules(&parsed);
+                    let opts = lto::Options {
+                        jobs,
+                        ..Default::default()
+                    };
+                    let start = Instant::now();
+                    lto::link(&mut modules, &opts);
+                    Ok(start.elapsed())
+                })
+            }
+            "json" => {
+                let stmts = self.parse()?.concat();
+                Box::new(move |jobs| {
+                    let start = Instant::now();
+                    json::to_json_chunks(&stmts, jobs)?;
+                    Ok(start.elapsed())
+                })
+            }
+            "kslangc" => {
+                let exe = std::env::current_exe().context("找不到 kslangc")?;
+                let output = self.dir.join("kslangc");
+                Box::new(move |jobs| {
+                    let mut command = Command::new(&exe);
+                    command.arg("build");
+                    for path in &self.paths {
+                        command.arg("-i").arg(path);
+                    }
+                    command
+                        .args(["--emit", "staticlib", "-o"])
+                        .arg(&output)
+                        .args(["--units", &units.to_string(), "-j", &jobs.to_string()]);
+                    let start = Instant::now();
+                    let status = command.status().context("无法运行 kslangc")?;
+                    let elapsed = start.elapsed();
+                    if !status.success() {
+                        anyhow::bail!("kslangc build 失败")
+                    }
+                    Ok(elapsed)
+                })
+            }
+            "cc" => {
+                let parsed = self.parse()?;
+                let output = self.dir.join("cc");
+                let opts = c::Options {
+                    units,
+                    ..Default::default()
+                };
+                let source = c::c_source(&self.modules(&parsed), &opts)?;
+                let files = write_c(&source, &output)?;
+                Box::new(move |jobs| {
+                    let start = Instant::now();
+                    static_lib(&files, &output, jobs)?;
+                    Ok(start.elapsed())
+                })
+            }
+            "exec" => {
+                let modules = [Module {
+                    src: KERNEL,
+                    stmts: parse(KERNEL)?,
+                    fp: FpMode::Strict,
+                }];
+                let program = Program::compile(&modules, &HashMap::new())?;
+                Box::new(move |jobs| {
+                    let program = &program;
+                    let chunk = ITERATIONS.div_ceil(jobs);
+                    let start = Instant::now();
+                    std::thread::scope(|scope| {
+                        let workers = (0..jobs)
+                            .map(|job| {
+                                let from = (job * chunk) as f64;
+                                let to = ((job + 1) * chunk).min(ITERATIONS) as f64;
+                                scope.spawn(move || {
+                                    let mut machine = Machine::new(program);
+                                    machine.run()?;
+                                    machine.call("work", &[from, to]).unwrap()
+                                })
+                            })
+                            .collect::<Vec<_>>();
+                        for worker in workers {
+                            worker.join().unwrap()?;
+                        }
+                        Ok::<_, anyhow::Error>(())
+                    })?;
+                    Ok(start.elapsed())
+                })
+            }
+            _ => anyhow::bail!("未知的模式(`{}`)", mode),
+        })
+    }
+}
+
+impl Drop for Corpus {
+    fn drop(&mut self) {
+        let _ = std::fs::remove_dir_all(&self.dir);
+    }
+}
+
+fn lex(text: &str) -> anyhow::Result<Vec<Token>> {
+    Lexer::from_text(0, text)
+        .collect::<Result<Vec<_>, _>>()
+        .map_err(|span| anyhow::anyhow!("{}: 词法分析出现错误", span))
+}
+
+fn parse(text: &str) -> anyhow::Result<Vec<Stmt>> {
+    let tokens = lex(text)?;
+    parse_ast(text, &tokens).map_err(|e| anyhow::anyhow!("{:?}", e))
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// 线性加速时串行比例为 0，无加速时为 1
+    #[test]
+    fn scaling_metrics() {
+        let t1 = Duration::from_secs(8);
+        assert_eq!(metrics(t1, 1, t1), (1.0, 1.0, None));
+        assert_eq!(
+            metrics(t1, 4, Duration::from_secs(2)),
+            (4.0, 1.0, Some(0.0))
+        );
+        assert_eq!(
+            metrics(t1, 4, Duration::from_secs(5)),
+            (1.6, 0.4, Some(0.5))
+        );
+        assert_eq!(metrics(t1, 2, t1), (1.0, 0.5, Some(1.0)));
+    }
+
+    /// 表格与 JSON 中每个线程数一行，均以单线程用时为基准
+    #[test]
+    fn scaling_report() {
+        let threads = [1, 2];
+        let times = vec![Duration::from_millis(400), Duration::from_millis(250)];
+        let runs = runs(&threads, &times);
+        assert_eq!(runs.len(), 2);
+        assert_eq!(runs[0]["serial_fraction"], Value::Null);
+        assert_eq!(runs[1]["threads"], 2);
+        assert_eq!(runs[1]["speedup"], 1.6);
+        assert_eq!(runs[1]["efficiency"], 0.8);
+
+        let table = table(&threads, &[("lex", times)]);
+        let lines = table.lines().collect::<Vec<_>>();
+        assert_eq!(lines.len(), 3);
+        assert!(lines[1].ends_with(" -"), "{}", lines[1]);
+        assert!(lines[2].contains("  80%"), "{}", lines[2]);
+        assert!(lines[2].ends_with("0.250"), "{}", lines[2]);
+    }
+}
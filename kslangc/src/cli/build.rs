@@ -0,0 +1,492 @@
+use super::utils::{fp_mode, parse_modules, read_sources};
+use anyhow::Context;
+use clap::{ArgAction, arg};
+use kslang::compiler::{
+    analyzer::Analyzer,
+    ast::{FpMode, Stmt},
+    emit::{self, EmitError, c, header},
+    lexer::{Source, SourceSequence},
+    opt::{self, fp, lto},
+    stream::{StmtStream, StreamError},
+};
+use std::{
+    collections::HashMap,
+    fs::File,
+    io::{BufWriter, Write},
+    path::{Path, PathBuf},
+    process::Command,
+    sync::atomic::{AtomicUsize, Ordering},
+};
+
+pub fn command() -> clap::Command {
+    clap::Command::new("build")
+        .about("预先编译源代码，生成可链接的产物")
+        .arg(
+            arg!(-i --input <IN> "源代码输入 <FILE> | <STRING> | stdin（默认），可重复指定多个模块")
+                .action(ArgAction::Append),
+        )
+        .arg(arg!(-o --output <OUT> "产物路径（不含扩展名），默认取第一个输入文件名"))
+        .arg(arg!(--emit <KIND> "产物类型 staticlib | c | ast"))
+        .arg(
+            arg!(--units <N> "生成 C 代码时拆分的翻译单元数，默认 1")
+                .value_parser(clap::value_parser!(usize)),
+        )
+        .arg(
+            arg!(-j --jobs <N> "同时运行的 C 编译器进程数，默认为 CPU 数")
+                .value_parser(clap::value_parser!(usize)),
+        )
+        .arg(arg!(--"emit-header" "生成声明导出函数的 C/C++ 头文件 <OUT>.h"))
+        .arg(arg!(--fp <MODE> "默认浮点语义 strict（默认）| contract | fast"))
+        .arg(arg!(--lto "全程序链接期优化：跨模块展开、死函数删除与常量传播"))
+        .arg(
+            arg!(--export <NAME> "链接期优化时保留的对外函数，可重复指定；默认保留全部顶层函数")
+                .action(ArgAction::Append),
+        )
+        .arg(arg!(--stream "逐条语句编译，不保留完整的 Token 序列与语法树，适用于超大输入"))
+}
+
+enum Emit {
+    StaticLib,
+    C,
+    Ast,
+}
+
+/// 生成 C 代码时拆分的翻译单元数与同时编译的单元数
+#[derive(Clone, Copy)]
+struct Units {
+    count: usize,
+    jobs: usize,
+}
+
+pub fn match_command(matches: &clap::ArgMatches, verbose: bool) -> anyhow::Result<()> {
+    let emit = match matches.get_one::<String>("emit").map(String::as_str) {
+        Some("staticlib") => Some(Emit::StaticLib),
+        Some("c") => Some(Emit::C),
+        Some("ast") => Some(Emit::Ast),
+        Some(kind) => anyhow::bail!("无效的产物类型(`{}`)", kind),
+        None => None,
+    };
+    let emit_header = matches.get_flag("emit-header");
+    let mode = fp_mode(matches)?;
+    if emit.is_none() && !emit_header {
+        anyhow::bail!("未指定产物，使用 --emit 或 --emit-header")
+    }
+
+    let inputs = matches.get_many::<String>("input").map_or_else(
+        || vec!["stdin"],
+        |inputs| inputs.map(String::as_str).collect(),
+    );
+    let srcs = read_sources(&inputs)?;
+    let units = Units {
+        count: matches.get_one::<usize>("units").copied().unwrap_or(1),
+        jobs: matches
+            .get_one::<usize>("jobs")
+            .copied()
+            .unwrap_or_else(|| std::thread::available_parallelism().map_or(1, |n| n.get())),
+    };
+
+    let output = match (matches.get_one::<String>("output"), &srcs.sources[0]) {
+        (Some(output), _) => PathBuf::from(output),
+        (None, Source::File { path, .. }) => path.with_extension(""),
+        (None, _) => PathBuf::from("out"),
+    };
+
+    if matches.get_flag("stream") {
+        if matches.get_flag("lto") {
+            anyhow::bail!("流式编译不支持链接期优化")
+        }
+        return build_stream(&srcs, &output, emit, emit_header, units, mode, verbose);
+    }
+
+    let mut modules = parse_modules(&srcs, mode)?;
+
+    if matches.get_flag("lto") {
+        // 产物都是供外部调用的库，未指定 --export 时保留全部顶层函数
+        let opts = lto::Options {
+            roots: matches
+                .get_many::<String>("export")
+                .map_or_else(|| lto::exported(&modules), |names| names.cloned().collect()),
+            ..Default::default()
+        };
+        let stats = lto::link(&mut modules, &opts);
+        if verbose {
+            eprintln!(
+                "链接期优化：展开 {} 处调用，传播 {} 个常量参数，删除 {} 个函数",
+                stats.inlined, stats.propagated, stats.removed
+            );
+        }
+    }
+
+    if let Some(Emit::Ast) = emit {
+        let ast = modules
+            .iter()
+            .map(|module| &module.stmts)
+            .collect::<Vec<_>>();
+        let path = output.with_extension("json");
+        let json = serde_json::to_vec(&ast).context("序列化抽象语法树失败")?;
+        std::fs::write(&path, json).context("写入抽象语法树失败")?;
+    }
+
+    if let Some(Emit::C | Emit::StaticLib) = emit {
+        let opts = c::Options {
+            units: units.count,
+            ..Default::default()
+        };
+        let source = c::c_source(&modules, &opts)?;
+        let files = write_c(&source, &output)?;
+        if verbose {
+            for file in &files {
+                eprintln!("生成 {}", file.display());
+            }
+        }
+        if let Some(Emit::StaticLib) = emit {
+            let path = static_lib(&files, &output, units.jobs)?;
+            if verbose {
+                eprintln!("生成 {}", path.display());
+            }
+        }
+    }
+
+    if emit_header {
+        let mut exports = Vec::new();
+        let mut seen = HashMap::new();
+        for module in &modules {
+            for export in emit::exports(module.src, &module.stmts)? {
+                if seen.insert(export.name, export.span).is_some() {
+                    return Err(EmitError::Duplicate(export.span).into());
+                }
+                exports.push(export);
+            }
+        }
+
+        let path = output.with_extension("h");
+        std::fs::write(&path, header::header(&exports)).context("写入头文件失败")?;
+        if verbose {
+            eprintln!("生成 {}（{} 个导出函数）", path.display(), exports.len());
+        }
+    }
+
+    Ok(())
+}
+
+/// 逐条语句完成解析、检查、优化与输出后即丢弃语法树，只保留签名与导出声明
+///
+/// 调用尚未出现的函数时暂记，定义出现后再核对。抽象语法树与非流式编译的格式
+/// 相同，但只做语句内的优化。生成 C 代码需要预先知道全部签名，因此在第一遍登记
+/// 之后再流式读取一遍输入，逐条翻译写出。
+fn build_stream(
+    srcs: &SourceSequence,
+    output: &Path,
+    emit: Option<Emit>,
+    emit_header: bool,
+    units: Units,
+    mode: FpMode,
+    verbose: bool,
+) -> anyhow::Result<()> {
+    let ast_path = output.with_extension("json");
+    let tmp_path = output.with_extension("json.tmp");
+    let mut ast = if let Some(Emit::Ast) = emit {
+        let file = File::create(&tmp_path).context("写入抽象语法树失败")?;
+        Some(BufWriter::new(file))
+    } else {
+        None
+    };
+    let mut emitter = matches!(emit, Some(Emit::C | Emit::StaticLib)).then(c::StreamEmitter::new);
+
+    let exports = match stream_modules(
+        srcs,
+        ast.as_mut(),
+        emit_header,
+        emitter.as_mut(),
+        mode,
+        verbose,
+    ) {
+        Ok(exports) => exports,
+        Err(e) => {
+            drop(ast);
+            let _ = std::fs::remove_file(&tmp_path);
+            return Err(e);
+        }
+    };
+
+    if let Some(out) = ast {
+        out.into_inner()
+            .map_err(|e| e.into_error())
+            .context("写入抽象语法树失败")?;
+        std::fs::rename(&tmp_path, &ast_path).context("写入抽象语法树失败")?;
+    }
+    if emit_header {
+        let path = output.with_extension("h");
+        std::fs::write(&path, header::header(&exports)).context("写入头文件失败")?;
+        if verbose {
+            eprintln!("生成 {}（{} 个导出函数）", path.display(), exports.len());
+        }
+    }
+    if let Some(emitter) = emitter {
+        let files = stream_c(srcs, emitter, output, units.count, mode)?;
+        if verbose {
+            for file in &files {
+                eprintln!("生成 {}", file.display());
+            }
+        }
+        if let Some(Emit::StaticLib) = emit {
+            let path = static_lib(&files, output, units.jobs)?;
+            if verbose {
+                eprintln!("生成 {}", path.display());
+            }
+        }
+    }
+    Ok(())
+}
+
+fn next_stmt(
+    src: &Source,
+    srcs: &SourceSequence,
+    stmt: Result<Stmt, StreamError>,
+) -> anyhow::Result<Stmt> {
+    match stmt {
+        Ok(stmt) => Ok(stmt),
+        Err(StreamError::Lexer(e)) => {
+            anyhow::bail!("[Lexer] {}@{}\t`{}`", src, e, srcs.get_text(e))
+        }
+        Err(StreamError::Parser(e)) => anyhow::bail!("[Parser] {}: {:?}", src, e),
+    }
+}
+
+/// 第一遍：检查调用、收集导出函数并登记 C 代码所需的签名，语义错误全部收集后一并返回
+fn stream_modules<'s>(
+    srcs: &'s SourceSequence,
+    mut ast: Option<&mut BufWriter<File>>,
+    emit_header: bool,
+    mut emitter: Option<&mut c::StreamEmitter<'s>>,
+    mode: FpMode,
+    verbose: bool,
+) -> anyhow::Result<Vec<emit::Export<'s>>> {
+    let mut analyzer = Analyzer::new();
+    let mut exports = Vec::new();
+    let mut seen = HashMap::new();
+    let mut errors = Vec::new();
+    if let Some(out) = &mut ast {
+        out.write_all(b"[")?;
+    }
+    for (src_id, src) in srcs.sources.iter().enumerate() {
+        let text = src.text();
+        let fp = fp::module_mode(text).unwrap_or(mode);
+        if let Some(out) = &mut ast {
+            out.write_all(if src_id == 0 { b"[" } else { b",[" })?;
+        }
+
+        let mut stream = StmtStream::new(src_id, srcs);
+        let mut count = 0;
+        for stmt in stream.by_ref() {
+            let mut stmt = next_stmt(src, srcs, stmt)?;
+
+            errors.extend(
+                analyzer
+                    .declare(text, &stmt)
+                    .into_iter()
+                    .map(|e| format!("[Analyzer] {}", e)),
+            );
+            if let Some(emitter) = &mut emitter {
+                emitter.declare(src_id, text, &stmt)?;
+            }
+            opt::optimize_stmt(text, &mut stmt, fp);
+
+            if emit_header {
+                for export in emit::exports(text, std::slice::from_ref(&stmt))? {
+                    if seen.insert(export.name, export.span).is_some() {
+                        return Err(EmitError::Duplicate(export.span).into());
+                    }
+                    exports.push(export);
+                }
+            }
+            if let Some(out) = &mut ast {
+                if count > 0 {
+                    out.write_all(b",")?;
+                }
+                serde_json::to_writer(&mut **out, &stmt).context("序列化抽象语法树失败")?;
+            }
+            count += 1;
+        }
+
+        if let Some(out) = &mut ast {
+            out.write_all(b"]")?;
+        }
+        if verbose {
+            eprintln!(
+                "{}：{} 条语句，最多缓存 {} 个 Token",
+                src,
+                count,
+                stream.peak()
+            );
+        }
+    }
+
+    errors.extend(
+        analyzer
+            .undefined()
+            .into_iter()
+            .map(|e| format!("[Analyzer] {}", e)),
+    );
+    if !errors.is_empty() {
+        anyhow::bail!(
+            "语义检查出现 {} 处错误\n{}",
+            errors.len(),
+            errors.join("\n")
+        )
+    }
+    if let Some(out) = &mut ast {
+        out.write_all(b"]")?;
+    }
+    Ok(exports)
+}
+
+/// 第二遍：逐条翻译为 C 代码
+///
+/// 公共声明写入 `<OUT>.prelude.h`；函数定义按已写出的代码量分配到 `units` 个
+/// 单元 `<OUT>.N.c`；顶层语句与 `ks_init` 写入 `<OUT>.init.c`。出错时删除已写出的文件。
+fn stream_c<'s>(
+    srcs: &'s SourceSequence,
+    mut emitter: c::StreamEmitter<'s>,
+    output: &Path,
+    units: usize,
+    mode: FpMode,
+) -> anyhow::Result<Vec<PathBuf>> {
+    let modules = srcs.sources.len();
+    let prelude = output.with_extension("prelude.h");
+    let mut paths = (0..units.max(1))
+        .map(|index| output.with_extension(format!("{}.c", index)))
+        .collect::<Vec<_>>();
+    paths.push(output.with_extension("init.c"));
+
+    let mut write = || -> anyhow::Result<()> {
+        std::fs::write(&prelude, emitter.prelude(modules)?).context("写入 C 代码失败")?;
+        let name = prelude.file_name().unwrap().to_string_lossy();
+        let mut files = Vec::with_capacity(paths.len());
+        for path in &paths {
+            let mut file = BufWriter::new(File::create(path).context("写入 C 代码失败")?);
+            writeln!(file, "#include \"{}\"", name)?;
+            files.push((file, 0));
+        }
+        let (init, defs) = files.split_last_mut().unwrap();
+        init.0.write_all(emitter.init_head().as_bytes())?;
+
+        for (src_id, src) in srcs.sources.iter().enumerate() {
+            let text = src.text();
+            let fp = fp::module_mode(text).unwrap_or(mode);
+            for stmt in StmtStream::new(src_id, srcs) {
+                let mut stmt = next_stmt(src, srcs, stmt)?;
+                opt::optimize_stmt(text, &mut stmt, fp);
+                match emitter.emit(src_id, text, fp, &stmt)? {
+                    Some(c::Fragment::Def(code)) => {
+                        let unit = defs.iter_mut().min_by_key(|(_, size)| *size).unwrap();
+                        unit.1 += code.len();
+                        unit.0.write_all(code.as_bytes())?;
+                    }
+                    Some(c::Fragment::Init(code)) => init.0.write_all(code.as_bytes())?,
+                    None => {}
+                }
+            }
+        }
+        init.0.write_all(emitter.init(modules).as_bytes())?;
+
+        for (file, _) in files {
+            file.into_inner()
+                .map_err(|e| e.into_error())
+                .context("写入 C 代码失败")?;
+        }
+        Ok(())
+    };
+    if let Err(e) = write() {
+        for path in paths.iter().chain([&prelude]) {
+            let _ = std::fs::remove_file(path);
+        }
+        return Err(e);
+    }
+    Ok(paths)
+}
+
+/// 单一单元时声明直接写在源文件开头，否则写入共用的 `<OUT>.prelude.h`
+pub(super) fn write_c(source: &c::CSource, output: &Path) -> anyhow::Result<Vec<PathBuf>> {
+    if let [unit] = source.units.as_slice() {
+        let path = output.with_extension("c");
+        std::fs::write(&path, format!("{}{}", source.prelude, unit)).context("写入 C 代码失败")?;
+        return Ok(vec![path]);
+    }
+
+    let prelude = output.with_extension("prelude.h");
+    std::fs::write(&prelude, &source.prelude).context("写入 C 代码失败")?;
+    let name = prelude.file_name().unwrap().to_string_lossy();
+    let mut files = Vec::with_capacity(source.units.len());
+    for (index, unit) in source.units.iter().enumerate() {
+        let path = output.with_extension(format!("{}.c", index));
+        std::fs::write(&path, format!("#include \"{}\"\n{}", name, unit))
+            .context("写入 C 代码失败")?;
+        files.push(path);
+    }
+    Ok(files)
+}
+
+/// 以 `$CC`（默认 `cc`）并行编译各单元，同时至多运行 `jobs` 个进程，再由 `ar` 打包
+pub(super) fn static_lib(files: &[PathBuf], output: &Path, jobs: usize) -> anyhow::Result<PathBuf> {
+    let cc = std::env::var("CC").unwrap_or_else(|_| "cc".to_string());
+    let objects = files
+        .iter()
+        .map(|file| file.with_extension("o"))
+        .collect::<Vec<_>>();
+    let cc = cc.as_str();
+    let next = AtomicUsize::new(0);
+    let compile = |index: usize| {
+        let file = &files[index];
+        let status = Command::new(cc)
+            .args(["-O2", "-ffp-contract=off", "-c"])
+            .arg(file)
+            .arg("-o")
+            .arg(&objects[index])
+            .status()
+            .with_context(|| format!("无法运行 C 编译器 `{}`", cc))?;
+        if !status.success() {
+            anyhow::bail!("编译 {} 失败", file.display())
+        }
+        Ok(())
+    };
+    std::thread::scope(|scope| {
+        let workers = (0..jobs.clamp(1, files.len().max(1)))
+            .map(|_| {
+                scope.spawn(|| {
+                    loop {
+                        let index = next.fetch_add(1, Ordering::Relaxed);
+                        if index >= files.len() {
+                            break Ok(());
+                        }
+                        if let Err(e) = compile(index) {
+                            // 令其余线程不再取新的单元
+                            next.store(files.len(), Ordering::Relaxed);
+                            break Err(e);
+                        }
+                    }
+                })
+            })
+            .collect::<Vec<_>>();
+        workers
+            .into_iter()
+            .map(|worker| worker.join().unwrap())
+            .collect::<anyhow::Result<()>>()
+    })?;
+
+    let path = output.with_extension("a");
+    let _ = std::fs::remove_file(&path);
+    let status = Command::new("ar")
+        .arg("rcs")
+        .arg(&path)
+        .args(&objects)
+        .status()
+        .context("无法运行 `ar`")?;
+    for object in &objects {
+        let _ = std::fs::remove_file(object);
+    }
+    if !status.success() {
+        anyhow::bail!("生成静态库失败")
+    }
+    Ok(path)
+}
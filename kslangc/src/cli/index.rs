@@ -0,0 +1,98 @@
+use anyhow::Context;
+use clap::arg;
+use kslang::compiler::index::{SymbolKind, WorkspaceIndex};
+use std::path::{Path, PathBuf};
+
+pub fn command() -> clap::Command {
+    clap::Command::new("index")
+        .about("建立或更新工作区符号索引，并可直接查询")
+        .arg(arg!(-w --workspace <DIR> "工作区目录，默认为当前目录"))
+        .arg(arg!(-x --index <FILE> "索引文件，默认为 <DIR>/.ksindex.json"))
+        .arg(arg!(-q --query <NAME> "查询符号的定义与引用"))
+        .arg(
+            arg!(-j --jobs <N> "并行线程数，默认为 CPU 数")
+                .value_parser(clap::value_parser!(usize)),
+        )
+        .arg(arg!(-n --"no-update" "只读取已有索引，不扫描工作区"))
+}
+
+pub fn match_command(matches: &clap::ArgMatches, verbose: bool) -> anyhow::Result<()> {
+    let workspace = PathBuf::from(
+        matches
+            .get_one::<String>("workspace")
+            .map_or(".", String::as_str),
+    );
+    let index_path = matches
+        .get_one::<String>("index")
+        .map_or_else(|| workspace.join(".ksindex.json"), PathBuf::from);
+    let jobs = matches
+        .get_one::<usize>("jobs")
+        .copied()
+        .unwrap_or_else(|| std::thread::available_parallelism().map_or(1, |n| n.get()));
+
+    let mut index = WorkspaceIndex::load(&index_path);
+    if !matches.get_flag("no-update") {
+        let mut paths = Vec::new();
+        collect_sources(&workspace, &mut paths).context("扫描工作区失败")?;
+        paths.sort();
+
+        let stats = index.update(&paths, jobs).context("读取源文件失败")?;
+        index.save(&index_path).context("写入索引失败")?;
+        if verbose {
+            eprintln!(
+                "索引 {} 个文件：复用 {}，重建 {}，移除 {}",
+                paths.len(),
+                stats.reused,
+                stats.indexed,
+                stats.removed
+            );
+            for file in index.files() {
+                if let Some(error) = &file.error {
+                    eprintln!("{}: {}", file.path.display(), error);
+                }
+            }
+        }
+    }
+
+    if let Some(name) = matches.get_one::<String>("query") {
+        for (path, symbol) in index.definitions(name) {
+            let kind = match symbol.kind {
+                SymbolKind::Def => "def",
+                SymbolKind::Extern => "extern",
+            };
+            let vararg = if symbol.vararg { ", ..." } else { "" };
+            println!(
+                "{} {}/{}{}\t{}@{}",
+                kind,
+                symbol.name,
+                symbol.arity,
+                vararg,
+                path.display(),
+                symbol.span
+            );
+        }
+        for (path, r) in index.references(name) {
+            println!("{:?}\t{}@{}", r.kind, path.display(), r.span());
+        }
+    }
+
+    Ok(())
+}
+
+/// 递归收集 `.ks` 文件，跳过隐藏目录与 `target`
+fn collect_sources(dir: &Path, paths: &mut Vec<PathBuf>) -> std::io::Result<()> {
+    for entry in std::fs::read_dir(dir)? {
+        let entry = entry?;
+        let path = entry.path();
+        let name = entry.file_name();
+        let hidden = name.to_string_lossy().starts_with('.');
+        if entry.file_type()?.is_dir() {
+            if !hidden && name != "target" {
+                collect_sources(&path, paths)?;
+            }
+        } else if path.extension().is_some_and(|ext| ext == "ks") {
+            paths.push(path);
+        }
+    }
+    Ok(())
+}
@@ -1,7 +1,7 @@
 use super::utils::*;
 use anyhow::Context;
 use clap::{Command, arg};
-use kslang::compiler::lexer::{Lexer, Source, SourceSequence};
+use kslang::compiler::{arena::SourceArena, lexer::Source};
 use std::{
     io::{BufWriter, Read, Write},
     path::PathBuf,
@@ -154,8 +154,9 @@ pub fn match_command(matches: &clap::ArgMatches, _verbose: bool) -> anyhow::Resu
         }
     };
 
-    let srcs = SourceSequence { sources: vec![src] };
-    let lexer = Lexer::new(0, &srcs);
+    let mut arena = SourceArena::new();
+    let src_id = arena.add(src)?;
+    let lexer = arena.lexer(src_id);
 
     let mut tokens = Vec::new();
     let mut err_cnt = 0;
@@ -167,8 +168,11 @@ pub fn match_command(matches: &clap::ArgMatches, _verbose: bool) -> anyhow::Resu
                 Format::Debug => println!("{:?}", token),
             },
             Err(e) => {
-                let src = &srcs.sources[0];
-                let text = srcs.get_text(e);
+                let src = arena.origin(src_id);
+                let text = arena
+                    .global(e)
+                    .and_then(|span| arena.get_text(span))
+                    .unwrap_or_default();
 
                 writeln!(err, "[Lexer:{}] {}@{}\t`{}`", err_cnt, src, e, text)
                     .context("写入错误输出失败")?;
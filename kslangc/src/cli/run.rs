@@ -0,0 +1,82 @@
+use super::utils::{fp_mode, parse_modules, parse_modules_lazy, read_sources};
+use clap::{ArgAction, arg};
+use kslang::compiler::exec::{Extern, Machine, Program};
+use std::{collections::HashMap, io::Write, time::Instant};
+
+/// 执行线程的栈大小，深递归时闭包调用链较长
+pub(super) const STACK_SIZE: usize = 1 << 30;
+
+pub fn command() -> clap::Command {
+    clap::Command::new("run")
+        .about("编译为闭包树并执行源代码")
+        .arg(
+            arg!(-i --input <IN> "源代码输入 <FILE> | <STRING> | stdin（默认），可重复指定多个模块")
+                .action(ArgAction::Append),
+        )
+        .arg(arg!(--fp <MODE> "默认浮点语义 strict（默认）| contract | fast"))
+        .arg(arg!(--call <NAME> "执行顶层代码后调用的函数，结果输出到 stdout"))
+        .arg(arg!(--lazy "只解析与编译顶层代码及 --call 函数用到的函数"))
+        .arg(
+            arg!(--arg <VALUE> "传给 --call 函数的实参，可重复指定")
+                .action(ArgAction::Append)
+                .value_parser(clap::value_parser!(f64)),
+        )
+}
+
+pub(super) fn printd(args: &[f64]) -> f64 {
+    println!("{}", args[0]);
+    0.0
+}
+
+pub(super) fn putchard(args: &[f64]) -> f64 {
+    let _ = std::io::stdout().write_all(&[args[0] as u8]);
+    0.0
+}
+
+pub fn match_command(matches: &clap::ArgMatches, verbose: bool) -> anyhow::Result<()> {
+    let mode = fp_mode(matches)?;
+    let inputs = matches.get_many::<String>("input").map_or_else(
+        || vec!["stdin"],
+        |inputs| inputs.map(String::as_str).collect(),
+    );
+    let srcs = read_sources(&inputs)?;
+    let call = matches.get_one::<String>("call");
+    let modules = if matches.get_flag("lazy") {
+        let roots = call.map_or_else(Vec::new, |name| vec![name.as_str()]);
+        parse_modules_lazy(&srcs, mode, &roots)?
+    } else {
+        parse_modules(&srcs, mode)?
+    };
+
+    let externs = HashMap::from([("printd", printd as Extern), ("putchard", putchard)]);
+    let program = Program::compile(&modules, &externs)?;
+    if verbose {
+        let stats = program.stats();
+        eprintln!("编译 {} 个函数，用时 {:?}", stats.functions, stats.elapsed);
+    }
+
+    let args = matches
+        .get_many::<f64>("arg")
+        .map_or_else(Vec::new, |args| args.copied().collect());
+    std::thread::scope(|scope| {
+        std::thread::Builder::new()
+            .stack_size(STACK_SIZE)
+            .spawn_scoped(scope, || {
+                let start = Instant::now();
+                let mut machine = Machine::new(&program);
+                machine.run()?;
+                if let Some(name) = call {
+                    match machine.call(name, &args) {
+                        Some(result) => println!("{}", result?),
+                        None => anyhow::bail!("无法调用 `{}`：未定义或实参个数不符", name),
+                    }
+                }
+                if verbose {
+                    eprintln!("执行用时 {:?}", start.elapsed());
+                }
+                Ok(())
+            })?
+            .join()
+            .unwrap()
+    })
+}
@@ -0,0 +1,377 @@
+mod metrics;
+
+use super::{
+    run::{STACK_SIZE, printd, putchard},
+    utils::fp_mode,
+};
+use anyhow::Context;
+use clap::arg;
+use kslang::compiler::{
+    ast::FpMode,
+    exec::{Extern, Machine, Program},
+    lexer::Lexer,
+    opt::{self, fp, lto::Module},
+    parse_ast,
+    snapshot::content_hash,
+};
+use metrics::{Counter, Phase};
+use serde_json::{Value, json};
+use std::{
+    collections::{HashMap, VecDeque},
+    io::{BufRead, BufReader, Read, Write},
+    net::{TcpListener, TcpStream},
+    os::unix::{
+        fs::FileTypeExt,
+        net::{UnixListener, UnixStream},
+    },
+    sync::{Arc, Mutex, mpsc},
+    time::{Duration, Instant},
+};
+
+pub fn command() -> clap::Command {
+    clap::Command::new("serve")
+        .about("常驻的编译执行服务，每行一个 JSON 请求")
+        .arg(arg!(-l --listen <ADDR> "请求地址 unix:<PATH> | <HOST:PORT>").required(true))
+        .arg(arg!(-m --metrics <ADDR> "指标导出地址 unix:<PATH> | <HOST:PORT>（HTTP）"))
+        .arg(
+            arg!(-j --jobs <N> "工作线程数，默认为 CPU 数")
+                .value_parser(clap::value_parser!(usize)),
+        )
+        .arg(
+            arg!(--cache <N> "缓存的编译结果个数，默认 256")
+                .value_parser(clap::value_parser!(usize)),
+        )
+        .arg(arg!(--fp <MODE> "默认浮点语义 strict（默认）| contract | fast"))
+        .arg(
+            arg!(--timeout <MS> "单个请求执行的时间上限（毫秒），默认 10000")
+                .value_parser(clap::value_parser!(u64)),
+        )
+}
+
+/// 连接线程只读写套接字，不执行请求
+const CONN_STACK_SIZE: usize = 256 * 1024;
+
+/// 接受连接出错后的等待时间，避免文件描述符耗尽等持续的错误占满 CPU
+const ACCEPT_BACKOFF: Duration = Duration::from_millis(50);
+
+/// 一个请求，工作线程处理后把应答发回所在连接
+struct Job {
+    line: String,
+    reply: mpsc::Sender<Value>,
+    queued: Instant,
+}
+
+pub fn match_command(matches: &clap::ArgMatches, verbose: bool) -> anyhow::Result<()> {
+    let mode = fp_mode(matches)?;
+    let jobs = matches
+        .get_one::<usize>("jobs")
+        .copied()
+        .unwrap_or_else(|| std::thread::available_parallelism().map_or(1, |n| n.get()));
+    let capacity = matches.get_one::<usize>("cache").copied().unwrap_or(256);
+    let timeout =
+        Duration::from_millis(matches.get_one::<u64>("timeout").copied().unwrap_or(10_000));
+
+    let listener = Listener::bind(matches.get_one::<String>("listen").unwrap())?;
+    if let Some(addr) = matches.get_one::<String>("metrics") {
+        let metrics = Listener::bind(addr)?;
+        std::thread::spawn(move || serve_metrics(metrics));
+    }
+    if verbose {
+        eprintln!("{} 个工作线程，等待请求", jobs);
+    }
+
+    let cache = Arc::new(Cache {
+        programs: Mutex::new((HashMap::new(), VecDeque::new())),
+        capacity,
+    });
+    // 工作线程按请求而不是按连接分派，空闲的连接不占用工作线程
+    let (sender, receiver) = mpsc::channel::<Job>();
+    let receiver = Arc::new(Mutex::new(receiver));
+    for _ in 0..jobs.max(1) {
+        let (receiver, cache) = (receiver.clone(), cache.clone());
+        std::thread::Builder::new()
+            .stack_size(STACK_SIZE)
+            .spawn(move || {
+                loop {
+                    let Ok(job) = receiver.lock().unwrap().recv() else {
+                        return;
+                    };
+                    metrics::queue_depth(-1);
+                    metrics::time(Phase::Queue, job.queued.elapsed());
+                    let response = respond(&job.line, &cache, mode, timeout);
+                    metrics::time(Phase::Request, job.queued.elapsed());
+                    let _ = job.reply.send(response);
+                }
+            })?;
+    }
+
+    loop {
+        let stream = match listener.accept() {
+            Ok(stream) => stream,
+            Err(e) => {
+                eprintln!("接受连接失败：{}", e);
+                std::thread::sleep(ACCEPT_BACKOFF);
+                continue;
+            }
+        };
+        let sender = sender.clone();
+        let spawned = std::thread::Builder::new()
+            .stack_size(CONN_STACK_SIZE)
+            .spawn(move || connection(stream, &sender));
+        if let Err(e) = spawned {
+            eprintln!("无法创建连接线程：{}", e);
+        }
+    }
+}
+
+enum Listener {
+    Unix(UnixListener),
+    Tcp(TcpListener),
+}
+
+enum Stream {
+    Unix(UnixStream),
+    Tcp(TcpStream),
+}
+
+impl Listener {
+    fn bind(addr: &str) -> anyhow::Result<Self> {
+        match addr.strip_prefix("unix:") {
+            Some(path) => {
+                // 清理上次运行留下的套接字文件
+                if std::fs::metadata(path).is_ok_and(|meta| meta.file_type().is_socket()) {
+                    std::fs::remove_file(path)?;
+                }
+                let listener = UnixListener::bind(path);
+                Ok(Self::Unix(
+                    listener.with_context(|| format!("无法监听 `{}`", addr))?,
+                ))
+            }
+            None => {
+                let listener = TcpListener::bind(addr);
+                Ok(Self::Tcp(
+                    listener.with_context(|| format!("无法监听 `{}`", addr))?,
+                ))
+            }
+        }
+    }
+
+    fn accept(&self) -> std::io::Result<Stream> {
+        match self {
+            Self::Unix(listener) => listener.accept().map(|(stream, _)| Stream::Unix(stream)),
+            Self::Tcp(listener) => listener.accept().map(|(stream, _)| Stream::Tcp(stream)),
+        }
+    }
+}
+
+impl Stream {
+    fn try_clone(&self) -> std::io::Result<Self> {
+        match self {
+            Self::Unix(stream) => stream.try_clone().map(Self::Unix),
+            Self::Tcp(stream) => stream.try_clone().map(Self::Tcp),
+        }
+    }
+}
+
+impl Read for Stream {
+    fn read(&mut self, buf: &mut [u8]) -> std::io::Result<usize> {
+        match self {
+            Self::Unix(stream) => stream.read(buf),
+            Self::Tcp(stream) => stream.read(buf),
+        }
+    }
+}
+
+impl Write for Stream {
+    fn write(&mut self, buf: &[u8]) -> std::io::Result<usize> {
+        match self {
+            Self::Unix(stream) => stream.write(buf),
+            Self::Tcp(stream) => stream.write(buf),
+        }
+    }
+
+    fn flush(&mut self) -> std::io::Result<()> {
+        match self {
+            Self::Unix(stream) => stream.flush(),
+            Self::Tcp(stream) => stream.flush(),
+        }
+    }
+}
+
+/// Unix 套接字上连接即输出；TCP 上按 HTTP 应答任意请求
+fn serve_metrics(listener: Listener) {
+    while let Ok(mut stream) = listener.accept() {
+        let body = metrics::export();
+        let _ = match &mut stream {
+            Stream::Unix(stream) => stream.write_all(body.as_bytes()),
+            Stream::Tcp(stream) => {
+                let _ = stream.set_read_timeout(Some(Duration::from_secs(1)));
+                let mut reader = BufReader::new(&*stream);
+                let mut line = String::new();
+                while reader.read_line(&mut line).is_ok_and(|n| n > 0) && line != "\r\n" {
+                    line.clear();
+                }
+                write!(
+                    stream,
+                    "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: {}\r\n\r\n{}",
+                    body.len(),
+                    body
+                )
+            }
+        };
+    }
+}
+
+/// 按源代码与浮点语义缓存的编译结果，满时淘汰最早加入的
+struct Cache {
+    programs: Mutex<(
+        HashMap<(u64, FpMode), Arc<(String, Program)>>,
+        VecDeque<(u64, FpMode)>,
+    )>,
+    capacity: usize,
+}
+
+impl Cache {
+    fn get(
+        &self,
+        source: &str,
+        mode: FpMode,
+        tenant: &str,
+    ) -> anyhow::Result<Arc<(String, Program)>> {
+        let key = (content_hash(source), mode);
+        if let Some(entry) = self.programs.lock().unwrap().0.get(&key)
+            && entry.0 == source
+        {
+            metrics::count(Counter::CacheHit, 1);
+            return Ok(entry.clone());
+        }
+        metrics::count(Counter::CacheMiss, 1);
+
+        let program = compile(source, mode)?;
+        metrics::tenant_compile(tenant);
+        let stats = program.stats();
+        metrics::count(Counter::CompiledNodes, stats.nodes as u64);
+        metrics::count(Counter::CompiledFunctions, stats.functions as u64);
+
+        let entry = Arc::new((source.to_string(), program));
+        let mut guard = self.programs.lock().unwrap();
+        let (programs, order) = &mut *guard;
+        if let Some(old) = programs.insert(key, entry.clone()) {
+            metrics::cached_nodes(-(old.1.stats().nodes as i64));
+        } else {
+            order.push_back(key);
+        }
+        metrics::cached_nodes(stats.nodes as i64);
+        while programs.len() > self.capacity.max(1) {
+            let Some(oldest) = order.pop_front() else {
+                break;
+            };
+            if let Some(old) = programs.remove(&oldest) {
+                metrics::cached_nodes(-(old.1.stats().nodes as i64));
+            }
+        }
+        Ok(entry)
+    }
+}
+
+fn compile(source: &str, mode: FpMode) -> anyhow::Result<Program> {
+    let start = Instant::now();
+    let tokens = Lexer::from_text(0, source)
+        .collect::<Result<Vec<_>, _>>()
+        .map_err(|span| anyhow::anyhow!("{}: 词法分析出现错误", span))?;
+    metrics::time(Phase::Lex, start.elapsed());
+
+    let start = Instant::now();
+    let mut stmts = parse_ast(source, &tokens).map_err(|e| anyhow::anyhow!("{:?}", e))?;
+    metrics::time(Phase::Parse, start.elapsed());
+
+    let start = Instant::now();
+    let mode = fp::module_mode(source).unwrap_or(mode);
+    opt::optimize(source, &mut stmts, mode);
+    metrics::time(Phase::Optimize, start.elapsed());
+
+    let start = Instant::now();
+    let modules = [Module {
+        src: source,
+        stmts,
+        fp: mode,
+    }];
+    let externs = HashMap::from([("printd", printd as Extern), ("putchard", putchard)]);
+    let program = Program::compile(&modules, &externs)?;
+    metrics::time(Phase::Compile, start.elapsed());
+    Ok(program)
+}
+
+/// 逐行读取请求交给工作线程，收到应答后再读下一行，同一连接上的应答保持请求顺序
+///
+/// 连接线程不记录阶段指标，各线程的指标分片在线程结束后也不会释放。
+fn connection(stream: Stream, jobs: &mpsc::Sender<Job>) -> std::io::Result<()> {
+    let mut out = stream.try_clone()?;
+    let (reply, replies) = mpsc::channel();
+    for line in BufReader::new(stream).lines() {
+        let line = line?;
+        if line.trim().is_empty() {
+            continue;
+        }
+        metrics::queue_depth(1);
+        let job = Job {
+            line,
+            reply: reply.clone(),
+            queued: Instant::now(),
+        };
+        if jobs.send(job).is_err() {
+            break;
+        }
+        let Ok(response) = replies.recv() else {
+            break;
+        };
+        writeln!(out, "{}", response)?;
+    }
+    Ok(())
+}
+
+/// 请求 `{"tenant", "source", "call"?, "args"?, "fp"?}`，
+/// 应答 `{"ok": true, "result"}` 或 `{"ok": false, "error"}`
+fn respond(line: &str, cache: &Cache, mode: FpMode, timeout: Duration) -> Value {
+    match request(line, cache, mode, timeout) {
+        Ok(result) => {
+            metrics::count(Counter::RequestOk, 1);
+            json!({ "ok": true, "result": result })
+        }
+        Err(e) => {
+            metrics::count(Counter::RequestError, 1);
+            json!({ "ok": false, "error": e.to_string() })
+        }
+    }
+}
+
+/// 顶层代码与调用共用 `timeout` 的时限
+fn request(line: &str, cache: &Cache, mode: FpMode, timeout: Duration) -> anyhow::Result<Value> {
+    let request = serde_json::from_str::<Value>(line).context("请求不是有效的 JSON")?;
+    let source = request["source"].as_str().context("缺少 `source`")?;
+    let tenant = request["tenant"].as_str().unwrap_or("default");
+    let mode = match request["fp"].as_str() {
+        Some(name) => {
+            FpMode::from_name(name).with_context(|| format!("无效的浮点语义 `{}`", name))?
+        }
+        None => mode,
+    };
+    let args = request["args"].as_array().map_or_else(Vec::new, |args| {
+        args.iter().filter_map(Value::as_f64).collect()
+    });
+
+    let entry = cache.get(source, mode, tenant)?;
+    let start = Instant::now();
+    let mut machine = Machine::new(&entry.1);
+    machine.set_deadline(Some(start + timeout));
+    machine.run()?;
+    let result = match request["call"].as_str() {
+        Some(name) => match machine.call(name, &args) {
+            Some(result) => json!(result?),
+            None => anyhow::bail!("无法调用 `{}`：未定义或实参个数不符", name),
+        },
+        None => Value::Null,
+    };
+    metrics::time(Phase::Execute, start.elapsed());
+    Ok(result)
+}
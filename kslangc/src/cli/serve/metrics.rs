@@ -0,0 +1,371 @@
+use std::{
+    cell::RefCell,
+    collections::HashMap,
+    fmt::Write,
+    sync::{
+        Arc, Mutex,
+        atomic::{AtomicI64, AtomicU64, Ordering},
+    },
+    time::Duration,
+};
+
+/// 每个二的幂区间的细分数，相对误差不超过 1/16
+const SUB_BUCKETS: usize = 16;
+const SUB_BITS: u32 = SUB_BUCKETS.trailing_zeros();
+const BUCKETS: usize = SUB_BUCKETS + (64 - SUB_BITS as usize) * SUB_BUCKETS;
+
+/// 超出后的租户计入 `other`
+const MAX_TENANTS: usize = 256;
+
+#[derive(Clone, Copy)]
+pub enum Phase {
+    /// 请求在队列中等待工作线程
+    Queue,
+    Lex,
+    Parse,
+    Optimize,
+    Compile,
+    Execute,
+    /// 单个请求从读入到应答就绪
+    Request,
+}
+
+const PHASES: [(Phase, &str); 7] = [
+    (Phase::Queue, "queue"),
+    (Phase::Lex, "lex"),
+    (Phase::Parse, "parse"),
+    (Phase::Optimize, "optimize"),
+    (Phase::Compile, "compile"),
+    (Phase::Execute, "execute"),
+    (Phase::Request, "request"),
+];
+
+#[derive(Clone, Copy)]
+pub enum Counter {
+    CacheHit,
+    CacheMiss,
+    RequestOk,
+    RequestError,
+    /// 编译的语法树节点数，近似为生成的闭包数
+    CompiledNodes,
+    CompiledFunctions,
+}
+
+const COUNTERS: usize = 6;
+
+/// 对数线性分桶的直方图，只记录计数，取分位数时以桶上界估计
+struct Histogram {
+    counts: Box<[AtomicU64]>,
+    sum: AtomicU64,
+}
+
+impl Histogram {
+    fn new() -> Self {
+        Self {
+            counts: (0..BUCKETS).map(|_| AtomicU64::new(0)).collect(),
+            sum: AtomicU64::new(0),
+        }
+    }
+
+    fn record(&self, value: u64) {
+        self.counts[bucket(value)].fetch_add(1, Ordering::Relaxed);
+        self.sum.fetch_add(value, Ordering::Relaxed);
+    }
+}
+
+fn bucket(value: u64) -> usize {
+    if value < SUB_BUCKETS as u64 {
+        return value as usize;
+    }
+    let exp = 63 - value.leading_zeros();
+    let sub = (value >> (exp - SUB_BITS)) as usize - SUB_BUCKETS;
+    SUB_BUCKETS + (exp - SUB_BITS) as usize * SUB_BUCKETS + sub
+}
+
+/// 桶内的最大值
+fn bucket_high(index: usize) -> u64 {
+    if index < SUB_BUCKETS {
+        return index as u64;
+    }
+    let shift = ((index - SUB_BUCKETS) / SUB_BUCKETS) as u32;
+    let low = ((SUB_BUCKETS + (index - SUB_BUCKETS) % SUB_BUCKETS) as u64) << shift;
+    low + ((1u64 << shift) - 1)
+}
+
+/// 单个线程的记录，只由所属线程写入，导出时与其他线程的合并
+struct Shard {
+    phases: Vec<Histogram>,
+    counters: [AtomicU64; COUNTERS],
+    tenants: Box<[AtomicU64]>,
+}
+
+struct Registry {
+    shards: Mutex<Vec<Arc<Shard>>>,
+    tenants: Mutex<Vec<String>>,
+    queue: AtomicI64,
+    cached: AtomicI64,
+}
+
+static REGISTRY: Registry = Registry {
+    shards: Mutex::new(Vec::new()),
+    tenants: Mutex::new(Vec::new()),
+    queue: AtomicI64::new(0),
+    cached: AtomicI64::new(0),
+};
+
+thread_local! {
+    static SHARD: Arc<Shard> = {
+        let shard = Arc::new(Shard {
+            phases: PHASES.iter().map(|_| Histogram::new()).collect(),
+            counters: Default::default(),
+            tenants: (0..=MAX_TENANTS).map(|_| AtomicU64::new(0)).collect(),
+        });
+        REGISTRY.shards.lock().unwrap().push(shard.clone());
+        shard
+    };
+    /// 已登记的租户名到编号的缓存，至多 `MAX_TENANTS` 项；计入 `other` 的租户不缓存，
+    /// 每次都查全局表
+    static TENANTS: RefCell<HashMap<String, usize>> = RefCell::new(HashMap::new());
+}
+
+pub fn time(phase: Phase, elapsed: Duration) {
+    let nanos = elapsed.as_nanos().min(u64::MAX as u128) as u64;
+    SHARD.with(|shard| shard.phases[phase as usize].record(nanos));
+}
+
+pub fn count(counter: Counter, value: u64) {
+    SHARD.with(|shard| shard.counters[counter as usize].fetch_add(value, Ordering::Relaxed));
+}
+
+pub fn tenant_compile(tenant: &str) {
+    let index = TENANTS.with(|cache| {
+        if let Some(index) = cache.borrow().get(tenant) {
+            return *index;
+        }
+        let mut names = REGISTRY.tenants.lock().unwrap();
+        let index = match names.iter().position(|name| name == tenant) {
+            Some(index) => index,
+            None if names.len() < MAX_TENANTS => {
+                names.push(tenant.to_string());
+                names.len() - 1
+            }
+            None => return MAX_TENANTS,
+        };
+        cache.borrow_mut().insert(tenant.to_string(), index);
+        index
+    });
+    SHARD.with(|shard| shard.tenants[index].fetch_add(1, Ordering::Relaxed));
+}
+
+pub fn queue_depth(delta: i64) {
+    REGISTRY.queue.fetch_add(delta, Ordering::Relaxed);
+}
+
+/// 缓存中程序的语法树节点总数
+pub fn cached_nodes(delta: i64) {
+    REGISTRY.cached.fetch_add(delta, Ordering::Relaxed);
+}
+
+/// 合并各线程的记录，以 Prometheus 文本格式输出
+pub fn export() -> String {
+    let shards = REGISTRY.shards.lock().unwrap().clone();
+    let tenants = REGISTRY.tenants.lock().unwrap().clone();
+    let mut out = String::new();
+
+    let mut phases = vec![(vec![0u64; BUCKETS], 0u64); PHASES.len()];
+    let mut counters = [0u64; COUNTERS];
+    let mut compiles = vec![0u64; MAX_TENANTS + 1];
+    for shard in &shards {
+        for (merged, histogram) in phases.iter_mut().zip(&shard.phases) {
+            for (total, count) in merged.0.iter_mut().zip(histogram.counts.iter()) {
+                *total += count.load(Ordering::Relaxed);
+            }
+            merged.1 += histogram.sum.load(Ordering::Relaxed);
+        }
+        for (total, counter) in counters.iter_mut().zip(&shard.counters) {
+            *total += counter.load(Ordering::Relaxed);
+        }
+        for (total, count) in compiles.iter_mut().zip(shard.tenants.iter()) {
+            *total += count.load(Ordering::Relaxed);
+        }
+    }
+
+    out.push_str("# HELP kslang_phase_seconds 各阶段用时\n");
+    out.push_str("# TYPE kslang_phase_seconds histogram\n");
+    for ((_, name), (counts, sum)) in PHASES.iter().zip(&phases) {
+        let total = counts.iter().sum::<u64>();
+        // 以二的幂纳秒为界，与分桶边界对齐，不需要插值
+        let mut cumulative = 0;
+        let mut index = 0;
+        for shift in 10..=36 {
+            let bound = 1u64 << shift;
+            while index < BUCKETS && bucket_high(index) < bound {
+                cumulative += counts[index];
+                index += 1;
+            }
+            let _ = writeln!(
+                out,
+                "kslang_phase_seconds_bucket{{phase=\"{}\",le=\"{}\"}} {}",
+                name,
+                seconds(bound),
+                cumulative
+            );
+        }
+        let _ = writeln!(
+            out,
+            "kslang_phase_seconds_bucket{{phase=\"{}\",le=\"+Inf\"}} {}",
+            name, total
+        );
+        let _ = writeln!(
+            out,
+            "kslang_phase_seconds_sum{{phase=\"{}\"}} {}",
+            name,
+            seconds(*sum)
+        );
+        let _ = writeln!(
+            out,
+            "kslang_phase_seconds_count{{phase=\"{}\"}} {}",
+            name, total
+        );
+    }
+
+    out.push_str("# HELP kslang_phase_quantile_seconds 各阶段用时的分位数，按分桶上界估计\n");
+    out.push_str("# TYPE kslang_phase_quantile_seconds gauge\n");
+    for ((_, name), (counts, _)) in PHASES.iter().zip(&phases) {
+        for quantile in ["0.5", "0.9", "0.99", "0.999"] {
+            let value = percentile(counts, quantile.parse().unwrap());
+            let _ = writeln!(
+                out,
+                "kslang_phase_quantile_seconds{{phase=\"{}\",quantile=\"{}\"}} {}",
+                name,
+                quantile,
+                seconds(value)
+            );
+        }
+    }
+
+    let [hit, miss, ok, error, nodes, functions] = counters;
+    out.push_str("# HELP kslang_cache_lookups_total 编译结果缓存的查找次数\n");
+    out.push_str("# TYPE kslang_cache_lookups_total counter\n");
+    let _ = writeln!(out, "kslang_cache_lookups_total{{result=\"hit\"}} {}", hit);
+    let _ = writeln!(
+        out,
+        "kslang_cache_lookups_total{{result=\"miss\"}} {}",
+        miss
+    );
+    out.push_str("# HELP kslang_requests_total 处理的请求数\n");
+    out.push_str("# TYPE kslang_requests_total counter\n");
+    let _ = writeln!(out, "kslang_requests_total{{status=\"ok\"}} {}", ok);
+    let _ = writeln!(out, "kslang_requests_total{{status=\"error\"}} {}", error);
+    out.push_str("# HELP kslang_compiled_nodes_total 编译的语法树节点数\n");
+    out.push_str("# TYPE kslang_compiled_nodes_total counter\n");
+    let _ = writeln!(out, "kslang_compiled_nodes_total {}", nodes);
+    out.push_str("# HELP kslang_compiled_functions_total 编译的函数数\n");
+    out.push_str("# TYPE kslang_compiled_functions_total counter\n");
+    let _ = writeln!(out, "kslang_compiled_functions_total {}", functions);
+    out.push_str("# HELP kslang_compiled_cached_nodes 缓存中程序的语法树节点总数\n");
+    out.push_str("# TYPE kslang_compiled_cached_nodes gauge\n");
+    let _ = writeln!(
+        out,
+        "kslang_compiled_cached_nodes {}",
+        REGISTRY.cached.load(Ordering::Relaxed)
+    );
+    out.push_str("# HELP kslang_queue_depth 等待工作线程的请求数\n");
+    out.push_str("# TYPE kslang_queue_depth gauge\n");
+    let _ = writeln!(
+        out,
+        "kslang_queue_depth {}",
+        REGISTRY.queue.load(Ordering::Relaxed)
+    );
+
+    out.push_str("# HELP kslang_tenant_compiles_total 各租户的编译次数\n");
+    out.push_str("# TYPE kslang_tenant_compiles_total counter\n");
+    for (name, count) in tenants.iter().zip(&compiles) {
+        let _ = writeln!(
+            out,
+            "kslang_tenant_compiles_total{{tenant=\"{}\"}} {}",
+            escape(name),
+            count
+        );
+    }
+    if compiles[MAX_TENANTS] > 0 {
+        let _ = writeln!(
+            out,
+            "kslang_tenant_compiles_total{{tenant=\"other\"}} {}",
+            compiles[MAX_TENANTS]
+        );
+    }
+    out
+}
+
+fn percentile(counts: &[u64], quantile: f64) -> u64 {
+    let total = counts.iter().sum::<u64>();
+    if total == 0 {
+        return 0;
+    }
+    let rank = ((total as f64 * quantile).ceil() as u64).max(1);
+    let mut seen = 0;
+    for (index, count) in counts.iter().enumerate() {
+        seen += count;
+        if seen >= rank {
+            return bucket_high(index);
+        }
+    }
+    bucket_high(BUCKETS - 1)
+}
+
+fn seconds(nanos: u64) -> f64 {
+    nanos as f64 / 1e9
+}
+
+fn escape(label: &str) -> String {
+    label
+        .replace('\\', "\\\\")
+        .replace('"', "\\\"")
+        .replace('\n', "\\n")
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// 每个桶的上界落在本桶内，下一个值落在下一个桶，相对误差不超过 1/16
+    #[test]
+    fn bucket_bounds() {
+        for index in 0..BUCKETS {
+            let high = bucket_high(index);
+            assert_eq!(bucket(high), index);
+            if index + 1 < BUCKETS {
+                assert_eq!(bucket(high + 1), index + 1);
+            }
+        }
+        assert_eq!(bucket_high(BUCKETS - 1), u64::MAX);
+        for value in [17, 1000, 123_456_789, u64::MAX / 3] {
+            let high = bucket_high(bucket(value));
+            assert!(value <= high && high - value <= value / SUB_BUCKETS as u64);
+        }
+
+        let mut counts = vec![0; BUCKETS];
+        counts[bucket(100)] = 90;
+        counts[bucket(5000)] = 10;
+        assert_eq!(percentile(&counts, 0.5), bucket_high(bucket(100)));
+        assert_eq!(percentile(&counts, 0.99), bucket_high(bucket(5000)));
+        assert_eq!(percentile(&[0; BUCKETS], 0.5), 0);
+    }
+
+    /// 超出上限的租户计入 `other` 且不进入线程缓存，标签值转义
+    #[test]
+    fn tenant_labels() {
+        let names = (0..MAX_TENANTS + 10)
+            .map(|index| format!("t\"{}\\\n", index))
+            .collect::<Vec<_>>();
+        for name in names.iter().chain(&names) {
+            tenant_compile(name);
+        }
+        assert_eq!(TENANTS.with(|cache| cache.borrow().len()), MAX_TENANTS);
+
+        let out = export();
+        assert!(out.contains("kslang_tenant_compiles_total{tenant=\"t\\\"0\\\\\\n\"} 2\n"));
+        assert!(out.contains("kslang_tenant_compiles_total{tenant=\"other\"} 20\n"));
+    }
+}
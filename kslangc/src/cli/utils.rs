@@ -1,4 +1,12 @@
-use std::path::PathBuf;
+use anyhow::Context;
+use kslang::compiler::{
+    ast::{FpMode, Stmt},
+    lazy::{self, LazyModule},
+    lexer::{Lexer, Source, SourceSequence, Token},
+    load,
+    opt::{self, fp, lto::Module},
+};
+use std::{io::Read, path::PathBuf};
 
 #[derive(Default)]
 pub enum Input {
@@ -51,3 +59,115 @@ pub enum ErrorOutput {
     Stdout,
     File(PathBuf),
 }
+
+/// `--fp` 选项，缺省为严格语义
+pub fn fp_mode(matches: &clap::ArgMatches) -> anyhow::Result<FpMode> {
+    match matches.get_one::<String>("fp") {
+        Some(name) => match FpMode::from_name(name) {
+            Some(mode) => Ok(mode),
+            None => anyhow::bail!("无效的浮点语义(`{}`)", name),
+        },
+        None => Ok(FpMode::default()),
+    }
+}
+
+/// `<FILE>` 不存在时视为源代码字符串；多个文件经批量读取器一起读入
+pub fn read_sources(inputs: &[&str]) -> anyhow::Result<SourceSequence> {
+    let mut sources = Vec::with_capacity(inputs.len());
+    let mut files = Vec::new();
+    for input in inputs {
+        if *input == "stdin" {
+            let mut buffer = String::new();
+            std::io::stdin()
+                .read_to_string(&mut buffer)
+                .context("读取输入失败")?;
+            sources.push(Some(Source::Stdin(buffer)));
+            continue;
+        }
+        let path = PathBuf::from(input);
+        if !path.try_exists().context("系统错误(try_exists)")? {
+            sources.push(Some(Source::String(input.to_string())));
+            continue;
+        }
+        files.push((sources.len(), path));
+        sources.push(None);
+    }
+
+    let paths = files
+        .iter()
+        .map(|(_, path)| path.clone())
+        .collect::<Vec<_>>();
+    let texts = load::read_files(&paths, &load::Options::default());
+    for ((index, path), contents) in files.into_iter().zip(texts) {
+        let contents = contents.context("读取输入文件失败")?;
+        sources[index] = Some(Source::File { path, contents });
+    }
+    Ok(SourceSequence {
+        sources: sources.into_iter().map(Option::unwrap).collect(),
+    })
+}
+
+fn lex_module(srcs: &SourceSequence, src_id: usize) -> anyhow::Result<Vec<Token>> {
+    let mut tokens = Vec::new();
+    for token in Lexer::new(src_id, srcs) {
+        match token {
+            Ok(token) => tokens.push(token),
+            Err(e) => anyhow::bail!(
+                "[Lexer] {}@{}\t`{}`",
+                srcs.sources[src_id],
+                e,
+                srcs.get_text(e)
+            ),
+        }
+    }
+    Ok(tokens)
+}
+
+fn optimize_module(text: &str, mut stmts: Vec<Stmt>, mode: FpMode) -> Module<'_> {
+    let fp = fp::module_mode(text).unwrap_or(mode);
+    opt::optimize(text, &mut stmts, fp);
+    Module {
+        src: text,
+        stmts,
+        fp,
+    }
+}
+
+/// 逐个模块解析并优化，模块开头的 `#!fp` 注释优先于 `mode`
+pub fn parse_modules(srcs: &SourceSequence, mode: FpMode) -> anyhow::Result<Vec<Module<'_>>> {
+    let mut modules = Vec::with_capacity(srcs.sources.len());
+    for (src_id, src) in srcs.sources.iter().enumerate() {
+        let text = src.text();
+        let tokens = lex_module(srcs, src_id)?;
+        let stmts = match kslang::compiler::parse_ast(text, &tokens) {
+            Ok(stmts) => stmts,
+            Err(e) => anyhow::bail!("[Parser] {}: {:?}", src, e),
+        };
+        modules.push(optimize_module(text, stmts, mode));
+    }
+    Ok(modules)
+}
+
+/// 预解析所有模块，只解析顶层代码与 `roots` 用到的函数体
+pub fn parse_modules_lazy<'s>(
+    srcs: &'s SourceSequence,
+    mode: FpMode,
+    roots: &[&str],
+) -> anyhow::Result<Vec<Module<'s>>> {
+    let mut tokens = Vec::with_capacity(srcs.sources.len());
+    for src_id in 0..srcs.sources.len() {
+        tokens.push(lex_module(srcs, src_id)?);
+    }
+    let mut lazy = Vec::with_capacity(srcs.sources.len());
+    for (src, tokens) in srcs.sources.iter().zip(&tokens) {
+        match LazyModule::preparse(src.text(), tokens) {
+            Ok(module) => lazy.push(module),
+            Err(e) => anyhow::bail!("[Parser] {}: {:?}", src, e),
+        }
+    }
+    let stmts = lazy::shake(lazy, roots).map_err(|e| anyhow::anyhow!("[Parser] {:?}", e))?;
+    let modules = srcs.sources.iter().zip(stmts);
+    Ok(modules
+        .map(|(src, stmts)| optimize_module(src.text(), stmts, mode))
+        .collect())
+}
@@ -0,0 +1,84 @@
+#include "ksc/exec.h"
+#include <cassert>
+#include <cstring>
+#include <iostream>
+
+static void release_borrowed(ArrowArray *array) { array->release = nullptr; }
+
+static void release_schema(ArrowSchema *schema) { schema->release = nullptr; }
+
+// 借用宿主缓冲区的分块
+static ArrowArray chunk(const void **buffers, int64_t length, int64_t offset,
+                        int64_t null_count) {
+    ArrowArray array = {};
+    array.length = length;
+    array.null_count = null_count;
+    array.offset = offset;
+    array.n_buffers = 2;
+    array.buffers = buffers;
+    array.release = release_borrowed;
+    return array;
+}
+
+int main() {
+    // 顶层代码只在编译时执行一次；`deep` 的递归深度超过宿主线程的默认栈
+    const char *str = "k = 10\n"
+                      "def mix(x, y) x * k + y\n"
+                      "def deep(n) if n < 1 then 0 else 1 + deep(n - 1)";
+    const KSCSource *source =
+        newKSCSource(KSC_SRC_STRING, str, strlen(str), nullptr, 0);
+    const KSCProgram *program = newKSCProgram(source);
+    assert(program != nullptr);
+
+    ArrowSchema f64 = {};
+    f64.format = "g";
+    f64.flags = ARROW_FLAG_NULLABLE;
+    f64.release = release_schema;
+
+    // x 分为两块，第二块的第 2 行为空值
+    double x0[] = {1, 2};
+    double x1[] = {3, 4, 5};
+    uint8_t bits[] = {0b101};
+    double y[] = {0.5, 0.5, 0.5, 0.5, 0.5};
+    const void *x0_buffers[] = {nullptr, x0};
+    const void *x1_buffers[] = {bits, x1};
+    const void *y_buffers[] = {nullptr, y};
+    ArrowArray x_chunks[] = {chunk(x0_buffers, 2, 0, 0),
+                             chunk(x1_buffers, 3, 0, 1)};
+    ArrowArray y_chunks[] = {chunk(y_buffers, 5, 0, 0)};
+    KSCColumn columns[] = {{&f64, x_chunks, 2}, {&f64, y_chunks, 1}};
+
+    ArrowSchema out_schema;
+    ArrowArray out;
+    KSCBatchErr err =
+        evalKSCBatch(program, "mix", 3, columns, 2, &out_schema, &out);
+    assert(err == KSC_BATCH_ERR_OK);
+    assert(std::strcmp(out_schema.format, "g") == 0);
+    assert(out.length == 5 && out.null_count == 1);
+
+    const double *values = static_cast<const double *>(out.buffers[1]);
+    const uint8_t *valid = static_cast<const uint8_t *>(out.buffers[0]);
+    assert(values[0] == 10.5 && values[2] == 30.5 && values[4] == 50.5);
+    assert((valid[0] & 0b11111) == 0b10111);
+    out.release(&out);
+    out_schema.release(&out_schema);
+
+    err = evalKSCBatch(program, "mix", 3, columns, 1, &out_schema, &out);
+    assert(err == KSC_BATCH_ERR_UNDEFINED);
+
+    double n[] = {90000};
+    const void *n_buffers[] = {nullptr, n};
+    ArrowArray n_chunks[] = {chunk(n_buffers, 1, 0, 0)};
+    KSCColumn deep[] = {{&f64, n_chunks, 1}};
+    err = evalKSCBatch(program, "deep", 4, deep, 1, &out_schema, &out);
+    assert(err == KSC_BATCH_ERR_OK);
+    assert(static_cast<const double *>(out.buffers[1])[0] == 90000);
+    out.release(&out);
+    out_schema.release(&out_schema);
+
+    freeKSCProgram(program);
+    freeKSCSource(source);
+
+    std::cout << "All tests passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,67 @@
+#include "ksc/lexer.h"
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+
+// 预热后允许的常驻内存增长，容纳分配器自身的缓存
+constexpr size_t kMaxGrowth = 4 << 20;
+
+static size_t resident_bytes() {
+    FILE *statm = std::fopen("/proc/self/statm", "r");
+    assert(statm != nullptr);
+    size_t size = 0, resident = 0;
+    int read = std::fscanf(statm, "%zu %zu", &size, &resident);
+    std::fclose(statm);
+    assert(read == 2);
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+static void round_trip(const char *str, bool valid) {
+    const KSCSource *source =
+        newKSCSource(KSC_SRC_STRING, str, strlen(str), nullptr, 0);
+    assert(source != nullptr);
+    assert(std::strncmp(getKSCSourceText(source), str, strlen(str)) == 0);
+
+    const KSCTokens *tokens = newKSCTokens(source);
+    assert(tokens != nullptr);
+    assert(getKSCTokensLen(tokens) > 0);
+
+    const KSCAst *ast = newKSCAst(source, tokens);
+    assert((ast != nullptr) == valid);
+    assert(getKSCAstLen(ast) == (valid ? 2 : 0));
+
+    freeKSCAst(ast);
+    freeKSCTokens(tokens);
+    freeKSCSource(source);
+}
+
+int main(int argc, char **argv) {
+    const char *valid =
+        "def fib(x) if x < 3 then 1 else fib(x-1) + fib(x-2)\nfib(10)";
+    const char *invalid = "def fib(x) (x < 3\nfib(10)";
+    size_t rounds = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+    size_t warmup = rounds / 10;
+
+    for (size_t i = 0; i < warmup; i++) {
+        round_trip(i % 16 == 0 ? invalid : valid, i % 16 != 0);
+    }
+    size_t before = resident_bytes();
+    for (size_t i = warmup; i < rounds; i++) {
+        round_trip(i % 16 == 0 ? invalid : valid, i % 16 != 0);
+    }
+    size_t after = resident_bytes();
+
+    std::cout << "rounds: " << rounds << ", rss: " << before << " -> "
+              << after << std::endl;
+    if (after > before + kMaxGrowth) {
+        std::cerr << "Resident memory grew by " << after - before << " bytes"
+                  << std::endl;
+        return 1;
+    }
+
+    std::cout << "All tests passed" << std::endl;
+    return 0;
+}